@@ -602,7 +602,6 @@ class GSam:
 		model = self._heap_view.get_model()
 	    # stack_push {{{4
 	    if ctype == "stack_push":
-		v = self.value_to_row(change.start, change.value)
 		last = self.get_last_iter(model, None)
 		if last is None:
 		    fbr = None
@@ -632,18 +631,22 @@ class GSam:
 					 '',
 					 label,
 					 -1))
-		viter = model.append(last, v)
+		# ADDSP records its pushes as one ranged change.
+		for i in range(0, change.size):
+		    v = self.value_to_row(change.start + i, change.value)
+		    viter = model.append(last, v)
 		vpath = model.get_path(viter)
 		self._stack_view.expand_to_path(vpath)
 		self._stack_view.scroll_to_cell(vpath)
 	    # stack_pop {{{4
 	    elif ctype == "stack_pop":
-		last = self.get_last_iter(model, None)
-		# If last is none, that is an error.
-		llast = self.get_last_iter(model, last)
-		model.remove(llast)
-		if model.iter_n_children(last) == 0:
-		    model.remove(last)
+		for i in range(0, change.size):
+		    last = self.get_last_iter(model, None)
+		    # If last is none, that is an error.
+		    llast = self.get_last_iter(model, last)
+		    model.remove(llast)
+		    if model.iter_n_children(last) == 0:
+			model.remove(last)
 	    # heap_alloc {{{4
 	    elif ctype == "heap_alloc":
 		iter = self.get_block_near_iter(model, change.start)
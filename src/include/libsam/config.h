@@ -47,8 +47,31 @@ typedef float sam_float;
 # define SAM_EPSILON FLT_EPSILON
 #endif /* __WORDSIZE == 64 */
 
-/** Greatest value a sam_heap_address can hold. */
-#define SAM_HEAP_PTR_MAX LONG_MAX
+/** Pack the type and value of each memory location into a single
+ *  NaN-boxed 64-bit word, rather than a type byte beside an 8-byte
+ *  value. Integers and addresses are then limited to 48 bits.
+ *  Everything built against libsam must agree on this setting. */
+#if !defined(SAM_NAN_BOX)
+# define SAM_NAN_BOX 0
+#endif /* !SAM_NAN_BOX */
+
+#if SAM_NAN_BOX && __WORDSIZE != 64
+# error "SAM_NAN_BOX needs sam_float to be a double"
+#endif /* SAM_NAN_BOX && __WORDSIZE != 64 */
+
+#if SAM_NAN_BOX
+/** Greatest allocation number a sam_ha can hold. */
+# define SAM_HEAP_ALLOC_MAX 0xffffffU
+
+/** Greatest index into an allocation a sam_ha can hold. */
+# define SAM_HEAP_INDEX_MAX 0xffffffU
+#else
+/** Greatest allocation number a sam_ha can hold. */
+# define SAM_HEAP_ALLOC_MAX UINT32_MAX
+
+/** Greatest index into an allocation a sam_ha can hold. */
+# define SAM_HEAP_INDEX_MAX UINT32_MAX
+#endif /* SAM_NAN_BOX */
 
 /** Greatest value a sam_stack_address can hold. */
 #define SAM_STACK_PTR_MAX LONG_MAX
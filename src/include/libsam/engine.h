@@ -0,0 +1,58 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_ENGINE_H
+#define LIBSAM_ENGINE_H
+
+#include "error.h"
+#include "execute_types.h"
+
+/**
+ *  Run the program from the current program counter until it stops,
+ *  an instruction fails or execution runs off the end of the
+ *  module. The threaded engine is used when it was compiled in, unless
+ *  #SAM_CALL_LOOP is set or memory changes are being tracked, in which
+ *  case every instruction is dispatched through its #sam_handler. With
+ *  #SAM_JIT, on x86-64, machine code is compiled for the program
+ *  instead, unless memory changes are being tracked. Otherwise, with
+ *  #SAM_REGISTERS, modules which were verified at load time run as
+ *  register code until they reach something only the stack engines
+ *  can follow. With #SAM_PROFILE the call loop is always used,
+ *  counting each instruction as it runs.
+ *
+ *  Either way the program counter is left one past the instruction
+ *  which stopped or failed, so that backtraces agree between engines.
+ *
+ *  @param es The current execution state.
+ *
+ *  @return The error which stopped execution, #SAM_STOP if the
+ *	    program stopped normally, or #SAM_OK if it ran off the end.
+ */
+extern sam_error sam_engine_run(sam_es *restrict es);
+
+#endif /* LIBSAM_ENGINE_H */
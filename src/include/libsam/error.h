@@ -66,6 +66,8 @@ typedef enum {
     SAM_ENOSYS,		/**< This opcode is not supported on this
 			 *   system because support for it was not
 			 *   compiled in. */
+    SAM_EHEAP_OVERFLW,	/**< Arithmetic on a heap address took its
+			 *   index out of the range of a sam_ha. */
 #if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
     SAM_EDLOPEN,	/**< There was a problem interfacing with the
 			 *   dynamic linking loader. */
@@ -96,6 +98,9 @@ extern sam_error sam_error_stack_input	     (sam_es *restrict es,
 extern sam_error sam_error_negative_shift    (sam_es *restrict es,
 					      sam_int i);
 extern sam_error sam_error_division_by_zero  (sam_es *restrict es);
+extern sam_error sam_error_heap_overflow     (sam_es *restrict es,
+					      sam_ha  ha,
+					      sam_int offset);
 extern sam_error sam_error_io		     (sam_es *restrict es);
 extern void sam_error_uninitialized	     (sam_es *restrict es);
 extern void sam_error_number_format	     (sam_es *restrict es,
@@ -45,12 +45,30 @@ typedef struct {
     unsigned stack: 1;
     unsigned add: 1;
     unsigned remove: 1;
-    sam_ma ma;		    /* point of removal/addition */
-    const sam_ml *ml;	    /* item added */
-    size_t size;	    /* size of allocation */
+    unsigned overflow: 1;   /* changes were dropped here; no other
+			     * field is meaningful */
+    sam_ma ma;		    /* point of removal/addition; for stack
+			     * removals, the stack pointer before */
+    sam_ml ml;		    /* item added, or every item of a ranged
+			     * stack addition */
+    size_t size;	    /* size of allocation, or number of stack
+			     * locations changed */
 } __attribute__((packed))
 sam_es_change;
 
+/** What the change log does with a new change when it is full. */
+typedef enum {
+    SAM_CHANGES_OVERFLOW,    /**< Drop new changes, then report one
+			      *   change with the overflow bit set. */
+    SAM_CHANGES_DROP_OLDEST, /**< Discard the oldest change. */
+    SAM_CHANGES_BLOCK	     /**< Call the drain function so the
+			      *   consumer can make room, falling back
+			      *   to #SAM_CHANGES_OVERFLOW if it does
+			      *   not. */
+} sam_es_change_policy;
+
+typedef void (*sam_es_change_drain)(sam_es *restrict es, void *data);
+
 /**
  * The list of labels corresponding to a line of code.
  */
@@ -59,6 +77,19 @@ typedef struct {
     sam_array labels;
 } sam_es_loc;
 
+/**
+ * What the verifier found out about a subroutine: the code reached
+ * from the start of the program, or from a JSR to pa.
+ */
+typedef struct {
+    sam_pa pa;		    /**< The first instruction. */
+    size_t depth;	    /**< The most locations it has on the stack
+			     *   at once, above those it was called
+			     *   with. */
+    size_t reach;	    /**< The same, counting the subroutines it
+			     *   calls, or SIZE_MAX if they recurse. */
+} sam_es_subroutine;
+
 typedef sam_error	   (*sam_library_fn)	     (sam_es *restrict es);
 
 extern inline void	     sam_es_bt_set	     (sam_es *restrict es,
@@ -80,27 +111,35 @@ bool                         sam_es_heap_is_allocation_valid(const sam_es *restr
                                                              unsigned allocation);
 size_t                       sam_es_heap_get_allocation_size(const sam_es *restrict es,
                                                              unsigned allocation);
+const sam_ml                *sam_es_heap_get_allocation_words(const sam_es *restrict es,
+                                                              unsigned allocation);
 inline bool                  sam_es_heap_leak_check(const sam_es *restrict es,
                                                     unsigned long *restrict block_count,
                                                     unsigned long *restrict leak_size);
 extern sam_error	     sam_es_string_get	     (sam_es *restrict es, char **restrict str,
 						      sam_ha ha);
-extern sam_ml		    *sam_es_stack_pop	     (sam_es *restrict es);
-extern bool		     sam_es_stack_push	     (sam_es *restrict es,
+extern inline bool	     sam_es_stack_pop	     (sam_es *restrict es,
 						      sam_ml *restrict m);
+extern inline bool	     sam_es_stack_push	     (sam_es *restrict es,
+						      sam_ml m);
+extern inline bool	     sam_es_stack_peek	     (const sam_es *restrict es,
+						      sam_ml *restrict m);
+extern bool		     sam_es_stack_resize     (sam_es *restrict es,
+						      sam_sa sp);
 extern inline sam_ml	    *sam_es_stack_get	     (const sam_es *restrict es,
 						      sam_sa sa);
 extern bool		     sam_es_stack_set	     (sam_es *restrict es,
-						      sam_ml *restrict ml,
+						      sam_ml ml,
 						      sam_sa  sa);
 extern size_t		     sam_es_stack_len	     (const sam_es *restrict es);
 extern inline sam_ml	    *sam_es_heap_get	     (const sam_es *restrict es,
 						      sam_ha  ha);
 extern bool		     sam_es_heap_set	     (sam_es *restrict es,
-						      sam_ml *restrict ml,
+						      sam_ml ml,
 						      sam_ha ha);
-extern sam_ha		     sam_es_heap_alloc	     (sam_es *restrict es,
-						      size_t size);
+extern bool		     sam_es_heap_alloc	     (sam_es *restrict es,
+						      size_t size,
+						      sam_ha *restrict res);
 extern sam_error	     sam_es_heap_dealloc     (sam_es *restrict es,
 						      sam_ha  ha);
 extern bool		     sam_es_labels_ins	     (sam_es *restrict es,
@@ -117,16 +156,21 @@ extern inline sam_array	    *sam_es_locs_get	     (sam_es *restrict es);
 extern inline const char    *sam_es_file_get	     (sam_es *restrict es,
 						      unsigned short module);
 extern inline void	     sam_es_instructions_ins (sam_es *restrict es,
+						      const sam_instruction *restrict i);
+extern inline bool	     sam_es_instructions_get (const sam_es *restrict es,
+						      sam_pa pa,
 						      sam_instruction *restrict i);
-extern inline sam_instruction *sam_es_instructions_get(const sam_es *restrict es,
-						      sam_pa pa);
-extern inline sam_instruction *sam_es_instructions_get_cur(const sam_es *restrict es,
-							   unsigned short line);
-extern inline sam_instruction *sam_es_instructions_cur(sam_es *restrict es);
+extern inline sam_handler    sam_es_handler_cur	     (const sam_es *restrict es);
+extern inline sam_op_value  *sam_es_operand_cur	     (sam_es *restrict es);
+extern inline sam_opcode     sam_es_opcode_cur	     (const sam_es *restrict es);
+extern inline sam_op_type    sam_es_optype_cur	     (const sam_es *restrict es);
 extern inline size_t	     sam_es_instructions_len (const sam_es *restrict es,
 						      unsigned short module);
 extern inline size_t	     sam_es_instructions_len_cur(const sam_es *restrict es);
 extern inline unsigned short sam_es_modules_len	     (const sam_es *restrict es);
+extern const sam_es_subroutine *sam_es_subroutines_get(const sam_es *restrict es,
+						      unsigned short module,
+						      size_t *restrict len);
 extern void		     sam_es_ro_alloc	     (const sam_es *restrict es,
 						      const char *symbol,
 						      sam_ml_value value,
@@ -157,8 +201,21 @@ extern sam_es		    *sam_es_new		     (const char *restrict file,
 						      sam_options options,
 						      /*@null@*/ sam_io_dispatcher dispatcher,
 						      /*@null@*/ void *io_data);
+extern sam_es		    *sam_es_new_string	     (const char *restrict name,
+						      const char *restrict source,
+						      size_t len,
+						      sam_options options,
+						      /*@null@*/ sam_io_dispatcher dispatcher,
+						      /*@null@*/ void *io_data);
 extern void		     sam_es_free	     (sam_es *restrict es);
 extern void		     sam_es_reset	     (sam_es *restrict es);
+extern void		     sam_es_changes_track    (sam_es *restrict es,
+						      bool track);
+extern void		     sam_es_changes_policy_set(sam_es *restrict es,
+						      size_t capacity,
+						      sam_es_change_policy policy,
+						      /*@null@*/ sam_es_change_drain drain,
+						      /*@null@*/ void *drain_data);
 extern bool		     sam_es_change_get	     (sam_es *restrict es,
 						      sam_es_change *restrict ch);
 #if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
@@ -59,12 +59,197 @@ typedef union {
     sam_sa    sa;
 } sam_ml_value;
 
-/** An element on the stack or on the heap. */
+#if SAM_NAN_BOX
+
+/** An element on the stack or on the heap. A float is kept as its
+ *  double; any other type is kept as a NaN, with the type in the 3
+ *  bits below the quiet bit and the value in the 48 bits below those.
+ *  The word is stored xored with #SAM_ML_NONE_BITS, so that zeroed
+ *  memory reads back as #SAM_ML_TYPE_NONE.
+ *
+ *  Access it only through the SAM_ML macros below. */
+typedef struct {
+    uint64_t bits;
+} sam_ml;
+
+/** The NaN which encodes an uninitialized location. */
+#define SAM_ML_NONE_BITS UINT64_C(0xfff8000000000000)
+
+/** The bits of a stored word which hold its value. */
+#define SAM_ML_PAYLOAD	 UINT64_C(0x0000ffffffffffff)
+
+/** The NaN every float NaN is stored as. */
+#define SAM_ML_NAN_BITS	 UINT64_C(0x7ff8000000000000)
+
+/** The least and greatest integers a sam_ml can hold. */
+#define SAM_ML_INT_MIN	 (-(INT64_C(1) << 47))
+#define SAM_ML_INT_MAX	 ((INT64_C(1) << 47) - 1)
+
+typedef union {
+    uint64_t  u;
+    sam_float f;
+} sam_ml_float_bits;
+
+static inline sam_ml_type
+sam_ml_type_of(sam_ml m)
+{
+    unsigned tag = m.bits >> 48;
+
+    /* a float's top 16 bits never xor to less than 8 */
+    return tag < 8? (sam_ml_type)tag: SAM_ML_TYPE_FLOAT;
+}
+
+static inline sam_int
+sam_ml_i(sam_ml m)
+{
+    return (int64_t)(m.bits << 16) >> 16;
+}
+
+static inline sam_float
+sam_ml_f(sam_ml m)
+{
+    sam_ml_float_bits b = {.u = m.bits ^ SAM_ML_NONE_BITS};
+    return b.f;
+}
+
+static inline sam_sa
+sam_ml_sa(sam_ml m)
+{
+    return m.bits & SAM_ML_PAYLOAD;
+}
+
+static inline sam_ha
+sam_ml_ha(sam_ml m)
+{
+    return (sam_ha){
+	.alloc = (m.bits >> 24) & SAM_HEAP_ALLOC_MAX,
+	.index = m.bits & SAM_HEAP_INDEX_MAX
+    };
+}
+
+static inline sam_pa
+sam_ml_pa(sam_ml m)
+{
+    return (sam_pa){.l = (uint32_t)m.bits, .m = m.bits >> 32};
+}
+
+static inline sam_ml
+sam_ml_tagged(sam_ml_type t,
+	      uint64_t payload)
+{
+    return (sam_ml){.bits = (uint64_t)t << 48 | (payload & SAM_ML_PAYLOAD)};
+}
+
+static inline sam_ml
+sam_ml_of_f(sam_float f)
+{
+    sam_ml_float_bits b = {.f = f};
+
+    if (f != f) {
+	b.u = SAM_ML_NAN_BITS;
+    }
+    return (sam_ml){.bits = b.u ^ SAM_ML_NONE_BITS};
+}
+
+static inline sam_ml_value
+sam_ml_value_of(sam_ml m)
+{
+    sam_ml_value v = {.i = 0};
+
+    switch (sam_ml_type_of(m)) {
+	case SAM_ML_TYPE_INT:	v.i = sam_ml_i(m);  break;
+	case SAM_ML_TYPE_FLOAT:	v.f = sam_ml_f(m);  break;
+	case SAM_ML_TYPE_SA:	v.sa = sam_ml_sa(m); break;
+	case SAM_ML_TYPE_HA:	v.ha = sam_ml_ha(m); break;
+	case SAM_ML_TYPE_PA:	v.pa = sam_ml_pa(m); break;
+	case SAM_ML_TYPE_NONE:	break;
+    }
+    return v;
+}
+
+static inline sam_ml
+sam_ml_make(sam_ml_value v,
+	    sam_ml_type t)
+{
+    switch (t) {
+	case SAM_ML_TYPE_INT:
+	    return sam_ml_tagged(t, v.i);
+	case SAM_ML_TYPE_FLOAT:
+	    return sam_ml_of_f(v.f);
+	case SAM_ML_TYPE_SA:
+	    return sam_ml_tagged(t, v.sa);
+	case SAM_ML_TYPE_HA:
+	    return sam_ml_tagged(t, (uint64_t)v.ha.alloc << 24 | v.ha.index);
+	case SAM_ML_TYPE_PA:
+	    return sam_ml_tagged(t, (uint64_t)v.pa.m << 32 | v.pa.l);
+	case SAM_ML_TYPE_NONE: /*@fallthrough@*/
+	default:
+	    return (sam_ml){.bits = 0};
+    }
+}
+
+# define SAM_ML_TYPE(m)		sam_ml_type_of(m)
+# define SAM_ML_VALUE(m)	sam_ml_value_of(m)
+# define SAM_ML_I(m)		sam_ml_i(m)
+# define SAM_ML_F(m)		sam_ml_f(m)
+# define SAM_ML_SA(m)		sam_ml_sa(m)
+# define SAM_ML_HA(m)		sam_ml_ha(m)
+# define SAM_ML_PA(m)		sam_ml_pa(m)
+# define SAM_ML(v, t)		sam_ml_make((v), (t))
+# define SAM_ML_OF_I(x)		sam_ml_tagged(SAM_ML_TYPE_INT, (x))
+# define SAM_ML_OF_F(x)		sam_ml_of_f(x)
+# define SAM_ML_OF_SA(x)	sam_ml_tagged(SAM_ML_TYPE_SA, (x))
+# define SAM_ML_OF_HA(x)	SAM_ML((sam_ml_value){.ha = (x)}, \
+				       SAM_ML_TYPE_HA)
+# define SAM_ML_OF_PA(x)	SAM_ML((sam_ml_value){.pa = (x)}, \
+				       SAM_ML_TYPE_PA)
+# define SAM_ML_NONE		((sam_ml){.bits = 0})
+
+/* Replace the integer or float held by m. */
+# define SAM_ML_REPLACE_I(m, x) ((m) = SAM_ML_OF_I(x))
+# define SAM_ML_REPLACE_F(m, x) ((m) = SAM_ML_OF_F(x))
+
+/* Store x, a member field of sam_ml_value, into m as type t. */
+# define SAM_ML_SET(m, field, x, t) \
+    ((m) = SAM_ML((sam_ml_value){.field = (x)}, (t)))
+
+#else /* SAM_NAN_BOX */
+
+/** An element on the stack or on the heap.
+ *
+ *  Access it through the SAM_ML macros below, which also work when
+ *  #SAM_NAN_BOX packs it into one word. */
 typedef struct {
     unsigned  type: 8;
     sam_ml_value value;
 } sam_ml;
 
+# define SAM_ML_TYPE(m)		((sam_ml_type)(m).type)
+# define SAM_ML_VALUE(m)	((m).value)
+# define SAM_ML_I(m)		((m).value.i)
+# define SAM_ML_F(m)		((m).value.f)
+# define SAM_ML_SA(m)		((m).value.sa)
+# define SAM_ML_HA(m)		((m).value.ha)
+# define SAM_ML_PA(m)		((m).value.pa)
+# define SAM_ML(v, t)		((sam_ml){.type = (t), .value = (v)})
+# define SAM_ML_OF_I(x)		((sam_ml){.type = SAM_ML_TYPE_INT, .value.i = (x)})
+# define SAM_ML_OF_F(x)		((sam_ml){.type = SAM_ML_TYPE_FLOAT, .value.f = (x)})
+# define SAM_ML_OF_SA(x)	((sam_ml){.type = SAM_ML_TYPE_SA, .value.sa = (x)})
+# define SAM_ML_OF_HA(x)	((sam_ml){.type = SAM_ML_TYPE_HA, .value.ha = (x)})
+# define SAM_ML_OF_PA(x)	((sam_ml){.type = SAM_ML_TYPE_PA, .value.pa = (x)})
+# define SAM_ML_NONE		((sam_ml){.type = SAM_ML_TYPE_NONE})
+
+/* Replace the integer or float held by m, leaving its type alone. */
+# define SAM_ML_REPLACE_I(m, x) ((m).value.i = (x))
+# define SAM_ML_REPLACE_F(m, x) ((m).value.f = (x))
+
+/* Store x, a member field of sam_ml_value, into m as type t, a field
+ * at a time. */
+# define SAM_ML_SET(m, field, x, t) \
+    ((m).value.field = (x), (m).type = (t))
+
+#endif /* SAM_NAN_BOX */
+
 /** A pointer to an element on the heap or the stack. */
 typedef union {
     sam_ha ha;
@@ -35,8 +35,36 @@
 /** Global program behavior defaults configurable by command line
  * options. */
 typedef enum {
-    SAM_QUIET = 1 << 0	/**< Suppress verbose error messages. Library
+    SAM_QUIET = 1 << 0,	/**< Suppress verbose error messages. Library
 			 *   errors are however not suppressed. */
+    SAM_TRACK_CHANGES = 1 << 1, /**< Record memory changes for consumers
+				 *   of sam_es_change_get(). */
+    SAM_CALL_LOOP = 1 << 2,	/**< Dispatch every instruction through
+				 *   its handler rather than with the
+				 *   threaded engine. */
+    SAM_NO_FUSION = 1 << 3,	/**< Don't fuse common sequences of
+				 *   instructions at load time, so that
+				 *   every handler executes exactly one
+				 *   instruction. */
+    SAM_CACHE_TOS = 1 << 4,	/**< Keep the top of the stack in a
+				 *   register in the threaded engine. */
+    SAM_JIT = 1 << 5,		/**< Compile runs of simple instructions
+				 *   to machine code, where supported. */
+    SAM_OPTIMIZE = 1 << 6,	/**< Fold constants, thread jumps,
+				 *   inline small subroutines and remove
+				 *   dead code at load time. */
+    SAM_LIST = 1 << 7,		/**< Print the program as it would be
+				 *   run rather than running it. */
+    SAM_PROFILE = 1 << 8,	/**< Count how often each instruction
+				 *   runs in the call loop, and write the
+				 *   counts beside the source. */
+    SAM_PROFILE_USE = 1 << 9,	/**< Lay the program out by the counts
+				 *   beside its source, if there are
+				 *   any. */
+    SAM_REGISTERS = 1 << 10,	/**< Run verified modules as register
+				 *   code rather than on the stack. */
+    SAM_GC = 1 << 11		/**< Free heap allocations the program
+				 *   can no longer reach. */
 } sam_options;
 
 /** Exit codes for main() in case of error. */
@@ -34,25 +34,187 @@
 #include "types.h"
 #include "error.h"
 
+/** The table of opcodes, from which both #sam_opcode and the table
+ *  of handlers in opcode.c are generated. Each entry is
+ *  X(opcode, name, optypes, handler, label_handler): the optypes are
+ *  the OR of the operand types the opcode accepts, the handler is
+ *  bound to instructions with any of them but #SAM_OP_TYPE_LABEL, and
+ *  the label_handler, if any, to those with a label. Extensions to
+ *  the standard instruction set are given to E instead of X. */
+#define SAM_OPCODE_TABLE(X, E)										\
+    X(FTOI,		"FTOI",		SAM_OP_TYPE_NONE,	sam_op_ftoi,		NULL)		\
+    X(FTOIR,		"FTOIR",	SAM_OP_TYPE_NONE,	sam_op_ftoir,		NULL)		\
+    X(ITOF,		"ITOF",		SAM_OP_TYPE_NONE,	sam_op_itof,		NULL)		\
+    X(PUSHIMM,		"PUSHIMM",	SAM_OP_TYPE_INT,	sam_op_pushimm,		NULL)		\
+    X(PUSHIMMF,		"PUSHIMMF",	SAM_OP_TYPE_FLOAT,	sam_op_pushimmf,	NULL)		\
+    X(PUSHIMMCH,	"PUSHIMMCH",	SAM_OP_TYPE_CHAR,	sam_op_pushimmch,	NULL)		\
+    X(PUSHIMMMA,	"PUSHIMMMA",	SAM_OP_TYPE_INT,	sam_op_pushimmma,	NULL)		\
+    X(PUSHIMMPA,	"PUSHIMMPA",	SAM_OP_TYPE_INT |						\
+					SAM_OP_TYPE_LABEL,	sam_op_pushimmpa_int,	sam_op_pushimmpa_label) \
+    X(PUSHIMMSTR,	"PUSHIMMSTR",	SAM_OP_TYPE_STR,	sam_op_pushimmstr,	NULL)		\
+    X(PUSHSP,		"PUSHSP",	SAM_OP_TYPE_NONE,	sam_op_pushsp,		NULL)		\
+    X(PUSHFBR,		"PUSHFBR",	SAM_OP_TYPE_NONE,	sam_op_pushfbr,		NULL)		\
+    X(POPSP,		"POPSP",	SAM_OP_TYPE_NONE,	sam_op_popsp,		NULL)		\
+    X(POPFBR,		"POPFBR",	SAM_OP_TYPE_NONE,	sam_op_popfbr,		NULL)		\
+    X(DUP,		"DUP",		SAM_OP_TYPE_NONE,	sam_op_dup,		NULL)		\
+    X(SWAP,		"SWAP",		SAM_OP_TYPE_NONE,	sam_op_swap,		NULL)		\
+    X(ADDSP,		"ADDSP",	SAM_OP_TYPE_INT,	sam_op_addsp,		NULL)		\
+    X(MALLOC,		"MALLOC",	SAM_OP_TYPE_NONE,	sam_op_malloc,		NULL)		\
+    X(FREE,		"FREE",		SAM_OP_TYPE_NONE,	sam_op_free,		NULL)		\
+    X(PUSHIND,		"PUSHIND",	SAM_OP_TYPE_NONE,	sam_op_pushind,		NULL)		\
+    X(STOREIND,		"STOREIND",	SAM_OP_TYPE_NONE,	sam_op_storeind,	NULL)		\
+    X(PUSHABS,		"PUSHABS",	SAM_OP_TYPE_INT,	sam_op_pushabs,		NULL)		\
+    X(STOREABS,		"STOREABS",	SAM_OP_TYPE_INT,	sam_op_storeabs,	NULL)		\
+    X(PUSHOFF,		"PUSHOFF",	SAM_OP_TYPE_INT,	sam_op_pushoff,		NULL)		\
+    X(STOREOFF,		"STOREOFF",	SAM_OP_TYPE_INT,	sam_op_storeoff,	NULL)		\
+    X(ADD,		"ADD",		SAM_OP_TYPE_NONE,	sam_op_add,		NULL)		\
+    X(SUB,		"SUB",		SAM_OP_TYPE_NONE,	sam_op_sub,		NULL)		\
+    X(TIMES,		"TIMES",	SAM_OP_TYPE_NONE,	sam_op_times,		NULL)		\
+    X(DIV,		"DIV",		SAM_OP_TYPE_NONE,	sam_op_div,		NULL)		\
+    X(MOD,		"MOD",		SAM_OP_TYPE_NONE,	sam_op_mod,		NULL)		\
+    X(ADDF,		"ADDF",		SAM_OP_TYPE_NONE,	sam_op_addf,		NULL)		\
+    X(SUBF,		"SUBF",		SAM_OP_TYPE_NONE,	sam_op_subf,		NULL)		\
+    X(TIMESF,		"TIMESF",	SAM_OP_TYPE_NONE,	sam_op_timesf,		NULL)		\
+    X(DIVF,		"DIVF",		SAM_OP_TYPE_NONE,	sam_op_divf,		NULL)		\
+    X(LSHIFT,		"LSHIFT",	SAM_OP_TYPE_INT,	sam_op_lshift,		NULL)		\
+    X(LSHIFTIND,	"LSHIFTIND",	SAM_OP_TYPE_NONE,	sam_op_lshiftind,	NULL)		\
+    X(RSHIFT,		"RSHIFT",	SAM_OP_TYPE_INT,	sam_op_rshift,		NULL)		\
+    X(RSHIFTIND,	"RSHIFTIND",	SAM_OP_TYPE_NONE,	sam_op_rshiftind,	NULL)		\
+    E(LRSHIFT,		"LRSHIFT",	SAM_OP_TYPE_INT,	sam_op_lrshift,		NULL)		\
+    E(LRSHIFTIND,	"LRSHIFTIND",	SAM_OP_TYPE_NONE,	sam_op_lrshiftind,	NULL)		\
+    X(AND,		"AND",		SAM_OP_TYPE_NONE,	sam_op_and,		NULL)		\
+    X(OR,		"OR",		SAM_OP_TYPE_NONE,	sam_op_or,		NULL)		\
+    X(NAND,		"NAND",		SAM_OP_TYPE_NONE,	sam_op_nand,		NULL)		\
+    X(NOR,		"NOR",		SAM_OP_TYPE_NONE,	sam_op_nor,		NULL)		\
+    X(XOR,		"XOR",		SAM_OP_TYPE_NONE,	sam_op_xor,		NULL)		\
+    X(NOT,		"NOT",		SAM_OP_TYPE_NONE,	sam_op_not,		NULL)		\
+    X(BITAND,		"BITAND",	SAM_OP_TYPE_NONE,	sam_op_bitand,		NULL)		\
+    X(BITOR,		"BITOR",	SAM_OP_TYPE_NONE,	sam_op_bitor,		NULL)		\
+    X(BITNAND,		"BITNAND",	SAM_OP_TYPE_NONE,	sam_op_bitnand,		NULL)		\
+    X(BITNOR,		"BITNOR",	SAM_OP_TYPE_NONE,	sam_op_bitnor,		NULL)		\
+    X(BITXOR,		"BITXOR",	SAM_OP_TYPE_NONE,	sam_op_bitxor,		NULL)		\
+    X(BITNOT,		"BITNOT",	SAM_OP_TYPE_NONE,	sam_op_bitnot,		NULL)		\
+    X(CMP,		"CMP",		SAM_OP_TYPE_NONE,	sam_op_cmp,		NULL)		\
+    X(CMPF,		"CMPF",		SAM_OP_TYPE_NONE,	sam_op_cmpf,		NULL)		\
+    X(GREATER,		"GREATER",	SAM_OP_TYPE_NONE,	sam_op_greater,		NULL)		\
+    X(LESS,		"LESS",		SAM_OP_TYPE_NONE,	sam_op_less,		NULL)		\
+    X(EQUAL,		"EQUAL",	SAM_OP_TYPE_NONE,	sam_op_equal,		NULL)		\
+    X(ISNIL,		"ISNIL",	SAM_OP_TYPE_NONE,	sam_op_isnil,		NULL)		\
+    X(ISPOS,		"ISPOS",	SAM_OP_TYPE_NONE,	sam_op_ispos,		NULL)		\
+    X(ISNEG,		"ISNEG",	SAM_OP_TYPE_NONE,	sam_op_isneg,		NULL)		\
+    X(JUMP,		"JUMP",		SAM_OP_TYPE_INT |						\
+					SAM_OP_TYPE_LABEL,	sam_op_jump,		sam_op_jump) \
+    X(JUMPC,		"JUMPC",	SAM_OP_TYPE_INT |						\
+					SAM_OP_TYPE_LABEL,	sam_op_jumpc,		sam_op_jumpc) \
+    X(JUMPIND,		"JUMPIND",	SAM_OP_TYPE_NONE,	sam_op_jumpind,		NULL)		\
+    X(RST,		"RST",		SAM_OP_TYPE_NONE,	sam_op_rst,		NULL)		\
+    X(JSR,		"JSR",		SAM_OP_TYPE_INT |						\
+					SAM_OP_TYPE_LABEL,	sam_op_jsr,		sam_op_jsr) \
+    X(JSRIND,		"JSRIND",	SAM_OP_TYPE_NONE,	sam_op_jsrind,		NULL)		\
+    X(SKIP,		"SKIP",		SAM_OP_TYPE_NONE,	sam_op_skip,		NULL)		\
+    X(LINK,		"LINK",		SAM_OP_TYPE_NONE,	sam_op_link,		NULL)		\
+    X(UNLINK,		"UNLINK",	SAM_OP_TYPE_NONE,	sam_op_unlink,		NULL)		\
+    X(READ,		"READ",		SAM_OP_TYPE_NONE,	sam_op_read,		NULL)		\
+    X(READF,		"READF",	SAM_OP_TYPE_NONE,	sam_op_readf,		NULL)		\
+    X(READCH,		"READCH",	SAM_OP_TYPE_NONE,	sam_op_readch,		NULL)		\
+    X(READSTR,		"READSTR",	SAM_OP_TYPE_NONE,	sam_op_readstr,		NULL)		\
+    X(WRITE,		"WRITE",	SAM_OP_TYPE_NONE,	sam_op_write,		NULL)		\
+    X(WRITEF,		"WRITEF",	SAM_OP_TYPE_NONE,	sam_op_writef,		NULL)		\
+    X(WRITECH,		"WRITECH",	SAM_OP_TYPE_NONE,	sam_op_writech,		NULL)		\
+    X(WRITESTR,		"WRITESTR",	SAM_OP_TYPE_NONE,	sam_op_writestr,	NULL)		\
+    X(STOP,		"STOP",		SAM_OP_TYPE_NONE,	sam_op_stop,		NULL)		\
+    E(PUSHIMMHA,	"pushimmha",	SAM_OP_TYPE_LABEL,	NULL,			sam_op_pushimmha) \
+    E(PATOI,		"patoi",	SAM_OP_TYPE_NONE,	sam_op_patoi,		NULL)		\
+    E(LOAD,		"load",		SAM_OP_TYPE_LABEL,	NULL,			sam_op_load)	\
+    E(CALL,		"call",		SAM_OP_TYPE_LABEL,	NULL,			sam_op_call)
+
+#define SAM_OPCODE_ENUM(op, name, optypes, handler, label_handler) \
+    SAM_OPCODE_##op,
+
+/** The identity of each opcode, used by the execution engines to
+ *  dispatch without calling through #sam_handler. */
+typedef enum {
+    SAM_OPCODE_TABLE(SAM_OPCODE_ENUM, SAM_OPCODE_ENUM)
+    SAM_OPCODE_COUNT
+} sam_opcode;
+
+#undef SAM_OPCODE_ENUM
+
 typedef struct _sam_instruction sam_instruction;
 typedef sam_error (*sam_handler)(sam_es *restrict es);
 
-/** An operation in sam. */
+/** An operation in sam, as it is parsed and as sam_es_instructions_get()
+ *  puts it back together. Modules don't store instructions like
+ *  this. */
 struct _sam_instruction {
-    /*@observer@*/ const char *name;	/**< The character string
-					 *   representing this opcode. */
-    sam_op_type optype;			/**< The OR of types allowed
-					 *   to be in the operand
-					 *   position of this opcode. */
+    sam_opcode opcode;			/**< Which opcode this is. */
+    sam_op_type optype;			/**< The type of the operand,
+					 *   or before it is parsed the
+					 *   OR of types allowed to be
+					 *   in the operand position of
+					 *   this opcode. */
     sam_op_value operand;		/**< The value of this
 					 *   instruction's operand,
 					 *   assigned on parsing. */
     /*@null@*/ /*@observer@*/
+    const char *label;			/**< The name of a label
+					 *   operand, which a resolved
+					 *   operand no longer holds,
+					 *   or NULL. */
+    /*@null@*/ /*@observer@*/
     sam_handler handler;		/**< A pointer to the function
 					 *   called when this
 					 *   instruction is executed. */
 };
 
-/*@null@*/ extern sam_instruction *sam_opcode_get(const char *restrict name);
+/**
+ *  Set up an instruction with the opcode named, and no operand yet.
+ *
+ *  @param name The name of the opcode.
+ *  @param i The instruction.
+ *
+ *  @return false if there is no such opcode.
+ */
+extern bool sam_opcode_get(const char *restrict name,
+			   /*@out@*/ sam_instruction *restrict i);
+
+/*@observer@*/ extern const char *sam_opcode_name(sam_opcode opcode);
+
+/**
+ *  Give an instruction the handler of its opcode for the type of its
+ *  operand, or one which reports a bad operand type if the opcode
+ *  doesn't accept it. Called again whenever the operand type changes.
+ *
+ *  @param i The instruction.
+ */
+extern void sam_opcode_bind(sam_instruction *restrict i);
+
+/**
+ *  Give the first instruction of each common sequence of instructions
+ *  a handler which executes the whole sequence at once. The other
+ *  instructions are left as they were, so labels inside a sequence
+ *  still work.
+ *
+ *  @param opcodes The opcodes of the instructions of a module.
+ *  @param handlers Their handlers.
+ *  @param len The number of instructions.
+ *
+ *  @return The number of sequences fused.
+ */
+extern size_t sam_opcode_fuse(const unsigned char *restrict opcodes,
+			      sam_handler *restrict handlers,
+			      size_t len);
+
+/**
+ *  Give an instruction a handler which skips the checks of the stack
+ *  depth, the operand types and the operand kind made by its own.
+ *  Only for instructions which sam_verify() has shown never need them.
+ *
+ *  @param i The instruction.
+ *
+ *  @return false if the opcode has no such handler, or the instruction
+ *	    has already been given a handler other than its own.
+ */
+extern bool sam_opcode_uncheck(sam_instruction *restrict i);
 
 #endif /* LIBSAM_OPCODE_H */
@@ -0,0 +1,152 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef LIBSAM_RUNTIME_H
+#define LIBSAM_RUNTIME_H
+
+#include <stddef.h>
+
+#include "engine.h"
+#include "error.h"
+#include "execute_types.h"
+#include "main.h"
+
+/*
+ * The runtime of programs translated to C by samc.
+ *
+ * A translated program keeps the stack registers in a local sam_rt_regs
+ * and runs the simple instructions inline. Everything else, including
+ * every error, is handed to the instruction's handler through
+ * sam_rt_step(), with the registers stored back into the execution
+ * state first, so that the handler sees the same state it would have
+ * under samiam. The macros below expand to the inline instructions;
+ * they expect an execution state es, registers r, the next instruction
+ * l and a label sN for the slow path of instruction N, as laid out by
+ * samc.
+ */
+
+/** The registers of the stack machine, held in locals. */
+typedef struct {
+    sam_ml *stack;  /**< The stack array. */
+    size_t  sp;	    /**< The stack pointer. */
+    size_t  alloc;  /**< The number of locations allocated. */
+    sam_sa  fbr;    /**< The frame base register. */
+} sam_rt_regs;
+
+extern sam_es	    *sam_rt_new	    (const char *restrict name,
+				     const char *restrict source,
+				     size_t len);
+extern sam_rt_regs   sam_rt_load    (const sam_es *restrict es);
+extern void	     sam_rt_store   (sam_es *restrict es,
+				     size_t sp,
+				     sam_sa fbr,
+				     unsigned l);
+extern void	     sam_rt_reserve (sam_es *restrict es,
+				     size_t sp,
+				     size_t n);
+extern unsigned	     sam_rt_step    (sam_es *restrict es,
+				     size_t sp,
+				     sam_sa fbr,
+				     unsigned l);
+extern void	     sam_rt_list    (sam_es *restrict es);
+extern sam_exit_code sam_rt_finish  (sam_es *restrict es,
+				     sam_error err);
+extern int	     sam_rt_exit    (sam_es *restrict es,
+				     sam_error err);
+
+#define SAM_RT_SLOW(k)	    goto s ## k
+#define SAM_RT_STEP(k)							\
+    do {								\
+	l = sam_rt_step(es, r.sp, r.fbr, (k));				\
+	r = sam_rt_load(es);						\
+    } while (0)
+#define SAM_RT_TOP	    (r.stack[r.sp - 1])
+#define SAM_RT_BELOW(n)	    (r.stack[r.sp - (n)])
+#define SAM_RT_NEED(n, k)   if (r.sp < (size_t)(n)) SAM_RT_SLOW(k)
+#define SAM_RT_NEED_TOP(t, k)					\
+    if (SAM_ML_TYPE(SAM_RT_TOP) != (t)) SAM_RT_SLOW(k)
+#define SAM_RT_NEED_BELOW(t, k)					\
+    if (SAM_ML_TYPE(SAM_RT_BELOW(2)) != (t)) SAM_RT_SLOW(k)
+#define SAM_RT_ROOM(n, k)						\
+    if (r.alloc - r.sp < (size_t)(n)) {					\
+	sam_rt_reserve(es, r.sp, (n));					\
+	r = sam_rt_load(es);						\
+	if (r.alloc - r.sp < (size_t)(n)) {				\
+	    SAM_RT_SLOW(k);						\
+	}								\
+    }
+#define SAM_RT_PUSH(t, field, v, k)					\
+    do {								\
+	SAM_RT_ROOM(1, k);						\
+	SAM_ML_SET(r.stack[r.sp], field, (v), (t));			\
+	++r.sp;								\
+    } while (0)
+#if SAM_NAN_BOX
+# define SAM_RT_COPY(d, s) ((d) = (s))
+#else
+/* Locations are copied field by field, the way the inline
+ * instructions write them: copying a whole location which was written
+ * a field at a time defeats store forwarding. */
+# define SAM_RT_COPY(d, s)						\
+    do {								\
+	sam_ml *d_ = &(d);						\
+	const sam_ml *s_ = &(s);					\
+	d_->value = s_->value;						\
+	d_->type = s_->type;						\
+    } while (0)
+#endif /* SAM_NAN_BOX */
+#define SAM_RT_INT_BINARY(expr, k)					\
+    do {								\
+	SAM_RT_NEED(2, k);						\
+	SAM_RT_NEED_TOP(SAM_ML_TYPE_INT, k);				\
+	SAM_RT_NEED_BELOW(SAM_ML_TYPE_INT, k);				\
+	sam_int a = SAM_ML_I(SAM_RT_BELOW(2));				\
+	sam_int b = SAM_ML_I(SAM_RT_TOP);				\
+	--r.sp;								\
+	SAM_ML_REPLACE_I(SAM_RT_TOP, (expr));				\
+    } while (0)
+#define SAM_RT_FLOAT_BINARY(expr, k)					\
+    do {								\
+	SAM_RT_NEED(2, k);						\
+	SAM_RT_NEED_TOP(SAM_ML_TYPE_FLOAT, k);				\
+	SAM_RT_NEED_BELOW(SAM_ML_TYPE_FLOAT, k);			\
+	sam_float a = SAM_ML_F(SAM_RT_BELOW(2));			\
+	sam_float b = SAM_ML_F(SAM_RT_TOP);				\
+	--r.sp;								\
+	SAM_ML_REPLACE_F(SAM_RT_TOP, (expr));				\
+    } while (0)
+#define SAM_RT_INT_UNARY(expr, k)					\
+    do {								\
+	SAM_RT_NEED(1, k);						\
+	SAM_RT_NEED_TOP(SAM_ML_TYPE_INT, k);				\
+	sam_int a = SAM_ML_I(SAM_RT_TOP);				\
+	SAM_ML_REPLACE_I(SAM_RT_TOP, (expr));				\
+    } while (0)
+
+#endif /* LIBSAM_RUNTIME_H */
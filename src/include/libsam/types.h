@@ -31,6 +31,7 @@
 #define LIBSAM_TYPES_H
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "config.h"
@@ -58,16 +59,19 @@ typedef unsigned long sam_unsigned_int;
 /** Make sure our chars are wide enough to be suitable return values. */
 typedef int sam_char;
 
+/** The index of an instruction in its module. */
+typedef uint32_t sam_line;
+
 /** An index into the array of instructions. */
 typedef struct {
-    unsigned short l;	/* line number */
+    sam_line	   l;	/* line number */
     unsigned short m;	/* module number */
 } sam_pa;
 
 /** An index into the heap. */
 typedef struct _sam_ha {
-    unsigned alloc: 12;
-    unsigned index: 12;
+    uint32_t alloc;	/* allocation number */
+    uint32_t index;	/* word within the allocation */
 } sam_ha;
 
 /** An index into the stack. */
@@ -78,17 +82,9 @@ typedef union {
     sam_int   i;
     sam_float f;
     sam_char  c;
-    char     *s;
-    sam_pa    pa;
+    char     *s;	/**< A string, or the name of a label. */
+    sam_pa    pa;	/**< The label operand of a jump or PUSHIMMPA,
+			 *   once sam_parse() has resolved it. */
 } sam_op_value;
 
-/** A label in the sam source. */
-typedef struct {
-    /** The pointer into the input to the name of the label. */
-    /*@observer@*/ char *restrict name;
-    /** The index into the array of instructions pointing to the following
-     *  instruction from the source. */
-    sam_pa pa;
-} sam_label;
-
 #endif /* LIBSAM_TYPES_H */
@@ -42,4 +42,12 @@
 /*@out@*/ /*@only@*/ /*@notnull@*/ extern void *sam_malloc(size_t size);
 /*@only@*/ /*@notnull@*/ extern void *sam_realloc(/*@only@*/ void *restrict p, size_t size);
 
+/**
+ *  Count the allocations made so far, for measuring how many it takes
+ *  to load a program.
+ *
+ *  @return How often sam_malloc() and sam_realloc() have been called.
+ */
+extern unsigned long sam_malloc_count(void);
+
 #endif /* LIBSAM_UTIL_H */
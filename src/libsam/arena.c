@@ -0,0 +1,103 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "libsam.h"
+
+#include <libsam/util.h>
+
+#include "arena.h"
+
+/* The room in the first chunk of an arena. Each chunk after it is
+ * twice the size of the one before, so that loading a large module
+ * takes a handful of allocations. */
+#define SAM_ARENA_CHUNK_MIN 4096
+
+/* Everything carved out is aligned to this. */
+#define SAM_ARENA_ALIGN (sizeof (void *) > sizeof (double)?		\
+			 sizeof (void *): sizeof (double))
+
+struct _sam_arena_chunk {
+    /*@null@*/ /*@only@*/
+    sam_arena_chunk *prev;  /**< The chunk filled before this one. */
+    size_t size;	    /**< The room after this header. */
+};
+
+/* The room in a chunk starts after its header, rounded up. */
+#define SAM_ARENA_HEADER						\
+    ((sizeof (sam_arena_chunk) + SAM_ARENA_ALIGN - 1) &		\
+     ~(SAM_ARENA_ALIGN - 1))
+
+void
+sam_arena_init(sam_arena *restrict a)
+{
+    a->chunk = NULL;
+    a->used = 0;
+    a->chunks = 0;
+    a->bytes = 0;
+}
+
+void *
+sam_arena_alloc(sam_arena *restrict a,
+		size_t size)
+{
+    size = (size + SAM_ARENA_ALIGN - 1) & ~(SAM_ARENA_ALIGN - 1);
+
+    if (a->chunk == NULL || a->used + size > a->chunk->size) {
+	size_t room = a->chunk == NULL? SAM_ARENA_CHUNK_MIN:
+	    2 * a->chunk->size;
+	sam_arena_chunk *restrict chunk;
+
+	if (room < size) {
+	    room = size;
+	}
+	chunk = sam_malloc(SAM_ARENA_HEADER + room);
+	chunk->prev = a->chunk;
+	chunk->size = room;
+	a->chunk = chunk;
+	a->used = 0;
+	++a->chunks;
+    }
+    a->used += size;
+    a->bytes += size;
+
+    return (char *)a->chunk + SAM_ARENA_HEADER + a->used - size;
+}
+
+void
+sam_arena_free(sam_arena *restrict a)
+{
+    while (a->chunk != NULL) {
+	sam_arena_chunk *restrict prev = a->chunk->prev;
+
+	free(a->chunk);
+	a->chunk = prev;
+    }
+    a->used = 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_ARENA_H
+#define LIBSAM_ARENA_H
+
+#include <stddef.h>
+
+typedef struct _sam_arena_chunk sam_arena_chunk;
+
+/**
+ * A region everything parsed into a module is carved out of: the
+ * addresses of its labels and globals, and its share of the list of
+ * locations. Nothing in it is freed on its own; sam_arena_free()
+ * releases it all at once when the module goes.
+ */
+typedef struct {
+    /*@null@*/ /*@only@*/
+    sam_arena_chunk *chunk; /**< The chunk being carved up, which links
+			     *   to those filled before it. */
+    size_t used;	    /**< The bytes of it handed out. */
+    size_t chunks;	    /**< How many chunks have been allocated. */
+    size_t bytes;	    /**< How many bytes have been handed out. */
+} sam_arena;
+
+extern void sam_arena_init(/*@out@*/ sam_arena *restrict a);
+
+/**
+ *  Carve room for size bytes out of an arena, aligned for any of the
+ *  types it holds.
+ *
+ *  @param a The arena.
+ *  @param size The number of bytes.
+ *
+ *  @return The room, which lasts as long as the arena.
+ */
+/*@dependent@*/ /*@notnull@*/ extern void *
+sam_arena_alloc(sam_arena *restrict a,
+		size_t size);
+
+extern void sam_arena_free(sam_arena *restrict a);
+
+#endif /* LIBSAM_ARENA_H */
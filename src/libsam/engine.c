@@ -0,0 +1,235 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/engine.h>
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "ir.h"
+#include "jit.h"
+
+#if defined(__GNUC__)
+# define SAM_ENGINE_THREADED 1
+#endif /* __GNUC__ */
+
+/* The reference engine: fetch each instruction through the execution
+ * state and call its handler. */
+static sam_error
+sam_engine_call_loop(/*@in@*/ sam_es *restrict es)
+{
+    sam_error err = SAM_OK;
+
+    for (; sam_es_pc_get(es).l < sam_es_instructions_len_cur(es) &&
+	    err == SAM_OK;
+	 sam_es_pc_pp(es)) {
+	err = sam_es_handler_cur(es)(es);
+    }
+
+    return err;
+}
+
+/* The call loop, counting for sam_layout() how often each instruction
+ * runs and how often control leaves it for somewhere other than the
+ * next one. */
+static sam_error
+sam_engine_profile(/*@in@*/ sam_es *restrict es)
+{
+    sam_error err = SAM_OK;
+
+    for (; sam_es_pc_get(es).l < sam_es_instructions_len_cur(es) &&
+	    err == SAM_OK;
+	 sam_es_pc_pp(es)) {
+	sam_pa pa = sam_es_pc_get(es);
+	sam_es_module *restrict module = SAM_MODULE(pa.m);
+
+	if (module->runs != NULL) {
+	    ++module->runs[pa.l];
+	}
+	err = sam_es_handler_cur(es)(es);
+	if (module->jumps != NULL &&
+	    (sam_es_pc_get(es).m != pa.m || sam_es_pc_get(es).l != pa.l)) {
+	    ++module->jumps[pa.l];
+	}
+    }
+
+    return err;
+}
+
+#if defined(SAM_ENGINE_THREADED)
+struct _sam_engine_cell {
+    const void *label;	    /**< The code implementing this
+			     *   instruction inside
+			     *   sam_engine_threaded(). */
+    sam_op_value arg;	    /**< The operand, with label operands
+			     *   replaced by their program address. */
+};
+
+/**
+ * Translate a module into threaded code. Instructions without a label
+ * in labels, and those with an operand of an unexpected type, run
+ * through their handler at slow. One extra cell past the end
+ * branches to end.
+ */
+static sam_engine_cell *
+sam_engine_translate(/*@in@*/ sam_es *restrict es,
+		     unsigned short m,
+		     const void *const *restrict labels,
+		     const void *slow,
+		     const void *end)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    size_t len = module->program.len;
+    sam_engine_cell *restrict code =
+	sam_malloc((len + 1) * sizeof (sam_engine_cell));
+
+    for (size_t l = 0; l < len; ++l) {
+	sam_instruction instruction = sam_program_get(&module->program, l);
+	const sam_instruction *restrict i = &instruction;
+	sam_engine_cell *restrict cell = &code[l];
+
+	cell->label = labels[i->opcode] == NULL? slow: labels[i->opcode];
+	cell->arg = i->operand;
+
+	switch (i->opcode) {
+	    case SAM_OPCODE_JUMP:
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_JSR:
+	    case SAM_OPCODE_PUSHIMMPA:
+		if (i->optype == SAM_OP_TYPE_INT) {
+		    if (i->opcode == SAM_OPCODE_PUSHIMMPA) {
+			cell->arg.pa = (sam_pa){.l = i->operand.i, .m = m};
+		    }
+		} else if (i->optype != SAM_OP_TYPE_LABEL) {
+		    cell->label = slow;
+		}
+		break;
+	    case SAM_OPCODE_PUSHIMM:
+	    case SAM_OPCODE_PUSHIMMMA:
+	    case SAM_OPCODE_PUSHABS:
+	    case SAM_OPCODE_STOREABS:
+	    case SAM_OPCODE_PUSHOFF:
+	    case SAM_OPCODE_STOREOFF:
+	    case SAM_OPCODE_ADDSP:
+		if (i->optype != SAM_OP_TYPE_INT) {
+		    cell->label = slow;
+		}
+		break;
+	    case SAM_OPCODE_PUSHIMMF:
+		if (i->optype != SAM_OP_TYPE_FLOAT) {
+		    cell->label = slow;
+		}
+		break;
+	    case SAM_OPCODE_PUSHIMMCH:
+		if (i->optype != SAM_OP_TYPE_CHAR) {
+		    cell->label = slow;
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+    code[len].label = end;
+
+    return code;
+}
+
+static sam_engine_cell *
+sam_engine_module(/*@in@*/ sam_es *restrict es,
+		  unsigned short m,
+		  const void *const *restrict labels,
+		  const void *slow,
+		  const void *end)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+
+    if (module->code_labels != labels) {
+	free(module->code);
+	module->code = sam_engine_translate(es, m, labels, slow, end);
+	module->code_labels = labels;
+    }
+
+    return module->code;
+}
+
+/* The direct-threaded engine, keeping the whole stack in memory. */
+# define SAM_ENGINE_FN	sam_engine_threaded
+# define SAM_ENGINE_TOS	0
+# include "engine_threaded.h"
+# undef SAM_ENGINE_FN
+# undef SAM_ENGINE_TOS
+
+/* The direct-threaded engine, keeping the top of the stack in a
+ * local. */
+# define SAM_ENGINE_FN	sam_engine_threaded_tos
+# define SAM_ENGINE_TOS	1
+# include "engine_threaded.h"
+# undef SAM_ENGINE_FN
+# undef SAM_ENGINE_TOS
+#endif /* SAM_ENGINE_THREADED */
+
+sam_error
+sam_engine_run(/*@in@*/ sam_es *restrict es)
+{
+    if (sam_es_options_get(es, SAM_PROFILE)) {
+	return sam_engine_profile(es);
+    }
+#if defined(SAM_JIT_X86_64)
+    if (sam_es_options_get(es, SAM_JIT) && !sam_es_changes_tracked(es)) {
+	return sam_jit_run(es);
+    }
+#endif /* SAM_JIT_X86_64 */
+    if (sam_es_options_get(es, SAM_REGISTERS) &&
+	!sam_es_changes_tracked(es)) {
+	sam_error err;
+
+	if (sam_ir_run(es, &err)) {
+	    return err;
+	}
+	/* go on on the stack from wherever it left off */
+    }
+#if defined(SAM_ENGINE_THREADED)
+    /* The threaded engine bypasses the change log, so it's only used
+     * when nobody is watching memory. */
+    if (!sam_es_options_get(es, SAM_CALL_LOOP) &&
+	!sam_es_changes_tracked(es)) {
+	return sam_es_options_get(es, SAM_CACHE_TOS)?
+	    sam_engine_threaded_tos(es):
+	    sam_engine_threaded(es);
+    }
+#endif /* SAM_ENGINE_THREADED */
+
+    return sam_engine_call_loop(es);
+}
@@ -0,0 +1,446 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The body of the threaded engine, included by engine.c once for each
+ * way of keeping the stack. SAM_ENGINE_FN names the function to
+ * define. When SAM_ENGINE_TOS is nonzero the top of the stack is kept
+ * in a local variable across instructions and only written back when
+ * an instruction reaches below it, calls a handler, or execution ends.
+ *
+ * Every instruction is a label in the function, reached by a computed
+ * goto through its cell in the module's translation. The program
+ * counter and stack pointer live in locals until an instruction needs
+ * its handler. Any case an instruction body doesn't handle itself,
+ * including every error, goes to the slow path before anything is
+ * modified, so that the handler sees the same state it would have
+ * under the call loop.
+ */
+
+#if SAM_ENGINE_TOS
+# define SAM_TOP	 tos
+# define SAM_SPILL()	 do { if (sp > 0) stack[sp - 1] = tos; } while (0)
+# define SAM_FILL()	 do { if (sp > 0) tos = stack[sp - 1]; } while (0)
+#else /* SAM_ENGINE_TOS */
+# define SAM_TOP	 (stack[sp - 1])
+# define SAM_SPILL()	 do { } while (0)
+# define SAM_FILL()	 do { } while (0)
+#endif /* SAM_ENGINE_TOS */
+
+#define SAM_BELOW(n)	 (stack[sp - (n)])
+#define SAM_SYNC()	 do { SAM_SPILL(); es->stack.len = sp; } while (0)
+#define SAM_LOAD()							\
+    do {								\
+	stack = es->stack.arr;						\
+	sp = es->stack.len;						\
+	SAM_FILL();							\
+    } while (0)
+#define SAM_ARG		 (code[pc].arg)
+#define SAM_NEED(n)	 if (sp < (n)) goto slow
+#define SAM_ROOM(n)	 if (es->stack.alloc - sp < (size_t)(n)) goto slow
+#define SAM_NEED_TOP(t)	 if (SAM_ML_TYPE(SAM_TOP) != (t)) goto slow
+#define SAM_NEED_BELOW(t) if (SAM_ML_TYPE(SAM_BELOW(2)) != (t)) goto slow
+#define SAM_PUSH_ML(ml)							\
+    do {								\
+	sam_ml ml_ = (ml);						\
+	SAM_SPILL();							\
+	++sp;								\
+	SAM_TOP = ml_;							\
+    } while (0)
+#define SAM_PUSH(t, field, v)						\
+    SAM_PUSH_ML(SAM_ML((sam_ml_value){.field = (v)}, (t)))
+#define SAM_DROP(n)	 do { sp -= (n); SAM_FILL(); } while (0)
+#define SAM_DISPATCH()	 goto *code[pc].label
+#define SAM_NEXT()	 do { ++pc; SAM_DISPATCH(); } while (0)
+#define SAM_GOTO(target)						\
+    do {								\
+	sam_pa target_ = (target);					\
+	if (target_.m != m) {						\
+	    if (target_.m >= es->modules.len) {				\
+		pc = target_.l;						\
+		goto end;						\
+	    }								\
+	    m = target_.m;						\
+	    code = sam_engine_module(es, m, labels, &&slow, &&end);	\
+	    len = SAM_MODULE(m)->program.len;			\
+	}								\
+	pc = target_.l;							\
+	if (pc >= len) {						\
+	    goto end;							\
+	}								\
+	SAM_DISPATCH();							\
+    } while (0)
+#define SAM_INT_BINARY(expr)						\
+    do {								\
+	SAM_NEED(2);							\
+	SAM_NEED_TOP(SAM_ML_TYPE_INT);					\
+	SAM_NEED_BELOW(SAM_ML_TYPE_INT);				\
+	sam_int a = SAM_ML_I(SAM_BELOW(2));				\
+	sam_int b = SAM_ML_I(SAM_TOP);					\
+	--sp;								\
+	SAM_ML_REPLACE_I(SAM_TOP, (expr));				\
+	SAM_NEXT();							\
+    } while (0)
+#define SAM_FLOAT_BINARY(expr)						\
+    do {								\
+	SAM_NEED(2);							\
+	SAM_NEED_TOP(SAM_ML_TYPE_FLOAT);				\
+	SAM_NEED_BELOW(SAM_ML_TYPE_FLOAT);				\
+	sam_float a = SAM_ML_F(SAM_BELOW(2));				\
+	sam_float b = SAM_ML_F(SAM_TOP);				\
+	--sp;								\
+	SAM_ML_REPLACE_F(SAM_TOP, (expr));				\
+	SAM_NEXT();							\
+    } while (0)
+#define SAM_INT_UNARY(expr)						\
+    do {								\
+	SAM_NEED(1);							\
+	SAM_NEED_TOP(SAM_ML_TYPE_INT);					\
+	sam_int a = SAM_ML_I(SAM_TOP);					\
+	SAM_ML_REPLACE_I(SAM_TOP, (expr));				\
+	SAM_NEXT();							\
+    } while (0)
+
+static sam_error
+SAM_ENGINE_FN(/*@in@*/ sam_es *restrict es)
+{
+    static const void *const labels[SAM_OPCODE_COUNT] = {
+	[SAM_OPCODE_ITOF]	= &&itof,
+	[SAM_OPCODE_PUSHIMM]	= &&pushimm,
+	[SAM_OPCODE_PUSHIMMF]	= &&pushimmf,
+	[SAM_OPCODE_PUSHIMMCH]	= &&pushimmch,
+	[SAM_OPCODE_PUSHIMMMA]	= &&pushimmma,
+	[SAM_OPCODE_PUSHIMMPA]	= &&pushimmpa,
+	[SAM_OPCODE_PUSHSP]	= &&pushsp,
+	[SAM_OPCODE_PUSHFBR]	= &&pushfbr,
+	[SAM_OPCODE_POPFBR]	= &&popfbr,
+	[SAM_OPCODE_UNLINK]	= &&popfbr,
+	[SAM_OPCODE_DUP]	= &&dup,
+	[SAM_OPCODE_SWAP]	= &&swap,
+	[SAM_OPCODE_ADDSP]	= &&addsp,
+	[SAM_OPCODE_PUSHIND]	= &&pushind,
+	[SAM_OPCODE_STOREIND]	= &&storeind,
+	[SAM_OPCODE_PUSHABS]	= &&pushabs,
+	[SAM_OPCODE_STOREABS]	= &&storeabs,
+	[SAM_OPCODE_PUSHOFF]	= &&pushoff,
+	[SAM_OPCODE_STOREOFF]	= &&storeoff,
+	[SAM_OPCODE_ADD]	= &&add,
+	[SAM_OPCODE_SUB]	= &&sub,
+	[SAM_OPCODE_TIMES]	= &&times,
+	[SAM_OPCODE_DIV]	= &&div,
+	[SAM_OPCODE_MOD]	= &&mod,
+	[SAM_OPCODE_ADDF]	= &&addf,
+	[SAM_OPCODE_SUBF]	= &&subf,
+	[SAM_OPCODE_TIMESF]	= &&timesf,
+	[SAM_OPCODE_DIVF]	= &&divf,
+	[SAM_OPCODE_AND]	= &&and,
+	[SAM_OPCODE_OR]		= &&or,
+	[SAM_OPCODE_NOT]	= &&not,
+	[SAM_OPCODE_BITAND]	= &&bitand,
+	[SAM_OPCODE_BITOR]	= &&bitor,
+	[SAM_OPCODE_BITXOR]	= &&bitxor,
+	[SAM_OPCODE_BITNOT]	= &&bitnot,
+	[SAM_OPCODE_CMP]	= &&cmp,
+	[SAM_OPCODE_GREATER]	= &&greater,
+	[SAM_OPCODE_LESS]	= &&less,
+	[SAM_OPCODE_EQUAL]	= &&equal,
+	[SAM_OPCODE_ISNIL]	= &&not,
+	[SAM_OPCODE_ISPOS]	= &&ispos,
+	[SAM_OPCODE_ISNEG]	= &&isneg,
+	[SAM_OPCODE_JUMP]	= &&jump,
+	[SAM_OPCODE_JUMPC]	= &&jumpc,
+	[SAM_OPCODE_JUMPIND]	= &&jumpind,
+	[SAM_OPCODE_RST]	= &&jumpind,
+	[SAM_OPCODE_JSR]	= &&jsr,
+	[SAM_OPCODE_JSRIND]	= &&jsrind,
+	[SAM_OPCODE_LINK]	= &&link,
+    };
+    unsigned short m = sam_es_pc_get(es).m;
+    size_t pc = sam_es_pc_get(es).l;
+    sam_engine_cell *restrict code =
+	sam_engine_module(es, m, labels, &&slow, &&end);
+    size_t len = SAM_MODULE(m)->program.len;
+    sam_ml *restrict stack;	/* es->stack.arr */
+    size_t sp;			/* es->stack.len */
+#if SAM_ENGINE_TOS
+    sam_ml tos = SAM_ML_NONE;	/* the top of the stack while sp > 0;
+				 * stack[sp - 1] is stale */
+#endif /* SAM_ENGINE_TOS */
+    sam_error err;
+
+    SAM_LOAD();
+    if (pc >= len) {
+	goto end;
+    }
+    SAM_DISPATCH();
+
+itof:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_INT);
+    SAM_ML_SET(SAM_TOP, f, (sam_float)SAM_ML_I(SAM_TOP), SAM_ML_TYPE_FLOAT);
+    SAM_NEXT();
+pushimm:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_INT, i, SAM_ARG.i);
+    SAM_NEXT();
+pushimmf:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_FLOAT, f, SAM_ARG.f);
+    SAM_NEXT();
+pushimmch:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_INT, i, SAM_ARG.c);
+    SAM_NEXT();
+pushimmma:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_SA, sa, (size_t)SAM_ARG.i);
+    SAM_NEXT();
+pushimmpa:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_PA, pa, SAM_ARG.pa);
+    SAM_NEXT();
+pushsp:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_SA, sa, sp);
+    SAM_NEXT();
+pushfbr:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_SA, sa, es->fbr);
+    SAM_NEXT();
+popfbr:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_SA);
+    es->fbr = SAM_ML_SA(SAM_TOP);
+    SAM_DROP(1);
+    SAM_NEXT();
+dup:
+    SAM_NEED(1);
+    SAM_ROOM(1);
+    SAM_PUSH_ML(SAM_TOP);
+    SAM_NEXT();
+swap:
+    SAM_NEED(2);
+    {
+	sam_ml top = SAM_TOP;
+	SAM_TOP = SAM_BELOW(2);
+	SAM_BELOW(2) = top;
+    }
+    SAM_NEXT();
+addsp:
+    if (SAM_ARG.i < 0) {
+	if ((size_t)-SAM_ARG.i > sp) {
+	    goto slow;
+	}
+    } else {
+	SAM_ROOM(SAM_ARG.i);
+	SAM_SPILL();
+	memset(stack + sp, 0, SAM_ARG.i * sizeof (sam_ml));
+    }
+    sp += SAM_ARG.i;
+    SAM_FILL();
+    SAM_NEXT();
+pushind:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_SA);
+    if (SAM_ML_SA(SAM_TOP) >= sp - 1) {
+	goto slow;
+    }
+    SAM_TOP = stack[SAM_ML_SA(SAM_TOP)];
+    SAM_NEXT();
+storeind:
+    SAM_NEED(2);
+    SAM_NEED_BELOW(SAM_ML_TYPE_SA);
+    if (SAM_ML_SA(SAM_BELOW(2)) >= sp - 2) {
+	goto slow;
+    }
+    stack[SAM_ML_SA(SAM_BELOW(2))] = SAM_TOP;
+    SAM_DROP(2);
+    SAM_NEXT();
+pushabs:
+    if ((size_t)SAM_ARG.i >= sp) {
+	goto slow;
+    }
+    SAM_ROOM(1);
+    SAM_SPILL();
+    SAM_PUSH_ML(stack[SAM_ARG.i]);
+    SAM_NEXT();
+storeabs:
+    SAM_NEED(1);
+    if ((size_t)SAM_ARG.i >= sp - 1) {
+	goto slow;
+    }
+    stack[SAM_ARG.i] = SAM_TOP;
+    SAM_DROP(1);
+    SAM_NEXT();
+pushoff:
+    if (es->fbr + SAM_ARG.i >= sp) {
+	goto slow;
+    }
+    SAM_ROOM(1);
+    SAM_SPILL();
+    SAM_PUSH_ML(stack[es->fbr + SAM_ARG.i]);
+    SAM_NEXT();
+storeoff:
+    SAM_NEED(1);
+    if (es->fbr + SAM_ARG.i >= sp - 1) {
+	goto slow;
+    }
+    stack[es->fbr + SAM_ARG.i] = SAM_TOP;
+    SAM_DROP(1);
+    SAM_NEXT();
+add:
+    SAM_INT_BINARY(a + b);
+sub:
+    SAM_INT_BINARY(a - b);
+times:
+    SAM_INT_BINARY(a * b);
+div:
+    SAM_NEED(1);
+    if (SAM_ML_I(SAM_TOP) == 0) {
+	goto slow;
+    }
+    SAM_INT_BINARY(a / b);
+mod:
+    SAM_NEED(1);
+    if (SAM_ML_I(SAM_TOP) == 0) {
+	goto slow;
+    }
+    SAM_INT_BINARY(a % b);
+addf:
+    SAM_FLOAT_BINARY(a + b);
+subf:
+    SAM_FLOAT_BINARY(a - b);
+timesf:
+    SAM_FLOAT_BINARY(a * b);
+divf:
+    SAM_FLOAT_BINARY(a / b);
+and:
+    SAM_INT_BINARY(a && b);
+or:
+    SAM_INT_BINARY(a || b);
+bitand:
+    SAM_INT_BINARY(a & b);
+bitor:
+    SAM_INT_BINARY(a | b);
+bitxor:
+    SAM_INT_BINARY(a ^ b);
+cmp:
+    SAM_INT_BINARY(a < b? -1: a == b? 0: 1);
+greater:
+    SAM_INT_BINARY(a > b);
+less:
+    SAM_INT_BINARY(a < b);
+equal:
+    SAM_INT_BINARY(a == b);
+not:
+    SAM_INT_UNARY(!a);
+bitnot:
+    SAM_INT_UNARY(~a);
+ispos:
+    SAM_INT_UNARY(a > 0);
+isneg:
+    SAM_INT_UNARY(a < 0);
+jump:
+    SAM_GOTO(SAM_ARG.pa);
+jumpc:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_INT);
+    if (SAM_ML_I(SAM_TOP) != 0) {
+	SAM_DROP(1);
+	SAM_GOTO(SAM_ARG.pa);
+    }
+    SAM_DROP(1);
+    SAM_NEXT();
+jumpind:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_PA);
+    {
+	sam_pa target = SAM_ML_PA(SAM_TOP);
+	SAM_DROP(1);
+	SAM_GOTO(target);
+    }
+jsr:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_PA, pa, ((sam_pa){.l = pc + 1, .m = m}));
+    SAM_GOTO(SAM_ARG.pa);
+jsrind:
+    SAM_NEED(1);
+    SAM_NEED_TOP(SAM_ML_TYPE_PA);
+    {
+	sam_pa target = SAM_ML_PA(SAM_TOP);
+	SAM_ML_SET(SAM_TOP, pa, ((sam_pa){.l = pc + 1, .m = m}),
+		   SAM_ML_TYPE_PA);
+	SAM_GOTO(target);
+    }
+link:
+    SAM_ROOM(1);
+    SAM_PUSH(SAM_ML_TYPE_SA, sa, es->fbr);
+    es->fbr = sp - 1;
+    SAM_NEXT();
+
+slow:
+    SAM_SYNC();
+    sam_es_pc_set(es, (sam_pa){.l = pc, .m = m});
+    if ((err = SAM_MODULE(m)->program.handlers[pc](es)) != SAM_OK) {
+	sam_es_pc_pp(es);
+	return err;
+    }
+    SAM_LOAD();
+    {
+	/* handlers leave the pc one before where execution resumes */
+	sam_pa next = sam_es_pc_get(es);
+	++next.l;
+	SAM_GOTO(next);
+    }
+
+end:
+    SAM_SYNC();
+    sam_es_pc_set(es, (sam_pa){.l = pc, .m = m});
+    return SAM_OK;
+}
+
+#undef SAM_TOP
+#undef SAM_SPILL
+#undef SAM_FILL
+#undef SAM_BELOW
+#undef SAM_SYNC
+#undef SAM_LOAD
+#undef SAM_ARG
+#undef SAM_NEED
+#undef SAM_ROOM
+#undef SAM_NEED_TOP
+#undef SAM_NEED_BELOW
+#undef SAM_PUSH_ML
+#undef SAM_PUSH
+#undef SAM_DROP
+#undef SAM_DISPATCH
+#undef SAM_NEXT
+#undef SAM_GOTO
+#undef SAM_INT_BINARY
+#undef SAM_FLOAT_BINARY
+#undef SAM_INT_UNARY
@@ -60,7 +60,7 @@ sam_error_optype(/*@in@*/ sam_es *restrict es)
 		       SAM_IOS_ERR,
 		       _("error: bad operand type given: %s.\n"),
 		       sam_op_type_to_string(
-			   sam_es_instructions_cur(es)->optype));
+			   sam_es_optype_cur(es)));
 	sam_es_bt_set(es, true);
     }
     return SAM_EOPTYPE;
@@ -83,9 +83,9 @@ sam_error_segmentation_fault(sam_es *restrict es,
 			   SAM_IOS_ERR,
 			   _("error: segmentation fault. attempt to access"
 			     " illegal memory at heap address "
-			     "%u:%u.\n"),
-			   ma.ha.alloc,
-			   ma.ha.index);
+			     "%lu:%lu.\n"),
+			   (unsigned long)ma.ha.alloc,
+			   (unsigned long)ma.ha.index);
 	sam_es_bt_set(es, true);
     }
     return SAM_ESEGFAULT;
@@ -99,9 +99,9 @@ sam_error_free(sam_es *restrict es,
 	sam_io_fprintf(es,
 		       SAM_IOS_ERR,
 		       _("error: attempt to free nonexistant or unused "
-			 "heap address %u:%uH\n"),
-		       ha.alloc,
-		       ha.index);
+			 "heap address %lu:%luH\n"),
+		       (unsigned long)ha.alloc,
+		       (unsigned long)ha.index);
 	sam_es_bt_set(es, true);
     }
     return SAM_EFREE;
@@ -184,7 +184,7 @@ sam_error_stack_input(/*@in@*/ sam_es *es,
 			 "found: %s\n"
 			 "expected: %s\n"),
 		       which,
-		       sam_es_instructions_cur(es)->name,
+		       sam_opcode_name(sam_es_opcode_cur(es)),
 		       sam_ml_type_to_string(found),
 		       sam_ml_type_to_string(expected));
 	sam_es_bt_set(es, true);
@@ -203,7 +203,7 @@ sam_error_negative_shift(/*@in@*/ sam_es *es,
 		       _("error: attempt to shift %ld by illegal negative value "
 			 "%ld.\n"),
 		       i,
-		       sam_es_instructions_cur(es)->operand.i);
+		       sam_es_operand_cur(es)->i);
     }
 
     return SAM_ESHIFT;
@@ -220,6 +220,25 @@ sam_error_division_by_zero(sam_es *es)
     return SAM_EDIVISION;
 }
 
+sam_error
+sam_error_heap_overflow(sam_es *es,
+			sam_ha ha,
+			sam_int offset)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("error: heap address %lu:%luH offset by %ld is "
+			 "out of range.\n"),
+		       (unsigned long)ha.alloc,
+		       (unsigned long)ha.index,
+		       offset);
+	sam_es_bt_set(es, true);
+    }
+
+    return SAM_EHEAP_OVERFLW;
+}
+
 sam_error
 sam_error_io(sam_es *es)
 {
@@ -239,9 +258,9 @@ sam_error_uninitialized(/*@in@*/ sam_es *es)
 	sam_io_fprintf(es,
 		       SAM_IOS_ERR,
 		       _("warning: use of uninitialized memory in module number "
-			 "%hu, line %hu.\n"),
+			 "%hu, line %lu.\n"),
 		       sam_es_pc_get(es).m,
-		       sam_es_pc_get(es).l);
+		       (unsigned long)sam_es_pc_get(es).l);
     }
 }
 
@@ -309,7 +328,7 @@ sam_error_dlsym(sam_es *restrict es)
 	sam_io_fprintf(es,
 		       SAM_IOS_ERR,
 		       _("error: couldn't call %s (not found).\n"),
-		       sam_es_instructions_cur(es)->operand.s);
+		       sam_es_operand_cur(es)->s);
 	sam_es_bt_set(es, true);
     }
 
@@ -40,7 +40,15 @@
 #include <libsam/string.h>
 #include <libsam/util.h>
 
+#include "es_private.h"
+#include "gc.h"
+#include "inline.h"
+#include "ir.h"
+#include "jit.h"
+#include "layout.h"
+#include "optimize.h"
 #include "parse.h"
+#include "verify.h"
 
 #if defined(HAVE_MMAN_H)
 # include <sys/mman.h>
@@ -50,9 +58,15 @@
 # include <dlfcn.h>
 #endif /* HAVE_DLFCN_H */
 
-#define SAM_MODULE_CUR ((sam_es_module *)es->modules.arr[sam_es_pc_get(es).m])
-#define SAM_MODULE_LAST ((sam_es_module *)es->modules.arr[es->modules.len - 1])
-#define SAM_MODULE(n) ((sam_es_module *)es->modules.arr[(n)])
+#define SAM_STACK_INIT_ALLOC 256
+#define SAM_CHANGES_INIT_CAPACITY 4096
+#define SAM_HEAP_INIT_ALLOC 16
+
+/* The smallest allocation, in bytes, given a mapping of its own. */
+#define SAM_HEAP_MAP_MIN (128 * 1024)
+
+/* The most locations set aside for a verified program up front. */
+#define SAM_STACK_RESERVE_MAX (1 << 16)
 
 #if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
 typedef struct {
@@ -61,106 +75,52 @@ typedef struct {
 } sam_dlhandle;
 #endif /* SAM_EXTENSIONS && HAVE_DLFCN_H */
 
-/* As we are simulating an abstract bytecode, there's no reason that
- * "heap allocations" be stored in a continuous heap. Each heap
- * allocation the program makes is tracked separately by samiam. This is
- * an array of heap allocations, where each heap allocation is
- * represented by the sam_heap_allocation structure */
-typedef sam_array sam_heap;
-
-typedef struct {
-    bool free;       /**< Is this being used as an allocation index? */
-    sam_array words; /**< What's at this allocation? */
-} sam_heap_allocation;
-
-typedef struct _sam_es_change_list sam_es_change_list;
-
-struct _sam_es_change_list {
-    sam_es_change change;
-    sam_es_change_list *next;
-    sam_es_change_list *prev;
-};
-
-typedef struct {
-    const char *file;	    /**< The name of the file. */
-    sam_array instructions; /**< A shallow copy of the instructions
-			     *   array allocated in main and initialized
-			     *   in sam_parse(). */
-    sam_hash_table labels;  /**< A shallow copy of the labels hash
-			     *   table allocated in main and initialized
-			     *   in sam_parse(). Has all labels this
-			     *   module can access. */
-    sam_hash_table globals; /**< A shallow copy of the globals hash
-			     *   table allocated in main and initialized
-			     *   in sam_parse(). Has all globals this
-			     *   module can access. */
-    sam_array allocs;	    /**< Automatically allocated read-only data
-			         and globals. */
-} sam_es_module;
-
-/** The parsed instructions and labels along with the current state
- *  of execution. */
-struct _sam_es {
-    bool bt;		    /**< Is a stack trace is needed? */
-    sam_string input;	    /**< The sam input file data. */
-    sam_pa pc;		    /**< The index into sam_es# program
-			     *   pointing to the current instruction,
-			     *   aka the program counter. Incremented by
-			     *   #sam_execute, not by the individual
-			     *   instruction handlers. */
-    sam_sa fbr;		    /**< The frame base register. */
-    /* stack pointer is stack->len */
-
-    sam_array modules;
-    sam_array locs;	    /**< An array of sam_es_locs ordered
-			         by pa. */
-
-    sam_array  stack;	    /**< The sam stack, an array of {@link
-			     *  sam_ml}s.  The stack pointer register is
-			     *  simply the length of this array. */
-    sam_array   heap;	    /**< The sam heap, managed by the functions
-			     *   #sam_es_heap_alloc and #sam_heap_free. */
-    sam_hash_table symbols; /**< Export symbol table. */
-
-    sam_es_change_list *first_change;
-    sam_es_change_list *last_change;
-    sam_io_dispatcher io_dispatcher;
-    void *io_data;
-    sam_options options;
-#if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
-    sam_array dlhandles;    /**< Handles returned from dlopen(). */
-#endif /* SAM_EXTENSIONS && HAVE_DLFCN_H */
-};
-
 static inline void
-sam_es_heap_allocation_free(sam_heap_allocation *alloc)
+sam_es_heap_allocation_init(sam_heap_allocation *restrict alloc,
+			    size_t size)
 {
-    if (alloc->free) {
-	free(alloc);
-    } else {
-	sam_array_free(&alloc->words);
-	free(alloc);
+    alloc->free = false;
+    alloc->mapped = false;
+    alloc->marked = false;
+    alloc->len = size;
+    if (size == 0) {
+	alloc->words = NULL;
+	return;
     }
-}
 
-static inline sam_heap_allocation *
-sam_es_heap_allocation_new(size_t size) {
-    sam_heap_allocation *restrict res = malloc(sizeof (sam_heap_allocation));
-
-    res->free = false;
-    sam_array_init(&res->words);
-    for (size_t i = 0; i < size; ++i) {
-	sam_ml_value v = { .i = 0 };
-	sam_array_ins(&res->words, sam_ml_new(v, SAM_ML_TYPE_NONE));
+#if defined(HAVE_MMAN_H)
+    /* Fresh anonymous pages read as zeroes, which are uninitialized
+     * words, so a large allocation costs nothing until it is
+     * touched, and goes back to the system when it's freed. */
+    if (size * sizeof (sam_ml) >= SAM_HEAP_MAP_MIN) {
+	void *words = mmap(NULL, size * sizeof (sam_ml),
+			   PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (words != MAP_FAILED) {
+	    alloc->words = words;
+	    alloc->mapped = true;
+	    return;
+	}
     }
-    return res;
+#endif /* HAVE_MMAN_H */
+
+    /* entire width of each word must be initialized; a zeroed word
+     * is an uninitialized one */
+    alloc->words = sam_malloc(size * sizeof (sam_ml));
+    memset(alloc->words, 0, size * sizeof (sam_ml));
 }
 
-static inline sam_heap_allocation *
-sam_es_heap_unused_allocation_new() {
-    sam_heap_allocation *restrict res = malloc(sizeof(sam_heap_allocation));
-    res->free = true;
-    return res;
+static inline void
+sam_es_heap_allocation_free(sam_heap_allocation *restrict alloc)
+{
+#if defined(HAVE_MMAN_H)
+    if (alloc->mapped) {
+	munmap(alloc->words, alloc->len * sizeof (sam_ml));
+	return;
+    }
+#endif /* HAVE_MMAN_H */
+    free(alloc->words);
 }
 
 size_t sam_es_heap_max_allocation_number(const sam_es *restrict es) {
@@ -169,25 +129,33 @@ size_t sam_es_heap_max_allocation_number(const sam_es *restrict es) {
 
 bool sam_es_heap_is_allocation_valid(const sam_es *restrict es,
 				     unsigned allocation) {
-    return allocation < es->heap.len &&
-	!((sam_heap_allocation *)es->heap.arr[allocation])->free;
+    return allocation < es->heap.len && !es->heap.arr[allocation].free;
 }
 
 size_t sam_es_heap_get_allocation_size(const sam_es *restrict es,
 				       unsigned allocation) {
     return sam_es_heap_is_allocation_valid(es, allocation)?
-        (size_t)-1:
-        ((sam_heap_allocation *)es->heap.arr[allocation])->words.len;
+        es->heap.arr[allocation].len:
+        (size_t)-1;
+}
+
+const sam_ml *
+sam_es_heap_get_allocation_words(const sam_es *restrict es,
+				 unsigned allocation) {
+    return sam_es_heap_is_allocation_valid(es, allocation)?
+        es->heap.arr[allocation].words:
+        NULL;
 }
 
 static inline void
 sam_es_heap_free(sam_es *restrict es)
 {
-    for (size_t i = 0; i< es->heap.len; ++i) {
-	sam_es_heap_allocation_free(es->heap.arr[i]);
-	es->heap.arr[i] = sam_es_heap_unused_allocation_new();
+    for (size_t i = 0; i < es->heap.len; ++i) {
+	if (!es->heap.arr[i].free) {
+	    sam_es_heap_allocation_free(&es->heap.arr[i]);
+	}
     }
-    sam_array_free(&es->heap);
+    free(es->heap.arr);
 }
 
 static inline void
@@ -196,33 +164,132 @@ sam_es_dlhandles_free(sam_array *restrict dlhandles)
     free(dlhandles->arr);
 }
 
-/* TODO: collapse changes */
+static inline void
+sam_es_change_append(sam_es_change_log *restrict log,
+		     const sam_es_change *restrict change)
+{
+    log->arr[(log->first + log->len) % log->cap] = *change;
+    ++log->len;
+}
+
+/* Try to fold change into the newest record still in the log. */
+static bool
+sam_es_change_collapse(sam_es_change_log *restrict log,
+		       const sam_es_change *restrict change)
+{
+    if (log->len == 0 || log->overflowed || !change->stack ||
+	!change->add) {
+	return false;
+    }
+
+    sam_es_change *restrict last =
+	&log->arr[(log->first + log->len - 1) % log->cap];
+
+    if (!last->stack) {
+	return false;
+    }
+    /* A pop followed by a push at the same address is a set. Pops
+     * record the stack pointer before the pop, one past the location
+     * removed. */
+    if (last->remove && last->size == 1 && change->size == 1 &&
+	last->ma.sa == change->ma.sa + 1) {
+	last->remove = 0;
+	last->ma.sa = change->ma.sa;
+	last->ml = change->ml;
+	return true;
+    }
+    /* Consecutive pushes of uninitialized memory form one range. */
+    if (last->add &&
+	SAM_ML_TYPE(last->ml) == SAM_ML_TYPE_NONE &&
+	SAM_ML_TYPE(change->ml) == SAM_ML_TYPE_NONE &&
+	last->ma.sa + last->size == change->ma.sa) {
+	last->size += change->size;
+	return true;
+    }
+
+    return false;
+}
+
 static void
 sam_es_change_register(sam_es *restrict es,
 		       const sam_es_change *restrict change)
 {
-    sam_es_change_list *new = sam_malloc(sizeof (sam_es_change_list));
-    new->change = *change;
-    new->next = NULL;
-    new->prev = es->last_change;
+    sam_es_change_log *restrict log = &es->changes;
 
-    if (es->last_change != NULL) {
-	es->last_change->next = new;
+    if (log->arr == NULL) {
+	log->arr = sam_malloc(log->cap * sizeof (sam_es_change));
+    }
+    if (sam_es_change_collapse(log, change)) {
+	return;
+    }
+    if (log->len == log->cap) {
+	switch (log->policy) {
+	    case SAM_CHANGES_BLOCK:
+		if (log->drain != NULL) {
+		    log->drain(es, log->drain_data);
+		}
+		if (log->len < log->cap) {
+		    break;
+		}
+		/*@fallthrough@*/
+	    case SAM_CHANGES_OVERFLOW:
+		log->overflowed = true;
+		return;
+	    case SAM_CHANGES_DROP_OLDEST:
+		log->first = (log->first + 1) % log->cap;
+		--log->len;
+		break;
+	}
     }
-    es->last_change = new;
-    if (es->first_change == NULL) {
-	es->first_change = new;
+    if (log->overflowed) {
+	/* Leave a marker where records were lost, once there is room
+	 * for it as well as the new record. */
+	if (log->len + 2 > log->cap) {
+	    return;
+	}
+	sam_es_change marker = {
+	    .overflow = 1,
+	};
+	sam_es_change_append(log, &marker);
+	log->overflowed = false;
     }
+    sam_es_change_append(log, change);
+}
+
+/* Add a label to a location, growing the list of its labels in the
+ * arena of its module. */
+static void
+sam_es_loc_label_ins(sam_es *restrict es,
+		     sam_es_loc *restrict loc,
+		     char *label)
+{
+    if (loc->labels.len == loc->labels.alloc) {
+	size_t alloc = loc->labels.alloc == 0? 1: 2 * loc->labels.alloc;
+	void **restrict arr = sam_arena_alloc(&SAM_MODULE(loc->pa.m)->arena,
+					      alloc * sizeof (void *));
+
+	if (loc->labels.len > 0) {
+	    memcpy(arr, loc->labels.arr, loc->labels.len * sizeof (void *));
+	}
+	loc->labels.arr = arr;
+	loc->labels.alloc = alloc;
+    }
+    loc->labels.arr[loc->labels.len++] = label;
 }
 
 static sam_es_loc *
-sam_es_loc_new(sam_pa pa, char *label)
+sam_es_loc_new(sam_es *restrict es,
+	       sam_pa pa,
+	       char *label)
 {
-    sam_es_loc *loc = sam_malloc(sizeof (sam_es_loc));
+    sam_es_loc *loc = sam_arena_alloc(&SAM_MODULE(pa.m)->arena,
+				      sizeof (sam_es_loc));
 
     loc->pa = pa;
-    sam_array_init(&loc->labels);
-    sam_array_ins(&loc->labels, label);
+    loc->labels.arr = NULL;
+    loc->labels.len = 0;
+    loc->labels.alloc = 0;
+    sam_es_loc_label_ins(es, loc, label);
 
     return loc;
 }
@@ -238,9 +305,9 @@ sam_es_loc_ins(sam_es *restrict es,
     if (es->locs.len == 0 ||
 	!(locs[es->locs.len - 1]->pa.m == line_no.m &&
 	  locs[es->locs.len - 1]->pa.l == line_no.l)) {
-	sam_array_ins(&es->locs, sam_es_loc_new(line_no, label));
+	sam_array_ins(&es->locs, sam_es_loc_new(es, line_no, label));
     } else {
-	sam_array_ins(&locs[es->locs.len - 1]->labels, label);
+	sam_es_loc_label_ins(es, locs[es->locs.len - 1], label);
     }
 }
 
@@ -302,17 +369,15 @@ sam_es_string_alloc(sam_es *restrict es,
 		    char *str,
 		    sam_ha *restrict res) {
 
-    /* XXX What if this wraps around the max number of heap
-     * allocations? */
-    *res = sam_es_heap_alloc(es, strlen(str)+1);
+    size_t len = strlen(str);
+    if (!sam_es_heap_alloc(es, len + 1, res)) {
+	return sam_error_no_memory(es);
+    }
 
-    size_t i;
-    sam_ha cur;
+    sam_ml *restrict words = es->heap.arr[res->alloc].words;
 
-    for (i = 0, cur = *res; i <= strlen(str); ++i, ++cur.index) {
-	sam_ml *restrict m = sam_es_heap_get(es, cur);
-	m->type = SAM_ML_TYPE_INT;
-	m->value.i = str[i];
+    for (size_t i = 0; i <= len; ++i) {
+	words[i] = SAM_ML_OF_I(str[i]);
     }
 
     return SAM_OK;
@@ -323,64 +388,152 @@ sam_es_string_get(/*@in@*/ sam_es *restrict es,
 		  /*@out@*/ char **restrict str,
 		  sam_ha ha)
 {
-    size_t len = 0;
-    size_t i;
-    sam_ha addr = ha;
+    const sam_heap_allocation *restrict alloc;
+    size_t len;
 
     *str = NULL;
-    for (;; ++addr.index, ++len) {
-	sam_ml *restrict m = sam_es_heap_get(es, addr);
-	if (m == NULL) {
-	    sam_ma ma = {.ha = addr};
-	    return sam_error_segmentation_fault(es, false, ma);
-	} else if (m->value.i == '\0') {
+    if (ha.alloc >= es->heap.len || es->heap.arr[ha.alloc].free) {
+	sam_ma ma = {.ha = ha};
+	return sam_error_segmentation_fault(es, false, ma);
+    }
+    alloc = &es->heap.arr[ha.alloc];
+    for (len = 0; ha.index + len < alloc->len; ++len) {
+	if (SAM_ML_I(alloc->words[ha.index + len]) == '\0') {
 	    break;
 	}
     }
+    if (ha.index + len >= alloc->len) {
+	sam_ma ma = {.ha = ha};
+	ma.ha.index = ha.index + len;
+	return sam_error_segmentation_fault(es, false, ma);
+    }
+
     *str = sam_malloc(len + 1);
-    addr = ha;
-    for (i = 0; i <= len; ++i, ++addr.index) {
-	sam_ml *restrict m = sam_es_heap_get(es, addr);
-	if (m->value.i == '\0') {
-	    (*str)[i] = '\0';
-	    break;
-	}
-	(*str)[i] = m->value.i;
+    for (size_t i = 0; i < len; ++i) {
+	(*str)[i] = SAM_ML_I(alloc->words[ha.index + i]);
     }
+    (*str)[len] = '\0';
 
     return SAM_OK;
 }
 
-/*@null@*/ inline sam_ml *
-sam_es_stack_pop(/*@in@*/ sam_es *restrict es)
+bool
+sam_es_stack_reserve(sam_es *restrict es,
+		     size_t len)
 {
-    sam_es_change ch = {
-	.stack  = 1,
-	.remove = 1,
-	.ma.sa  = es->stack.len,
-    };
-    sam_es_change_register(es, &ch);
-    return sam_array_rem(&es->stack);
+    if (len > SAM_STACK_PTR_MAX) {
+	return false;
+    }
+    if (len > es->stack.alloc) {
+	size_t alloc = es->stack.alloc;
+	while (alloc < len) {
+	    alloc *= 2;
+	}
+	es->stack.arr = sam_realloc(es->stack.arr, alloc * sizeof (sam_ml));
+	es->stack.alloc = alloc;
+    }
+
+    return true;
 }
 
-bool
+inline bool
+sam_es_stack_pop(/*@in@*/ sam_es *restrict es,
+		 /*@null@*/ /*@out@*/ sam_ml *restrict ml)
+{
+    if (es->stack.len == 0) {
+	return false;
+    }
+
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack  = 1,
+	    .remove = 1,
+	    .ma.sa  = es->stack.len,
+	    .size   = 1,
+	};
+	sam_es_change_register(es, &ch);
+    }
+
+    --es->stack.len;
+    if (ml != NULL) {
+	*ml = es->stack.arr[es->stack.len];
+    }
+    return true;
+}
+
+inline bool
 sam_es_stack_push(/*@in@*/ sam_es *restrict es,
-		  /*@only@*/ /*@out@*/ sam_ml *ml)
+		  sam_ml ml)
 {
-    if (es->stack.len == SAM_STACK_PTR_MAX) {
-	free(ml);
+    if (es->stack.len == es->stack.alloc &&
+	!sam_es_stack_reserve(es, es->stack.len + 1)) {
 	return false;
     }
 
-    sam_es_change ch = {
-	.stack = 1,
-	.add   = 1,
-	.ma.sa = es->stack.len,
-	.ml    = ml,
-    };
-    sam_es_change_register(es, &ch);
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack = 1,
+	    .add   = 1,
+	    .ma.sa = es->stack.len,
+	    .ml    = ml,
+	    .size  = 1,
+	};
+	sam_es_change_register(es, &ch);
+    }
+
+    es->stack.arr[es->stack.len++] = ml;
+    return true;
+}
+
+inline bool
+sam_es_stack_peek(/*@in@*/ const sam_es *restrict es,
+		  /*@out@*/ sam_ml *restrict ml)
+{
+    if (es->stack.len == 0) {
+	return false;
+    }
+    *ml = es->stack.arr[es->stack.len - 1];
+    return true;
+}
+
+/**
+ * Move the stack pointer to sp in one step, filling any new
+ * locations with uninitialized memory.
+ *
+ *  @param es The current execution state.
+ *  @param sp The new stack pointer.
+ *
+ *  @return false if sp exceeds #SAM_STACK_PTR_MAX.
+ */
+bool
+sam_es_stack_resize(/*@in@*/ sam_es *restrict es,
+		    sam_sa sp)
+{
+    if (!sam_es_stack_reserve(es, sp)) {
+	return false;
+    }
+    if (sp > es->stack.len) {
+	memset(es->stack.arr + es->stack.len, 0,
+	       (sp - es->stack.len) * sizeof (sam_ml));
+    }
+    if (sam_es_changes_tracked(es) && sp != es->stack.len) {
+	/* Record the whole move as a single ranged change. */
+	sam_es_change ch = {
+	    .stack = 1,
+	};
+	if (sp > es->stack.len) {
+	    ch.add = 1;
+	    ch.ma.sa = es->stack.len;
+	    ch.size = sp - es->stack.len;
+	} else {
+	    ch.remove = 1;
+	    ch.ma.sa = es->stack.len;
+	    ch.size = es->stack.len - sp;
+	}
+	sam_es_change_register(es, &ch);
+    }
+    es->stack.len = sp;
 
-    sam_array_ins(&es->stack, ml);
     return true;
 }
 
@@ -394,27 +547,28 @@ inline sam_ml *
 sam_es_stack_get(const sam_es *restrict es,
 		 sam_sa sa)
 {
-    return sa < sam_es_stack_len(es)? es->stack.arr[sa]: NULL;
+    return sa < sam_es_stack_len(es)? &es->stack.arr[sa]: NULL;
 }
 
 bool
 sam_es_stack_set(sam_es *restrict es,
-		 /*@only@*/ sam_ml *ml,
-		 sam_sa  sa)
+		 sam_ml ml,
+		 sam_sa sa)
 {
     if (sa >= sam_es_stack_len(es)) {
-	free(ml);
 	return false;
     }
 
-    sam_es_change ch = {
-	.stack = 1,
-	.ma.sa = sa,
-	.ml    = ml,
-    };
-    sam_es_change_register(es, &ch);
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack = 1,
+	    .ma.sa = sa,
+	    .ml    = ml,
+	    .size  = 1,
+	};
+	sam_es_change_register(es, &ch);
+    }
 
-    free(es->stack.arr[sa]);
     es->stack.arr[sa] = ml;
 
     return true;
@@ -424,65 +578,71 @@ inline sam_ml *
 sam_es_heap_get(const sam_es *restrict es,
 		sam_ha ha)
 {
-    sam_heap_allocation *alloc;
+    const sam_heap_allocation *alloc;
 
     /* Get allocation. */
     if (ha.alloc >= es->heap.len) {
 	return NULL;
     }
-    alloc = es->heap.arr[ha.alloc];
+    alloc = &es->heap.arr[ha.alloc];
+    if (alloc->free) {
+	return NULL;
+    }
 
     /* Get exact address. */
-    if (ha.index >= alloc->words.len) {
+    if (ha.index >= alloc->len) {
 	return NULL;
     }
-    return alloc->words.arr[ha.index];
+    return &alloc->words[ha.index];
 }
 
 bool
 sam_es_heap_set(sam_es *restrict es,
-		/*@only@*/ sam_ml *ml,
+		sam_ml ml,
 		sam_ha ha)
 {
     sam_heap_allocation *alloc;
     if (ha.alloc >= es->heap.len) {
-	goto error;
+	return false;
     }
 
-    alloc = es->heap.arr[ha.alloc];
+    alloc = &es->heap.arr[ha.alloc];
+    if (alloc->free) {
+	return false;
+    }
 
-    if (ha.index >= alloc->words.len) {
-	goto error;
+    if (ha.index >= alloc->len) {
+	return false;
     }
 
-    sam_es_change ch = {
-	.stack = 0,
-	.ma.ha = ha,
-	.ml    = ml,
-    };
-    sam_es_change_register(es, &ch);
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack = 0,
+	    .ma.ha = ha,
+	    .ml    = ml,
+	};
+	sam_es_change_register(es, &ch);
+    }
 
-    free(alloc->words.arr[ha.index]);
-    alloc->words.arr[ha.index] = ml;
+    alloc->words[ha.index] = ml;
 
     return true;
-error:
-    free(ml);
-    return false;
 }
 
 static sam_pa *
-sam_es_pa_new(sam_pa pa)
+sam_es_pa_new(sam_es_module *restrict module,
+	      sam_pa pa)
 {
-    sam_pa *ptr = sam_malloc(sizeof (sam_pa));
+    sam_pa *ptr = sam_arena_alloc(&module->arena, sizeof (sam_pa));
     *ptr = pa;
     return ptr;
 }
 
 static sam_ha *
-sam_es_ha_new(sam_ha ha)
+sam_es_ha_new(sam_es_module *restrict module,
+	      sam_ha ha)
 {
-    sam_ha *ptr = sam_malloc(sizeof (sam_ha));
+    sam_ha *ptr = sam_arena_alloc(&module->arena, sizeof (sam_ha));
     *ptr = ha;
     return ptr;
 }
@@ -494,7 +654,7 @@ sam_es_labels_ins(sam_es *restrict es,
 {
     if (sam_hash_table_ins(&SAM_MODULE_LAST->labels,
 			   label,
-			   sam_es_pa_new(line_no))) {
+			   sam_es_pa_new(SAM_MODULE_LAST, line_no))) {
 	sam_es_loc_ins(es, line_no, label);
 	return true;
     } else {
@@ -532,10 +692,15 @@ sam_es_globals_ins(sam_es *restrict es,
 		  char *restrict symbol,
 		  size_t size)
 {
-    sam_ha loc = sam_es_heap_alloc(es, size);
-    return sam_hash_table_ins(&SAM_MODULE_LAST->globals,
-			   symbol,
-			   sam_es_ha_new(loc));
+    sam_ha loc;
+    sam_ha *ha;
+
+    if (!sam_es_heap_alloc(es, size, &loc)) {
+	return false;
+    }
+    ha = sam_es_ha_new(SAM_MODULE_LAST, loc);
+    sam_array_ins(&SAM_MODULE_LAST->allocs, ha);
+    return sam_hash_table_ins(&SAM_MODULE_LAST->globals, symbol, ha);
 }
 
 inline bool
@@ -569,6 +734,116 @@ sam_es_locs_get(sam_es *restrict es)
     return &es->locs;
 }
 
+bool
+sam_es_instruction_target(const sam_instruction *restrict i,
+			  unsigned short m,
+			  /*@out@*/ size_t *restrict l)
+{
+    sam_pa pa;
+
+    switch (i->opcode) {
+	case SAM_OPCODE_JUMP:
+	case SAM_OPCODE_JUMPC:
+	case SAM_OPCODE_JSR:
+	case SAM_OPCODE_PUSHIMMPA:
+	    break;
+	default:
+	    return false;
+    }
+    if (i->optype == SAM_OP_TYPE_LABEL || i->optype == SAM_OP_TYPE_INT) {
+	pa = i->operand.pa;
+    } else {
+	return false;
+    }
+    if (pa.m != m) {
+	return false;
+    }
+    *l = pa.l;
+
+    return true;
+}
+
+static int
+sam_es_loc_cmp(const void *a,
+	       const void *b)
+{
+    const sam_es_loc *restrict x = *(sam_es_loc *const *)a;
+    const sam_es_loc *restrict y = *(sam_es_loc *const *)b;
+
+    if (x->pa.m != y->pa.m) {
+	return x->pa.m < y->pa.m? -1: 1;
+    }
+
+    return x->pa.l < y->pa.l? -1: x->pa.l > y->pa.l;
+}
+
+void
+sam_es_module_renumber(sam_es *restrict es,
+		       unsigned short m,
+		       const size_t *restrict map,
+		       size_t len,
+		       const bool *restrict skip)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    sam_es_loc **restrict locs = (sam_es_loc **)es->locs.arr;
+    size_t k = 0;
+
+#define SAM_ES_RENUMBER(l) \
+    ((sam_line)((l) <= len? map[(l)]: map[len] + ((l) - len)))
+
+    for (size_t l = 0; l < module->program.len; ++l) {
+	sam_instruction i;
+	size_t t;
+
+	if (skip != NULL && skip[l]) {
+	    continue;
+	}
+	i = sam_program_get(&module->program, l);
+	if (!sam_es_instruction_target(&i, m, &t)) {
+	    continue;
+	}
+	if (i.optype == SAM_OP_TYPE_LABEL) {
+	    module->program.operands[l].pa.l = SAM_ES_RENUMBER(t);
+	} else {
+	    module->program.operands[l].i = SAM_ES_RENUMBER(t);
+	    module->program.operands[l].pa.m = m;
+	}
+    }
+
+    for (size_t n = 0; n < es->locs.len; ++n) {
+	sam_es_loc *restrict loc = locs[n];
+
+	if (loc->pa.m != m) {
+	    continue;
+	}
+	loc->pa.l = SAM_ES_RENUMBER(loc->pa.l);
+	for (size_t j = 0; j < loc->labels.len; ++j) {
+	    sam_pa *restrict pa =
+		sam_hash_table_get(&module->labels, loc->labels.arr[j]);
+
+	    if (pa != NULL) {
+		*pa = loc->pa;
+	    }
+	}
+    }
+#undef SAM_ES_RENUMBER
+
+    /* Keep the locations in order, with the labels of instructions
+     * which now share an address together. */
+    qsort(locs, es->locs.len, sizeof (sam_es_loc *), sam_es_loc_cmp);
+    for (size_t n = 0; n < es->locs.len; ++n) {
+	if (k > 0 && sam_es_loc_cmp(&locs[k - 1], &locs[n]) == 0) {
+	    /* the location left behind goes with the arena */
+	    for (size_t j = 0; j < locs[n]->labels.len; ++j) {
+		sam_es_loc_label_ins(es, locs[k - 1], locs[n]->labels.arr[j]);
+	    }
+	} else {
+	    locs[k++] = locs[n];
+	}
+    }
+    es->locs.len = k;
+}
+
 inline const char *
 sam_es_file_get(sam_es *restrict es,
 		unsigned short module)
@@ -578,44 +853,59 @@ sam_es_file_get(sam_es *restrict es,
 
 inline void
 sam_es_instructions_ins(sam_es *restrict es,
-			sam_instruction *restrict i)
+			const sam_instruction *restrict i)
 {
-    sam_array_ins(&SAM_MODULE_LAST->instructions, i);
+    sam_program_ins(&SAM_MODULE_LAST->program, i);
 }
 
-/*@null@*/ inline sam_instruction *
+inline bool
 sam_es_instructions_get(/*@in@*/ const sam_es *restrict es,
-			sam_pa pa)
+			sam_pa pa,
+			/*@out@*/ sam_instruction *restrict i)
 {
-    return pa.l < SAM_MODULE(pa.m)->instructions.len?
-	SAM_MODULE(pa.m)->instructions.arr[pa.l]: NULL;
+    if (pa.l >= SAM_MODULE(pa.m)->program.len) {
+	return false;
+    }
+    *i = sam_program_get(&SAM_MODULE(pa.m)->program, pa.l);
+
+    return true;
+}
+
+inline sam_handler
+sam_es_handler_cur(const sam_es *restrict es)
+{
+    return SAM_MODULE_CUR->program.handlers[es->pc.l];
+}
+
+inline sam_op_value *
+sam_es_operand_cur(sam_es *restrict es)
+{
+    return &SAM_MODULE_CUR->program.operands[es->pc.l];
 }
 
-/*@null@*/ inline sam_instruction *
-sam_es_instructions_get_cur(/*@in@*/ const sam_es *restrict es,
-			    unsigned short line)
+inline sam_opcode
+sam_es_opcode_cur(const sam_es *restrict es)
 {
-    return line < SAM_MODULE_CUR->instructions.len?
-	SAM_MODULE_CUR->instructions.arr[line]: NULL;
+    return SAM_MODULE_CUR->program.opcodes[es->pc.l];
 }
 
-sam_instruction *
-sam_es_instructions_cur(sam_es *restrict es)
+inline sam_op_type
+sam_es_optype_cur(const sam_es *restrict es)
 {
-    return SAM_MODULE_CUR->instructions.arr[es->pc.l];
+    return SAM_MODULE_CUR->program.optypes[es->pc.l];
 }
 
 inline size_t
 sam_es_instructions_len(const sam_es *restrict es,
 			unsigned short module)
 {
-    return SAM_MODULE(module)->instructions.len;
+    return SAM_MODULE(module)->program.len;
 }
 
 inline size_t
 sam_es_instructions_len_cur(const sam_es *restrict es)
 {
-    return SAM_MODULE_CUR->instructions.len;
+    return SAM_MODULE_CUR->program.len;
 }
 
 inline unsigned short
@@ -624,6 +914,15 @@ sam_es_modules_len(const sam_es *restrict es)
     return es->modules.len;
 }
 
+const sam_es_subroutine *
+sam_es_subroutines_get(const sam_es *restrict es,
+		       unsigned short module,
+		       size_t *restrict len)
+{
+    *len = SAM_MODULE(module)->subroutines_len;
+    return SAM_MODULE(module)->subroutines;
+}
+
 #if 0
 void
 sam_es_ro_alloc(const sam_es *restrict es,
@@ -652,45 +951,59 @@ sam_es_import(const sam_es *restrict es, const char *symbol)
 #endif
 
 /**
- * Allocate space on the heap.
+ * Allocate space on the heap. The most recently freed allocation
+ * index is reused if there is one.
  *
  *  @param es The current execution state.
  *  @param size The number of memory locations to allocate.
+ *  @param res Set to the address of the first location.
  *
- *  @return An index into the sam_heap#a#arr, or #SAM_HEAP_PTR_MAX on
- *	    overflow.
+ *  @return false if size is more than a sam_ha can index or every
+ *	    allocation number is in use, true otherwise.
  */
-sam_ha
+bool
 sam_es_heap_alloc(/*@in@*/ sam_es *restrict es,
-		  size_t size)
+		  size_t size,
+		  /*@out@*/ sam_ha *restrict res)
 {
-    sam_ha res = {
-        .index = 0,
-    };
-    for (size_t i = 0; i < es->heap.len; ++i) {
-	if (((sam_heap_allocation *)es->heap.arr[i])->free) {
-	    free(es->heap.arr[i]);
-	    es->heap.arr[i] = sam_es_heap_allocation_new(size);
-	    res.alloc = i;
-	    goto finish;
+    size_t i;
+
+    if (size > (size_t)SAM_HEAP_INDEX_MAX + 1) {
+	return false;
+    }
+    sam_gc_allocating(es, size);
+    i = es->heap.free;
+    if (i != SAM_HEAP_NONE_FREE) {
+	es->heap.free = es->heap.arr[i].next;
+    } else {
+	if (es->heap.len > SAM_HEAP_ALLOC_MAX) {
+	    return false;
 	}
+	if (es->heap.len == es->heap.alloc) {
+	    es->heap.alloc = es->heap.alloc == 0?
+		SAM_HEAP_INIT_ALLOC: es->heap.alloc * 2;
+	    es->heap.arr = sam_realloc(es->heap.arr, es->heap.alloc *
+				       sizeof (sam_heap_allocation));
+	}
+	i = es->heap.len++;
     }
-    sam_array_ins(&es->heap, sam_es_heap_allocation_new(size));
-    res.alloc = es->heap.len - 1;
-
-finish:
-    {
-        sam_es_change ch = {
-            .stack = 0,
-            .add = 1,
-            .ma = {
-                .ha = res,
-            },
-            .size = size,
-        };
-        sam_es_change_register(es, &ch);
-        return res;
+    sam_es_heap_allocation_init(&es->heap.arr[i], size);
+    res->alloc = i;
+    res->index = 0;
+
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack = 0,
+	    .add = 1,
+	    .ma = {
+		.ha = *res,
+	    },
+	    .size = size,
+	};
+	sam_es_change_register(es, &ch);
     }
+
+    return true;
 }
 
 inline bool
@@ -699,11 +1012,11 @@ sam_es_heap_leak_check(const sam_es *restrict es,
 		       unsigned long *restrict leak_size)
 {
     for (size_t i = 0; i < es->heap.len; ++i) {
-        sam_heap_allocation *restrict a = es->heap.arr[i];
+        const sam_heap_allocation *restrict a = &es->heap.arr[i];
 
         if (!a->free) {
             ++*block_count;
-            *leak_size += a->words.len;
+            *leak_size += a->len;
         }
     }
     return *leak_size > 0;
@@ -724,30 +1037,42 @@ sam_es_heap_dealloc(sam_es *restrict es,
     }
 
     /* Double-free. */
-    if (((sam_heap_allocation *)es->heap.arr[ha.alloc])->free) {
+    if (es->heap.arr[ha.alloc].free) {
 	goto failure;
     }
 
-    size_t size = ((sam_heap_allocation *)es->heap.arr[ha.alloc])->words.len;
-
-    sam_es_heap_allocation_free(es->heap.arr[ha.alloc]);
-    es->heap.arr[ha.alloc] = sam_es_heap_unused_allocation_new();
-
-    sam_es_change ch = {
-	.stack = 0,
-	.remove = 1,
-	.ma = {
-	    .ha = ha
-	},
-	.size = size
-    };
-    sam_es_change_register(es, &ch);
+    sam_es_heap_release(es, ha.alloc);
     return SAM_OK;
 
 failure:
     return sam_error_free(es, ha);
 }
 
+void
+sam_es_heap_release(sam_es *restrict es,
+		    size_t i)
+{
+    sam_heap_allocation *restrict alloc = &es->heap.arr[i];
+    size_t size = alloc->len;
+
+    sam_es_heap_allocation_free(alloc);
+    alloc->free = true;
+    alloc->next = es->heap.free;
+    es->heap.free = i;
+
+    if (sam_es_changes_tracked(es)) {
+	sam_es_change ch = {
+	    .stack = 0,
+	    .remove = 1,
+	    .ma = {
+		.ha = {.alloc = i, .index = 0}
+	    },
+	    .size = size
+	};
+	sam_es_change_register(es, &ch);
+    }
+}
+
 sam_io_vfprintf_func
 sam_es_io_func_vfprintf(const sam_es *restrict es)
 {
@@ -788,28 +1113,94 @@ sam_es_input_get(sam_es *restrict es)
     return &es->input;
 }
 
+/**
+ * Turn recording of memory changes on or off. Changes are only
+ * recorded while a consumer is draining them with
+ * #sam_es_change_get; turning tracking off discards any changes not
+ * yet consumed.
+ *
+ *  @param es The current execution state.
+ *  @param track Whether changes should be recorded.
+ */
+void
+sam_es_changes_track(sam_es *restrict es,
+		     bool track)
+{
+    if (track) {
+	es->options |= SAM_TRACK_CHANGES;
+    } else {
+	es->options &= ~SAM_TRACK_CHANGES;
+	while (sam_es_change_get(es, NULL));
+    }
+}
+
+/**
+ * Configure the bounds of the change log.
+ *
+ *  @param es The current execution state.
+ *  @param capacity The number of change records to hold before the
+ *		    overflow policy applies.
+ *  @param policy What to do with a change when the log is full.
+ *  @param drain Under #SAM_CHANGES_BLOCK, called with drain_data to
+ *		 consume changes when the log is full. May be NULL.
+ *  @param drain_data Passed to drain.
+ */
+void
+sam_es_changes_policy_set(sam_es *restrict es,
+			  size_t capacity,
+			  sam_es_change_policy policy,
+			  /*@null@*/ sam_es_change_drain drain,
+			  /*@null@*/ void *drain_data)
+{
+    sam_es_change_log *restrict log = &es->changes;
+
+    if (capacity < 2) {
+	capacity = 2;
+    }
+    if (log->arr != NULL && capacity != log->cap) {
+	sam_es_change *arr = sam_malloc(capacity * sizeof (sam_es_change));
+	size_t len = 0;
+
+	/* Keep the newest records that fit. */
+	while (log->len > capacity) {
+	    log->first = (log->first + 1) % log->cap;
+	    --log->len;
+	}
+	for (; len < log->len; ++len) {
+	    arr[len] = log->arr[(log->first + len) % log->cap];
+	}
+	free(log->arr);
+	log->arr = arr;
+	log->first = 0;
+    }
+    log->cap = capacity;
+    log->policy = policy;
+    log->drain = drain;
+    log->drain_data = drain_data;
+}
+
 bool
 sam_es_change_get(sam_es *restrict es,
 		  sam_es_change *ch)
 {
-    if (es->first_change == NULL) {
-	return false;
-    }
+    sam_es_change_log *restrict log = &es->changes;
 
-    if (ch != NULL) {
-	*ch = es->first_change->change;
+    if (log->len == 0) {
+	if (!log->overflowed) {
+	    return false;
+	}
+	log->overflowed = false;
+	if (ch != NULL) {
+	    *ch = (sam_es_change){.overflow = 1};
+	}
+	return true;
     }
 
-    sam_es_change_list *next = es->first_change->next;
-    free(es->first_change);
-
-    if (es->first_change == es->last_change) {
-	es->first_change = NULL;
-	es->last_change = NULL;
-    } else {
-	es->first_change = next;
-	es->first_change->prev = NULL;
+    if (ch != NULL) {
+	*ch = log->arr[log->first];
     }
+    log->first = (log->first + 1) % log->cap;
+    --log->len;
 
     return true;
 }
@@ -822,10 +1213,18 @@ sam_es_init(sam_es *restrict es)
     es->bt = false;
     es->pc = (sam_pa){.l = 0, .m = 0};
     es->fbr = 0;
-    sam_array_init(&es->stack);
-    sam_array_init(&es->heap);
-    es->first_change = NULL;
-    es->last_change = NULL;
+    es->stack.len = 0;
+    es->stack.alloc = SAM_STACK_INIT_ALLOC;
+    es->stack.arr = sam_malloc(SAM_STACK_INIT_ALLOC * sizeof (sam_ml));
+    es->heap.len = 0;
+    es->heap.alloc = 0;
+    es->heap.free = SAM_HEAP_NONE_FREE;
+    es->heap.arr = NULL;
+    sam_gc_init(es);
+    es->changes.arr = NULL;
+    es->changes.first = 0;
+    es->changes.len = 0;
+    es->changes.overflowed = false;
 
 #if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
     sam_array_init(&es->dlhandles);
@@ -837,10 +1236,11 @@ sam_es_init(sam_es *restrict es)
 static void
 sam_es_clear(sam_es *restrict es)
 {
-    sam_array_free(&es->stack);
+    free(es->stack.arr);
     sam_es_heap_free(es);
+    sam_gc_free(es);
 
-    while (sam_es_change_get(es, NULL));
+    free(es->changes.arr);
 #if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
     sam_array_free(&es->dlhandles);
 #endif /* SAM_EXTENSIONS && HAVE_DLFCN_H */
@@ -849,10 +1249,20 @@ sam_es_clear(sam_es *restrict es)
 static void
 sam_es_module_free(sam_es_module *restrict module)
 {
-    sam_array_free(&module->instructions);
-    sam_array_free(&module->allocs);
+    sam_program_free(&module->program);
+    free(module->allocs.arr);	/* in the arena */
     sam_hash_table_free(&module->labels);
     sam_hash_table_free(&module->globals);
+    sam_arena_free(&module->arena);
+    free(module->code);
+    free(module->subroutines);
+    free(module->frames);
+    sam_ir_module_free(module->ir);
+    free(module->runs);
+    free(module->jumps);
+#if defined(SAM_JIT_X86_64)
+    sam_jit_module_free(module->jit);
+#endif /* SAM_JIT_X86_64 */
 }
 
 static sam_es_module *
@@ -860,37 +1270,102 @@ sam_es_module_new(sam_es *const restrict es,
 		  const char *file)
 {
     sam_es_module *restrict module = sam_malloc(sizeof (sam_es_module));
+    unsigned long *trained = NULL;
 
     module->file = file;
-    sam_array_init(&module->instructions);
+    sam_program_init(&module->program, 0);
     sam_array_init(&module->allocs);
     sam_hash_table_init(&module->labels);
     sam_hash_table_init(&module->globals);
+    sam_arena_init(&module->arena);
+    module->code = NULL;
+    module->code_labels = NULL;
+    module->jit = NULL;
+    module->subroutines = NULL;
+    module->subroutines_len = 0;
+    module->frames = NULL;
+    module->ir = NULL;
+    module->runs = NULL;
+    module->jumps = NULL;
 
     sam_array_ins(&es->modules, module);
 
     if (!sam_parse(es, file)) {
 	return NULL;
     }
+    if (sam_es_options_get(es, SAM_OPTIMIZE)) {
+	sam_optimize(es, es->modules.len - 1);
+    }
+    if (sam_es_options_get(es, SAM_PROFILE)) {
+	/* count every instruction, as it is in the profile */
+	size_t len = module->program.len;
+
+	module->runs = sam_malloc((len + 1) * sizeof (unsigned long));
+	module->jumps = sam_malloc((len + 1) * sizeof (unsigned long));
+	memset(module->runs, 0, (len + 1) * sizeof (unsigned long));
+	memset(module->jumps, 0, (len + 1) * sizeof (unsigned long));
+    } else if (sam_es_options_get(es, SAM_PROFILE_USE)) {
+	sam_layout(es, es->modules.len - 1, &trained);
+    }
+    /* A training run keeps its calls, so that the profile says how
+     * often each ran. */
+    if (sam_es_options_get(es, SAM_OPTIMIZE) &&
+	!sam_es_options_get(es, SAM_PROFILE) &&
+	sam_inline(es, es->modules.len - 1, trained) > 0) {
+	sam_optimize(es, es->modules.len - 1);
+    }
+    free(trained);
+    /* Profiles count, and the register engine translates, single
+     * instructions. */
+    if (!sam_es_options_get(es, SAM_NO_FUSION) &&
+	!sam_es_options_get(es, SAM_PROFILE) &&
+	!sam_es_options_get(es, SAM_REGISTERS)) {
+	sam_opcode_fuse(module->program.opcodes, module->program.handlers,
+			module->program.len);
+    }
+    /* Programs whose stack is watched keep their checks, since they
+     * can be stepped with any registers. */
+    if (!sam_es_changes_tracked(es) &&
+	sam_verify(es, es->modules.len - 1) &&
+	module->subroutines[0].reach <= SAM_STACK_RESERVE_MAX) {
+	sam_es_stack_reserve(es, module->subroutines[0].reach);
+    }
 
     return module;
 }
 
-/*@only@*/ sam_es *
-sam_es_new(const char *restrict file,
-	   sam_options options,
-	   /*@in@*/ sam_io_dispatcher io_dispatcher,
-	   void *io_data)
+/* The part of sam_es_new() and sam_es_new_string() before the source
+ * is parsed. */
+/*@only@*/ static sam_es *
+sam_es_create(sam_options options,
+	      /*@in@*/ sam_io_dispatcher io_dispatcher,
+	      void *io_data)
 {
     sam_es *restrict es = sam_malloc(sizeof (sam_es));
     sam_es_init(es);
 
     es->options = options;
+    es->changes.cap = SAM_CHANGES_INIT_CAPACITY;
+    es->changes.policy = SAM_CHANGES_OVERFLOW;
+    es->changes.drain = NULL;
+    es->changes.drain_data = NULL;
     es->io_dispatcher = io_dispatcher;
     es->io_data = io_data;
+    es->input.alloc = 0;
 
     sam_array_init(&es->modules);
     sam_array_init(&es->locs);
+
+    return es;
+}
+
+/*@only@*/ sam_es *
+sam_es_new(const char *restrict file,
+	   sam_options options,
+	   /*@in@*/ sam_io_dispatcher io_dispatcher,
+	   void *io_data)
+{
+    sam_es *restrict es = sam_es_create(options, io_dispatcher, io_data);
     sam_es_module *module = sam_es_module_new(es, file);
 
     if (module == NULL) {
@@ -901,16 +1376,51 @@ sam_es_new(const char *restrict file,
     return es;
 }
 
+/**
+ *  Create an execution state for source which is already in memory,
+ *  such as the copy a program translated by samc carries with it.
+ *
+ *  @param name The name to report as the file of the module.
+ *  @param source The program text; it is copied, since parsing
+ *		  writes into its input.
+ *  @param len The length of source.
+ */
+/*@only@*/ sam_es *
+sam_es_new_string(const char *restrict name,
+		  const char *restrict source,
+		  size_t len,
+		  sam_options options,
+		  /*@in@*/ sam_io_dispatcher io_dispatcher,
+		  void *io_data)
+{
+    sam_es *restrict es = sam_es_create(options, io_dispatcher, io_data);
+
+    es->input.data = sam_malloc(len + 1);
+    memcpy(es->input.data, source, len);
+    es->input.data[len] = '\0';
+    es->input.len = len;
+    es->input.alloc = len + 1;
+#if defined(HAVE_MMAN_H)
+    es->input.mmapped = false;
+#endif /* HAVE_MMAN_H */
+
+    sam_es_module *module = sam_es_module_new(es, name);
+
+    if (module == NULL) {
+	sam_es_free(es);
+	return NULL;
+    }
+
+    return es;
+}
+
 void
 sam_es_free(/*@in@*/ /*@only@*/ sam_es *restrict es)
 {
     sam_es_clear(es);
 
-    for (size_t i = 0; i < es->locs.len; ++i) {
-	sam_es_loc *restrict loc = es->locs.arr[i];
-	free(loc->labels.arr);
-    }
-    sam_array_free(&es->locs);
+    /* the locations themselves are in the arenas of their modules */
+    free(es->locs.arr);
 
     if (es->input.alloc > 0) {
 #if defined(HAVE_MMAN_H)
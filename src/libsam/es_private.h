@@ -0,0 +1,278 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_ES_PRIVATE_H
+#define LIBSAM_ES_PRIVATE_H
+
+#include <stdbool.h>
+
+#include <libsam/array.h>
+#include <libsam/hash_table.h>
+#include <libsam/es.h>
+#include <libsam/string.h>
+
+#include "arena.h"
+#include "program.h"
+
+/** An instruction translated for the threaded engine; defined in
+ *  engine.c. */
+typedef struct _sam_engine_cell sam_engine_cell;
+
+/** The machine code compiled for a module; defined in jit.c. */
+typedef struct _sam_jit_module sam_jit_module;
+
+/** A module translated into register code; defined in ir.c. */
+typedef struct _sam_ir_module sam_ir_module;
+
+#define SAM_MODULE_CUR ((sam_es_module *)es->modules.arr[sam_es_pc_get(es).m])
+#define SAM_MODULE_LAST ((sam_es_module *)es->modules.arr[es->modules.len - 1])
+#define SAM_MODULE(n) ((sam_es_module *)es->modules.arr[(n)])
+
+/* As we are simulating an abstract bytecode, there's no reason that
+ * "heap allocations" be stored in a continuous heap. Each heap
+ * allocation the program makes is tracked separately by samiam. This is
+ * an array of heap allocations, where each heap allocation is
+ * represented by the sam_heap_allocation structure */
+typedef struct {
+    bool free;       /**< Is this being used as an allocation index? */
+    size_t next;     /**< The next free allocation index, if free. */
+    bool mapped;     /**< Were the words mapped rather than
+		      *   malloc'd? */
+    bool marked;     /**< Has the collector found it reachable? */
+    size_t len;      /**< The number of words at this allocation. */
+    sam_ml *words;   /**< What's at this allocation? A single block
+		      *   of len words, or NULL if len is 0. */
+} sam_heap_allocation;
+
+/** No allocation index is free. */
+#define SAM_HEAP_NONE_FREE ((size_t)-1)
+
+/** The allocations, stored by value. Freed allocation indices are
+ *  threaded into a list through sam_heap_allocation#next and handed
+ *  out again most recently freed first. */
+typedef struct {
+    size_t len;			/**< The number of allocation indices. */
+    size_t alloc;		/**< The number of indices arr holds. */
+    size_t free;		/**< The first free index, or
+				 *   #SAM_HEAP_NONE_FREE. */
+    sam_heap_allocation *arr;
+} sam_heap;
+
+/** The state of the collector, used under #SAM_GC. */
+typedef struct {
+    size_t allocated;	      /**< The words allocated since the last
+			       *   collection. */
+    size_t threshold;	      /**< Collect when allocated reaches
+			       *   this. */
+    size_t *work;	      /**< The allocations marked but not yet
+			       *   scanned. */
+    size_t work_alloc;	      /**< The number of indices work holds. */
+    unsigned long collections;
+    unsigned long reclaimed;  /**< The allocations collected. */
+    unsigned long reclaimed_words; /**< The words they held. */
+    double pause;	      /**< Seconds spent collecting. */
+} sam_gc;
+
+/** The stack is a single contiguous buffer of unboxed memory
+ *  locations, grown geometrically as it fills up. */
+typedef struct {
+    size_t  len;    /**< The stack pointer register. */
+    size_t  alloc;  /**< The number of locations allocated. */
+    sam_ml *arr;
+} sam_stack;
+
+/** The change log is a fixed-capacity ring buffer of change records,
+ *  allocated the first time a change is recorded. */
+typedef struct {
+    sam_es_change *arr;
+    size_t cap;			 /**< The number of records arr holds. */
+    size_t first;		 /**< The index of the oldest record. */
+    size_t len;			 /**< The number of records held. */
+    bool overflowed;		 /**< Were records dropped since the
+				  *   last overflow marker? */
+    sam_es_change_policy policy; /**< What to do when the log is full. */
+    sam_es_change_drain drain;	 /**< Called to make room under
+				  *   #SAM_CHANGES_BLOCK. */
+    void *drain_data;
+} sam_es_change_log;
+
+/** What sam_verify() found out about the stack before an
+ *  instruction. */
+typedef struct {
+    long depth;		    /**< The locations pushed since the entry of
+			     *   its subroutine, or -1 if it can't be
+			     *   reached. */
+    long fbr;		    /**< Where the frame base register points,
+			     *   counted from the entry, or LONG_MIN if
+			     *   that isn't known. */
+    bool proved;	    /**< Can none of its checks fail? */
+    signed char below;	    /**< The types of the top two locations, */
+    signed char top;	    /**< or -1 if they aren't known. */
+} sam_es_frame;
+
+typedef struct {
+    const char *file;	    /**< The name of the file. */
+    sam_program program;    /**< The instructions, added by
+			     *   sam_parse(). */
+    sam_hash_table labels;  /**< A shallow copy of the labels hash
+			     *   table allocated in main and initialized
+			     *   in sam_parse(). Has all labels this
+			     *   module can access. */
+    sam_hash_table globals; /**< A shallow copy of the globals hash
+			     *   table allocated in main and initialized
+			     *   in sam_parse(). Has all globals this
+			     *   module can access. */
+    sam_array allocs;	    /**< Automatically allocated read-only data
+			         and globals. The collector never
+			         frees these. */
+    sam_arena arena;	    /**< Holds the addresses the labels and
+			     *   globals tables point to, and the
+			     *   locations of the labels. */
+    /*@null@*/ /*@only@*/
+    sam_engine_cell *code;  /**< The instructions translated for the
+			     *   threaded engine, built the first time
+			     *   it enters this module. */
+    const void *const *code_labels; /**< The engine #code was translated
+				     *   for. */
+    /*@null@*/ /*@only@*/
+    sam_jit_module *jit;    /**< The code compiled by the JIT, set up the
+			     *   first time it enters this module. */
+    /*@null@*/ /*@only@*/
+    sam_es_subroutine *subroutines; /**< The subroutines found by
+				     *   sam_verify(), or NULL if the
+				     *   module wasn't verified. */
+    size_t subroutines_len;
+    /*@null@*/ /*@only@*/
+    sam_es_frame *frames;   /**< The stack before each instruction, kept
+			     *   by sam_verify() if #SAM_REGISTERS is
+			     *   set. */
+    /*@null@*/ /*@only@*/
+    sam_ir_module *ir;	    /**< The register code, translated the first
+			     *   time the register engine enters this
+			     *   module. */
+    /*@null@*/ /*@only@*/
+    unsigned long *runs;    /**< How often each instruction has run, if
+			     *   #SAM_PROFILE is set. */
+    /*@null@*/ /*@only@*/
+    unsigned long *jumps;   /**< How often each has jumped elsewhere. */
+} sam_es_module;
+
+/** The parsed instructions and labels along with the current state
+ *  of execution. */
+struct _sam_es {
+    bool bt;		    /**< Is a stack trace is needed? */
+    sam_string input;	    /**< The sam input file data. */
+    sam_pa pc;		    /**< The index into sam_es# program
+			     *   pointing to the current instruction,
+			     *   aka the program counter. Incremented by
+			     *   #sam_execute, not by the individual
+			     *   instruction handlers. */
+    sam_sa fbr;		    /**< The frame base register. */
+    /* stack pointer is stack->len */
+
+    sam_array modules;
+    sam_array locs;	    /**< An array of sam_es_locs ordered
+			         by pa. */
+
+    sam_stack  stack;	    /**< The sam stack, an array of {@link
+			     *  sam_ml}s.  The stack pointer register is
+			     *  simply the length of this array. */
+    sam_heap    heap;	    /**< The sam heap, managed by the functions
+			     *   #sam_es_heap_alloc and #sam_heap_free. */
+    sam_gc      gc;
+    sam_hash_table symbols; /**< Export symbol table. */
+
+    sam_es_change_log changes;
+    sam_io_dispatcher io_dispatcher;
+    void *io_data;
+    sam_options options;
+#if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
+    sam_array dlhandles;    /**< Handles returned from dlopen(). */
+#endif /* SAM_EXTENSIONS && HAVE_DLFCN_H */
+};
+
+static inline bool
+sam_es_changes_tracked(const sam_es *restrict es)
+{
+    return (es->options & SAM_TRACK_CHANGES) != 0;
+}
+
+/**
+ *  Free a live heap allocation and put its number on the free list.
+ *
+ *  @param es The current execution state.
+ *  @param i The allocation number.
+ */
+extern void sam_es_heap_release(sam_es *restrict es,
+				size_t i);
+
+/**
+ *  Make room for the stack to hold len locations without moving.
+ *
+ *  @param es The current execution state.
+ *  @param len The number of locations.
+ *
+ *  @return false if len exceeds #SAM_STACK_PTR_MAX.
+ */
+extern bool sam_es_stack_reserve(sam_es *restrict es,
+				 size_t len);
+
+/**
+ *  Find the program address in a module named by the operand of a
+ *  JUMP, JUMPC, JSR or PUSHIMMPA.
+ *
+ *  @param i The instruction.
+ *  @param m The module it belongs to.
+ *  @param l Set to the index of the instruction named.
+ *
+ *  @return false if the instruction names no address in module m.
+ */
+extern bool sam_es_instruction_target(const sam_instruction *restrict i,
+				      unsigned short m,
+				      /*@out@*/ size_t *restrict l);
+
+/**
+ *  Bring the program addresses in a module up to date after its
+ *  instructions have been removed, added or moved around: the jump and
+ *  PUSHIMMPA operands, the labels and the list of locations.
+ *
+ *  @param es The current execution state.
+ *  @param m The module, whose instructions are in their new places.
+ *  @param map The new index of each instruction, by its old one, and
+ *	       at map[len] the new number of instructions.
+ *  @param len The old number of instructions.
+ *  @param skip If not NULL, the instructions by their new index whose
+ *		operands are already right.
+ */
+extern void sam_es_module_renumber(sam_es *restrict es,
+				   unsigned short m,
+				   const size_t *restrict map,
+				   size_t len,
+				   /*@null@*/ const bool *restrict skip);
+
+#endif /* LIBSAM_ES_PRIVATE_H */
@@ -43,8 +43,7 @@ sam_ml_new(sam_ml_value v,
     /* entire width of m must be initialized */
     memset(m, 0, sizeof (sam_ml));
 
-    m->type = t;
-    m->value = v;
+    *m = SAM_ML(v, t);
     return m;
 }
 
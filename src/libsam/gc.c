@@ -0,0 +1,156 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/io.h>
+#include <libsam/util.h>
+
+#include "gc.h"
+
+void
+sam_gc_init(sam_es *restrict es)
+{
+    es->gc.allocated = 0;
+    es->gc.threshold = SAM_GC_MIN_WORDS;
+    es->gc.work = NULL;
+    es->gc.work_alloc = 0;
+    es->gc.collections = 0;
+    es->gc.reclaimed = 0;
+    es->gc.reclaimed_words = 0;
+    es->gc.pause = 0;
+}
+
+/* Mark the allocation ha points into, and queue it to be scanned if
+ * it wasn't marked already. Returns the new length of the queue. */
+static inline size_t
+sam_gc_mark(sam_es *restrict es,
+	    sam_ha ha,
+	    size_t top)
+{
+    sam_heap_allocation *restrict alloc;
+
+    if (ha.alloc >= es->heap.len) {
+	return top;
+    }
+    alloc = &es->heap.arr[ha.alloc];
+    if (alloc->free || alloc->marked) {
+	return top;
+    }
+    alloc->marked = true;
+    es->gc.work[top] = ha.alloc;
+    return top + 1;
+}
+
+void
+sam_gc_collect(sam_es *restrict es)
+{
+    clock_t start = clock();
+    size_t top = 0;
+    size_t live = 0;
+
+    /* each allocation is queued at most once */
+    if (es->gc.work_alloc < es->heap.len) {
+	es->gc.work_alloc = es->heap.len;
+	es->gc.work = sam_realloc(es->gc.work,
+				  es->gc.work_alloc * sizeof (size_t));
+    }
+
+    for (size_t i = 0; i < es->stack.len; ++i) {
+	if (SAM_ML_TYPE(es->stack.arr[i]) == SAM_ML_TYPE_HA) {
+	    top = sam_gc_mark(es, SAM_ML_HA(es->stack.arr[i]), top);
+	}
+    }
+    for (size_t m = 0; m < es->modules.len; ++m) {
+	const sam_array *restrict allocs = &SAM_MODULE(m)->allocs;
+
+	for (size_t i = 0; i < allocs->len; ++i) {
+	    top = sam_gc_mark(es, *(sam_ha *)allocs->arr[i], top);
+	}
+    }
+    while (top > 0) {
+	const sam_heap_allocation *restrict alloc =
+	    &es->heap.arr[es->gc.work[--top]];
+
+	for (size_t i = 0; i < alloc->len; ++i) {
+	    if (SAM_ML_TYPE(alloc->words[i]) == SAM_ML_TYPE_HA) {
+		top = sam_gc_mark(es, SAM_ML_HA(alloc->words[i]), top);
+	    }
+	}
+    }
+
+    /* Sweep from the top, so that the lowest numbers are the first
+     * handed out again. */
+    for (size_t i = es->heap.len; i-- > 0;) {
+	sam_heap_allocation *restrict alloc = &es->heap.arr[i];
+
+	if (alloc->free) {
+	    continue;
+	}
+	if (alloc->marked) {
+	    alloc->marked = false;
+	    live += alloc->len + 1;
+	    continue;
+	}
+	++es->gc.reclaimed;
+	es->gc.reclaimed_words += alloc->len;
+	sam_es_heap_release(es, i);
+    }
+
+    es->gc.allocated = 0;
+    es->gc.threshold = live > SAM_GC_MIN_WORDS? live: SAM_GC_MIN_WORDS;
+    ++es->gc.collections;
+    es->gc.pause += (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void
+sam_gc_free(sam_es *restrict es)
+{
+    free(es->gc.work);
+}
+
+void
+sam_gc_report(sam_es *restrict es)
+{
+    if (!sam_es_options_get(es, SAM_GC) ||
+	sam_es_options_get(es, SAM_QUIET)) {
+	return;
+    }
+    sam_io_fprintf(es,
+		   SAM_IOS_ERR,
+		   _("gc: %lu collection%s, %.3f ms paused, %lu "
+		     "allocation%s (%lu bytes) reclaimed.\n"),
+		   es->gc.collections, es->gc.collections == 1? "": "s",
+		   es->gc.pause * 1000,
+		   es->gc.reclaimed, es->gc.reclaimed == 1? "": "s",
+		   es->gc.reclaimed_words * (unsigned long)sizeof (sam_ml));
+}
@@ -0,0 +1,88 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_GC_H
+#define LIBSAM_GC_H
+
+#include "es_private.h"
+
+/** The fewest words allocated between two collections. */
+#define SAM_GC_MIN_WORDS (1 << 16)
+
+/**
+ *  Set up the collector of an execution state.
+ *
+ *  @param es The current execution state.
+ */
+extern void sam_gc_init(/*@out@*/ sam_es *restrict es);
+
+/**
+ *  Free every heap allocation that can't be reached from the stack or
+ *  from the globals of a module. Any word of type #SAM_ML_TYPE_HA
+ *  keeps the whole allocation it points into alive.
+ *
+ *  @param es The current execution state.
+ */
+extern void sam_gc_collect(/*@in@*/ sam_es *restrict es);
+
+/**
+ *  Take down the collector of an execution state.
+ *
+ *  @param es The current execution state.
+ */
+extern void sam_gc_free(/*@in@*/ sam_es *restrict es);
+
+/**
+ *  Print how much the collector did, under #SAM_GC.
+ *
+ *  @param es The current execution state.
+ */
+extern void sam_gc_report(/*@in@*/ sam_es *restrict es);
+
+/**
+ *  Count an allocation of size words toward the next collection,
+ *  and collect if it is due. Does nothing unless #SAM_GC is set.
+ *
+ *  @param es The current execution state.
+ *  @param size The number of words about to be allocated.
+ */
+static inline void
+sam_gc_allocating(/*@in@*/ sam_es *restrict es,
+		  size_t size)
+{
+    if ((es->options & SAM_GC) == 0) {
+	return;
+    }
+    /* count the allocation itself, so that many empty ones add up */
+    es->gc.allocated += size + 1;
+    if (es->gc.allocated >= es->gc.threshold) {
+	sam_gc_collect(es);
+    }
+}
+
+#endif /* LIBSAM_GC_H */
@@ -170,12 +170,9 @@ sam_hash_table_get(/*@in@*/ const sam_hash_table *restrict h,
     }
 }
 
+/* The values belong to whoever put them in. */
 inline void
 sam_hash_table_free(sam_hash_table *restrict h)
 {
-    for (size_t i = 0; i < h->alloc; ++i) {
-	free(h->arr[i].value);
-    }
-
     free(h->arr);
 }
@@ -0,0 +1,441 @@
+/*
+ * inline.c    copy small subroutines into the places which call them
+ * optimize.c    simplify a module before it is run
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/*
+ * With #SAM_OPTIMIZE, sam_inline() replaces each JSR to a small leaf
+ * subroutine of the usual shape
+ *
+ *	sub:	LINK
+ *		...		no calls or frame changes
+ *		POPFBR
+ *		RST		or JUMPIND
+ *
+ * with a copy of the subroutine: the instructions which can be reached
+ * from its LINK without returning, in the order they are in. The copy
+ * doesn't push a return address, so its PUSHOFF and STOREOFF offsets
+ * move to match. Where the verifier knows where the caller's frame
+ * base is at the call, the LINK and POPFBR are left out of the copy
+ * too, and its offsets are counted from the caller's frame base
+ * instead. A jump inside the subroutine jumps inside the copy, and a
+ * return jumps past it, or falls through if it is last.
+ *
+ * Only modules the verifier can follow are inlined into, and only
+ * subroutines which keep the frame their LINK made until they return,
+ * without touching the saved frame base or the return address, are
+ * copied. The subroutine itself is left where it is, for anything else
+ * that reaches it; the optimizer removes it afterwards if nothing does.
+ *
+ * A subroutine is copied if it has at most SAM_INLINE_SIZE_MAX
+ * instructions besides its LINK, POPFBRs and returns. With the profile
+ * of a training run (#SAM_PROFILE_USE), calls which never ran aren't
+ * inlined, and calls which ran at least SAM_INLINE_HOT times may copy
+ * subroutines SAM_INLINE_HOT_SCALE times as big. No module grows by
+ * more than its own length, or SAM_INLINE_GROWTH_MIN instructions if
+ * that is more.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "inline.h"
+#include "verify.h"
+
+/* The most instructions a copied subroutine may have, not counting its
+ * LINK, POPFBRs and returns. */
+#define SAM_INLINE_SIZE_MAX 16
+
+/* How often a call must have run in the training run to be hot. */
+#define SAM_INLINE_HOT 1000
+
+/* How much bigger a subroutine called by a hot call may be. */
+#define SAM_INLINE_HOT_SCALE 4
+
+/* How many instructions any module may grow by, however short. */
+#define SAM_INLINE_GROWTH_MIN 256
+
+typedef struct {
+    sam_instruction *instructions; /**< Unpacked from the module. */
+    size_t len;
+    unsigned short m;
+    const sam_es_frame *frames;
+    bool addresses;	    /**< Might the module make the address of a
+			     *   stack location? */
+    bool *inside;	    /**< Is each instruction in the subroutine
+			     *   last looked at? */
+    size_t *body;	    /**< Its instructions other than the LINK, in
+			     *   order. */
+    size_t body_len;
+    size_t *at;		    /**< Where each of them goes in its copy. */
+    size_t *work;
+    bool *copied;	    /**< Is each instruction placed part of a
+			     *   copy? */
+} sam_inliner;
+
+static inline bool
+sam_inline_returns(sam_opcode opcode)
+{
+    return opcode == SAM_OPCODE_RST || opcode == SAM_OPCODE_JUMPIND;
+}
+
+static inline bool
+sam_inline_unlinks(sam_opcode opcode)
+{
+    return opcode == SAM_OPCODE_POPFBR || opcode == SAM_OPCODE_UNLINK;
+}
+
+/* Could i leave the address of a stack location on the stack? A
+ * PUSHOFF 0 reads the FBR saved by a LINK, and native code may push
+ * anything. */
+static inline bool
+sam_inline_addresses(const sam_instruction *restrict i)
+{
+    switch (i->opcode) {
+	case SAM_OPCODE_PUSHSP:
+	case SAM_OPCODE_PUSHFBR:
+	case SAM_OPCODE_PUSHIMMMA:
+	case SAM_OPCODE_CALL:
+	    return true;
+	case SAM_OPCODE_PUSHOFF:
+	    return i->optype != SAM_OP_TYPE_INT || i->operand.i == 0;
+	default:
+	    return false;
+    }
+}
+
+/* Could an instruction of the subroutine at entry, other than its
+ * LINK, POPFBRs and returns, be copied? */
+static bool
+sam_inline_copyable(const sam_inliner *restrict in,
+		    const sam_instruction *restrict i,
+		    size_t entry)
+{
+    size_t t;
+
+    switch (i->opcode) {
+	case SAM_OPCODE_PUSHOFF:
+	case SAM_OPCODE_STOREOFF:
+	    /* not the saved frame base or return address */
+	    return i->optype == SAM_OP_TYPE_INT &&
+		(i->operand.i <= -2 || i->operand.i >= 1);
+	case SAM_OPCODE_JUMP:
+	case SAM_OPCODE_JUMPC:
+	    return sam_es_instruction_target(i, in->m, &t) &&
+		t < in->len && t != entry &&
+		!sam_inline_returns(in->instructions[t].opcode);
+	case SAM_OPCODE_PUSHIND:
+	case SAM_OPCODE_STOREIND:
+	    /* the address could be of the subroutine's own frame,
+	     * which moves */
+	    return !in->addresses;
+	case SAM_OPCODE_PUSHSP:
+	case SAM_OPCODE_PUSHFBR:
+	case SAM_OPCODE_POPSP:
+	case SAM_OPCODE_POPFBR:
+	case SAM_OPCODE_LINK:
+	case SAM_OPCODE_UNLINK:
+	case SAM_OPCODE_PUSHABS:
+	case SAM_OPCODE_STOREABS:
+	case SAM_OPCODE_PUSHIMMPA:
+	case SAM_OPCODE_JUMPIND:
+	case SAM_OPCODE_RST:
+	case SAM_OPCODE_JSR:
+	case SAM_OPCODE_JSRIND:
+	case SAM_OPCODE_SKIP:
+	case SAM_OPCODE_STOP:
+	case SAM_OPCODE_LOAD:
+	case SAM_OPCODE_CALL:
+	    return false;
+	default:
+	    return true;
+    }
+}
+
+static int
+sam_inline_cmp(const void *a,
+	       const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+    return x < y? -1: x > y;
+}
+
+/* Find the instructions of the subroutine at entry, if it can be
+ * copied and has at most size of them. */
+static bool
+sam_inline_callee(sam_inliner *restrict in,
+		  size_t entry,
+		  size_t size)
+{
+    const sam_es_frame *restrict f = in->frames;
+    size_t work_len = 0, n = 0;
+
+    for (size_t k = 0; k < in->body_len; ++k) {
+	in->inside[in->body[k]] = false;
+    }
+    in->body_len = 0;
+    if (entry + 1 >= in->len ||
+	in->instructions[entry].opcode != SAM_OPCODE_LINK ||
+	f[entry].depth != 0) {
+	return false;
+    }
+    in->work[work_len++] = entry + 1;
+    while (work_len > 0) {
+	size_t l = in->work[--work_len];
+	const sam_instruction *restrict i;
+	size_t t;
+
+	if (l >= in->len) {
+	    return false;
+	}
+	if (in->inside[l]) {
+	    continue;
+	}
+	in->inside[l] = true;
+	in->body[in->body_len++] = l;
+	i = &in->instructions[l];
+	if (sam_inline_returns(i->opcode)) {
+	    continue;
+	}
+	if (sam_inline_unlinks(i->opcode)) {
+	    /* the frame is gone, and must be returned from */
+	    if (f[l].depth != 1 || f[l].fbr != 0 || l + 1 >= in->len ||
+		!sam_inline_returns(in->instructions[l + 1].opcode) ||
+		f[l + 1].depth != 0) {
+		return false;
+	    }
+	    in->work[work_len++] = l + 1;
+	    continue;
+	}
+	if (++n > size || f[l].depth < 1 || f[l].fbr != 0 ||
+	    !sam_inline_copyable(in, i, entry)) {
+	    return false;
+	}
+	if (sam_es_instruction_target(i, in->m, &t)) {
+	    in->work[work_len++] = t;
+	}
+	if (i->opcode != SAM_OPCODE_JUMP) {
+	    /* returning without POPFBR would keep the subroutine's
+	     * frame */
+	    if (l + 1 < in->len &&
+		sam_inline_returns(in->instructions[l + 1].opcode)) {
+		return false;
+	    }
+	    in->work[work_len++] = l + 1;
+	}
+    }
+    qsort(in->body, in->body_len, sizeof (size_t), sam_inline_cmp);
+
+    return true;
+}
+
+/* Point a copied jump at l. Its label is dropped, since that names
+ * the jump's target in the subroutine and not in the copy. */
+static void
+sam_inline_retarget(sam_instruction *restrict i,
+		    unsigned short m,
+		    size_t l)
+{
+    i->optype = SAM_OP_TYPE_INT;
+    i->operand.i = (sam_int)l;
+    i->operand.pa.m = m;
+    i->label = NULL;
+    sam_opcode_bind(i);
+}
+
+/* Append a copy of the subroutine found by sam_inline_callee() at
+ * entry, for the JSR at site, to placed. */
+static void
+sam_inline_copy(sam_inliner *restrict in,
+		sam_program *restrict placed,
+		size_t site,
+		size_t entry)
+{
+    const sam_es_frame *restrict f = &in->frames[site];
+    /* without its LINK, the copy runs in the caller's frame */
+    bool linked = f->fbr == LONG_MIN;
+    size_t after = placed->len + linked;
+
+    /* Work out where everything goes first, for the jumps. A POPFBR
+     * left out, or a return which is last, goes where the next
+     * instruction does. */
+    for (size_t k = 0; k < in->body_len; ++k) {
+	sam_opcode opcode = in->instructions[in->body[k]].opcode;
+
+	in->at[k] = after;
+	if ((sam_inline_unlinks(opcode) && !linked) ||
+	    (sam_inline_returns(opcode) && k + 1 == in->body_len)) {
+	    continue;
+	}
+	++after;
+    }
+
+    if (linked) {
+	in->copied[placed->len] = true;
+	sam_program_ins(placed, &in->instructions[entry]);
+    }
+    for (size_t k = 0; k < in->body_len; ++k) {
+	const sam_instruction *restrict i = &in->instructions[in->body[k]];
+	sam_instruction copy;
+	size_t t;
+
+	if (sam_inline_returns(i->opcode)) {
+	    if (k + 1 < in->body_len) {
+		sam_opcode_get("JUMP", &copy);
+		sam_inline_retarget(&copy, in->m, after);
+		in->copied[placed->len] = true;
+		sam_program_ins(placed, &copy);
+	    }
+	    continue;
+	}
+	if (sam_inline_unlinks(i->opcode) && !linked) {
+	    continue;
+	}
+	copy = *i;
+	if (i->opcode == SAM_OPCODE_PUSHOFF ||
+	    i->opcode == SAM_OPCODE_STOREOFF) {
+	    long off = i->operand.i;
+
+	    /* Called, the subroutine's arguments are below a return
+	     * address and the saved frame base, and its locals above
+	     * them. */
+	    if (linked) {
+		copy.operand.i = (sam_int)(off < 0? off + 1: off);
+	    } else {
+		copy.operand.i = (sam_int)(f->depth - f->fbr +
+					   (off < 0? off + 1: off - 1));
+	    }
+	} else if (sam_es_instruction_target(i, in->m, &t)) {
+	    const size_t *restrict b =
+		bsearch(&t, in->body, in->body_len, sizeof (size_t),
+			sam_inline_cmp);
+
+	    sam_inline_retarget(&copy, in->m, in->at[b - in->body]);
+	}
+	in->copied[placed->len] = true;
+	sam_program_ins(placed, &copy);
+    }
+}
+
+size_t
+sam_inline(sam_es *restrict es,
+	   unsigned short m,
+	   const unsigned long *restrict trained)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    size_t len = module->program.len;
+    size_t grow = len > SAM_INLINE_GROWTH_MIN? len: SAM_INLINE_GROWTH_MIN;
+    sam_inliner in = {
+	.instructions = NULL,
+	.len = len,
+	.m = m,
+	.frames = NULL,
+	.addresses = false,
+	.body_len = 0,
+    };
+    sam_es_frame *restrict frames;
+    sam_program placed;
+    size_t *restrict map;
+    size_t inlined = 0;
+
+    if (len == 0 || (frames = sam_verify_frames(es, m)) == NULL) {
+	return 0;
+    }
+    in.frames = frames;
+    in.instructions = sam_program_unpack(&module->program);
+    in.copied = sam_malloc((len + grow) * sizeof (bool));
+    memset(in.copied, 0, (len + grow) * sizeof (bool));
+    in.inside = sam_malloc(len * sizeof (bool));
+    in.body = sam_malloc(len * sizeof (size_t));
+    in.at = sam_malloc(len * sizeof (size_t));
+    in.work = sam_malloc(2 * len * sizeof (size_t));
+    memset(in.inside, 0, len * sizeof (bool));
+    for (size_t l = 0; l < len; ++l) {
+	if (sam_inline_addresses(&in.instructions[l])) {
+	    in.addresses = true;
+	}
+    }
+
+    map = sam_malloc((len + 1) * sizeof (size_t));
+    sam_program_init(&placed, len);
+    for (size_t l = 0; l < len; ++l) {
+	const sam_instruction *restrict i = &in.instructions[l];
+	size_t size = SAM_INLINE_SIZE_MAX;
+	size_t entry, grown;
+
+	map[l] = placed.len;
+	if (i->opcode != SAM_OPCODE_JSR || frames[l].depth < 0 ||
+	    !sam_es_instruction_target(i, m, &entry) ||
+	    (trained != NULL && trained[l] == 0)) {
+	    sam_program_ins(&placed, i);
+	    continue;
+	}
+	if (trained != NULL && trained[l] >= SAM_INLINE_HOT) {
+	    size *= SAM_INLINE_HOT_SCALE;
+	}
+	if (!sam_inline_callee(&in, entry, size) ||
+	    (grown = placed.len + in.body_len + 1 + (len - l)) > len + grow ||
+	    grown > UINT32_MAX) {
+	    sam_program_ins(&placed, i);
+	    continue;
+	}
+	sam_inline_copy(&in, &placed, l, entry);
+	++inlined;
+    }
+    map[len] = placed.len;
+
+    if (inlined > 0) {
+	sam_program_free(&module->program);
+	module->program = placed;
+	/* The copies already jump where they should, so only the
+	 * instructions which were there before are renumbered. */
+	sam_es_module_renumber(es, m, map, len, in.copied);
+    } else {
+	sam_program_free(&placed);
+    }
+
+    free(map);
+    free(in.instructions);
+    free(in.copied);
+    free(frames);
+    free(in.inside);
+    free(in.body);
+    free(in.at);
+    free(in.work);
+
+    return inlined;
+}
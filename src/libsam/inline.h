@@ -0,0 +1,50 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_INLINE_H
+#define LIBSAM_INLINE_H
+
+#include "es_private.h"
+
+/**
+ *  Replace each JSR to a small leaf subroutine in a module with a copy
+ *  of the subroutine. Jump and PUSHIMMPA operands and labels are
+ *  renumbered to match.
+ *
+ *  @param es The current execution state.
+ *  @param m The module, which has been parsed but not yet fused.
+ *  @param trained How often each instruction ran in a training run, or
+ *		   NULL.
+ *
+ *  @return The number of calls inlined.
+ */
+extern size_t sam_inline(/*@in@*/ sam_es *restrict es,
+			 unsigned short m,
+			 /*@null@*/ const unsigned long *restrict trained);
+
+#endif /* LIBSAM_INLINE_H */
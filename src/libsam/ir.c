@@ -0,0 +1,1207 @@
+/*
+ * ir.c    translate verified modules into register code and run it
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The register engine. Before each instruction of a module sam_verify()
+ * could follow, the depth of the stack is known counted from the entry
+ * of the subroutine it runs in, and so, often, is where the frame base
+ * register points. Every location in a frame can then be named by its
+ * distance from the entry: those are the registers here. Register r is
+ * stack[base + r], where base is the stack pointer when the subroutine
+ * was entered, so the arguments and the return address are the negative
+ * registers. The stack pointer itself is never kept, as it is always
+ * base plus the depth the translation knows.
+ *
+ * Each basic block is translated with a model of the stack in which a
+ * location may hold a constant or a copy of a register rather than
+ * having been written, so pushes, PUSHOFF, DUP and ADDSP cost nothing
+ * and each operation reads its operands where they already are. A
+ * result that STOREOFF stores straight away is written into the
+ * register it is stored in, and a comparison that JUMPC tests straight
+ * away becomes a conditional branch, so that
+ *
+ *	PUSHOFF 1		PUSHOFF 2
+ *	PUSHIMM 1		PUSHOFF 3
+ *	SUB			LESS
+ *	STOREOFF 1		JUMPC loop
+ *
+ * become SUBI r1, r1, 1 and JLT r2, r3, loop. Every location is written
+ * out at the end of a block and before any instruction that runs
+ * through its handler, so wherever control can leave the block the
+ * stack in memory is just what the stack engines would have left.
+ *
+ * A return to anything but the return point of a JSR in the module
+ * hands the program back to the stack engines, as do modules the
+ * verifier couldn't follow: those with POPSP, JSRIND, indirect jumps
+ * other than returns, or calls into dynamic libraries.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "ir.h"
+
+typedef enum {
+    SAM_IR_NONE,
+    SAM_IR_MOV,		    /* d = a */
+    SAM_IR_MOVI,	    /* d = k */
+    SAM_IR_SWAP,	    /* d <-> d + 1 */
+    SAM_IR_ADD,		    /* d = a + b, and likewise below */
+    SAM_IR_ADDI,	    /* d = a + k, and likewise below */
+    SAM_IR_SUB,
+    SAM_IR_SUBI,
+    SAM_IR_TIMES,
+    SAM_IR_TIMESI,
+    SAM_IR_DIV,
+    SAM_IR_MOD,
+    SAM_IR_AND,
+    SAM_IR_ANDI,
+    SAM_IR_OR,
+    SAM_IR_ORI,
+    SAM_IR_BITAND,
+    SAM_IR_BITANDI,
+    SAM_IR_BITOR,
+    SAM_IR_BITORI,
+    SAM_IR_BITXOR,
+    SAM_IR_BITXORI,
+    SAM_IR_CMP,
+    SAM_IR_CMPI,
+    SAM_IR_GREATER,
+    SAM_IR_GREATERI,
+    SAM_IR_LESS,
+    SAM_IR_LESSI,
+    SAM_IR_EQUAL,
+    SAM_IR_EQUALI,
+    SAM_IR_ADDF,
+    SAM_IR_SUBF,
+    SAM_IR_TIMESF,
+    SAM_IR_DIVF,
+    SAM_IR_NOT,		    /* d = !a, and likewise below */
+    SAM_IR_ISPOS,
+    SAM_IR_ISNEG,
+    SAM_IR_BITNOT,
+    SAM_IR_LINK,	    /* d = fbr; fbr = base + d */
+    SAM_IR_POPFBR,	    /* fbr = a */
+    SAM_IR_PUSHFBR,	    /* d = fbr */
+    SAM_IR_PUSHSP,	    /* d = base + d */
+    SAM_IR_JUMP,	    /* goto t */
+    SAM_IR_JNZ,		    /* if a != 0 goto t */
+    SAM_IR_JLT,		    /* if a < b goto t, and likewise below */
+    SAM_IR_JLTI,	    /* if a < k goto t, and likewise below */
+    SAM_IR_JGT,
+    SAM_IR_JGTI,
+    SAM_IR_JEQ,
+    SAM_IR_JEQI,
+    SAM_IR_JNE,
+    SAM_IR_JNEI,
+    SAM_IR_CALL,	    /* d = the return address; base += d + 1;
+			     * goto t */
+    SAM_IR_RET,		    /* return to the address in -1 */
+    SAM_IR_GUARD,	    /* unless a and b have the type of k goto t */
+    SAM_IR_SLOW,	    /* run the instruction l through its handler,
+			     * with d locations in the frame */
+    SAM_IR_EXIT		    /* stop here with d locations in the frame,
+			     * and go on on the stack from l */
+} sam_ir_op;
+
+/* A register instruction. */
+typedef struct {
+    unsigned char op;	    /**< A #sam_ir_op. */
+    sam_line l;		    /**< The instruction it was translated from,
+			     *   or for EXIT where to go on from. */
+    int d;		    /**< The register written, or the depth of
+			     *   the frame. */
+    int a;		    /**< The registers read. */
+    int b;
+    size_t t;		    /**< The target of a branch. */
+    sam_ml k;		    /**< The constant operand. */
+} sam_ir_insn;
+
+struct _sam_ir_module {
+    /*@only@*/ sam_ir_insn *code;
+    /*@only@*/ size_t *at;  /**< Where the register code for each
+			     *   instruction starting a block begins, or
+			     *   SIZE_MAX. */
+    size_t room;	    /**< The most locations any subroutine in
+			     *   the module pushes. */
+};
+
+/* What the translation knows a location of the stack to hold. Each
+ * location either holds its own register, which is to say it has been
+ * written, or a constant or a copy of a register below it which has
+ * been. */
+typedef struct {
+    bool constant;
+    int r;		    /**< The register, if not constant. */
+    sam_ml k;		    /**< The constant. */
+} sam_ir_value;
+
+/* The way around an operation for operands of the wrong type: the
+ * model of the frame is written out, the instructions it was
+ * translated from run through their handlers, and control goes on
+ * after it. Any location written again afterwards is only written with
+ * what it already holds. */
+typedef struct {
+    size_t guard;	    /**< The GUARD leading here. */
+    size_t after;	    /**< The operation it guards. */
+    sam_line l[2];	    /**< The instructions to run. */
+    int depths[2];	    /**< The depth of the frame before each. */
+    size_t n;
+    int depth;
+    /*@only@*/
+    sam_ir_value *stack;    /**< The model at the guard. */
+} sam_ir_stub;
+
+typedef struct {
+    const sam_program *program;
+    const sam_es_frame *frames;
+    size_t len;
+    unsigned short m;
+    sam_line l;		    /**< The instruction being translated. */
+    sam_ir_insn *code;
+    size_t code_len;
+    size_t code_alloc;
+    size_t *at;
+    bool *leader;	    /**< Does a block start at each
+			     *   instruction? */
+    sam_ir_value *stack;    /**< The model of the frame. */
+    int depth;
+    size_t last;	    /**< The register instruction whose result
+			     *   is on top of the model, if it is the
+			     *   last one written, or SIZE_MAX. */
+    unsigned char jump;	    /**< The branch it turns into when JUMPC
+			     *   tests its result, or SAM_IR_NONE. */
+    size_t stub;	    /**< The stub for it, or SIZE_MAX. */
+    sam_ir_stub *stubs;
+    size_t stubs_len;
+    size_t stubs_alloc;
+} sam_ir_translator;
+
+/* The operations translated from instructions which pop two locations
+ * and push one: the register instruction for two registers, the one
+ * for a register and a constant if there is one, and the branches they
+ * turn into when the result is tested straight away. */
+static const struct {
+    sam_opcode opcode;
+    unsigned char op;
+    unsigned char opi;
+    bool commutes;
+    unsigned char jump;
+    unsigned char jumpi;
+} sam_ir_binaries[] = {
+    { SAM_OPCODE_ADD,	  SAM_IR_ADD,	  SAM_IR_ADDI,	   true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_SUB,	  SAM_IR_SUB,	  SAM_IR_SUBI,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_TIMES,	  SAM_IR_TIMES,	  SAM_IR_TIMESI,   true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_DIV,	  SAM_IR_DIV,	  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_MOD,	  SAM_IR_MOD,	  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_AND,	  SAM_IR_AND,	  SAM_IR_ANDI,	   true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_OR,	  SAM_IR_OR,	  SAM_IR_ORI,	   true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_BITAND,  SAM_IR_BITAND,  SAM_IR_BITANDI,  true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_BITOR,	  SAM_IR_BITOR,	  SAM_IR_BITORI,   true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_BITXOR,  SAM_IR_BITXOR,  SAM_IR_BITXORI,  true,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_CMP,	  SAM_IR_CMP,	  SAM_IR_CMPI,	   false,
+	SAM_IR_JNE,	SAM_IR_JNEI },
+    { SAM_OPCODE_GREATER, SAM_IR_GREATER, SAM_IR_GREATERI, false,
+	SAM_IR_JGT,	SAM_IR_JGTI },
+    { SAM_OPCODE_LESS,	  SAM_IR_LESS,	  SAM_IR_LESSI,	   false,
+	SAM_IR_JLT,	SAM_IR_JLTI },
+    { SAM_OPCODE_EQUAL,	  SAM_IR_EQUAL,	  SAM_IR_EQUALI,   true,
+	SAM_IR_JEQ,	SAM_IR_JEQI },
+    { SAM_OPCODE_ADDF,	  SAM_IR_ADDF,	  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_SUBF,	  SAM_IR_SUBF,	  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_TIMESF,  SAM_IR_TIMESF,  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+    { SAM_OPCODE_DIVF,	  SAM_IR_DIVF,	  SAM_IR_NONE,	   false,
+	SAM_IR_NONE,	SAM_IR_NONE },
+};
+
+/* Likewise for those which pop one location and push one. A test of
+ * the result becomes a branch comparing the operand with k. */
+static const struct {
+    sam_opcode opcode;
+    unsigned char op;
+    unsigned char jump;
+    sam_int k;
+} sam_ir_unaries[] = {
+    { SAM_OPCODE_NOT,	 SAM_IR_NOT,	SAM_IR_JEQI, 0 },
+    { SAM_OPCODE_ISNIL,	 SAM_IR_NOT,	SAM_IR_JEQI, 0 },
+    { SAM_OPCODE_ISPOS,	 SAM_IR_ISPOS,	SAM_IR_JGTI, 0 },
+    { SAM_OPCODE_ISNEG,	 SAM_IR_ISNEG,	SAM_IR_JLTI, 0 },
+    { SAM_OPCODE_BITNOT, SAM_IR_BITNOT, SAM_IR_JNEI, -1 },
+};
+
+static size_t
+sam_ir_emit(sam_ir_translator *restrict t,
+	    sam_ir_insn x)
+{
+    if (t->code_len == t->code_alloc) {
+	t->code_alloc *= 2;
+	t->code = sam_realloc(t->code, t->code_alloc * sizeof (sam_ir_insn));
+    }
+    x.l = t->l;
+    t->code[t->code_len] = x;
+    t->last = SIZE_MAX;
+
+    return t->code_len++;
+}
+
+/* Write the value of location r to memory. */
+static void
+sam_ir_write(sam_ir_translator *restrict t,
+	     int r)
+{
+    sam_ir_value *restrict v = &t->stack[r];
+
+    if (v->constant) {
+	sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_MOVI, .d = r, .k = v->k});
+    } else if (v->r != r) {
+	sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_MOV, .d = r, .a = v->r});
+    }
+    *v = (sam_ir_value){.r = r};
+}
+
+/* Write every location of the frame to memory. */
+static void
+sam_ir_flush(sam_ir_translator *restrict t)
+{
+    for (int r = 0; r < t->depth; ++r) {
+	sam_ir_write(t, r);
+    }
+}
+
+/* Write to memory every location holding a copy of register r, before
+ * r is overwritten. */
+static void
+sam_ir_clobber(sam_ir_translator *restrict t,
+	       int r)
+{
+    for (int j = 0; j < t->depth; ++j) {
+	if (!t->stack[j].constant && t->stack[j].r == r && j != r) {
+	    sam_ir_write(t, j);
+	}
+    }
+}
+
+static inline void
+sam_ir_push(sam_ir_translator *restrict t,
+	    sam_ir_value v)
+{
+    t->stack[t->depth++] = v;
+}
+
+static inline void
+sam_ir_push_constant(sam_ir_translator *restrict t,
+		     sam_ml_type type,
+		     sam_ml_value value)
+{
+    sam_ir_push(t, (sam_ir_value){
+	.constant = true,
+	.k = SAM_ML(value, type)
+    });
+}
+
+/* Push the value of register r, which may itself be a constant or a
+ * copy that hasn't been written yet. */
+static inline void
+sam_ir_push_register(sam_ir_translator *restrict t,
+		     int r)
+{
+    sam_ir_push(t, r >= 0 && r < t->depth?
+		t->stack[r]: (sam_ir_value){.r = r});
+}
+
+/* Make sure the location r is in a register, writing its constant. */
+static inline int
+sam_ir_register(sam_ir_translator *restrict t,
+		int r)
+{
+    if (t->stack[r].constant) {
+	sam_ir_write(t, r);
+    }
+
+    return t->stack[r].r;
+}
+
+/* Run the instruction through its handler, with the frame as it is
+ * after flushing. */
+static void
+sam_ir_slow(sam_ir_translator *restrict t)
+{
+    sam_ir_flush(t);
+    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_SLOW, .d = t->depth});
+    if ((size_t)t->l + 1 < t->len && t->frames[t->l + 1].depth >= 0) {
+	t->depth = t->frames[t->l + 1].depth;
+	for (int r = 0; r < t->depth; ++r) {
+	    t->stack[r] = (sam_ir_value){.r = r};
+	}
+    }
+}
+
+/* Check that the top n locations of the model have the given type
+ * before an operation is translated, leaving through a stub if they
+ * don't. Returns false if one is a constant of another type, in which
+ * case the instruction has to run through its handler. */
+static bool
+sam_ir_guard(sam_ir_translator *restrict t,
+	     int n,
+	     sam_ml_type type)
+{
+    const sam_ir_value *restrict a = &t->stack[t->depth - n];
+    const sam_ir_value *restrict b = &t->stack[t->depth - 1];
+    sam_ir_stub *restrict stub;
+
+    t->stub = SIZE_MAX;
+    if ((a->constant && SAM_ML_TYPE(a->k) != type) ||
+	(b->constant && SAM_ML_TYPE(b->k) != type)) {
+	return false;
+    }
+    if (a->constant && b->constant) {
+	return true;
+    }
+    if (t->stubs_len == t->stubs_alloc) {
+	t->stubs_alloc = t->stubs_alloc * 2 + 1;
+	t->stubs = sam_realloc(t->stubs,
+			       t->stubs_alloc * sizeof (sam_ir_stub));
+    }
+    stub = &t->stubs[t->stub = t->stubs_len++];
+    stub->guard = sam_ir_emit(t, (sam_ir_insn){
+	.op = SAM_IR_GUARD,
+	.a = a->constant? b->r: a->r,
+	.b = b->constant? a->r: b->r,
+	.k = SAM_ML((sam_ml_value){.i = 0}, type),
+    });
+    stub->l[0] = t->l;
+    stub->depths[0] = t->depth;
+    stub->n = 1;
+    stub->depth = t->depth;
+    stub->stack = sam_malloc((t->depth + 1) * sizeof (sam_ir_value));
+    memcpy(stub->stack, t->stack, t->depth * sizeof (sam_ir_value));
+
+    return true;
+}
+
+/* Note that the last operation, which may have a stub, was written
+ * again at n, now taking in the instruction being translated. */
+static void
+sam_ir_fused(sam_ir_translator *restrict t,
+	     size_t n)
+{
+    if (t->stub != SIZE_MAX) {
+	sam_ir_stub *restrict stub = &t->stubs[t->stub];
+
+	stub->after = n;
+	stub->l[stub->n] = t->l;
+	stub->depths[stub->n++] = t->depth + 1;
+    }
+}
+
+/* Translate an instruction which pops two locations and pushes one. */
+static void
+sam_ir_binary(sam_ir_translator *restrict t,
+	      size_t e,
+	      bool proved)
+{
+    int d = t->depth;
+    sam_ir_value a, b;
+    sam_ir_insn x;
+
+    if (sam_ir_binaries[e].op == SAM_IR_DIV ||
+	sam_ir_binaries[e].op == SAM_IR_MOD) {
+	/* a zero divisor leaves through the handler, which needs the
+	 * stack as it is */
+	sam_ir_flush(t);
+    }
+    if (!proved &&
+	!sam_ir_guard(t, 2, sam_ir_binaries[e].op >= SAM_IR_ADDF &&
+		      sam_ir_binaries[e].op <= SAM_IR_DIVF?
+		      SAM_ML_TYPE_FLOAT: SAM_ML_TYPE_INT)) {
+	sam_ir_slow(t);
+	return;
+    }
+    if (proved) {
+	t->stub = SIZE_MAX;
+    }
+    if (t->stack[d - 2].constant && !t->stack[d - 1].constant &&
+	sam_ir_binaries[e].commutes) {
+	sam_ir_value v = t->stack[d - 2];
+
+	t->stack[d - 2] = t->stack[d - 1];
+	t->stack[d - 1] = v;
+    }
+    sam_ir_register(t, d - 2);
+    if (sam_ir_binaries[e].opi == SAM_IR_NONE) {
+	sam_ir_register(t, d - 1);
+    }
+    a = t->stack[d - 2];
+    b = t->stack[d - 1];
+    x = (sam_ir_insn){
+	.op = b.constant? sam_ir_binaries[e].opi: sam_ir_binaries[e].op,
+	.d = d - 2,
+	.a = a.r,
+	.b = b.r,
+	.k = b.k,
+    };
+    t->depth = d - 2;
+    t->last = sam_ir_emit(t, x);
+    t->jump = b.constant? sam_ir_binaries[e].jumpi: sam_ir_binaries[e].jump;
+    if (t->stub != SIZE_MAX) {
+	t->stubs[t->stub].after = t->last;
+    }
+    if (x.op == SAM_IR_DIV || x.op == SAM_IR_MOD) {
+	/* which keep their registers, for the handler */
+	t->last = SIZE_MAX;
+    }
+    sam_ir_push(t, (sam_ir_value){.r = d - 2});
+}
+
+/* Translate an instruction which pops one location and pushes one. */
+static void
+sam_ir_unary(sam_ir_translator *restrict t,
+	     size_t e,
+	     bool proved)
+{
+    int d = t->depth;
+    int a;
+
+    if (!proved && !sam_ir_guard(t, 1, SAM_ML_TYPE_INT)) {
+	sam_ir_slow(t);
+	return;
+    }
+    if (proved) {
+	t->stub = SIZE_MAX;
+    }
+    a = sam_ir_register(t, d - 1);
+    --t->depth;
+    t->last = sam_ir_emit(t, (sam_ir_insn){
+	.op = sam_ir_unaries[e].op,
+	.d = d - 1,
+	.a = a,
+	.k = SAM_ML_OF_I(sam_ir_unaries[e].k),
+    });
+    t->jump = sam_ir_unaries[e].jump;
+    if (t->stub != SIZE_MAX) {
+	t->stubs[t->stub].after = t->last;
+    }
+    sam_ir_push(t, (sam_ir_value){.r = d - 1});
+}
+
+/* Is the top of the model the result of the last register instruction
+ * written? */
+static inline bool
+sam_ir_fusable(const sam_ir_translator *restrict t)
+{
+    const sam_ir_value *restrict v = &t->stack[t->depth - 1];
+
+    return t->last != SIZE_MAX && !v->constant && v->r == t->depth - 1 &&
+	t->code[t->last].d == t->depth - 1;
+}
+
+/* Translate STOREOFF into register r. */
+static void
+sam_ir_store(sam_ir_translator *restrict t,
+	     int r)
+{
+    if (sam_ir_fusable(t)) {
+	/* store the result straight into r */
+	sam_ir_insn x = t->code[--t->code_len];
+
+	--t->depth;
+	sam_ir_clobber(t, r);
+	x.d = r;
+	sam_ir_fused(t, sam_ir_emit(t, x));
+    } else {
+	sam_ir_value v = t->stack[--t->depth];
+
+	sam_ir_clobber(t, r);
+	if (v.constant) {
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_MOVI, .d = r, .k = v.k});
+	} else if (v.r != r) {
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_MOV, .d = r, .a = v.r});
+	}
+    }
+    if (r >= 0 && r < t->depth) {
+	t->stack[r] = (sam_ir_value){.r = r};
+    }
+}
+
+/* Translate JUMPC to the instruction at l. */
+static void
+sam_ir_branch(sam_ir_translator *restrict t,
+	      size_t l)
+{
+    if (sam_ir_fusable(t) && t->jump != SAM_IR_NONE) {
+	/* branch on the comparison itself */
+	sam_ir_insn x = t->code[--t->code_len];
+
+	--t->depth;
+	sam_ir_flush(t);
+	x.op = t->jump;
+	x.d = t->depth;
+	x.t = l;
+	sam_ir_fused(t, sam_ir_emit(t, x));
+    } else {
+	sam_ir_value v = t->stack[--t->depth];
+
+	sam_ir_flush(t);
+	if (!v.constant) {
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_JNZ,
+		.d = t->depth,
+		.a = v.r,
+		.t = l
+	    });
+	} else if (SAM_ML_I(v.k) != 0) {
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_JUMP,
+		.d = t->depth,
+		.t = l
+	    });
+	}
+    }
+}
+
+static void
+sam_ir_leaders(sam_ir_translator *restrict t)
+{
+    memset(t->leader, 0, t->len * sizeof (bool));
+    t->leader[0] = true;
+    for (size_t l = 0; l < t->len; ++l) {
+	sam_instruction i = sam_program_get(t->program, l);
+	size_t target;
+
+	switch (i.opcode) {
+	    case SAM_OPCODE_JUMP:
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_JSR:
+		if (sam_es_instruction_target(&i, t->m, &target) &&
+		    target < t->len) {
+		    t->leader[target] = true;
+		}
+		/* FALLTHROUGH */
+	    case SAM_OPCODE_JUMPIND:
+	    case SAM_OPCODE_RST:
+	    case SAM_OPCODE_STOP:
+		if (l + 1 < t->len) {
+		    t->leader[l + 1] = true;
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+}
+
+/* Translate the instruction at t->l. Returns whether control can go on
+ * to the next one. */
+static bool
+sam_ir_instruction(sam_ir_translator *restrict t)
+{
+    const sam_instruction instruction = sam_program_get(t->program, t->l);
+    const sam_instruction *restrict i = &instruction;
+    const sam_es_frame *restrict f = &t->frames[t->l];
+    int d = t->depth;
+    size_t target;
+
+    for (size_t e = 0;
+	 e < sizeof sam_ir_binaries / sizeof sam_ir_binaries[0];
+	 ++e) {
+	if (sam_ir_binaries[e].opcode != i->opcode) {
+	    continue;
+	}
+	sam_ir_binary(t, e, f->proved &&
+		      (i->opcode != SAM_OPCODE_EQUAL ||
+		       (f->top == SAM_ML_TYPE_INT &&
+			f->below == SAM_ML_TYPE_INT)));
+	return true;
+    }
+    for (size_t e = 0;
+	 e < sizeof sam_ir_unaries / sizeof sam_ir_unaries[0];
+	 ++e) {
+	if (sam_ir_unaries[e].opcode != i->opcode) {
+	    continue;
+	}
+	sam_ir_unary(t, e, f->proved);
+	return true;
+    }
+
+    switch (i->opcode) {
+	case SAM_OPCODE_PUSHIMM:
+	    if (i->optype != SAM_OP_TYPE_INT) {
+		break;
+	    }
+	    sam_ir_push_constant(t, SAM_ML_TYPE_INT,
+				 (sam_ml_value){.i = i->operand.i});
+	    return true;
+	case SAM_OPCODE_PUSHIMMCH:
+	    if (i->optype != SAM_OP_TYPE_CHAR) {
+		break;
+	    }
+	    sam_ir_push_constant(t, SAM_ML_TYPE_INT,
+				 (sam_ml_value){.i = i->operand.c});
+	    return true;
+	case SAM_OPCODE_PUSHIMMF:
+	    if (i->optype != SAM_OP_TYPE_FLOAT) {
+		break;
+	    }
+	    sam_ir_push_constant(t, SAM_ML_TYPE_FLOAT,
+				 (sam_ml_value){.f = i->operand.f});
+	    return true;
+	case SAM_OPCODE_PUSHIMMMA:
+	    if (i->optype != SAM_OP_TYPE_INT) {
+		break;
+	    }
+	    sam_ir_push_constant(t, SAM_ML_TYPE_SA,
+				 (sam_ml_value){.sa = (size_t)i->operand.i});
+	    return true;
+	case SAM_OPCODE_PUSHOFF:
+	    if (!f->proved || f->fbr == LONG_MIN) {
+		break;
+	    }
+	    sam_ir_push_register(t, f->fbr + i->operand.i);
+	    return true;
+	case SAM_OPCODE_STOREOFF:
+	    if (!f->proved || f->fbr == LONG_MIN) {
+		break;
+	    }
+	    sam_ir_store(t, f->fbr + i->operand.i);
+	    return true;
+	case SAM_OPCODE_DUP:
+	    sam_ir_push(t, t->stack[d - 1]);
+	    return true;
+	case SAM_OPCODE_SWAP:
+	    sam_ir_write(t, d - 2);
+	    sam_ir_write(t, d - 1);
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_SWAP, .d = d - 2});
+	    return true;
+	case SAM_OPCODE_ADDSP:
+	    if (i->operand.i < 0) {
+		t->depth += i->operand.i;
+	    }
+	    for (long n = 0; n < i->operand.i; ++n) {
+		/* ADDSP fills the new locations with zeroes */
+		sam_ir_push_constant(t, SAM_ML_TYPE_NONE,
+				     (sam_ml_value){.i = 0});
+	    }
+	    return true;
+	case SAM_OPCODE_LINK:
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_LINK, .d = d});
+	    sam_ir_push(t, (sam_ir_value){.r = d});
+	    return true;
+	case SAM_OPCODE_PUSHFBR:
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_PUSHFBR, .d = d});
+	    sam_ir_push(t, (sam_ir_value){.r = d});
+	    return true;
+	case SAM_OPCODE_PUSHSP:
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_PUSHSP, .d = d});
+	    sam_ir_push(t, (sam_ir_value){.r = d});
+	    return true;
+	case SAM_OPCODE_POPFBR:
+	case SAM_OPCODE_UNLINK:
+	    if (!f->proved) {
+		break;
+	    }
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_POPFBR,
+		.a = sam_ir_register(t, d - 1)
+	    });
+	    --t->depth;
+	    return true;
+	case SAM_OPCODE_JUMP:
+	    if (!sam_es_instruction_target(i, t->m, &target)) {
+		break;
+	    }
+	    sam_ir_flush(t);
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_JUMP,
+		.d = d,
+		.t = target
+	    });
+	    return false;
+	case SAM_OPCODE_JUMPC:
+	    if (!f->proved || !sam_es_instruction_target(i, t->m, &target)) {
+		break;
+	    }
+	    sam_ir_branch(t, target);
+	    return true;
+	case SAM_OPCODE_JSR:
+	    if (!sam_es_instruction_target(i, t->m, &target)) {
+		break;
+	    }
+	    sam_ir_flush(t);
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_CALL,
+		.d = d,
+		.t = target
+	    });
+	    return false;
+	case SAM_OPCODE_JUMPIND:
+	case SAM_OPCODE_RST:
+	    /* the verifier only lets these return */
+	    sam_ir_flush(t);
+	    sam_ir_emit(t, (sam_ir_insn){.op = SAM_IR_RET});
+	    return false;
+	case SAM_OPCODE_STOP:
+	    sam_ir_slow(t);
+	    return false;
+	default:
+	    break;
+    }
+    sam_ir_slow(t);
+
+    return true;
+}
+
+/* Point each branch at the register code for its target. */
+static void
+sam_ir_link(sam_ir_translator *restrict t)
+{
+    size_t len = t->code_len;
+
+    for (size_t n = 0; n < len; ++n) {
+	sam_ir_insn *restrict x = &t->code[n];
+
+	switch (x->op) {
+	    case SAM_IR_JUMP:
+	    case SAM_IR_JNZ:
+	    case SAM_IR_JLT:
+	    case SAM_IR_JLTI:
+	    case SAM_IR_JGT:
+	    case SAM_IR_JGTI:
+	    case SAM_IR_JEQ:
+	    case SAM_IR_JEQI:
+	    case SAM_IR_JNE:
+	    case SAM_IR_JNEI:
+	    case SAM_IR_CALL:
+		if (x->t < t->len && t->at[x->t] != SIZE_MAX) {
+		    x->t = t->at[x->t];
+		} else {
+		    /* off the end */
+		    size_t exit;
+
+		    t->l = x->t;
+		    exit = sam_ir_emit(t, (sam_ir_insn){
+			.op = SAM_IR_EXIT,
+			.d = x->d
+		    });
+		    t->code[n].t = exit;
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+}
+
+/* Write out the stubs, once the code they lead back to is in place. */
+static void
+sam_ir_stubs(sam_ir_translator *restrict t)
+{
+    for (size_t n = 0; n < t->stubs_len; ++n) {
+	sam_ir_stub *restrict stub = &t->stubs[n];
+
+	t->code[stub->guard].t = t->code_len;
+	t->l = stub->l[0];
+	t->depth = stub->depth;
+	memcpy(t->stack, stub->stack, stub->depth * sizeof (sam_ir_value));
+	sam_ir_flush(t);
+	for (size_t k = 0; k < stub->n; ++k) {
+	    t->l = stub->l[k];
+	    sam_ir_emit(t, (sam_ir_insn){
+		.op = SAM_IR_SLOW,
+		.d = stub->depths[k]
+	    });
+	}
+	sam_ir_emit(t, (sam_ir_insn){
+	    .op = SAM_IR_JUMP,
+	    .t = stub->after + 1
+	});
+	free(stub->stack);
+    }
+    free(t->stubs);
+}
+
+/*@only@*/ static sam_ir_module *
+sam_ir_translate(/*@in@*/ sam_es *restrict es,
+		 unsigned short m)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    size_t len = module->program.len;
+    sam_ir_module *restrict ir = sam_malloc(sizeof (sam_ir_module));
+    sam_ir_translator t = {
+	.program = &module->program,
+	.frames = module->frames,
+	.len = len,
+	.m = m,
+	.code_alloc = len + 1,
+	.code = sam_malloc((len + 1) * sizeof (sam_ir_insn)),
+	.at = sam_malloc((len + 1) * sizeof (size_t)),
+	.leader = sam_malloc((len + 1) * sizeof (bool)),
+	.last = SIZE_MAX,
+	.stub = SIZE_MAX,
+    };
+    bool falls = false;
+
+    ir->room = 1;
+    for (size_t n = 0; n < module->subroutines_len; ++n) {
+	if (module->subroutines[n].depth + 1 > ir->room) {
+	    ir->room = module->subroutines[n].depth + 1;
+	}
+    }
+    t.stack = sam_malloc(ir->room * sizeof (sam_ir_value));
+
+    sam_ir_leaders(&t);
+    for (size_t l = 0; l < len; ++l) {
+	const sam_es_frame *restrict f = &t.frames[l];
+
+	t.at[l] = SIZE_MAX;
+	t.l = l;
+	if (falls && (f->depth < 0 || f->depth != t.depth)) {
+	    /* can't happen in a verified module, but if it did the
+	     * stack engines would know what to do */
+	    sam_ir_flush(&t);
+	    sam_ir_emit(&t, (sam_ir_insn){.op = SAM_IR_EXIT, .d = t.depth});
+	    falls = false;
+	}
+	if (f->depth < 0) {
+	    continue;
+	}
+	if (t.leader[l] || !falls) {
+	    if (falls) {
+		sam_ir_flush(&t);
+	    }
+	    t.at[l] = t.code_len;
+	    t.last = SIZE_MAX;
+	    t.depth = f->depth;
+	    for (int r = 0; r < t.depth; ++r) {
+		t.stack[r] = (sam_ir_value){.r = r};
+	    }
+	}
+	falls = sam_ir_instruction(&t);
+    }
+    if (falls) {
+	t.l = len;
+	sam_ir_flush(&t);
+	sam_ir_emit(&t, (sam_ir_insn){.op = SAM_IR_EXIT, .d = t.depth});
+    }
+    sam_ir_link(&t);
+    sam_ir_stubs(&t);
+
+    free(t.leader);
+    free(t.stack);
+    ir->code = t.code;
+    ir->at = t.at;
+
+    return ir;
+}
+
+#define SAM_IR_INT(expr)						\
+    do {								\
+	sam_int a = SAM_ML_I(r[x->a]);					\
+	sam_int b = SAM_ML_I(r[x->b]);					\
+	r[x->d] = SAM_ML_OF_I(expr);					\
+    } while (0)
+#define SAM_IR_INTI(expr)						\
+    do {								\
+	sam_int a = SAM_ML_I(r[x->a]);					\
+	sam_int b = SAM_ML_I(x->k);					\
+	r[x->d] = SAM_ML_OF_I(expr);					\
+    } while (0)
+#define SAM_IR_FLOAT(expr)						\
+    do {								\
+	sam_float a = SAM_ML_F(r[x->a]);				\
+	sam_float b = SAM_ML_F(r[x->b]);				\
+	r[x->d] = SAM_ML_OF_F(expr);					\
+    } while (0)
+#define SAM_IR_UNARY(expr)						\
+    do {								\
+	sam_int a = SAM_ML_I(r[x->a]);					\
+	r[x->d] = SAM_ML_OF_I(expr);					\
+    } while (0)
+#define SAM_IR_IF(cond)							\
+    do {								\
+	if (cond) {							\
+	    ip = x->t;							\
+	}								\
+    } while (0)
+
+bool
+sam_ir_run(sam_es *restrict es,
+	   sam_error *restrict err)
+{
+    sam_pa pc = sam_es_pc_get(es);
+    unsigned short m = pc.m;
+    sam_es_module *restrict module;
+    sam_ir_module *restrict ir;
+    const sam_ir_insn *restrict code;
+    size_t len;
+    size_t ip;
+    size_t base;		/* the stack pointer at the entry */
+    size_t fbr = es->fbr;
+    sam_ml *r;			/* es->stack.arr + base */
+    int depth;
+    sam_pa to;			/* where to go on from, */
+    size_t sp;			/* with this many locations */
+
+    if (m >= es->modules.len) {
+	return false;
+    }
+    module = SAM_MODULE(m);
+    len = module->program.len;
+    if (module->frames == NULL || pc.l >= len) {
+	return false;
+    }
+    if (module->ir == NULL) {
+	module->ir = sam_ir_translate(es, m);
+    }
+    ir = module->ir;
+    code = ir->code;
+    if ((ip = ir->at[pc.l]) == SIZE_MAX ||
+	es->stack.len < (size_t)module->frames[pc.l].depth) {
+	return false;
+    }
+    base = es->stack.len - module->frames[pc.l].depth;
+    if (!sam_es_stack_reserve(es, base + ir->room)) {
+	return false;
+    }
+    r = es->stack.arr + base;
+
+    for (;;) {
+	const sam_ir_insn *restrict x = &code[ip++];
+
+	switch (x->op) {
+	    case SAM_IR_MOV:
+		r[x->d] = r[x->a];
+		break;
+	    case SAM_IR_MOVI:
+		r[x->d] = x->k;
+		break;
+	    case SAM_IR_SWAP: {
+		sam_ml top = r[x->d + 1];
+
+		r[x->d + 1] = r[x->d];
+		r[x->d] = top;
+		break;
+	    }
+	    case SAM_IR_ADD:	  SAM_IR_INT(a + b);		break;
+	    case SAM_IR_ADDI:	  SAM_IR_INTI(a + b);		break;
+	    case SAM_IR_SUB:	  SAM_IR_INT(a - b);		break;
+	    case SAM_IR_SUBI:	  SAM_IR_INTI(a - b);		break;
+	    case SAM_IR_TIMES:	  SAM_IR_INT(a * b);		break;
+	    case SAM_IR_TIMESI:	  SAM_IR_INTI(a * b);		break;
+	    case SAM_IR_DIV:
+		if (SAM_ML_I(r[x->b]) == 0) {
+		    depth = x->d + 2;
+		    goto slow;
+		}
+		SAM_IR_INT(a / b);
+		break;
+	    case SAM_IR_MOD:
+		if (SAM_ML_I(r[x->b]) == 0) {
+		    depth = x->d + 2;
+		    goto slow;
+		}
+		SAM_IR_INT(a % b);
+		break;
+	    case SAM_IR_AND:	  SAM_IR_INT(a && b);		break;
+	    case SAM_IR_ANDI:	  SAM_IR_INTI(a && b);		break;
+	    case SAM_IR_OR:	  SAM_IR_INT(a || b);		break;
+	    case SAM_IR_ORI:	  SAM_IR_INTI(a || b);		break;
+	    case SAM_IR_BITAND:	  SAM_IR_INT(a & b);		break;
+	    case SAM_IR_BITANDI:  SAM_IR_INTI(a & b);		break;
+	    case SAM_IR_BITOR:	  SAM_IR_INT(a | b);		break;
+	    case SAM_IR_BITORI:	  SAM_IR_INTI(a | b);		break;
+	    case SAM_IR_BITXOR:	  SAM_IR_INT(a ^ b);		break;
+	    case SAM_IR_BITXORI:  SAM_IR_INTI(a ^ b);		break;
+	    case SAM_IR_CMP:	  SAM_IR_INT(a < b? -1: a > b); break;
+	    case SAM_IR_CMPI:	  SAM_IR_INTI(a < b? -1: a > b); break;
+	    case SAM_IR_GREATER:  SAM_IR_INT(a > b);		break;
+	    case SAM_IR_GREATERI: SAM_IR_INTI(a > b);		break;
+	    case SAM_IR_LESS:	  SAM_IR_INT(a < b);		break;
+	    case SAM_IR_LESSI:	  SAM_IR_INTI(a < b);		break;
+	    case SAM_IR_EQUAL:	  SAM_IR_INT(a == b);		break;
+	    case SAM_IR_EQUALI:	  SAM_IR_INTI(a == b);		break;
+	    case SAM_IR_ADDF:	  SAM_IR_FLOAT(a + b);		break;
+	    case SAM_IR_SUBF:	  SAM_IR_FLOAT(a - b);		break;
+	    case SAM_IR_TIMESF:	  SAM_IR_FLOAT(a * b);		break;
+	    case SAM_IR_DIVF:	  SAM_IR_FLOAT(a / b);		break;
+	    case SAM_IR_NOT:	  SAM_IR_UNARY(!a);		break;
+	    case SAM_IR_ISPOS:	  SAM_IR_UNARY(a > 0);		break;
+	    case SAM_IR_ISNEG:	  SAM_IR_UNARY(a < 0);		break;
+	    case SAM_IR_BITNOT:	  SAM_IR_UNARY(~a);		break;
+	    case SAM_IR_LINK:
+		r[x->d] = SAM_ML_OF_SA(fbr);
+		fbr = base + x->d;
+		break;
+	    case SAM_IR_POPFBR:
+		fbr = SAM_ML_SA(r[x->a]);
+		break;
+	    case SAM_IR_PUSHFBR:
+		r[x->d] = SAM_ML_OF_SA(fbr);
+		break;
+	    case SAM_IR_PUSHSP:
+		r[x->d] = SAM_ML_OF_SA(base + x->d);
+		break;
+	    case SAM_IR_JUMP:	  ip = x->t;			break;
+	    case SAM_IR_JNZ:	  SAM_IR_IF(SAM_ML_I(r[x->a]) != 0); break;
+	    case SAM_IR_JLT:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) < SAM_ML_I(r[x->b]));
+		break;
+	    case SAM_IR_JLTI:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) < SAM_ML_I(x->k));
+		break;
+	    case SAM_IR_JGT:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) > SAM_ML_I(r[x->b]));
+		break;
+	    case SAM_IR_JGTI:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) > SAM_ML_I(x->k));
+		break;
+	    case SAM_IR_JEQ:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) == SAM_ML_I(r[x->b]));
+		break;
+	    case SAM_IR_JEQI:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) == SAM_ML_I(x->k));
+		break;
+	    case SAM_IR_JNE:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) != SAM_ML_I(r[x->b]));
+		break;
+	    case SAM_IR_JNEI:
+		SAM_IR_IF(SAM_ML_I(r[x->a]) != SAM_ML_I(x->k));
+		break;
+	    case SAM_IR_CALL:
+		if (es->stack.alloc < base + x->d + 1 + ir->room) {
+		    if (!sam_es_stack_reserve(es,
+					      base + x->d + 1 + ir->room)) {
+			es->stack.len = base + x->d;
+			es->fbr = fbr;
+			sam_es_pc_set(es, (sam_pa){.l = x->l, .m = m});
+			return false;
+		    }
+		    r = es->stack.arr + base;
+		}
+		r[x->d] = SAM_ML_OF_PA(((sam_pa){.l = x->l + 1, .m = m}));
+		base += x->d + 1;
+		r += x->d + 1;
+		ip = x->t;
+		break;
+	    case SAM_IR_RET:
+		if (SAM_ML_TYPE(r[-1]) != SAM_ML_TYPE_PA) {
+		    depth = 0;
+		    goto slow;
+		}
+		to = SAM_ML_PA(r[-1]);
+		sp = base - 1;
+		goto resume;
+	    case SAM_IR_GUARD:
+		SAM_IR_IF(SAM_ML_TYPE(r[x->a]) != SAM_ML_TYPE(x->k) ||
+			  SAM_ML_TYPE(r[x->b]) != SAM_ML_TYPE(x->k));
+		break;
+	    case SAM_IR_SLOW:
+		depth = x->d;
+		goto slow;
+	    case SAM_IR_EXIT:
+		es->stack.len = base + x->d;
+		es->fbr = fbr;
+		sam_es_pc_set(es, (sam_pa){.l = x->l, .m = m});
+		if (x->l >= len) {
+		    *err = SAM_OK;
+		    return true;
+		}
+		return false;
+	    default:
+		break;
+	}
+	continue;
+
+    slow:
+	es->stack.len = base + depth;
+	es->fbr = fbr;
+	sam_es_pc_set(es, (sam_pa){.l = x->l, .m = m});
+	if ((*err = module->program.handlers[x->l](es)) != SAM_OK) {
+	    sam_es_pc_pp(es);
+	    return true;
+	}
+	fbr = es->fbr;
+	r = es->stack.arr + base;
+	to = sam_es_pc_get(es);
+	if (to.m == m && to.l == x->l) {
+	    continue;
+	}
+	/* the handler jumped */
+	++to.l;
+	sp = es->stack.len;
+
+    resume:
+	if (to.m != m || to.l >= len || ir->at[to.l] == SIZE_MAX ||
+	    sp < (size_t)module->frames[to.l].depth) {
+	    es->stack.len = sp;
+	    es->fbr = fbr;
+	    sam_es_pc_set(es, to);
+	    if (to.m == m && to.l >= len) {
+		*err = SAM_OK;
+		return true;
+	    }
+	    return false;
+	}
+	base = sp - module->frames[to.l].depth;
+	r = es->stack.arr + base;
+	ip = ir->at[to.l];
+    }
+}
+
+void
+sam_ir_module_free(sam_ir_module *restrict ir)
+{
+    if (ir != NULL) {
+	free(ir->code);
+	free(ir->at);
+	free(ir);
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_IR_H
+#define LIBSAM_IR_H
+
+#include "es_private.h"
+
+/**
+ *  Run the program like sam_engine_run() for as long as it stays in
+ *  modules sam_verify() followed, translating each into register code
+ *  the first time it is entered. Instructions the register code
+ *  doesn't cover run through their handler.
+ *
+ *  @param es The current execution state.
+ *  @param err Set to the error which stopped the program, #SAM_STOP if
+ *	       it stopped normally, or #SAM_OK if it ran off the end.
+ *
+ *  @return false if the program has to go on on the stack from the
+ *	    program counter instead, because it got somewhere the
+ *	    register code can't follow it. err is left alone.
+ */
+extern bool sam_ir_run(/*@in@*/ sam_es *restrict es,
+		       /*@out@*/ sam_error *restrict err);
+
+/**
+ *  Release the register code translated for a module.
+ *
+ *  @param ir The register code, or NULL if none was.
+ */
+extern void sam_ir_module_free(/*@null@*/ /*@only@*/ sam_ir_module *ir);
+
+#endif /* LIBSAM_IR_H */
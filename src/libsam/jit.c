@@ -0,0 +1,946 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "jit.h"
+
+#if defined(SAM_JIT_X86_64)
+# include <sys/mman.h>
+
+/*
+ * A template JIT. Each run of instructions with a template below is
+ * compiled, the first time execution enters it, into a function
+ * taking the execution state and returning the index of the
+ * instruction to continue at. While it runs, the stack array, the
+ * stack pointer, the number of stack locations allocated and the frame
+ * base register are kept in r8 to r11, with the last three scaled to
+ * byte offsets.
+ *
+ * Every template checks its operands before changing anything, and
+ * exits with SAM_JIT_BAIL set in the returned index when a check
+ * fails, so that the handler runs the instruction instead and reports
+ * any error exactly as the other engines do. Jumps within a run are
+ * compiled to native jumps; any other control transfer returns to
+ * sam_jit_run().
+ */
+
+/** Set in the value returned from compiled code when the instruction
+ *  it names must run through its handler. */
+#define SAM_JIT_BAIL	    0x80000000u
+/** The size of each executable mapping. */
+#define SAM_JIT_CHUNK_SIZE  (64 * 1024)
+/** The most instructions compiled into one function, so that every
+ *  function fits in a mapping. */
+#define SAM_JIT_RUN_MAX	    512
+
+/* x86-64 register numbers */
+enum {
+    SAM_JIT_RAX = 0,
+    SAM_JIT_RCX = 1,
+    SAM_JIT_RDX = 2,
+    SAM_JIT_RSI = 6,
+    SAM_JIT_R9	= 9,
+    SAM_JIT_R11 = 11
+};
+
+typedef unsigned (*sam_jit_fn)(sam_es *restrict es);
+
+typedef struct _sam_jit_chunk {
+    struct _sam_jit_chunk *next;
+    unsigned char *mem;
+    size_t used;
+} sam_jit_chunk;
+
+struct _sam_jit_module {
+    /*@null@*/ sam_jit_fn *entries; /**< The code entered at each
+				     *   instruction, if compiled. */
+    bool *tried;		    /**< Has compiling at each
+				     *   instruction been attempted? */
+    /*@null@*/ sam_jit_chunk *chunks;
+};
+
+/** A reference to a position not yet known. */
+typedef struct {
+    size_t at;		    /**< Where the rel32 to patch starts. */
+    uint64_t target;	    /**< The instruction jumped to, or with
+			     *   #SAM_JIT_EXIT set, the value to exit
+			     *   with. */
+} sam_jit_fixup;
+
+/** Marks a fixup whose target is an exit from the compiled code. */
+#define SAM_JIT_EXIT	    (1ull << 32)
+
+typedef struct {
+    unsigned char *code;
+    size_t len;
+    size_t alloc;
+    sam_jit_fixup *fixups;
+    size_t fixups_len;
+    size_t fixups_alloc;
+} sam_jit_buf;
+
+static void
+sam_jit_byte(sam_jit_buf *restrict b,
+	     unsigned char c)
+{
+    if (b->len == b->alloc) {
+	b->alloc *= 2;
+	b->code = sam_realloc(b->code, b->alloc);
+    }
+    b->code[b->len++] = c;
+}
+
+static void
+sam_jit_bytes(sam_jit_buf *restrict b,
+	      const char *restrict s,
+	      size_t n)
+{
+    for (size_t k = 0; k < n; ++k) {
+	sam_jit_byte(b, (unsigned char)s[k]);
+    }
+}
+
+#define SAM_JIT_EMIT(b, s) sam_jit_bytes((b), (s), sizeof (s) - 1)
+
+static void
+sam_jit_imm32(sam_jit_buf *restrict b,
+	      uint32_t v)
+{
+    for (int k = 0; k < 4; ++k) {
+	sam_jit_byte(b, (v >> (8 * k)) & 0xff);
+    }
+}
+
+static void
+sam_jit_imm64(sam_jit_buf *restrict b,
+	      uint64_t v)
+{
+    sam_jit_imm32(b, (uint32_t)v);
+    sam_jit_imm32(b, (uint32_t)(v >> 32));
+}
+
+/* Emit an instruction with a memory operand [r8 + index + disp], where
+ * r8 holds the stack array. op is one or two (0x0f-prefixed) opcode
+ * bytes, and prefix a mandatory prefix, or 0 for none. */
+static void
+sam_jit_mem(sam_jit_buf *restrict b,
+	    unsigned char prefix,
+	    bool w,
+	    unsigned op,
+	    unsigned reg,
+	    unsigned index,
+	    int32_t disp)
+{
+    bool short_disp = disp >= -128 && disp <= 127;
+
+    if (prefix != 0) {
+	sam_jit_byte(b, prefix);
+    }
+    sam_jit_byte(b, 0x41 | w << 3 | (reg >> 3) << 2 | (index >> 3) << 1);
+    if (op > 0xff) {
+	sam_jit_byte(b, op >> 8);
+    }
+    sam_jit_byte(b, op & 0xff);
+    sam_jit_byte(b, (short_disp? 0x44: 0x84) | (reg & 7) << 3);
+    sam_jit_byte(b, (index & 7) << 3);
+    if (short_disp) {
+	sam_jit_byte(b, (unsigned char)disp);
+    } else {
+	sam_jit_imm32(b, (uint32_t)disp);
+    }
+}
+
+/* A jump with a rel32 to be patched, as j. The condition code cc is
+ * that of the jcc; -1 for an unconditional jump. */
+static void
+sam_jit_jump(sam_jit_buf *restrict b,
+	     int cc,
+	     uint64_t target)
+{
+    if (cc < 0) {
+	sam_jit_byte(b, 0xe9);
+    } else {
+	sam_jit_byte(b, 0x0f);
+	sam_jit_byte(b, 0x80 | cc);
+    }
+    if (b->fixups_len == b->fixups_alloc) {
+	b->fixups_alloc *= 2;
+	b->fixups = sam_realloc(b->fixups,
+				b->fixups_alloc * sizeof (sam_jit_fixup));
+    }
+    b->fixups[b->fixups_len++] = (sam_jit_fixup){
+	.at = b->len,
+	.target = target
+    };
+    sam_jit_imm32(b, 0);
+}
+
+/* Condition codes */
+enum {
+    SAM_JIT_B  = 0x2,
+    SAM_JIT_AE = 0x3,
+    SAM_JIT_E  = 0x4,
+    SAM_JIT_NE = 0x5,
+    SAM_JIT_A  = 0x7,
+    SAM_JIT_L  = 0xc,
+    SAM_JIT_G  = 0xf
+};
+
+/* Byte offsets of the type and value of the nth location from the
+ * top of the stack, relative to the stack pointer. */
+#define SAM_JIT_TYPE(n)	 (-16 * (n))
+#define SAM_JIT_VALUE(n) (-16 * (n) + 8)
+
+/* Bail out of the instruction at l unless at least n locations are on
+ * the stack. */
+static void
+sam_jit_need(sam_jit_buf *restrict b,
+	     size_t n,
+	     unsigned l)
+{
+    SAM_JIT_EMIT(b, "\x49\x83\xf9");	/* cmp r9, n * 16 */
+    sam_jit_byte(b, n * 16);
+    sam_jit_jump(b, SAM_JIT_B, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+}
+
+/* Bail out unless there is room to push one location. */
+static void
+sam_jit_room(sam_jit_buf *restrict b,
+	     unsigned l)
+{
+    SAM_JIT_EMIT(b, "\x4d\x39\xd1");	/* cmp r9, r10 */
+    sam_jit_jump(b, SAM_JIT_AE, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+}
+
+/* Bail out unless the nth location from the top has type t. */
+static void
+sam_jit_type(sam_jit_buf *restrict b,
+	     size_t n,
+	     sam_ml_type t,
+	     unsigned l)
+{
+    /* cmp byte [r8 + r9 + type], t */
+    sam_jit_mem(b, 0, false, 0x80, 7, SAM_JIT_R9, SAM_JIT_TYPE(n));
+    sam_jit_byte(b, t);
+    sam_jit_jump(b, SAM_JIT_NE, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+}
+
+/* Set the type of a location. The whole word is written, so that
+ * later loads of the location can be forwarded from the store. */
+static void
+sam_jit_set_type(sam_jit_buf *restrict b,
+		 unsigned index,
+		 int32_t disp,
+		 sam_ml_type t)
+{
+    /* mov qword [r8 + index + disp], t */
+    sam_jit_mem(b, 0, true, 0xc7, 0, index, disp);
+    sam_jit_imm32(b, t);
+}
+
+/* Copy a location through two registers. */
+static void
+sam_jit_copy(sam_jit_buf *restrict b,
+	     unsigned from,
+	     int32_t from_disp,
+	     unsigned to,
+	     int32_t to_disp,
+	     unsigned r1,
+	     unsigned r2)
+{
+    sam_jit_mem(b, 0, true, 0x8b, r1, from, from_disp);
+    sam_jit_mem(b, 0, true, 0x8b, r2, from, from_disp + 8);
+    sam_jit_mem(b, 0, true, 0x89, r1, to, to_disp);
+    sam_jit_mem(b, 0, true, 0x89, r2, to, to_disp + 8);
+}
+
+static void
+sam_jit_push(sam_jit_buf *restrict b)
+{
+    SAM_JIT_EMIT(b, "\x49\x83\xc1\x10");	/* add r9, 16 */
+}
+
+static void
+sam_jit_pop(sam_jit_buf *restrict b)
+{
+    SAM_JIT_EMIT(b, "\x49\x83\xe9\x10");	/* sub r9, 16 */
+}
+
+/* Push a location of type t holding the 64 bits v. */
+static void
+sam_jit_push_imm(sam_jit_buf *restrict b,
+		 sam_ml_type t,
+		 uint64_t v,
+		 unsigned l)
+{
+    sam_jit_room(b, l);
+    sam_jit_set_type(b, SAM_JIT_R9, 0, t);
+    if ((int64_t)v == (int32_t)v) {
+	/* mov qword [r8 + r9 + 8], v */
+	sam_jit_mem(b, 0, true, 0xc7, 0, SAM_JIT_R9, 8);
+	sam_jit_imm32(b, (uint32_t)v);
+    } else {
+	SAM_JIT_EMIT(b, "\x48\xb8");	/* mov rax, v */
+	sam_jit_imm64(b, v);
+	/* mov [r8 + r9 + 8], rax */
+	sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RAX, SAM_JIT_R9, 8);
+    }
+    sam_jit_push(b);
+}
+
+/* Load the byte offset of the stack location k, relative to the frame
+ * base register if off, into rax. */
+static void
+sam_jit_address(sam_jit_buf *restrict b,
+		bool off,
+		sam_int k)
+{
+    if (off) {
+	SAM_JIT_EMIT(b, "\x49\x8d\x83");	/* lea rax, [r11 + k * 16] */
+    } else {
+	SAM_JIT_EMIT(b, "\x48\xc7\xc0");	/* mov rax, k * 16 */
+    }
+    sam_jit_imm32(b, (uint32_t)(k * 16));
+}
+
+/* PUSHOFF and PUSHABS */
+static void
+sam_jit_pushoff(sam_jit_buf *restrict b,
+		bool off,
+		sam_int k,
+		unsigned l)
+{
+    sam_jit_address(b, off, k);
+    SAM_JIT_EMIT(b, "\x4c\x39\xc8");	/* cmp rax, r9 */
+    sam_jit_jump(b, SAM_JIT_AE, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+    sam_jit_room(b, l);
+    sam_jit_copy(b, SAM_JIT_RAX, 0, SAM_JIT_R9, 0, SAM_JIT_RCX, SAM_JIT_RDX);
+    sam_jit_push(b);
+}
+
+/* STOREOFF and STOREABS */
+static void
+sam_jit_storeoff(sam_jit_buf *restrict b,
+		 bool off,
+		 sam_int k,
+		 unsigned l)
+{
+    sam_jit_need(b, 1, l);
+    sam_jit_address(b, off, k);
+    SAM_JIT_EMIT(b, "\x49\x8d\x49\xf0"	/* lea rcx, [r9 - 16] */
+		    "\x48\x39\xc8");	/* cmp rax, rcx */
+    sam_jit_jump(b, SAM_JIT_AE, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+    sam_jit_copy(b, SAM_JIT_R9, -16, SAM_JIT_RAX, 0, SAM_JIT_RCX, SAM_JIT_RDX);
+    sam_jit_pop(b);
+}
+
+/* Check that the top two locations have type t, then load the lower
+ * into rax (or xmm0, for floats). */
+static void
+sam_jit_binary(sam_jit_buf *restrict b,
+	       sam_ml_type t,
+	       unsigned l)
+{
+    sam_jit_need(b, 2, l);
+    sam_jit_type(b, 1, t, l);
+    sam_jit_type(b, 2, t, l);
+    if (t == SAM_ML_TYPE_FLOAT) {
+	/* movsd xmm0, [r8 + r9 - 24] */
+	sam_jit_mem(b, 0xf2, false, 0x0f10, 0, SAM_JIT_R9, SAM_JIT_VALUE(2));
+    } else {
+	/* mov rax, [r8 + r9 - 24] */
+	sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RAX, SAM_JIT_R9,
+		    SAM_JIT_VALUE(2));
+    }
+}
+
+/* Store rax as the value of the lower of the top two locations, and
+ * pop the top one. */
+static void
+sam_jit_binary_end(sam_jit_buf *restrict b)
+{
+    /* mov [r8 + r9 - 24], rax */
+    sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(2));
+    sam_jit_pop(b);
+}
+
+/* An integer operation rax op= [top] */
+static void
+sam_jit_int_op(sam_jit_buf *restrict b,
+	       unsigned op,
+	       unsigned l)
+{
+    sam_jit_binary(b, SAM_ML_TYPE_INT, l);
+    sam_jit_mem(b, 0, true, op, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(1));
+    sam_jit_binary_end(b);
+}
+
+/* ADD and SUB: an integer added to or subtracted from an integer or
+ * a stack address. */
+static void
+sam_jit_add(sam_jit_buf *restrict b,
+	    unsigned op,
+	    unsigned l)
+{
+    size_t skip;
+
+    sam_jit_need(b, 2, l);
+    sam_jit_type(b, 1, SAM_ML_TYPE_INT, l);
+    /* cmp byte [r8 + r9 - 32], SAM_ML_TYPE_INT; je over the next
+     * check */
+    sam_jit_mem(b, 0, false, 0x80, 7, SAM_JIT_R9, SAM_JIT_TYPE(2));
+    sam_jit_byte(b, SAM_ML_TYPE_INT);
+    sam_jit_byte(b, 0x74);
+    skip = b->len;
+    sam_jit_byte(b, 0);
+    sam_jit_type(b, 2, SAM_ML_TYPE_SA, l);
+    b->code[skip] = b->len - (skip + 1);
+    /* mov rax, [r8 + r9 - 24]; op rax, [r8 + r9 - 8] */
+    sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(2));
+    sam_jit_mem(b, 0, true, op, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(1));
+    sam_jit_binary_end(b);
+}
+
+/* Compare the top two integers, setting the lower to the result of
+ * setcc. */
+static void
+sam_jit_int_cmp(sam_jit_buf *restrict b,
+		int cc,
+		unsigned l)
+{
+    sam_jit_binary(b, SAM_ML_TYPE_INT, l);
+    /* cmp rax, [r8 + r9 - 8] */
+    sam_jit_mem(b, 0, true, 0x3b, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(1));
+    if (cc < 0) {
+	/* CMP: (a > b) - (a < b) */
+	SAM_JIT_EMIT(b, "\x0f\x9f\xc0"	/* setg al */
+			"\x0f\x9c\xc1"	/* setl cl */
+			"\x0f\xb6\xc0"	/* movzx eax, al */
+			"\x0f\xb6\xc9"	/* movzx ecx, cl */
+			"\x48\x29\xc8");	/* sub rax, rcx */
+    } else {
+	sam_jit_byte(b, 0x0f);		/* setcc al */
+	sam_jit_byte(b, 0x90 | cc);
+	sam_jit_byte(b, 0xc0);
+	SAM_JIT_EMIT(b, "\x0f\xb6\xc0");	/* movzx eax, al */
+    }
+    sam_jit_binary_end(b);
+}
+
+/* Set the integer on top of the stack to the result of setcc after
+ * comparing it with zero. */
+static void
+sam_jit_int_test(sam_jit_buf *restrict b,
+		 int cc,
+		 unsigned l)
+{
+    sam_jit_need(b, 1, l);
+    sam_jit_type(b, 1, SAM_ML_TYPE_INT, l);
+    /* mov rax, [r8 + r9 - 8] */
+    sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(1));
+    SAM_JIT_EMIT(b, "\x48\x85\xc0");	/* test rax, rax */
+    sam_jit_byte(b, 0x0f);		/* setcc al */
+    sam_jit_byte(b, 0x90 | cc);
+    sam_jit_byte(b, 0xc0);
+    SAM_JIT_EMIT(b, "\x0f\xb6\xc0");	/* movzx eax, al */
+    /* mov [r8 + r9 - 8], rax */
+    sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RAX, SAM_JIT_R9, SAM_JIT_VALUE(1));
+}
+
+/* A floating point operation xmm0 op= [top] */
+static void
+sam_jit_float_op(sam_jit_buf *restrict b,
+		 unsigned op,
+		 unsigned l)
+{
+    sam_jit_binary(b, SAM_ML_TYPE_FLOAT, l);
+    sam_jit_mem(b, 0xf2, false, op, 0, SAM_JIT_R9, SAM_JIT_VALUE(1));
+    /* movsd [r8 + r9 - 24], xmm0 */
+    sam_jit_mem(b, 0xf2, false, 0x0f11, 0, SAM_JIT_R9, SAM_JIT_VALUE(2));
+    sam_jit_pop(b);
+}
+
+/* The target of a jump, if it is in module m. */
+static bool
+sam_jit_target(const sam_instruction *restrict i,
+	       unsigned short m,
+	       /*@out@*/ unsigned *restrict l)
+{
+    sam_pa pa;
+
+    if (i->optype == SAM_OP_TYPE_LABEL || i->optype == SAM_OP_TYPE_INT) {
+	pa = i->operand.pa;
+    } else {
+	return false;
+    }
+    *l = pa.l;
+
+    return pa.m == m;
+}
+
+/* Emit the template for i, the instruction at l in module m, or return
+ * false if it has none. Jumps to instructions from start to end are
+ * left for sam_jit_compile() to resolve. */
+static bool
+sam_jit_template(sam_jit_buf *restrict b,
+		 const sam_instruction *restrict i,
+		 unsigned short m,
+		 unsigned l)
+{
+    /* operands scaled to byte offsets must fit in 32 bits */
+    bool small = i->optype == SAM_OP_TYPE_INT &&
+	i->operand.i > -(1l << 26) && i->operand.i < 1l << 26;
+    unsigned target;
+
+    switch (i->opcode) {
+	case SAM_OPCODE_PUSHIMM:
+	    if (i->optype != SAM_OP_TYPE_INT) {
+		return false;
+	    }
+	    sam_jit_push_imm(b, SAM_ML_TYPE_INT, (uint64_t)i->operand.i, l);
+	    return true;
+	case SAM_OPCODE_PUSHIMMF:
+	    if (i->optype != SAM_OP_TYPE_FLOAT) {
+		return false;
+	    }
+	    {
+		union { sam_float f; uint64_t u; } v = {.f = i->operand.f};
+		sam_jit_push_imm(b, SAM_ML_TYPE_FLOAT, v.u, l);
+	    }
+	    return true;
+	case SAM_OPCODE_PUSHOFF:
+	case SAM_OPCODE_PUSHABS:
+	    if (!small || (i->opcode == SAM_OPCODE_PUSHABS &&
+			   i->operand.i < 0)) {
+		return false;
+	    }
+	    sam_jit_pushoff(b, i->opcode == SAM_OPCODE_PUSHOFF,
+			    i->operand.i, l);
+	    return true;
+	case SAM_OPCODE_STOREOFF:
+	case SAM_OPCODE_STOREABS:
+	    if (!small || (i->opcode == SAM_OPCODE_STOREABS &&
+			   i->operand.i < 0)) {
+		return false;
+	    }
+	    sam_jit_storeoff(b, i->opcode == SAM_OPCODE_STOREOFF,
+			     i->operand.i, l);
+	    return true;
+	case SAM_OPCODE_PUSHSP:
+	    sam_jit_room(b, l);
+	    sam_jit_set_type(b, SAM_JIT_R9, 0, SAM_ML_TYPE_SA);
+	    SAM_JIT_EMIT(b, "\x4c\x89\xc8"	/* mov rax, r9 */
+			    "\x48\xc1\xe8\x04");	/* shr rax, 4 */
+	    /* mov [r8 + r9 + 8], rax */
+	    sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RAX, SAM_JIT_R9, 8);
+	    sam_jit_push(b);
+	    return true;
+	case SAM_OPCODE_DUP:
+	    sam_jit_need(b, 1, l);
+	    sam_jit_room(b, l);
+	    sam_jit_copy(b, SAM_JIT_R9, -16, SAM_JIT_R9, 0,
+			 SAM_JIT_RCX, SAM_JIT_RDX);
+	    sam_jit_push(b);
+	    return true;
+	case SAM_OPCODE_SWAP:
+	    sam_jit_need(b, 2, l);
+	    sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RAX, SAM_JIT_R9, -16);
+	    sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RCX, SAM_JIT_R9, -8);
+	    sam_jit_copy(b, SAM_JIT_R9, -32, SAM_JIT_R9, -16,
+			 SAM_JIT_RDX, SAM_JIT_RSI);
+	    sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RAX, SAM_JIT_R9, -32);
+	    sam_jit_mem(b, 0, true, 0x89, SAM_JIT_RCX, SAM_JIT_R9, -24);
+	    return true;
+	case SAM_OPCODE_ADDSP:
+	    /* only shrinking the stack; growing it may reallocate */
+	    if (!small || i->operand.i > 0) {
+		return false;
+	    }
+	    if (i->operand.i < 0) {
+		SAM_JIT_EMIT(b, "\x49\x81\xf9");	/* cmp r9, -k * 16 */
+		sam_jit_imm32(b, (uint32_t)(-i->operand.i * 16));
+		sam_jit_jump(b, SAM_JIT_B, SAM_JIT_EXIT | SAM_JIT_BAIL | l);
+		SAM_JIT_EMIT(b, "\x49\x81\xe9");	/* sub r9, -k * 16 */
+		sam_jit_imm32(b, (uint32_t)(-i->operand.i * 16));
+	    }
+	    return true;
+	case SAM_OPCODE_ADD:
+	    sam_jit_add(b, 0x03, l);
+	    return true;
+	case SAM_OPCODE_SUB:
+	    sam_jit_add(b, 0x2b, l);
+	    return true;
+	case SAM_OPCODE_TIMES:
+	    sam_jit_int_op(b, 0x0faf, l);
+	    return true;
+	case SAM_OPCODE_BITAND:
+	    sam_jit_int_op(b, 0x23, l);
+	    return true;
+	case SAM_OPCODE_BITOR:
+	    sam_jit_int_op(b, 0x0b, l);
+	    return true;
+	case SAM_OPCODE_BITXOR:
+	    sam_jit_int_op(b, 0x33, l);
+	    return true;
+	case SAM_OPCODE_CMP:
+	    sam_jit_int_cmp(b, -1, l);
+	    return true;
+	case SAM_OPCODE_LESS:
+	    sam_jit_int_cmp(b, SAM_JIT_L, l);
+	    return true;
+	case SAM_OPCODE_GREATER:
+	    sam_jit_int_cmp(b, SAM_JIT_G, l);
+	    return true;
+	case SAM_OPCODE_EQUAL:
+	    sam_jit_int_cmp(b, SAM_JIT_E, l);
+	    return true;
+	case SAM_OPCODE_NOT:
+	case SAM_OPCODE_ISNIL:
+	    sam_jit_int_test(b, SAM_JIT_E, l);
+	    return true;
+	case SAM_OPCODE_ISPOS:
+	    sam_jit_int_test(b, SAM_JIT_G, l);
+	    return true;
+	case SAM_OPCODE_ISNEG:
+	    sam_jit_int_test(b, SAM_JIT_L, l);
+	    return true;
+	case SAM_OPCODE_ADDF:
+	    sam_jit_float_op(b, 0x0f58, l);
+	    return true;
+	case SAM_OPCODE_SUBF:
+	    sam_jit_float_op(b, 0x0f5c, l);
+	    return true;
+	case SAM_OPCODE_TIMESF:
+	    sam_jit_float_op(b, 0x0f59, l);
+	    return true;
+	case SAM_OPCODE_DIVF:
+	    sam_jit_float_op(b, 0x0f5e, l);
+	    return true;
+	case SAM_OPCODE_ITOF:
+	    sam_jit_need(b, 1, l);
+	    sam_jit_type(b, 1, SAM_ML_TYPE_INT, l);
+	    /* cvtsi2sd xmm0, qword [r8 + r9 - 8]; movsd [r8 + r9 - 8], xmm0 */
+	    sam_jit_mem(b, 0xf2, true, 0x0f2a, 0, SAM_JIT_R9, SAM_JIT_VALUE(1));
+	    sam_jit_mem(b, 0xf2, false, 0x0f11, 0, SAM_JIT_R9,
+			SAM_JIT_VALUE(1));
+	    sam_jit_set_type(b, SAM_JIT_R9, SAM_JIT_TYPE(1), SAM_ML_TYPE_FLOAT);
+	    return true;
+	case SAM_OPCODE_JUMP:
+	    if (!sam_jit_target(i, m, &target)) {
+		return false;
+	    }
+	    sam_jit_jump(b, -1, target);
+	    return true;
+	case SAM_OPCODE_JUMPC:
+	    if (!sam_jit_target(i, m, &target)) {
+		return false;
+	    }
+	    sam_jit_need(b, 1, l);
+	    sam_jit_type(b, 1, SAM_ML_TYPE_INT, l);
+	    /* mov rax, [r8 + r9 - 8] */
+	    sam_jit_mem(b, 0, true, 0x8b, SAM_JIT_RAX, SAM_JIT_R9,
+			SAM_JIT_VALUE(1));
+	    sam_jit_pop(b);
+	    SAM_JIT_EMIT(b, "\x48\x85\xc0");	/* test rax, rax */
+	    sam_jit_jump(b, SAM_JIT_NE, target);
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+/* Copy code into executable memory. */
+/*@null@*/ static sam_jit_fn
+sam_jit_install(sam_jit_module *restrict jm,
+		const unsigned char *restrict code,
+		size_t len)
+{
+    sam_jit_chunk *restrict c = jm->chunks;
+
+    if (len > SAM_JIT_CHUNK_SIZE) {
+	return NULL;
+    }
+    if (c == NULL || c->used + len > SAM_JIT_CHUNK_SIZE) {
+	void *mem = mmap(NULL, SAM_JIT_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (mem == MAP_FAILED) {
+	    return NULL;
+	}
+	c = sam_malloc(sizeof (sam_jit_chunk));
+	c->next = jm->chunks;
+	c->mem = mem;
+	c->used = 0;
+	jm->chunks = c;
+    } else if (mprotect(c->mem, SAM_JIT_CHUNK_SIZE,
+			PROT_READ | PROT_WRITE) < 0) {
+	return NULL;
+    }
+    memcpy(c->mem + c->used, code, len);
+    if (mprotect(c->mem, SAM_JIT_CHUNK_SIZE, PROT_READ | PROT_EXEC) < 0) {
+	return NULL;
+    }
+
+    union { unsigned char *p; sam_jit_fn fn; } entry = {
+	.p = c->mem + c->used
+    };
+    c->used += (len + 15) & ~(size_t)15;
+
+    return entry.fn;
+}
+
+/* Compile the run of instructions starting at start in module m. */
+/*@null@*/ static sam_jit_fn
+sam_jit_compile(/*@in@*/ sam_es *restrict es,
+		unsigned short m,
+		unsigned start)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    const sam_program *restrict program = &module->program;
+    size_t len = program->len;
+    sam_jit_buf b = {
+	.code = sam_malloc(256),
+	.alloc = 256,
+	.fixups = sam_malloc(16 * sizeof (sam_jit_fixup)),
+	.fixups_alloc = 16,
+    };
+    size_t *offsets = sam_malloc((len - start + 1) * sizeof (size_t));
+    size_t *bails;
+    size_t *exits;
+    size_t exits_len = 0;
+    unsigned end = start;
+    sam_jit_fn fn = NULL;
+
+    /* mov r8, [rdi + arr]; mov r9, [rdi + len]; mov r10, [rdi +
+     * alloc]; mov r11, [rdi + fbr], then scale all but r8 by 16 */
+    SAM_JIT_EMIT(&b, "\x4c\x8b\x87");
+    sam_jit_imm32(&b, offsetof(sam_es, stack) + offsetof(sam_stack, arr));
+    SAM_JIT_EMIT(&b, "\x4c\x8b\x8f");
+    sam_jit_imm32(&b, offsetof(sam_es, stack) + offsetof(sam_stack, len));
+    SAM_JIT_EMIT(&b, "\x4c\x8b\x97");
+    sam_jit_imm32(&b, offsetof(sam_es, stack) + offsetof(sam_stack, alloc));
+    SAM_JIT_EMIT(&b, "\x4c\x8b\x9f");
+    sam_jit_imm32(&b, offsetof(sam_es, fbr));
+    SAM_JIT_EMIT(&b, "\x49\xc1\xe1\x04"
+		     "\x49\xc1\xe2\x04"
+		     "\x49\xc1\xe3\x04");
+
+    for (; end < len && end - start < SAM_JIT_RUN_MAX; ++end) {
+	sam_instruction i = sam_program_get(program, end);
+	size_t mark = b.len;
+	size_t fixups_mark = b.fixups_len;
+
+	offsets[end - start] = b.len;
+	if (!sam_jit_template(&b, &i, m, end)) {
+	    b.len = mark;
+	    b.fixups_len = fixups_mark;
+	    break;
+	}
+	if (i.opcode == SAM_OPCODE_JUMP) {
+	    ++end;
+	    break;
+	}
+    }
+    if (end == start) {
+	goto done;
+    }
+    if (program->opcodes[end - 1] != SAM_OPCODE_JUMP) {
+	sam_jit_jump(&b, -1, SAM_JIT_EXIT | end);
+    }
+
+    /* Resolve jumps within the run, and emit an exit for each other
+     * target: mov eax, target; jmp out. Bail-outs from the same
+     * instruction share their exit. */
+    bails = sam_malloc((end - start) * sizeof (size_t));
+    for (size_t k = 0; k < end - start; ++k) {
+	bails[k] = 0;
+    }
+    exits = sam_malloc(b.fixups_len * sizeof (size_t));
+    for (size_t f = 0; f < b.fixups_len; ++f) {
+	uint64_t target = b.fixups[f].target;
+	size_t to;
+
+	if (!(target & SAM_JIT_EXIT) && target >= start && target < end) {
+	    to = offsets[target - start];
+	} else {
+	    size_t *bail = NULL;
+
+	    target &= ~SAM_JIT_EXIT;
+	    if (target & SAM_JIT_BAIL) {
+		bail = &bails[(target & ~SAM_JIT_BAIL) - start];
+	    }
+	    if (bail != NULL && *bail != 0) {
+		to = *bail;
+	    } else {
+		to = exits[exits_len++] = b.len;
+		sam_jit_byte(&b, 0xb8);
+		sam_jit_imm32(&b, (uint32_t)target);
+		sam_jit_byte(&b, 0xe9);
+		sam_jit_imm32(&b, 0);
+		if (bail != NULL) {
+		    *bail = to;
+		}
+	    }
+	}
+	uint32_t rel = (uint32_t)(to - (b.fixups[f].at + 4));
+	memcpy(b.code + b.fixups[f].at, &rel, 4);
+    }
+    free(bails);
+
+    /* Every exit stores the registers back: shr r9, 4; shr r11, 4;
+     * mov [rdi + len], r9; mov [rdi + fbr], r11; ret */
+    size_t out = b.len;
+    SAM_JIT_EMIT(&b, "\x49\xc1\xe9\x04"
+		     "\x49\xc1\xeb\x04"
+		     "\x4c\x89\x8f");
+    sam_jit_imm32(&b, offsetof(sam_es, stack) + offsetof(sam_stack, len));
+    SAM_JIT_EMIT(&b, "\x4c\x89\x9f");
+    sam_jit_imm32(&b, offsetof(sam_es, fbr));
+    sam_jit_byte(&b, 0xc3);
+    for (size_t e = 0; e < exits_len; ++e) {
+	uint32_t rel = (uint32_t)(out - (exits[e] + 10));
+	memcpy(b.code + exits[e] + 6, &rel, 4);
+    }
+    free(exits);
+
+    fn = sam_jit_install(module->jit, b.code, b.len);
+
+done:
+    free(offsets);
+    free(b.fixups);
+    free(b.code);
+    return fn;
+}
+
+/* The code entered at instruction l of module m, compiling it if this
+ * is the first time. */
+/*@null@*/ static inline sam_jit_fn
+sam_jit_entry(/*@in@*/ sam_es *restrict es,
+	      unsigned short m,
+	      unsigned l)
+{
+    sam_jit_module *restrict jm = SAM_MODULE(m)->jit;
+
+    if (jm == NULL) {
+	size_t len = SAM_MODULE(m)->program.len;
+
+	jm = SAM_MODULE(m)->jit = sam_malloc(sizeof (sam_jit_module));
+	jm->entries = sam_malloc(len * sizeof (sam_jit_fn));
+	jm->tried = sam_malloc(len * sizeof (bool));
+	jm->chunks = NULL;
+	for (size_t k = 0; k < len; ++k) {
+	    jm->entries[k] = NULL;
+	    jm->tried[k] = false;
+	}
+
+	/* The labels are where most runs are entered. */
+	for (size_t k = 0; k < es->locs.len; ++k) {
+	    sam_es_loc *restrict loc = es->locs.arr[k];
+
+	    if (loc->pa.m == m && loc->pa.l < len &&
+		!jm->tried[loc->pa.l]) {
+		jm->entries[loc->pa.l] = sam_jit_compile(es, m, loc->pa.l);
+		jm->tried[loc->pa.l] = true;
+	    }
+	}
+    }
+    if (!jm->tried[l]) {
+	jm->entries[l] = sam_jit_compile(es, m, l);
+	jm->tried[l] = true;
+    }
+
+    return jm->entries[l];
+}
+
+sam_error
+sam_jit_run(/*@in@*/ sam_es *restrict es)
+{
+    /* The templates assume this layout of memory locations, which a
+     * NaN-boxed sam_ml doesn't have. */
+#if SAM_NAN_BOX
+    bool layout = false;
+#else
+    bool layout = sizeof (sam_ml) == 16 && offsetof(sam_ml, value) == 8;
+#endif /* SAM_NAN_BOX */
+    sam_error err;
+
+    for (;;) {
+	sam_pa pc = sam_es_pc_get(es);
+	sam_jit_fn fn;
+
+	if (pc.l >= sam_es_instructions_len_cur(es)) {
+	    return SAM_OK;
+	}
+	/* compiled code can only return the indices below SAM_JIT_BAIL */
+	if (layout && sam_es_instructions_len_cur(es) < SAM_JIT_BAIL &&
+	    (fn = sam_jit_entry(es, pc.m, pc.l)) != NULL) {
+	    unsigned next = fn(es);
+
+	    sam_es_pc_set(es, (sam_pa){.l = next & ~SAM_JIT_BAIL, .m = pc.m});
+	    if (!(next & SAM_JIT_BAIL)) {
+		continue;
+	    }
+	}
+	err = sam_es_handler_cur(es)(es);
+	sam_es_pc_pp(es);
+	if (err != SAM_OK) {
+	    return err;
+	}
+    }
+}
+
+void
+sam_jit_module_free(/*@null@*/ /*@only@*/ sam_jit_module *jm)
+{
+    if (jm == NULL) {
+	return;
+    }
+    while (jm->chunks != NULL) {
+	sam_jit_chunk *next = jm->chunks->next;
+
+	munmap(jm->chunks->mem, SAM_JIT_CHUNK_SIZE);
+	free(jm->chunks);
+	jm->chunks = next;
+    }
+    free(jm->entries);
+    free(jm->tried);
+    free(jm);
+}
+#endif /* SAM_JIT_X86_64 */
@@ -0,0 +1,62 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_JIT_H
+#define LIBSAM_JIT_H
+
+#include "es_private.h"
+
+/* The JIT emits x86-64 code into executable mappings, so it is only
+ * built where both are available. */
+#if defined(__x86_64__) && defined(HAVE_MMAN_H)
+# define SAM_JIT_X86_64 1
+#endif /* __x86_64__ && HAVE_MMAN_H */
+
+#if defined(SAM_JIT_X86_64)
+/**
+ *  Run the program like sam_engine_run(), compiling each straight run
+ *  of simple instructions into machine code the first time it is
+ *  entered. Instructions the JIT can't translate, and those whose
+ *  operands fail a check in the compiled code, run through their
+ *  handler.
+ *
+ *  @param es The current execution state.
+ *
+ *  @return As for sam_engine_run().
+ */
+extern sam_error sam_jit_run(/*@in@*/ sam_es *restrict es);
+
+/**
+ *  Release the code compiled for a module.
+ *
+ *  @param jm The compiled code, or NULL if none was.
+ */
+extern void sam_jit_module_free(/*@null@*/ /*@only@*/ sam_jit_module *jm);
+#endif /* SAM_JIT_X86_64 */
+
+#endif /* LIBSAM_JIT_H */
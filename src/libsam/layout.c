@@ -0,0 +1,497 @@
+/*
+ * layout.c    lay a module out by a profile of a training run
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * With #SAM_PROFILE, the call loop counts how often each instruction
+ * runs and how often control leaves it by a jump, and the counts are
+ * written beside the source when the run finishes. With
+ * #SAM_PROFILE_USE, sam_layout() reads them back when the module is
+ * loaded and moves its basic blocks around:
+ *
+ *  - Blocks are joined into chains along their hottest edges, greatest
+ *    first, the way Pettis and Hansen do it, so that the hot path
+ *    through a loop falls through from one block to the next.
+ *  - The chain holding the start of the program comes first, then the
+ *    other chains which ran, in their original order, and then the
+ *    blocks which never ran.
+ *  - A block whose fall-through successor no longer follows it gets a
+ *    JUMP to it, and a JUMP to the block which now follows it is
+ *    dropped.
+ *
+ * A JSR keeps its return address, since a JUMP put after it takes the
+ * return on to the block which used to follow. Every program address
+ * in the module is then renumbered, so labels, backtraces and
+ * PUSHIMMPA agree with the new order.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/io.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "layout.h"
+
+/* The first line of a profile. */
+#define SAM_PROFILE_MAGIC "samiam profile 1"
+
+/* Appended to the name of the source to name its profile. */
+#define SAM_PROFILE_SUFFIX ".prof"
+
+typedef struct {
+    size_t start;	    /**< The first instruction. */
+    size_t end;		    /**< One past the last. */
+    size_t next;	    /**< The block it falls through to, SIZE_MAX if
+			     *   none, or the number of blocks if it falls
+			     *   off the end of the module. */
+    size_t target;	    /**< The block a JUMP or JUMPC at its end goes
+			     *   to, or SIZE_MAX. */
+    size_t chain;	    /**< The first block of its chain. */
+    size_t after;	    /**< The block after it in its chain, or
+			     *   SIZE_MAX. */
+    unsigned long runs;	    /**< How often it was entered. */
+} sam_layout_block;
+
+typedef struct {
+    unsigned long weight;
+    size_t from;
+    size_t to;
+} sam_layout_edge;
+
+static void
+sam_warning_profile(const sam_es *restrict es,
+		    const char *restrict path,
+		    const char *restrict why)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("warning: profile %s %s.\n"),
+		       path,
+		       why);
+    }
+}
+
+/* A hash of the opcodes of a module, to tell whether a profile was
+ * made from the same program. */
+static unsigned long
+sam_layout_hash(const sam_es_module *restrict module)
+{
+    unsigned long h = 2166136261UL;
+
+    for (size_t l = 0; l < module->program.len; ++l) {
+	h = (h ^ (unsigned long)module->program.opcodes[l]) * 16777619UL;
+	h &= 0xffffffffUL;
+    }
+
+    return h;
+}
+
+/*@null@*/ /*@only@*/ static char *
+sam_layout_profile_path(const sam_es_module *restrict module)
+{
+    char *restrict path;
+
+    if (module->file == NULL) {
+	return NULL;
+    }
+    path = sam_malloc(strlen(module->file) + sizeof SAM_PROFILE_SUFFIX);
+    strcpy(path, module->file);
+    strcat(path, SAM_PROFILE_SUFFIX);
+
+    return path;
+}
+
+void
+sam_layout_profile_write(sam_es *restrict es)
+{
+    sam_es_module *restrict module = SAM_MODULE(0);
+    char *restrict path = sam_layout_profile_path(module);
+    FILE *restrict f;
+
+    if (path == NULL || module->runs == NULL) {
+	free(path);
+	return;
+    }
+    if ((f = fopen(path, "w")) == NULL) {
+	sam_warning_profile(es, path, _("couldn't be written"));
+	free(path);
+	return;
+    }
+    fprintf(f, SAM_PROFILE_MAGIC "\n%lu %lu\n",
+	    (unsigned long)module->program.len, sam_layout_hash(module));
+    for (size_t l = 0; l < module->program.len; ++l) {
+	if (module->runs[l] > 0) {
+	    fprintf(f, "%lu %lu %lu\n",
+		    (unsigned long)l, module->runs[l], module->jumps[l]);
+	}
+    }
+    if (fclose(f) != 0) {
+	sam_warning_profile(es, path, _("couldn't be written"));
+    }
+    free(path);
+}
+
+/* Read the counts for a module from its profile. */
+static bool
+sam_layout_profile_read(const sam_es *restrict es,
+			const sam_es_module *restrict module,
+			unsigned long *restrict runs,
+			unsigned long *restrict jumps)
+{
+    char *restrict path = sam_layout_profile_path(module);
+    char magic[sizeof SAM_PROFILE_MAGIC + 1];
+    unsigned long len, hash, l, r, j;
+    bool ok = false;
+    FILE *restrict f;
+
+    if (path == NULL || (f = fopen(path, "r")) == NULL) {
+	free(path);
+	return false;
+    }
+    memset(runs, 0, module->program.len * sizeof (unsigned long));
+    memset(jumps, 0, module->program.len * sizeof (unsigned long));
+    if (fgets(magic, sizeof magic, f) == NULL ||
+	strcmp(magic, SAM_PROFILE_MAGIC "\n") != 0 ||
+	fscanf(f, "%lu %lu", &len, &hash) != 2) {
+	sam_warning_profile(es, path, _("is corrupt"));
+    } else if (len != module->program.len ||
+	       hash != sam_layout_hash(module)) {
+	sam_warning_profile(es, path, _("is for a different program"));
+    } else {
+	ok = true;
+	while (fscanf(f, "%lu %lu %lu", &l, &r, &j) == 3) {
+	    if (l >= len || j > r) {
+		sam_warning_profile(es, path, _("is corrupt"));
+		ok = false;
+		break;
+	    }
+	    runs[l] = r;
+	    jumps[l] = j;
+	}
+    }
+    fclose(f);
+    free(path);
+
+    return ok;
+}
+
+/* Does control never go on from an instruction to the next one? */
+static inline bool
+sam_layout_ends(sam_opcode opcode)
+{
+    switch (opcode) {
+	case SAM_OPCODE_JUMP:
+	case SAM_OPCODE_JUMPIND:
+	case SAM_OPCODE_RST:
+	case SAM_OPCODE_STOP:
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+/* Does an instruction end a basic block? */
+static inline bool
+sam_layout_branches(sam_opcode opcode)
+{
+    switch (opcode) {
+	case SAM_OPCODE_JUMPC:
+	case SAM_OPCODE_JSR:
+	case SAM_OPCODE_JSRIND:
+	    return true;
+	default:
+	    return sam_layout_ends(opcode);
+    }
+}
+
+static int
+sam_layout_edge_cmp(const void *a,
+		    const void *b)
+{
+    const sam_layout_edge *restrict x = a;
+    const sam_layout_edge *restrict y = b;
+
+    if (x->weight != y->weight) {
+	return x->weight > y->weight? -1: 1;
+    }
+
+    return x->from < y->from? -1: x->from > y->from;
+}
+
+/* Split the module into basic blocks, and return how many there are. */
+static size_t
+sam_layout_blocks(const sam_instruction *restrict instructions,
+		  size_t len,
+		  unsigned short m,
+		  const unsigned long *restrict runs,
+		  /*@out@*/ sam_layout_block *restrict blocks,
+		  /*@out@*/ size_t *restrict block_at)
+{
+    bool *restrict leader = sam_malloc((len + 1) * sizeof (bool));
+    size_t n = 0;
+
+    memset(leader, 0, (len + 1) * sizeof (bool));
+    leader[0] = true;
+    for (size_t l = 0; l < len; ++l) {
+	size_t t;
+
+	if (sam_es_instruction_target(&instructions[l], m, &t) && t < len) {
+	    leader[t] = true;
+	}
+	if (sam_layout_branches(instructions[l].opcode)) {
+	    leader[l + 1] = true;
+	}
+    }
+    for (size_t l = 0; l < len; ++l) {
+	if (leader[l]) {
+	    if (n > 0) {
+		blocks[n - 1].end = l;
+	    }
+	    blocks[n] = (sam_layout_block){
+		.start = l,
+		.chain = n,
+		.after = SIZE_MAX,
+		.runs = runs[l],
+	    };
+	    ++n;
+	}
+	block_at[l] = n - 1;
+    }
+    blocks[n - 1].end = len;
+
+    for (size_t b = 0; b < n; ++b) {
+	const sam_instruction *restrict last = &instructions[blocks[b].end - 1];
+	size_t t;
+
+	blocks[b].next = sam_layout_ends(last->opcode)? SIZE_MAX:
+	    blocks[b].end == len? n: block_at[blocks[b].end];
+	blocks[b].target = SIZE_MAX;
+	if ((last->opcode == SAM_OPCODE_JUMP ||
+	     last->opcode == SAM_OPCODE_JUMPC) &&
+	    sam_es_instruction_target(last, m, &t) && t < len) {
+	    blocks[b].target = block_at[t];
+	}
+    }
+    free(leader);
+
+    return n;
+}
+
+/* Join blocks into chains along their hottest edges. */
+static void
+sam_layout_chain(sam_layout_block *restrict blocks,
+		 size_t n,
+		 const sam_instruction *restrict instructions,
+		 const unsigned long *restrict runs,
+		 const unsigned long *restrict jumps)
+{
+    sam_layout_edge *restrict edges =
+	sam_malloc(2 * n * sizeof (sam_layout_edge));
+    size_t edges_len = 0;
+
+    for (size_t b = 0; b < n; ++b) {
+	size_t last = blocks[b].end - 1;
+
+	if (blocks[b].next != SIZE_MAX && blocks[b].next != n) {
+	    edges[edges_len++] = (sam_layout_edge){
+		.weight = runs[last] - jumps[last],
+		.from = b,
+		.to = blocks[b].next,
+	    };
+	    if (instructions[last].opcode == SAM_OPCODE_JSR ||
+		instructions[last].opcode == SAM_OPCODE_JSRIND) {
+		/* the return comes back here about as often */
+		edges[edges_len - 1].weight = runs[last];
+	    }
+	}
+	if (blocks[b].target != SIZE_MAX) {
+	    edges[edges_len++] = (sam_layout_edge){
+		.weight = jumps[last],
+		.from = b,
+		.to = blocks[b].target,
+	    };
+	}
+    }
+    qsort(edges, edges_len, sizeof (sam_layout_edge), sam_layout_edge_cmp);
+
+    for (size_t e = 0; e < edges_len && edges[e].weight > 0; ++e) {
+	sam_layout_block *restrict from = &blocks[edges[e].from];
+	sam_layout_block *restrict to = &blocks[edges[e].to];
+	size_t head;
+
+	/* only the end of one chain to the start of another, and never
+	 * in front of the start of the program */
+	if (from->after != SIZE_MAX || to->chain != edges[e].to ||
+	    from->chain == to->chain || edges[e].to == 0) {
+	    continue;
+	}
+	from->after = edges[e].to;
+	head = from->chain;
+	for (size_t b = edges[e].to; b != SIZE_MAX; b = blocks[b].after) {
+	    blocks[b].chain = head;
+	}
+    }
+    free(edges);
+}
+
+/* Put the chains in order, and return the blocks in their new order. */
+/*@only@*/ static size_t *
+sam_layout_order(const sam_layout_block *restrict blocks,
+		 size_t n)
+{
+    size_t *restrict order = sam_malloc(n * sizeof (size_t));
+    bool *restrict hot = sam_malloc(n * sizeof (bool));
+    size_t k = 0;
+
+    memset(hot, 0, n * sizeof (bool));
+    for (size_t b = 0; b < n; ++b) {
+	if (blocks[b].runs > 0) {
+	    hot[blocks[b].chain] = true;
+	}
+    }
+    /* the start, the chains which ran, and then the rest */
+    for (unsigned pass = 0; pass < 3; ++pass) {
+	for (size_t c = 0; c < n; ++c) {
+	    if (blocks[c].chain != c || (pass == 0) != (c == 0) ||
+		(pass > 0 && (pass == 1) != hot[c])) {
+		continue;
+	    }
+	    for (size_t b = c; b != SIZE_MAX; b = blocks[b].after) {
+		order[k++] = b;
+	    }
+	}
+    }
+    free(hot);
+
+    return order;
+}
+
+bool
+sam_layout(sam_es *restrict es,
+	   unsigned short m,
+	   unsigned long **restrict trained)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    sam_instruction *restrict instructions;
+    size_t len = module->program.len;
+    unsigned long *restrict runs, *restrict jumps;
+    sam_layout_block *restrict blocks;
+    size_t *restrict block_at, *restrict order, *restrict map;
+    sam_program placed;
+    size_t n;
+    bool moved = false;
+
+    *trained = NULL;
+    if (len == 0) {
+	return false;
+    }
+    runs = sam_malloc(len * sizeof (unsigned long));
+    jumps = sam_malloc(len * sizeof (unsigned long));
+    if (!sam_layout_profile_read(es, module, runs, jumps)) {
+	free(runs);
+	free(jumps);
+	return false;
+    }
+
+    instructions = sam_program_unpack(&module->program);
+    blocks = sam_malloc(len * sizeof (sam_layout_block));
+    block_at = sam_malloc(len * sizeof (size_t));
+    n = sam_layout_blocks(instructions, len, m, runs, blocks, block_at);
+    sam_layout_chain(blocks, n, instructions, runs, jumps);
+    order = sam_layout_order(blocks, n);
+    for (size_t k = 0; k < n; ++k) {
+	if (order[k] != k) {
+	    moved = true;
+	    break;
+	}
+    }
+    if (!moved) {
+	*trained = runs;
+	runs = NULL;
+	goto out;
+    }
+
+    map = sam_malloc((len + 1) * sizeof (size_t));
+    /* at most one JUMP is added after each block */
+    *trained = sam_malloc((len + n) * sizeof (unsigned long));
+    memset(*trained, 0, (len + n) * sizeof (unsigned long));
+    sam_program_init(&placed, len + n);
+    for (size_t k = 0; k < n; ++k) {
+	const sam_layout_block *restrict b = &blocks[order[k]];
+	size_t following = k + 1 < n? order[k + 1]: n;
+
+	for (size_t l = b->start; l < b->end; ++l) {
+	    map[l] = placed.len;
+	    if (l == b->end - 1 && b->target == following &&
+		instructions[l].opcode == SAM_OPCODE_JUMP) {
+		/* its target follows it now */
+		continue;
+	    }
+	    (*trained)[placed.len] = runs[l];
+	    sam_program_ins(&placed, &instructions[l]);
+	}
+	if (b->next != SIZE_MAX && b->next != following) {
+	    /* it no longer falls through to its successor, or off the
+	     * end of the module */
+	    sam_instruction jump;
+
+	    sam_opcode_get("JUMP", &jump);
+	    jump.optype = SAM_OP_TYPE_INT;
+	    jump.operand.i = b->next == n? len: blocks[b->next].start;
+	    jump.operand.pa.m = m;
+	    sam_opcode_bind(&jump);
+	    sam_program_ins(&placed, &jump);
+	}
+    }
+    map[len] = placed.len;
+
+    sam_program_free(&module->program);
+    module->program = placed;
+    sam_es_module_renumber(es, m, map, len, NULL);
+    free(map);
+
+out:
+    free(instructions);
+    free(runs);
+    free(jumps);
+    free(blocks);
+    free(block_at);
+    free(order);
+
+    return moved;
+}
@@ -0,0 +1,62 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_LAYOUT_H
+#define LIBSAM_LAYOUT_H
+
+#include "es_private.h"
+
+/**
+ *  Move the basic blocks of a module around by the profile of a
+ *  training run, so that hot paths fall through and blocks which never
+ *  ran come last. Every program address in the module is renumbered to
+ *  match.
+ *
+ *  @param es The current execution state.
+ *  @param m The module, which has been parsed but not yet fused.
+ *  @param trained Set to how often each instruction of the module, as
+ *		   it is laid out, ran in the training run, to be freed
+ *		   by the caller, or to NULL if there was no usable
+ *		   profile.
+ *
+ *  @return false if there was no usable profile, or the blocks were
+ *	    already in the best order.
+ */
+extern bool sam_layout(/*@in@*/ sam_es *restrict es,
+		       unsigned short m,
+		       /*@out@*/ unsigned long **restrict trained);
+
+/**
+ *  Write the counts taken with #SAM_PROFILE beside the source of the
+ *  program, for a later run with #SAM_PROFILE_USE.
+ *
+ *  @param es The execution state of the finished run.
+ */
+extern void sam_layout_profile_write(/*@in@*/ sam_es *restrict es);
+
+#endif /* LIBSAM_LAYOUT_H */
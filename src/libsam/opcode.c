@@ -39,6 +39,8 @@
 #include <libsam/opcode.h>
 #include <libsam/util.h>
 
+#include "es_private.h"
+
 typedef enum {
     SAM_OP_TIMES,
     SAM_OP_DIV,
@@ -80,54 +82,38 @@ typedef enum {
     SAM_SHIFT_LOGIC_RIGHT
 } sam_bitshift_type;
 
+static void sam_quicken(/*@in@*/ sam_es *restrict es,
+			sam_ml_type t1,
+			sam_ml_type t2);
+
 static sam_error
-sam_get_jump_target(/*@in@*/ sam_es *restrict es,
-		    /*@out@*/ sam_pa *restrict p)
+sam_push(/*@in@*/ sam_es *restrict es,
+	 sam_ml_value v,
+	 sam_ml_type t)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
-
-    if (cur->optype == SAM_OP_TYPE_INT) {
-	/* subtract 1 when we change the pa because it will be
-	 * incremented by the loop in sam_execute */
-	p->m = cur->operand.pa.m;
-	p->l = cur->operand.pa.l - 1;
-    } else if (cur->optype == SAM_OP_TYPE_LABEL) {
-	/* TODO: are jumps automatically module-agnostic? */
-	if (sam_es_labels_get_cur(es, p, cur->operand.s)) {
-	    /* as above */
-	    --p->l;
-	} else {
-	    p->l = 0;
-	    return sam_error_unknown_identifier(es, cur->operand.s);
-	}
-    } else {
-	p->l = 0;
-	return sam_error_optype(es);
-    }
-
-    return SAM_OK;
+    return sam_es_stack_push(es, SAM_ML(v, t))?
+	SAM_OK: sam_error_stack_overflow(es);
 }
 
-static sam_error
-sam_sp_shift(sam_es *restrict es,
-	     sam_sa sp)
+/* A location popped off the stack by a generic handler, unpacked so
+ * that its type and value can be taken apart and rebuilt. */
+typedef struct {
+    sam_ml_type  type;
+    sam_ml_value value;
+} sam_ml_unpacked;
+
+static inline bool
+sam_pop(/*@in@*/ sam_es *restrict es,
+	/*@out@*/ sam_ml_unpacked *restrict u)
 {
-    while (sp < sam_es_stack_len(es)) {
-	sam_ml *m;
-	if ((m = sam_es_stack_pop(es)) == NULL) {
-	    return sam_error_stack_underflow(es);
-	}
-	free(m);
-    }
-    while (sp > sam_es_stack_len(es)) {
-	if (!sam_es_stack_push(es,
-			       sam_ml_new((sam_ml_value){.i = 0},
-					  SAM_ML_TYPE_NONE))) {
-	    return sam_error_stack_overflow(es);
-	}
-    }
+    sam_ml m;
 
-    return SAM_OK;
+    if (!sam_es_stack_pop(es, &m)) {
+	return false;
+    }
+    u->type = SAM_ML_TYPE(m);
+    u->value = SAM_ML_VALUE(m);
+    return true;
 }
 
 static sam_error
@@ -141,13 +127,13 @@ sam_pushabs(/*@in@*/ sam_es *restrict es,
 
     return m == NULL?
 	sam_error_segmentation_fault(es, stack, ma):
-	    (sam_es_stack_push(es, sam_ml_new(m->value, m->type))?
+	    (sam_es_stack_push(es, *m)?
 	     SAM_OK: sam_error_stack_overflow(es));
 }
 
 static sam_error
 sam_storeabs(/*@in@*/ sam_es *restrict es,
-	     /*@only@*/ sam_ml *m,
+	     sam_ml m,
 	     bool stack,
 	     sam_ma ma)
 {
@@ -157,230 +143,199 @@ sam_storeabs(/*@in@*/ sam_es *restrict es,
 		SAM_OK: sam_error_segmentation_fault(es, stack, ma);
 }
 
+/* Move ha by sign * off words, unless that would take its index out
+ * of the range of a sam_ha. */
+static inline bool
+sam_ha_offset(sam_ha *restrict ha,
+	      int sign,
+	      sam_int off)
+{
+    sam_int index = ha->index;
+
+    if (sign < 0? off >= index - (sam_int)SAM_HEAP_INDEX_MAX && off <= index:
+		  off >= -index && off <= (sam_int)SAM_HEAP_INDEX_MAX - index) {
+	ha->index = index + sign * off;
+	return true;
+    }
+    return false;
+}
+
 static sam_error
 sam_addition(/*@in@*/ sam_es *restrict es,
 	     bool	      add)
 {
     int sign = add? 1: -1;
+    sam_ml_unpacked m1, m2;
 
-    sam_ml *restrict m2 = sam_es_stack_pop(es);
-    if (m2 == NULL) {
-	return sam_error_stack_underflow(es);
-    }
-    sam_ml *restrict m1 = sam_es_stack_pop(es);
-    if (m1 == NULL) {
-	free(m2);
+    if (!sam_pop(es, &m2) || !sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m1->type == SAM_ML_TYPE_NONE) {
+    sam_quicken(es, m1.type, m2.type);
+    if (m1.type == SAM_ML_TYPE_NONE) {
 	sam_error_uninitialized(es);
-	m1->type = SAM_ML_TYPE_INT;
-	m1->value.i = 0;
+	m1.type = SAM_ML_TYPE_INT;
+	m1.value.i = 0;
     }
-    if (m2->type == SAM_ML_TYPE_NONE) {
+    if (m2.type == SAM_ML_TYPE_NONE) {
 	sam_error_uninitialized(es);
-	m2->type = SAM_ML_TYPE_INT;
-	m2->value.i = 0;
+	m2.type = SAM_ML_TYPE_INT;
+	m2.value.i = 0;
     }
 
-    sam_ml_type t;
-    switch (m1->type) {
+    switch (m1.type) {
 	case SAM_ML_TYPE_PA:
-	    if (m2->type == SAM_ML_TYPE_INT) {
+	    if (m2.type == SAM_ML_TYPE_INT) {
 		/* user could set an illegal index here */
-		m1->value.pa.l = m1->value.pa.l + sign * m2->value.i;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		m1.value.pa.l = m1.value.pa.l + sign * m2.value.i;
+		return sam_push(es, m1.value, m1.type);
 	    }
 	    break;
 	case SAM_ML_TYPE_HA:
-	    /* user could set an illegal index here or could overflow
-	     * the address */
-	    if (m2->type == SAM_ML_TYPE_INT) {
-		m1->value.ha.index += sign * m2->value.i;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
-	    } else if (m2->type == SAM_ML_TYPE_HA && sign == -1) {
-		if(m1->value.ha.alloc != m2->value.ha.alloc)
+	    /* user could set an illegal index here */
+	    if (m2.type == SAM_ML_TYPE_INT) {
+		if (!sam_ha_offset(&m1.value.ha, sign, m2.value.i)) {
+		    return sam_error_heap_overflow(es, m1.value.ha,
+						   sign * m2.value.i);
+		}
+		return sam_push(es, m1.value, m1.type);
+	    } else if (m2.type == SAM_ML_TYPE_HA && sign == -1) {
+		if(m1.value.ha.alloc != m2.value.ha.alloc)
 		    break;
-		m1->value.i = m1->value.ha.index - m2->value.ha.index;
-		m1->type = SAM_ML_TYPE_INT;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		m1.value.i = (sam_int)m1.value.ha.index - m2.value.ha.index;
+		return sam_push(es, m1.value, SAM_ML_TYPE_INT);
 	    }
 	    break;
 	case SAM_ML_TYPE_SA:
-	    if (m2->type == SAM_ML_TYPE_INT) {
+	    if (m2.type == SAM_ML_TYPE_INT) {
 		/* user could set an illegal index here or could
 		 * overflow the address */
-		m1->value.sa = m1->value.sa + sign * m2->value.i;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
-	    } else if (m2->type == SAM_ML_TYPE_SA) {
-		m1->value.i = m1->value.sa - m2->value.sa;
-		m1->type = SAM_ML_TYPE_INT;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		m1.value.sa = m1.value.sa + sign * m2.value.i;
+		return sam_push(es, m1.value, m1.type);
+	    } else if (m2.type == SAM_ML_TYPE_SA) {
+		m1.value.i = m1.value.sa - m2.value.sa;
+		return sam_push(es, m1.value, SAM_ML_TYPE_INT);
 	    }
 	    break;
 	case SAM_ML_TYPE_INT:
-	    if (m2->type == SAM_ML_TYPE_INT) {
-		m1->value.i += sign * m2->value.i;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+	    if (m2.type == SAM_ML_TYPE_INT) {
+		m1.value.i += sign * m2.value.i;
+		return sam_push(es, m1.value, m1.type);
 	    }
-	    if (m2->type == SAM_ML_TYPE_PA) {
+	    if (m2.type == SAM_ML_TYPE_PA) {
 		/* user could set an illegal index here */
-		m1->value.pa.l = m1->value.i + sign * m2->value.pa.l;
-		m1->type = SAM_ML_TYPE_PA;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		m1.value.pa = (sam_pa){
+		    .l = m1.value.i + sign * m2.value.pa.l,
+		    .m = m2.value.pa.m
+		};
+		return sam_push(es, m1.value, SAM_ML_TYPE_PA);
 	    }
-	    if (m2->type == SAM_ML_TYPE_HA) {
-		/* user could set an illegal index here or overflow */
+	    if (m2.type == SAM_ML_TYPE_HA) {
+		/* user could set an illegal index here */
 		if(sign != 1)
 		    break;
-		m1->value.ha.index = m1->value.i + m2->value.ha.index;
-		m1->value.ha.alloc = m2->value.ha.alloc;
-		m1->type = SAM_ML_TYPE_HA;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		if (!sam_ha_offset(&m2.value.ha, 1, m1.value.i)) {
+		    return sam_error_heap_overflow(es, m2.value.ha,
+						   m1.value.i);
+		}
+		return sam_push(es, m2.value, SAM_ML_TYPE_HA);
 	    }
-	    if (m2->type == SAM_ML_TYPE_SA) {
+	    if (m2.type == SAM_ML_TYPE_SA) {
 		/* user could set an illegal index here or overflow */
-		m1->value.sa = m1->value.i + sign * m2->value.sa;
-		m1->type = SAM_ML_TYPE_SA;
-		free(m2);
-		return sam_es_stack_push(es, m1)?
-		    SAM_OK: sam_error_stack_overflow(es);
+		m1.value.sa = m1.value.i + sign * m2.value.sa;
+		return sam_push(es, m1.value, SAM_ML_TYPE_SA);
 	    }
 	    break;
 	default:
-	    t = m1->type;
-	    free(m1);
-	    free(m2);
-	    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+	    return sam_error_stack_input(es, 1, m1.type, SAM_ML_TYPE_INT);
     }
-    t = m2->type;
-    free(m1);
-    free(m2);
-    return sam_error_stack_input(es, 2, t, SAM_ML_TYPE_INT);
+    return sam_error_stack_input(es, 2, m2.type, SAM_ML_TYPE_INT);
 }
 
 static sam_error
 sam_integer_arithmetic(sam_es *restrict es, 
 		       sam_integer_arithmetic_operation op)
 {
-    sam_ml *restrict m2 = sam_es_stack_pop(es);
-    if (m2 == NULL) {
-	return sam_error_stack_underflow(es);
-    }
-    sam_ml *restrict m1 = sam_es_stack_pop(es);
-    if (m1 == NULL) {
-	free(m2);
+    sam_ml_unpacked m1, m2;
+
+    if (!sam_pop(es, &m2) || !sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
     if (op == SAM_OP_CMP || op == SAM_OP_LESS || op == SAM_OP_GREATER) {
-	if(m1->type != m2->type) {
-	    sam_ml_type expected = m1->type;
-	    sam_ml_type found = m2->type;
-	    free(m1);
-	    free(m2);
-	    return sam_error_stack_input(es, 2, found, expected);
+	sam_quicken(es, m1.type, m2.type);
+	if(m1.type != m2.type) {
+	    return sam_error_stack_input(es, 2, m2.type, m1.type);
 	}
     } else {
-	if (m1->type != SAM_ML_TYPE_INT) {
-	    sam_ml_type t = m1->type;
-	    free(m1);
-	    free(m2);
-	    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+	if (m1.type != SAM_ML_TYPE_INT) {
+	    return sam_error_stack_input(es, 1, m1.type, SAM_ML_TYPE_INT);
 	}
-	if (m2->type != SAM_ML_TYPE_INT) {
-	    sam_ml_type t = m2->type;
-	    free(m1);
-	    free(m2);
-	    return sam_error_stack_input(es, 2, t, SAM_ML_TYPE_INT);
+	if (m2.type != SAM_ML_TYPE_INT) {
+	    return sam_error_stack_input(es, 2, m2.type, SAM_ML_TYPE_INT);
 	}
     }
 
     switch(op) {
 	case SAM_OP_TIMES:
-	    m1->value.i = m1->value.i * m2->value.i;
+	    m1.value.i = m1.value.i * m2.value.i;
 	    break;
 	case SAM_OP_AND:
-	    m1->value.i = m1->value.i && m2->value.i;
+	    m1.value.i = m1.value.i && m2.value.i;
 	    break;
 	case SAM_OP_OR:
-	    m1->value.i = m1->value.i || m2->value.i;
+	    m1.value.i = m1.value.i || m2.value.i;
 	    break;
 	case SAM_OP_XOR:
-	    m1->value.i = (!m1->value.i) ^ (!m2->value.i);
+	    m1.value.i = (!m1.value.i) ^ (!m2.value.i);
 	    break;
 	case SAM_OP_NOR:
-	    m1->value.i = !(m1->value.i || m2->value.i);
+	    m1.value.i = !(m1.value.i || m2.value.i);
 	    break;
 	case SAM_OP_NAND:
-	    m1->value.i = !(m1->value.i && m2->value.i);
+	    m1.value.i = !(m1.value.i && m2.value.i);
 	    break;
 	case SAM_OP_DIV:
-	    if (m2->value.i == 0) {
-		free(m1);
-		free(m2);
+	    if (m2.value.i == 0) {
 		return sam_error_division_by_zero(es);
 	    }
-	    m1->value.i = m1->value.i / m2->value.i;
+	    m1.value.i = m1.value.i / m2.value.i;
 	    break;
 	case SAM_OP_MOD:
-	    if(m2->value.i == 0) {
-		free(m1);
-		free(m2);
+	    if(m2.value.i == 0) {
 		return sam_error_division_by_zero(es);
 	    }
-	    m1->value.i = m1->value.i % m2->value.i;
+	    m1.value.i = m1.value.i % m2.value.i;
 	    break;
 	case SAM_OP_BITAND:
-	    m1->value.i = m1->value.i & m2->value.i;
+	    m1.value.i = m1.value.i & m2.value.i;
 	    break;
 	case SAM_OP_BITOR:
-	    m1->value.i = m1->value.i | m2->value.i;
+	    m1.value.i = m1.value.i | m2.value.i;
 	    break;
 	case SAM_OP_BITNAND:
-	    m1->value.i = ~(m1->value.i & m2->value.i);
+	    m1.value.i = ~(m1.value.i & m2.value.i);
 	    break;
 	case SAM_OP_BITNOR:
-	    m1->value.i = ~(m1->value.i | m2->value.i);
+	    m1.value.i = ~(m1.value.i | m2.value.i);
 	    break;
 	case SAM_OP_BITXOR:
-	    m1->value.i = m1->value.i ^ m2->value.i;
+	    m1.value.i = m1.value.i ^ m2.value.i;
 	    break;
 	case SAM_OP_CMP:
-	    m1->value.i = m1->value.i < m2->value.i?
-		-1: m2->value.i == m1->value.i? 0: 1;
-	    m1->type = SAM_ML_TYPE_INT;
+	    m1.value.i = m1.value.i < m2.value.i?
+		-1: m2.value.i == m1.value.i? 0: 1;
+	    m1.type = SAM_ML_TYPE_INT;
 	    break;
 	case SAM_OP_GREATER:
-	    m1->value.i = m1->value.i > m2->value.i;
-	    m1->type = SAM_ML_TYPE_INT;
+	    m1.value.i = m1.value.i > m2.value.i;
+	    m1.type = SAM_ML_TYPE_INT;
 	    break;
 	case SAM_OP_LESS:
-	    m1->value.i = m1->value.i < m2->value.i;
-	    m1->type = SAM_ML_TYPE_INT;
+	    m1.value.i = m1.value.i < m2.value.i;
+	    m1.type = SAM_ML_TYPE_INT;
 	    break;
     }
-    free(m2);
-    if (!sam_es_stack_push(es, m1)) {
-	return sam_error_stack_overflow(es);
-    }
 
-    return SAM_OK;
+    return sam_push(es, m1.value, m1.type);
 }
 
 static bool
@@ -395,86 +350,74 @@ static sam_error
 sam_float_arithmetic(sam_es *restrict es,
 		     sam_float_arithmetic_operation op)
 {
-    sam_ml *restrict m2 = sam_es_stack_pop(es);
-    if (m2 == NULL) {
+    sam_ml_unpacked m1, m2;
+
+    if (!sam_pop(es, &m2)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m2->type != SAM_ML_TYPE_FLOAT) {
-	sam_ml_type t = m2->type;
-	free(m2);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_FLOAT);
+    if (m2.type != SAM_ML_TYPE_FLOAT) {
+	return sam_error_stack_input(es, 1, m2.type, SAM_ML_TYPE_FLOAT);
     }
-    sam_ml *restrict m1 = sam_es_stack_pop(es);
-    if (m1 == NULL) {
-	free(m2);
+    if (!sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m1->type != SAM_ML_TYPE_FLOAT) {
-	sam_ml_type t = m1->type;
-	free(m1);
-	free(m2);
-	return sam_error_stack_input(es, 2, t, SAM_ML_TYPE_INT);
+    if (m1.type != SAM_ML_TYPE_FLOAT) {
+	return sam_error_stack_input(es, 2, m1.type, SAM_ML_TYPE_INT);
     }
 
     switch(op) {
 	case SAM_OP_ADDF:
-	    m1->value.f = m1->value.f + m2->value.f;
+	    m1.value.f = m1.value.f + m2.value.f;
 	    break;
 	case SAM_OP_SUBF:
-	    m1->value.f = m1->value.f - m2->value.f;
+	    m1.value.f = m1.value.f - m2.value.f;
 	    break;
 	case SAM_OP_TIMESF:
-	    m1->value.f = m1->value.f * m2->value.f;
+	    m1.value.f = m1.value.f * m2.value.f;
 	    break;
 	case SAM_OP_DIVF:
-	    m1->value.f = m1->value.f / m2->value.f;
+	    m1.value.f = m1.value.f / m2.value.f;
 	    break;
 	case SAM_OP_CMPF:
-	    m1->value.f =
-		sam_float_equal(m1->value.f, m2->value.f)?
-		0: m1->value.f < m2->value.f? -1: 1;
+	    m1.value.f =
+		sam_float_equal(m1.value.f, m2.value.f)?
+		0: m1.value.f < m2.value.f? -1: 1;
 	    break;
     }
-    free(m2);
-    m1->type = SAM_ML_TYPE_FLOAT;
 
-    return sam_es_stack_push(es, m1)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, m1.value, SAM_ML_TYPE_FLOAT);
 }
 
 static sam_error
 sam_unary_arithmetic(sam_es			    *restrict es,
 		     sam_unary_arithmetic_operation  op)
 {
-    sam_ml *m1;
+    sam_ml_unpacked m1;
 
-    if ((m1 = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m1->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m1->type;
-	free(m1);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m1.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m1.type, SAM_ML_TYPE_INT);
     }
 
     switch(op) {
 	case SAM_OP_NOT: /*@fallthrough@*/
 	case SAM_OP_ISNIL:
-	    m1->value.i = !m1->value.i;
+	    m1.value.i = !m1.value.i;
 	    break;
 	case SAM_OP_BITNOT:
-	    m1->value.i = ~m1->value.i;
+	    m1.value.i = ~m1.value.i;
 	    break;
 	case SAM_OP_ISPOS:
-	    m1->value.i = m1->value.i > 0;
+	    m1.value.i = m1.value.i > 0;
 	    break;
 	case SAM_OP_ISNEG:
-	    m1->value.i = m1->value.i < 0;
+	    m1.value.i = m1.value.i < 0;
 	    break;
     }
 
-    return sam_es_stack_push(es, m1)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, m1.value, m1.type);
 }
 
 static sam_int
@@ -498,59 +441,44 @@ static sam_error
 sam_bitshift(/*@in@*/ sam_es    *restrict es,
 	     sam_bitshift_type	type)
 {
-    sam_ml	    *m;
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_ml_unpacked	     m;
+    sam_op_value *cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_INT);
     }
-    if (cur->operand.i < 0) {
-	sam_int i = m->value.i;
-	free(m);
-	return sam_error_negative_shift(es, i);
+    if (cur->i < 0) {
+	return sam_error_negative_shift(es, m.value.i);
     }
-    m->value.i = sam_do_shift(m->value.i, cur->operand.i, type);
+    m.value.i = sam_do_shift(m.value.i, cur->i, type);
 
-    return sam_es_stack_push(es, m)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, m.value, m.type);
 }
 
 static sam_error
 sam_bitshiftind(/*@in@*/ sam_es *restrict es,
 		sam_bitshift_type type)
 {
-    sam_ml *restrict m2 = sam_es_stack_pop(es);
-    if (m2 == NULL) {
+    sam_ml_unpacked m1, m2;
+
+    if (!sam_pop(es, &m2)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m2->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m2->type;
-	free(m2);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m2.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m2.type, SAM_ML_TYPE_INT);
     }
-
-    sam_ml *restrict m1 = sam_es_stack_pop(es);
-    if (m1 == NULL) {
-	free(m2);
+    if (!sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m1->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m1->type;
-	free(m1);
-	free(m2);
-	return sam_error_stack_input(es, 2, t, SAM_ML_TYPE_INT);
+    if (m1.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 2, m1.type, SAM_ML_TYPE_INT);
     }
-    m1->value.i = sam_do_shift(m1->value.i, m2->value.i, type);
-    free(m2);
-    return sam_es_stack_push(es, m1)? SAM_OK: sam_error_stack_overflow(es);
+    m1.value.i = sam_do_shift(m1.value.i, m2.value.i, type);
+
+    return sam_push(es, m1.value, m1.type);
 }
 
 static sam_error
@@ -563,424 +491,310 @@ sam_es_read(/*@in@*/ sam_es *restrict es,
     return (t == SAM_ML_TYPE_FLOAT?
 	sam_io_scanf(es, fmt, &v.f):
 	sam_io_scanf(es, fmt, &v.i)) == 1?
-	    (sam_es_stack_push(es, sam_ml_new(v, t))?
-		SAM_OK: sam_error_stack_overflow(es)):
-	    sam_error_io(es);
-
+	    sam_push(es, v, t): sam_error_io(es);
 }
 
 /* Opcode implementations. */
 static sam_error
 sam_op_ftoi(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_FLOAT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, t,
+    if (m.type != SAM_ML_TYPE_FLOAT) {
+	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, m.type,
 					 SAM_ML_TYPE_FLOAT);
     }
-    m->value.i = floor(m->value.f);
-    m->type = SAM_ML_TYPE_INT;
+    m.value.i = floor(m.value.f);
 
-    return sam_es_stack_push(es, m)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, m.value, SAM_ML_TYPE_INT);
 }
 
 static sam_error
 sam_op_ftoir(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_FLOAT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, t,
+    if (m.type != SAM_ML_TYPE_FLOAT) {
+	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, m.type,
 					 SAM_ML_TYPE_FLOAT);
     }
-    m->value.i = round(m->value.f);
-    m->type = SAM_ML_TYPE_INT;
+    m.value.i = round(m.value.f);
 
-    return sam_es_stack_push(es, m)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, m.value, SAM_ML_TYPE_INT);
 }
 
 static sam_error
 sam_op_itof(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_type_conversion(es, SAM_ML_TYPE_FLOAT, t,
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_type_conversion(es, SAM_ML_TYPE_FLOAT, m.type,
 					 SAM_ML_TYPE_INT);
     }
-    m->value.f = (sam_float)m->value.i;
-    m->type = SAM_ML_TYPE_FLOAT;
-    if (!sam_es_stack_push(es, m)) {
-	return sam_error_stack_overflow(es);
-    }
+    m.value.f = (sam_float)m.value.i;
 
-    return SAM_OK;
+    return sam_push(es, m.value, SAM_ML_TYPE_FLOAT);
 }
 
 static sam_error
 sam_op_pushimm(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
-    sam_ml_value v = {.i = cur->operand.i};
-    sam_ml *restrict m = sam_ml_new(v, SAM_ML_TYPE_INT);
-    if (!sam_es_stack_push(es, m)) {
-	return sam_error_stack_overflow(es);
-    }
-
-    return SAM_OK;
+    return sam_push(es, (sam_ml_value){.i = cur->i},
+		    SAM_ML_TYPE_INT);
 }
 
 static sam_error
 sam_op_pushimmf(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    sam_ml_value v;
-
-    if (cur->optype != SAM_OP_TYPE_FLOAT) {
-	return sam_error_optype(es);
-    }
-    v.f = cur->operand.f;
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
 
-    sam_ml *restrict m = sam_ml_new(v, SAM_ML_TYPE_FLOAT);
-    return sam_es_stack_push(es, m)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, (sam_ml_value){.f = cur->f},
+		    SAM_ML_TYPE_FLOAT);
 }
 
 static sam_error
 sam_op_pushimmch(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    sam_ml_value v;
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_CHAR) {
-	return sam_error_optype(es);
-    }
-    v.i = cur->operand.c;
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_INT))) {
-	return sam_error_stack_overflow(es);
-    }
-
-    return SAM_OK;
+    return sam_push(es, (sam_ml_value){.i = cur->c},
+		    SAM_ML_TYPE_INT);
 }
 
 static sam_error
 sam_op_pushimmma(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction	*cur = sam_es_instructions_cur(es);
-    sam_ml_value	 v;
+    sam_op_value *cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
     /* weird things happen when user pushes a negative operand */
-    v.sa = (size_t)cur->operand.i;
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_SA))) {
-	return sam_error_stack_overflow(es);
-    }
-
-    return SAM_OK;
+    return sam_push(es, (sam_ml_value){.sa = (size_t)cur->i},
+		    SAM_ML_TYPE_SA);
 }
 
 static sam_error
-sam_op_pushimmpa(/*@in@*/ sam_es *restrict es)
+sam_op_pushimmpa_int(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
-    if (cur->optype == SAM_OP_TYPE_INT) {
-	if (!sam_es_stack_push(es, sam_ml_new(
-	    (sam_ml_value){
-		.pa = (sam_pa){
-		    .l = cur->operand.i,
-		    .m = sam_es_pc_get(es).m}
-		},
-		SAM_ML_TYPE_PA))) {
-	    return sam_error_stack_overflow(es);
-	}
-    } else if (cur->optype == SAM_OP_TYPE_LABEL) {
-	sam_ml_value v;
-	/* TODO: are jumps automatically module-agnostic? */
-	if (sam_es_labels_get_cur(es, &v.pa, cur->operand.s)) {
-	    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_PA))) {
-		return sam_error_stack_overflow(es);
-	    }
-	} else {
-	    return sam_error_unknown_identifier(es, cur->operand.s);
-	}
-    } else {
-	return sam_error_optype(es);
-    }
+    sam_op_value *cur = sam_es_operand_cur(es);
 
-    return SAM_OK;
+    return sam_push(es, (sam_ml_value){.pa = {
+			.l = cur->i,
+			.m = sam_es_pc_get(es).m
+		    }}, SAM_ML_TYPE_PA);
+}
+
+static sam_error
+sam_op_pushimmpa_label(/*@in@*/ sam_es *restrict es)
+{
+    return sam_push(es,
+		    (sam_ml_value){
+			.pa = sam_es_operand_cur(es)->pa
+		    }, SAM_ML_TYPE_PA);
 }
 
 static sam_error
 sam_op_pushimmstr(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
     sam_ml_value v;
     sam_error rv;
 
-    if (cur->optype != SAM_OP_TYPE_STR) {
-	return sam_error_optype(es);
-    }
-
-    if((rv=sam_es_string_alloc(es,cur->operand.s,&v.ha))!=SAM_OK) {
+    if((rv=sam_es_string_alloc(es,cur->s,&v.ha))!=SAM_OK) {
 	return rv;
     }
 
-    return sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_HA))?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, v, SAM_ML_TYPE_HA);
 }
 
 static sam_error
 sam_op_pushsp(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml_value v;
-    v.sa = sam_es_stack_len(es);
-    return sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_SA))?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, (sam_ml_value){.sa = sam_es_stack_len(es)},
+		    SAM_ML_TYPE_SA);
 }
 
 static sam_error
 sam_op_pushfbr(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml_value v;
-    v.sa = sam_es_fbr_get(es);
-    return sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_SA))?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, (sam_ml_value){.sa = sam_es_fbr_get(es)},
+		    SAM_ML_TYPE_SA);
 }
 
 static sam_error
 sam_op_popsp(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m;
-    size_t  i;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_SA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_SA);
+    if (m.type != SAM_ML_TYPE_SA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_SA);
     }
-    i = m->value.sa;
-    free(m);
 
-    return sam_sp_shift(es, i);
+    return sam_es_stack_resize(es, m.value.sa)?
+	SAM_OK: sam_error_stack_overflow(es);
 }
 
 static sam_error
 sam_op_popfbr(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_SA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_SA);
+    if (m.type != SAM_ML_TYPE_SA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_SA);
     }
-    sam_es_fbr_set(es, m->value.sa);
-    free(m);
+    sam_es_fbr_set(es, m.value.sa);
+
     return SAM_OK;
 }
 
 static sam_error
 sam_op_dup(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m1, *m2;
+    sam_ml m;
 
-    if ((m1 = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_es_stack_peek(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    m2 = sam_ml_new(m1->value, m1->type);
 
-    if (!sam_es_stack_push(es, m1)) {
-	free(m2);
-	return sam_error_stack_overflow(es);
-    }
-    return sam_es_stack_push(es, m2)?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_es_stack_push(es, m)? SAM_OK: sam_error_stack_overflow(es);
 }
 
 static sam_error
 sam_op_swap(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m1, *m2;
+    sam_ml m1, m2;
 
-    if ((m1 = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_es_stack_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if ((m2 = sam_es_stack_pop(es)) == NULL) {
-	free(m1);
+    if (!sam_es_stack_pop(es, &m2)) {
 	return sam_error_stack_underflow(es);
     }
-    if (!sam_es_stack_push(es, m1)) {
-	free(m2);
+    if (!sam_es_stack_push(es, m1) || !sam_es_stack_push(es, m2)) {
 	return sam_error_stack_overflow(es);
     }
-    return sam_es_stack_push(es, m2)?
-	SAM_OK: sam_error_stack_overflow(es);
+
+    return SAM_OK;
 }
 
 static sam_error
 sam_op_addsp(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
-    if (cur->operand.i + (int)sam_es_stack_len(es) < 0) {
+    if (cur->i + (int)sam_es_stack_len(es) < 0) {
 	return sam_error_stack_underflow(es);
     }
-    return sam_sp_shift(es, (size_t)cur->operand.i + sam_es_stack_len(es));
+
+    return sam_es_stack_resize(es, (size_t)cur->i +
+				   sam_es_stack_len(es))?
+	SAM_OK: sam_error_stack_overflow(es);
 }
 
 static sam_error
 sam_op_malloc(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml_value v;
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_INT);
     }
-    if (m->value.i == 0) {
-	m->value.i = 1;
+    if (m.value.i == 0) {
+	m.value.i = 1;
     }
 
-    /* XXX?
-    if ((v.ha = sam_es_heap_alloc(es, m->value.i)) == SAM_HEAP_PTR_MAX) {
-	free(m);
+    /* sam_es_heap_alloc makes sure values are properly marked
+     * uninited */
+    sam_ml_value v;
+    if (m.value.i < 0 || !sam_es_heap_alloc(es, m.value.i, &v.ha)) {
 	return sam_error_no_memory(es);
     }
-    */
-    v.ha = sam_es_heap_alloc(es, m->value.i);
-    
-    /*sam_es_heap_alloc makes sure values are properly marked uninited*/
-
-    free(m);
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_HA))) {
-	return sam_error_stack_overflow(es);
-    }
-
-    return SAM_OK;
+    return sam_push(es, v, SAM_ML_TYPE_HA);
 }
 
 static sam_error
 sam_op_free(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_HA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_HA);
+    if (m.type != SAM_ML_TYPE_HA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_HA);
     }
-    sam_ha ha = m->value.ha;
-    free(m);
-    return sam_es_heap_dealloc(es, ha);
+
+    return sam_es_heap_dealloc(es, m.value.ha);
 }
 
 static sam_error
 sam_op_pushind(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml  *m;
-    sam_ml_type t;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type == SAM_ML_TYPE_HA) {
-	sam_ma ma = {.ha = m->value.ha};
-	free(m);
+    if (m.type == SAM_ML_TYPE_HA) {
+	sam_ma ma = {.ha = m.value.ha};
 	return sam_pushabs(es, false, ma);
     }
-    if (m->type == SAM_ML_TYPE_SA) {
-	sam_ma ma = {.sa = m->value.sa};
-	free(m);
+    if (m.type == SAM_ML_TYPE_SA) {
+	sam_ma ma = {.sa = m.value.sa};
 	return sam_pushabs(es, true, ma);
     }
-    t = m->type;
-    free(m);
-    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_SA);   /* XXX */
+
+    return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_SA);   /* XXX */
 }
 
 static sam_error
 sam_op_storeind(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml_type t;
-    /*@null@*/ sam_ml *m2 = sam_es_stack_pop(es);
-
-    if (m2 == NULL) {
-	return sam_error_stack_underflow(es);
-    }
+    sam_ml_unpacked m1;
+    sam_ml m2;
 
-    /*@null@*/ sam_ml *m1 = sam_es_stack_pop(es);
-    if (m1 == NULL) {
-	free(m2);
+    if (!sam_es_stack_pop(es, &m2) || !sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m1->type == SAM_ML_TYPE_HA) {
-	sam_ma ma = {.ha = m1->value.ha};
-	free(m1);
+    if (m1.type == SAM_ML_TYPE_HA) {
+	sam_ma ma = {.ha = m1.value.ha};
 	return sam_storeabs(es, m2, false, ma);
     }
-    if (m1->type == SAM_ML_TYPE_SA) {
-	sam_ma ma = {.sa = m1->value.sa};
-	free(m1);
+    if (m1.type == SAM_ML_TYPE_SA) {
+	sam_ma ma = {.sa = m1.value.sa};
 	return sam_storeabs(es, m2, true, ma);
     }
-    t = m1->type;
-    free(m1);
-    free(m2);
-    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_SA); /* XXX */
+
+    return sam_error_stack_input(es, 1, m1.type, SAM_ML_TYPE_SA); /* XXX */
 }
 
 /* cannot be used to push from the heap. */
 static sam_error
 sam_op_pushabs(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
     
-    sam_ma ma = {.sa = cur->operand.i};
+    sam_ma ma = {.sa = cur->i};
 
     return sam_pushabs(es, true, ma);
 }
@@ -989,49 +803,35 @@ sam_op_pushabs(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_storeabs(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
+    sam_ml m;
 
-    if (m == NULL) {
+    if (!sam_es_stack_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	free(m);
-	return sam_error_optype(es);
-    }
-
-    sam_ma ma = {.sa = cur->operand.i};
+    sam_ma ma = {.sa = cur->i};
     return sam_storeabs(es, m, true, ma);
 }
 
 static sam_error
 sam_op_pushoff(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	return sam_error_optype(es);
-    }
-
-    sam_ma ma = {.sa = sam_es_fbr_get(es) + cur->operand.i};
+    sam_ma ma = {.sa = sam_es_fbr_get(es) + cur->i};
     return sam_pushabs(es, true, ma);
 }
 
 static sam_error
 sam_op_storeoff(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    sam_ml	    *m;
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
+    sam_ml m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_es_stack_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (cur->optype != SAM_OP_TYPE_INT) {
-	free(m);
-	return sam_error_optype(es);
-    }
-
-    sam_ma ma = {.sa = sam_es_fbr_get(es) + cur->operand.i};
+    sam_ma ma = {.sa = sam_es_fbr_get(es) + cur->i};
     return sam_storeabs(es, m, true, ma);
 }
 
@@ -1224,66 +1024,56 @@ sam_op_less(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_equal(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m1, *m2;
+    sam_ml_unpacked m1, m2;
 
-    if ((m2 = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m2) || !sam_pop(es, &m1)) {
 	return sam_error_stack_underflow(es);
     }
-    if ((m1 = sam_es_stack_pop(es)) == NULL) {
-	free(m2);
-	return sam_error_stack_underflow(es);
-    }
-    switch (m1->type) {
+    switch (m1.type) {
 	case SAM_ML_TYPE_FLOAT:
-	    if (m2->type == SAM_ML_TYPE_FLOAT) {
-		m1->value.i = sam_float_equal(m1->value.f, m2->value.f);
+	    if (m2.type == SAM_ML_TYPE_FLOAT) {
+		m1.value.i = sam_float_equal(m1.value.f, m2.value.f);
 	    } else {
-		m1->value.i = false;
+		m1.value.i = false;
 	    }
 	    break;
 	case SAM_ML_TYPE_INT:
-	    if (m2->type == SAM_ML_TYPE_INT) {
-		m1->value.i = m1->value.i == m2->value.i;
+	    if (m2.type == SAM_ML_TYPE_INT) {
+		m1.value.i = m1.value.i == m2.value.i;
 	    } else {
-		m1->value.i = false;
+		m1.value.i = false;
 	    }
 	    break;
 	case SAM_ML_TYPE_PA:
-	    if (m2->type == SAM_ML_TYPE_PA) {
-		m1->value.i = (m1->value.pa.l == m2->value.pa.l) && (m1->value.pa.m == m2->value.pa.m);
+	    if (m2.type == SAM_ML_TYPE_PA) {
+		m1.value.i = (m1.value.pa.l == m2.value.pa.l) && (m1.value.pa.m == m2.value.pa.m);
 	    } else {
-		m1->value.i = false;
+		m1.value.i = false;
 	    }
 	    break;
 	case SAM_ML_TYPE_HA:
-	    if (m2->type == SAM_ML_TYPE_HA) {
-		m1->value.i =
-		    m1->value.ha.index == m2->value.ha.index &&
-		    m1->value.ha.alloc == m2->value.ha.alloc;
+	    if (m2.type == SAM_ML_TYPE_HA) {
+		m1.value.i =
+		    m1.value.ha.index == m2.value.ha.index &&
+		    m1.value.ha.alloc == m2.value.ha.alloc;
 	    } else {
-		m1->value.i = false;
+		m1.value.i = false;
 	    }
 	    break;
 	case SAM_ML_TYPE_SA:
-	    if (m2->type == SAM_ML_TYPE_SA) {
-		m1->value.i = m1->value.sa == m2->value.sa;
+	    if (m2.type == SAM_ML_TYPE_SA) {
+		m1.value.i = m1.value.sa == m2.value.sa;
 	    } else {
-		m1->value.i = false;
+		m1.value.i = false;
 	    }
 	    break;
 	case SAM_ML_TYPE_NONE: /*@fallthrough@*/
 	default:
-	    m1->value.i = false;
+	    m1.value.i = false;
 	    break;
     }
 
-    m1->type = SAM_ML_TYPE_INT;
-    free(m2);
-    if (!sam_es_stack_push(es, m1)) {
-	return sam_error_stack_overflow(es);
-    }
-
-    return SAM_OK;
+    return sam_push(es, m1.value, SAM_ML_TYPE_INT);
 }
 
 static sam_error
@@ -1304,16 +1094,17 @@ sam_op_isneg(/*@in@*/ sam_es *restrict es)
     return sam_unary_arithmetic(es, SAM_OP_ISNEG);
 }
 
+/* JUMP, JUMPC and JSR take the same handlers whether their operand was
+ * an address or a label, since sam_parse() resolves both to a pa. */
 static sam_error
 sam_op_jump(/*@in@*/ sam_es *restrict es)
 {
-    sam_pa    target;
-    sam_error err;
+    sam_pa p = sam_es_operand_cur(es)->pa;
 
-    if ((err = sam_get_jump_target(es, &target)) != SAM_OK) {
-	return err;
-    }
-    sam_es_pc_set(es, target);
+    /* subtract 1 when we change the pa because it will be
+     * incremented by the loop in sam_execute */
+    --p.l;
+    sam_es_pc_set(es, p);
 
     return SAM_OK;
 }
@@ -1321,47 +1112,50 @@ sam_op_jump(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_jumpc(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_INT);
     }
-    if (m->value.i == 0) {
-	free(m);
+    if (m.value.i == 0) {
 	return SAM_OK;
     }
-    sam_pa target;
-    sam_error err = sam_get_jump_target(es, &target);
-    if (err != SAM_OK) {
-	free(m);
+
+    return sam_op_jump(es);
+}
+
+static sam_error
+sam_op_jsr(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml_value v;
+    sam_error    err;
+
+    v.pa = sam_es_pc_get(es);
+    ++v.pa.l;
+
+    if ((err = sam_push(es, v, SAM_ML_TYPE_PA)) != SAM_OK) {
 	return err;
     }
 
-    sam_es_pc_set(es, target);
-    free(m);
-    return SAM_OK;
+    return sam_op_jump(es);
 }
 
 static sam_error
 sam_op_jumpind(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_PA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_PA);
+    if (m.type != SAM_ML_TYPE_PA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_PA);
     }
-    sam_es_pc_set(es, (sam_pa){.m = m->value.pa.m, .l = m->value.pa.l - 1});
-    free(m);
+    sam_es_pc_set(es, (sam_pa){.m = m.value.pa.m, .l = m.value.pa.l - 1});
+
     return SAM_OK;
 }
 
@@ -1371,80 +1165,58 @@ sam_op_rst(/*@in@*/ sam_es *restrict es)
     return sam_op_jumpind(es);
 }
 
-static sam_error
-sam_op_jsr(/*@in@*/ sam_es *restrict es)
-{
-    sam_ml_value v;
-    sam_pa	 target;
-    sam_error	 err;
-
-    v.pa = sam_es_pc_get(es);
-    ++v.pa.l;
-
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_PA))) {
-	return sam_error_stack_overflow(es);
-    }
-    if ((err = sam_get_jump_target(es, &target)) != SAM_OK) {
-	return err;
-    }
-    sam_es_pc_set(es, target);
-
-    return SAM_OK;
-}
-
 static sam_error
 sam_op_jsrind(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml	 *m;
+    sam_ml_unpacked	  m;
     sam_ml_value  v;
+    sam_error	  err;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_PA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_PA);
+    if (m.type != SAM_ML_TYPE_PA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_PA);
     }
 
     v.pa = sam_es_pc_get(es);
     ++v.pa.l;
 
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_PA))) {
-	free(m);
-	return sam_error_stack_overflow(es);
+    if ((err = sam_push(es, v, SAM_ML_TYPE_PA)) != SAM_OK) {
+	return err;
     }
-    sam_es_pc_set(es, (sam_pa){.m = m->value.pa.m, .l = m->value.pa.l - 1});
+    sam_es_pc_set(es, (sam_pa){.m = m.value.pa.m, .l = m.value.pa.l - 1});
 
-    free(m);
     return SAM_OK;
 }
 
 static sam_error
 sam_op_skip(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
     sam_es_pc_set(es, (sam_pa){
 		      .m = sam_es_pc_get(es).m,
-		      .l = sam_es_pc_get(es).l + m->value.pa.l
+		      .l = sam_es_pc_get(es).l + m.value.pa.l
 		  });
 
-    free(m);
     return SAM_OK;
 }
 
 static sam_error
 sam_op_link(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml_value v = {.sa = sam_es_fbr_get(es)};
-    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_SA))) {
-	sam_error_stack_overflow(es);
+    sam_error err;
+
+    if ((err = sam_push(es, (sam_ml_value){.sa = sam_es_fbr_get(es)},
+			SAM_ML_TYPE_SA)) != SAM_OK) {
+	return err;
     }
     sam_es_fbr_set(es, sam_es_stack_len(es) - 1);
+
     return SAM_OK;
 }
 
@@ -1488,66 +1260,52 @@ sam_op_readstr(/*@in@*/ sam_es *restrict es)
     }
 
     free(str);
-    return sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_HA))?
-	SAM_OK: sam_error_stack_overflow(es);
+    return sam_push(es, v, SAM_ML_TYPE_HA);
 }
 
 static sam_error
 sam_op_write(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *m;
-    sam_int i;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_INT);
     }
-    i = m->value.i;
-    free(m);
 
-    return sam_io_printf(es, "%ld", i) > 0? SAM_OK: sam_error_io(es);
+    return sam_io_printf(es, "%ld", m.value.i) > 0? SAM_OK: sam_error_io(es);
 }
 
 static sam_error
 sam_op_writef(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml    *m;
-    sam_float  f;
+    sam_ml_unpacked m;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_FLOAT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_FLOAT);
+    if (m.type != SAM_ML_TYPE_FLOAT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_FLOAT);
     }
-    f = m->value.f;
-    free(m);
 
-    return sam_io_printf(es, "%g", f) > 0? SAM_OK: sam_error_io(es);
+    return sam_io_printf(es, "%g", m.value.f) > 0? SAM_OK: sam_error_io(es);
 }
 
 static sam_error
 sam_op_writech(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml   *m;
-    sam_char  c;
+    sam_ml_unpacked   m;
+    sam_char c;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_INT) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+    if (m.type != SAM_ML_TYPE_INT) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_INT);
     }
-    c = m->value.i;
-    free(m);
+    c = m.value.i;
 
     return sam_io_printf(es, "%c", c) == 1? SAM_OK: sam_error_io(es);
 }
@@ -1555,23 +1313,18 @@ sam_op_writech(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_writestr(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml    *m;
-    sam_ha     ha;
+    sam_ml_unpacked     m;
     sam_error  rv;
     char      *str;
 
-    if ((m = sam_es_stack_pop(es)) == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_HA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_HA);
+    if (m.type != SAM_ML_TYPE_HA) {
+	return sam_error_stack_input(es, 1, m.type, SAM_ML_TYPE_HA);
     }
-    ha = m->value.ha;
-    free(m);
 
-    if ((rv = sam_es_string_get(es, &str, ha)) != SAM_OK) {
+    if ((rv = sam_es_string_get(es, &str, m.value.ha)) != SAM_OK) {
 	return rv;
     }
 
@@ -1595,23 +1348,16 @@ sam_op_stop(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_load(sam_es *restrict es)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
 
-    if (cur->optype != SAM_OP_TYPE_LABEL) {
-	return sam_error_optype(es);
-    }
-    return sam_es_dlhandles_ins(es, cur->operand.s);
+    return sam_es_dlhandles_ins(es, cur->s);
 }
 
 static sam_error
 sam_op_call(sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    if (sam_es_instructions_cur(es)->optype != SAM_OP_TYPE_LABEL) {
-	return sam_error_optype(es);
-    }
-
-    sam_library_fn fn = sam_es_dlhandles_get(es, cur->operand.s);
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
+    sam_library_fn fn = sam_es_dlhandles_get(es, cur->s);
     return fn == NULL? sam_error_dlsym(es): fn(es);
 }
 
@@ -1636,13 +1382,13 @@ sam_op_call(UNUSED sam_es *restrict es)
 static sam_error
 sam_op_import(sam_es *restrict es)
 {
-    sam_instruction *restrict cur = sam_es_instructions_cur(es);
-    if (sam_es_instructions_cur(es)->optype != SAM_OP_TYPE_LABEL) {
+    sam_op_value *restrict cur = sam_es_operand_cur(es);
+    if (sam_es_optype_cur(es) != SAM_OP_TYPE_LABEL) {
 	return sam_error_optype(es);
     }
     return sam_es_stack_push(es, sam_ml_new((sam_ml_value) {
 				    .i = sam_main(sam_es_options(es),
-						  cur->operand.s,
+						  cur->s,
 						  sam_es_io_funcs(es))
 				    }, SAM_ML_TYPE_INT))?
 	SAM_OK: sam_error_stack_overflow(es);
@@ -1658,25 +1404,18 @@ sam_op_export(UNUSED sam_es *restrict es)
 static sam_error
 sam_op_pushimmha(/*@in@*/ sam_es *restrict es)
 {
-    sam_instruction *cur = sam_es_instructions_cur(es);
-    if (cur->optype == SAM_OP_TYPE_LABEL) {
-	sam_ml_value v;
-	/* TODO: are jumps automatically module-agnostic? */
-	if (sam_es_globals_get_cur(es, &v.ha, cur->operand.s)) {
-	    if (!sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_HA))) {
-		return sam_error_stack_overflow(es);
-	    }
-	} else {
-	    return sam_error_unknown_identifier(es, cur->operand.s);
-	}
-    } else {
-	return sam_error_optype(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
+    sam_ml_value v;
+
+    /* TODO: are jumps automatically module-agnostic? */
+    if (!sam_es_globals_get_cur(es, &v.ha, cur->s)) {
+	return sam_error_unknown_identifier(es, cur->s);
     }
 
-    return SAM_OK;
+    return sam_push(es, v, SAM_ML_TYPE_HA);
 }
 /*{
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
 
     if (cur->optype != SAM_OP_TYPE_LABEL) {
 	return sam_error_optype(es);
@@ -1698,16 +1437,16 @@ sam_op_pushimmha(/*@in@*/ sam_es *restrict es)
 }*/
 
 #if 0
-    sam_instruction *cur = sam_es_instructions_cur(es);
+    sam_op_value *cur = sam_es_operand_cur(es);
 
     if (cur->optype == SAM_OP_TYPE_LABEL) {
 	/* TODO: are jumps automatically module-agnostic? */
-	if (sam_es_labels_get_cur(es, p, cur->operand.s)) {
+	if (sam_es_labels_get_cur(es, p, cur->s)) {
 	    /* as above */
 	    --p->l;
 	} else {
 	    p->l = 0;
-	    return sam_error_unknown_identifier(es, cur->operand.s);
+	    return sam_error_unknown_identifier(es, cur->s);
 	}
     } else {
 	p->l = 0;
@@ -1720,134 +1459,691 @@ sam_op_pushimmha(/*@in@*/ sam_es *restrict es)
 static sam_error
 sam_op_patoi(/*@in@*/ sam_es *restrict es)
 {
-    sam_ml *restrict m = sam_es_stack_pop(es);
+    sam_ml_unpacked m;
 
-    if (m == NULL) {
+    if (!sam_pop(es, &m)) {
 	return sam_error_stack_underflow(es);
     }
-    if (m->type != SAM_ML_TYPE_PA) {
-	sam_ml_type t = m->type;
-	free(m);
-	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, t, SAM_ML_TYPE_PA);
+    if (m.type != SAM_ML_TYPE_PA) {
+	return sam_error_type_conversion(es, SAM_ML_TYPE_INT, m.type, SAM_ML_TYPE_PA);
     }
-    m->value.i = m->value.pa.l;
-    m->type = SAM_ML_TYPE_INT;
-    return sam_es_stack_push(es, m)? SAM_OK: sam_error_stack_overflow(es);
+    m.value.i = m.value.pa.l;
+
+    return sam_push(es, m.value, SAM_ML_TYPE_INT);
+}
+
+/* Run by instructions whose operand is of a type their opcode doesn't
+ * accept, so that the handlers of the rest need not check. */
+static sam_error
+sam_op_optype(/*@in@*/ sam_es *restrict es)
+{
+    return sam_error_optype(es);
 }
 
+#define SAM_OPCODE_ENTRY(op, name, optypes, handler, label_handler)	\
+    [SAM_OPCODE_##op] = {name, optypes, handler, label_handler},
+#define SAM_OPCODE_OMIT(op, name, optypes, handler, label_handler)
+#if defined(SAM_EXTENSIONS)
+# define SAM_OPCODE_EXTENSION SAM_OPCODE_ENTRY
+#else
+# define SAM_OPCODE_EXTENSION SAM_OPCODE_OMIT
+#endif
+
+/* Indexed by opcode; the name of an omitted extension is NULL. */
 static const struct {
-    const char *name;
+    /*@null@*/ const char *name;
     sam_op_type optype;
+    /*@null@*/ sam_handler handler;
+    /*@null@*/ sam_handler label_handler;
+} sam_opcodes[SAM_OPCODE_COUNT] = {
+    SAM_OPCODE_TABLE(SAM_OPCODE_ENTRY, SAM_OPCODE_EXTENSION)
+};
+
+#undef SAM_OPCODE_ENTRY
+#undef SAM_OPCODE_OMIT
+#undef SAM_OPCODE_EXTENSION
+
+/* Quickening. The generic ADD, SUB, CMP, LESS and GREATER handlers
+ * record the types they were given by rewriting the handler of the
+ * instruction they are executing to one specialised for those types.
+ * A specialised handler checks the types of its operands and, if they
+ * have changed, runs the generic handler, which specialises the
+ * instruction again. Handlers installed by sam_opcode_fuse() are never
+ * replaced. */
+
+/* Do the top two items of the stack have the types t1 and t2? */
+static inline bool
+sam_quick_match(/*@in@*/ const sam_es *restrict es,
+		sam_ml_type t1,
+		sam_ml_type t2)
+{
+    return es->stack.len >= 2 &&
+	SAM_ML_TYPE(es->stack.arr[es->stack.len - 2]) == t1 &&
+	SAM_ML_TYPE(es->stack.arr[es->stack.len - 1]) == t2;
+}
+
+/* Define a handler, name, for the instruction handled by generic,
+ * which computes expr from the values a and b of types t1 and t2 and leaves the
+ * result on the stack as type t. expr may clear ok to leave the
+ * operands to generic, which reports the error. Unless somebody is
+ * watching the stack, the result is written in place of the
+ * operands. */
+#define SAM_QUICKENED(name, generic, t1, t2, t, expr)			\
+    static sam_error							\
+    name(/*@in@*/ sam_es *restrict es)					\
+    {									\
+	sam_ml_value a, b;						\
+	bool ok = true;							\
+									\
+	if (!sam_quick_match(es, t1, t2)) {				\
+	    return generic(es);						\
+	}								\
+	a = SAM_ML_VALUE(es->stack.arr[es->stack.len - 2]);		\
+	b = SAM_ML_VALUE(es->stack.arr[es->stack.len - 1]);		\
+	expr;								\
+	if (!ok) {							\
+	    return generic(es);						\
+	}								\
+	if (sam_es_changes_tracked(es)) {				\
+	    sam_es_stack_pop(es, NULL);					\
+	    sam_es_stack_pop(es, NULL);					\
+	    return sam_push(es, a, t);					\
+	}								\
+	es->stack.arr[--es->stack.len - 1] = SAM_ML(a, t);		\
+									\
+	return SAM_OK;							\
+    }
+
+SAM_QUICKENED(sam_op_add_int_int, sam_op_add,
+	      SAM_ML_TYPE_INT, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	      a.i += b.i)
+SAM_QUICKENED(sam_op_add_sa_int, sam_op_add,
+	      SAM_ML_TYPE_SA, SAM_ML_TYPE_INT, SAM_ML_TYPE_SA,
+	      a.sa += b.i)
+SAM_QUICKENED(sam_op_add_ha_int, sam_op_add,
+	      SAM_ML_TYPE_HA, SAM_ML_TYPE_INT, SAM_ML_TYPE_HA,
+	      ok = sam_ha_offset(&a.ha, 1, b.i))
+SAM_QUICKENED(sam_op_add_pa_int, sam_op_add,
+	      SAM_ML_TYPE_PA, SAM_ML_TYPE_INT, SAM_ML_TYPE_PA,
+	      a.pa.l += b.i)
+SAM_QUICKENED(sam_op_sub_int_int, sam_op_sub,
+	      SAM_ML_TYPE_INT, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	      a.i -= b.i)
+SAM_QUICKENED(sam_op_sub_sa_int, sam_op_sub,
+	      SAM_ML_TYPE_SA, SAM_ML_TYPE_INT, SAM_ML_TYPE_SA,
+	      a.sa -= b.i)
+SAM_QUICKENED(sam_op_sub_sa_sa, sam_op_sub,
+	      SAM_ML_TYPE_SA, SAM_ML_TYPE_SA, SAM_ML_TYPE_INT,
+	      a.i = a.sa - b.sa)
+SAM_QUICKENED(sam_op_sub_ha_int, sam_op_sub,
+	      SAM_ML_TYPE_HA, SAM_ML_TYPE_INT, SAM_ML_TYPE_HA,
+	      ok = sam_ha_offset(&a.ha, -1, b.i))
+SAM_QUICKENED(sam_op_cmp_int_int, sam_op_cmp,
+	      SAM_ML_TYPE_INT, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	      a.i = a.i < b.i?
+		  -1: a.i == b.i? 0: 1)
+SAM_QUICKENED(sam_op_less_int_int, sam_op_less,
+	      SAM_ML_TYPE_INT, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	      a.i = a.i < b.i)
+SAM_QUICKENED(sam_op_greater_int_int, sam_op_greater,
+	      SAM_ML_TYPE_INT, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	      a.i = a.i > b.i)
+
+#undef SAM_QUICKENED
+
+/* The specialisations of each quickened instruction. */
+static const struct {
+    sam_opcode opcode;
+    sam_ml_type t1, t2;
+    sam_handler generic;
     sam_handler handler;
-} sam_opcodes[] = {
-    { "FTOI",		SAM_OP_TYPE_NONE,  sam_op_ftoi		},
-    { "FTOIR",		SAM_OP_TYPE_NONE,  sam_op_ftoir		},
-    { "ITOF",		SAM_OP_TYPE_NONE,  sam_op_itof		},
-    { "PUSHIMM",	SAM_OP_TYPE_INT,   sam_op_pushimm	},
-    { "PUSHIMMF",	SAM_OP_TYPE_FLOAT, sam_op_pushimmf	},
-    { "PUSHIMMCH",	SAM_OP_TYPE_CHAR,  sam_op_pushimmch	},
-    { "PUSHIMMMA",	SAM_OP_TYPE_INT,   sam_op_pushimmma	},
-    { "PUSHIMMPA",	SAM_OP_TYPE_LABEL |
-			SAM_OP_TYPE_INT,   sam_op_pushimmpa	},
-    { "PUSHIMMSTR",	SAM_OP_TYPE_STR,   sam_op_pushimmstr	},
-    { "PUSHSP",		SAM_OP_TYPE_NONE,  sam_op_pushsp	},
-    { "PUSHFBR",	SAM_OP_TYPE_NONE,  sam_op_pushfbr	},
-    { "POPSP",		SAM_OP_TYPE_NONE,  sam_op_popsp		},
-    { "POPFBR",		SAM_OP_TYPE_NONE,  sam_op_popfbr	},
-    { "DUP",		SAM_OP_TYPE_NONE,  sam_op_dup		},
-    { "SWAP",		SAM_OP_TYPE_NONE,  sam_op_swap		},
-    { "ADDSP",		SAM_OP_TYPE_INT,   sam_op_addsp		},
-    { "MALLOC",		SAM_OP_TYPE_NONE,  sam_op_malloc	},
-    { "FREE",		SAM_OP_TYPE_NONE,  sam_op_free		},
-    { "PUSHIND",	SAM_OP_TYPE_NONE,  sam_op_pushind	},
-    { "STOREIND",	SAM_OP_TYPE_NONE,  sam_op_storeind	},
-    { "PUSHABS",	SAM_OP_TYPE_INT,   sam_op_pushabs	},
-    { "STOREABS",	SAM_OP_TYPE_INT,   sam_op_storeabs	},
-    { "PUSHOFF",	SAM_OP_TYPE_INT,   sam_op_pushoff	},
-    { "STOREOFF",	SAM_OP_TYPE_INT,   sam_op_storeoff	},
-    { "ADD",		SAM_OP_TYPE_NONE,  sam_op_add		},
-    { "SUB",		SAM_OP_TYPE_NONE,  sam_op_sub		},
-    { "TIMES",		SAM_OP_TYPE_NONE,  sam_op_times		},
-    { "DIV",		SAM_OP_TYPE_NONE,  sam_op_div		},
-    { "MOD",		SAM_OP_TYPE_NONE,  sam_op_mod		},
-    { "ADDF",		SAM_OP_TYPE_NONE,  sam_op_addf		},
-    { "SUBF",		SAM_OP_TYPE_NONE,  sam_op_subf		},
-    { "TIMESF",		SAM_OP_TYPE_NONE,  sam_op_timesf	},
-    { "DIVF",		SAM_OP_TYPE_NONE,  sam_op_divf		},
-    { "LSHIFT",		SAM_OP_TYPE_INT,   sam_op_lshift	},
-    { "LSHIFTIND",	SAM_OP_TYPE_NONE,  sam_op_lshiftind	},
-    { "RSHIFT",		SAM_OP_TYPE_INT,   sam_op_rshift	},
-    { "RSHIFTIND",	SAM_OP_TYPE_NONE,  sam_op_rshiftind	},
-#if defined(SAM_EXTENSIONS)
-    { "LRSHIFT",	SAM_OP_TYPE_INT,   sam_op_lrshift	},
-    { "LRSHIFTIND",	SAM_OP_TYPE_NONE,  sam_op_lrshiftind	},
-#endif
-    { "AND",		SAM_OP_TYPE_NONE,  sam_op_and		},
-    { "OR",		SAM_OP_TYPE_NONE,  sam_op_or		},
-    { "NAND",		SAM_OP_TYPE_NONE,  sam_op_nand		},
-    { "NOR",		SAM_OP_TYPE_NONE,  sam_op_nor		},
-    { "XOR",		SAM_OP_TYPE_NONE,  sam_op_xor		},
-    { "NOT",		SAM_OP_TYPE_NONE,  sam_op_not		},
-    { "BITAND",		SAM_OP_TYPE_NONE,  sam_op_bitand	},
-    { "BITOR",		SAM_OP_TYPE_NONE,  sam_op_bitor		},
-    { "BITNAND",	SAM_OP_TYPE_NONE,  sam_op_bitnand	},
-    { "BITNOR",		SAM_OP_TYPE_NONE,  sam_op_bitnor	},
-    { "BITXOR",		SAM_OP_TYPE_NONE,  sam_op_bitxor	},
-    { "BITNOT",		SAM_OP_TYPE_NONE,  sam_op_bitnot	},
-    { "CMP",		SAM_OP_TYPE_NONE,  sam_op_cmp		},
-    { "CMPF",		SAM_OP_TYPE_NONE,  sam_op_cmpf		},
-    { "GREATER",	SAM_OP_TYPE_NONE,  sam_op_greater	},
-    { "LESS",		SAM_OP_TYPE_NONE,  sam_op_less		},
-    { "EQUAL",		SAM_OP_TYPE_NONE,  sam_op_equal		},
-    { "ISNIL",		SAM_OP_TYPE_NONE,  sam_op_isnil		},
-    { "ISPOS",		SAM_OP_TYPE_NONE,  sam_op_ispos		},
-    { "ISNEG",		SAM_OP_TYPE_NONE,  sam_op_isneg		},
-    { "JUMP",		SAM_OP_TYPE_LABEL |
-			SAM_OP_TYPE_INT,   sam_op_jump		},
-    { "JUMPC",		SAM_OP_TYPE_LABEL |
-			SAM_OP_TYPE_INT,   sam_op_jumpc		},
-    { "JUMPIND",	SAM_OP_TYPE_NONE,  sam_op_jumpind	},
-    { "RST",		SAM_OP_TYPE_NONE,  sam_op_rst		},
-    { "JSR",		SAM_OP_TYPE_LABEL |
-			SAM_OP_TYPE_INT,   sam_op_jsr		},
-    { "JSRIND",		SAM_OP_TYPE_NONE,  sam_op_jsrind	},
-    { "SKIP",		SAM_OP_TYPE_NONE,  sam_op_skip		},
-    { "LINK",		SAM_OP_TYPE_NONE,  sam_op_link		},
-    { "UNLINK",		SAM_OP_TYPE_NONE,  sam_op_unlink	},
-    { "READ",		SAM_OP_TYPE_NONE,  sam_op_read		},
-    { "READF",		SAM_OP_TYPE_NONE,  sam_op_readf		},
-    { "READCH",		SAM_OP_TYPE_NONE,  sam_op_readch	},
-    { "READSTR",	SAM_OP_TYPE_NONE,  sam_op_readstr	},
-    { "WRITE",		SAM_OP_TYPE_NONE,  sam_op_write		},
-    { "WRITEF",		SAM_OP_TYPE_NONE,  sam_op_writef	},
-    { "WRITECH",	SAM_OP_TYPE_NONE,  sam_op_writech	},
-    { "WRITESTR",	SAM_OP_TYPE_NONE,  sam_op_writestr	},
-    { "STOP",		SAM_OP_TYPE_NONE,  sam_op_stop		},
-#if defined(SAM_EXTENSIONS)
-    { "pushimmha",	SAM_OP_TYPE_LABEL, sam_op_pushimmha	},
-    { "patoi",		SAM_OP_TYPE_NONE,  sam_op_patoi		},
-    { "load",		SAM_OP_TYPE_LABEL, sam_op_load		},
-    { "call",		SAM_OP_TYPE_LABEL, sam_op_call		},
-#endif
-#if 0
-    { "import",		SAM_OP_TYPE_LABEL, sam_op_import	},
-    { "export",		SAM_OP_TYPE_LABEL, sam_op_export	},
-#endif
-    { "",		SAM_OP_TYPE_NONE,  NULL			},
+} sam_quickenings[] = {
+    { SAM_OPCODE_ADD,	  SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	sam_op_add,	sam_op_add_int_int	},
+    { SAM_OPCODE_ADD,	  SAM_ML_TYPE_SA,  SAM_ML_TYPE_INT,
+	sam_op_add,	sam_op_add_sa_int	},
+    { SAM_OPCODE_ADD,	  SAM_ML_TYPE_HA,  SAM_ML_TYPE_INT,
+	sam_op_add,	sam_op_add_ha_int	},
+    { SAM_OPCODE_ADD,	  SAM_ML_TYPE_PA,  SAM_ML_TYPE_INT,
+	sam_op_add,	sam_op_add_pa_int	},
+    { SAM_OPCODE_SUB,	  SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	sam_op_sub,	sam_op_sub_int_int	},
+    { SAM_OPCODE_SUB,	  SAM_ML_TYPE_SA,  SAM_ML_TYPE_INT,
+	sam_op_sub,	sam_op_sub_sa_int	},
+    { SAM_OPCODE_SUB,	  SAM_ML_TYPE_SA,  SAM_ML_TYPE_SA,
+	sam_op_sub,	sam_op_sub_sa_sa	},
+    { SAM_OPCODE_SUB,	  SAM_ML_TYPE_HA,  SAM_ML_TYPE_INT,
+	sam_op_sub,	sam_op_sub_ha_int	},
+    { SAM_OPCODE_CMP,	  SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	sam_op_cmp,	sam_op_cmp_int_int	},
+    { SAM_OPCODE_LESS,	  SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	sam_op_less,	sam_op_less_int_int	},
+    { SAM_OPCODE_GREATER, SAM_ML_TYPE_INT, SAM_ML_TYPE_INT,
+	sam_op_greater,	sam_op_greater_int_int	},
+};
+
+/* Give the current instruction the handler specialised for operands
+ * of types t1 and t2, or its generic handler if there is none. */
+static void
+sam_quicken(/*@in@*/ sam_es *restrict es,
+	    sam_ml_type t1,
+	    sam_ml_type t2)
+{
+    sam_program *restrict program = &SAM_MODULE_CUR->program;
+    sam_handler *restrict cur = &program->handlers[es->pc.l];
+    sam_handler handler = NULL;
+    bool ours = false;
+
+    for (size_t q = 0;
+	 q < sizeof sam_quickenings / sizeof sam_quickenings[0];
+	 ++q) {
+	if (sam_quickenings[q].opcode != program->opcodes[es->pc.l]) {
+	    continue;
+	}
+	if (*cur == sam_quickenings[q].generic ||
+	    *cur == sam_quickenings[q].handler) {
+	    ours = true;
+	}
+	if (handler == NULL) {
+	    handler = sam_quickenings[q].generic;
+	}
+	if (sam_quickenings[q].t1 == t1 && sam_quickenings[q].t2 == t2) {
+	    handler = sam_quickenings[q].handler;
+	}
+    }
+    if (ours) {
+	*cur = handler;
+    }
+}
+
+/* Unchecked handlers. sam_verify() installs these on the instructions
+ * it has shown will always find the stack deep enough, their operands
+ * of the right types and their own operand of the right kind, so they
+ * skip all three checks. Like the quickened handlers, they run the
+ * generic handler instead while changes are being tracked. */
+
+static sam_error
+sam_op_pushimm_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    return sam_push(es, (sam_ml_value){
+			.i = sam_es_operand_cur(es)->i
+		    }, SAM_ML_TYPE_INT);
+}
+
+static sam_error
+sam_op_pushimmf_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    return sam_push(es, (sam_ml_value){
+			.f = sam_es_operand_cur(es)->f
+		    }, SAM_ML_TYPE_FLOAT);
+}
+
+static sam_error
+sam_op_dup_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml m = es->stack.arr[es->stack.len - 1];
+
+    return sam_es_stack_push(es, m)? SAM_OK: sam_error_stack_overflow(es);
+}
+
+static sam_error
+sam_op_swap_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml *restrict top = &es->stack.arr[es->stack.len - 1];
+    sam_ml m;
+
+    if (sam_es_changes_tracked(es)) {
+	return sam_op_swap(es);
+    }
+    m = top[0];
+    top[0] = top[-1];
+    top[-1] = m;
+
+    return SAM_OK;
+}
+
+static sam_error
+sam_op_addsp_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    return sam_es_stack_resize(es, es->stack.len +
+				   sam_es_operand_cur(es)->i)?
+	SAM_OK: sam_error_stack_overflow(es);
+}
+
+static sam_error
+sam_op_pushoff_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml m = es->stack.arr[es->fbr +
+			     sam_es_operand_cur(es)->i];
+
+    return sam_es_stack_push(es, m)? SAM_OK: sam_error_stack_overflow(es);
+}
+
+static sam_error
+sam_op_storeoff_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    if (sam_es_changes_tracked(es)) {
+	return sam_op_storeoff(es);
+    }
+    --es->stack.len;
+    es->stack.arr[es->fbr + sam_es_operand_cur(es)->i] =
+	es->stack.arr[es->stack.len];
+
+    return SAM_OK;
+}
+
+static sam_error
+sam_op_popfbr_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    if (sam_es_changes_tracked(es)) {
+	return sam_op_popfbr(es);
+    }
+    es->fbr = SAM_ML_SA(es->stack.arr[--es->stack.len]);
+
+    return SAM_OK;
+}
+
+static sam_error
+sam_op_jumpc_unchecked(/*@in@*/ sam_es *restrict es)
+{
+    if (sam_es_changes_tracked(es)) {
+	return sam_op_jumpc(es);
+    }
+
+    return SAM_ML_I(es->stack.arr[--es->stack.len]) == 0?
+	SAM_OK: sam_op_jump(es);
+}
+
+/* Define a handler, name, for the instruction handled by generic,
+ * which replaces the integer a on top of the stack with expr. */
+#define SAM_UNCHECKED_UNARY(name, generic, expr)			\
+    static sam_error							\
+    name(/*@in@*/ sam_es *restrict es)					\
+    {									\
+	sam_ml *restrict top;						\
+	sam_int a;							\
+									\
+	if (sam_es_changes_tracked(es)) {				\
+	    return generic(es);						\
+	}								\
+	top = &es->stack.arr[es->stack.len - 1];			\
+	a = SAM_ML_I(*top);						\
+	SAM_ML_REPLACE_I(*top, expr);					\
+									\
+	return SAM_OK;							\
+    }
+
+/* Define a handler, name, for the instruction handled by generic,
+ * which replaces the integers a and b on top of the stack with
+ * expr. */
+#define SAM_UNCHECKED_BINARY(name, generic, expr)			\
+    static sam_error							\
+    name(/*@in@*/ sam_es *restrict es)					\
+    {									\
+	sam_ml *restrict top;						\
+	sam_int a, b;							\
+									\
+	if (sam_es_changes_tracked(es)) {				\
+	    return generic(es);						\
+	}								\
+	b = SAM_ML_I(es->stack.arr[--es->stack.len]);			\
+	top = &es->stack.arr[es->stack.len - 1];			\
+	a = SAM_ML_I(*top);						\
+	SAM_ML_REPLACE_I(*top, expr);					\
+									\
+	return SAM_OK;							\
+    }
+
+SAM_UNCHECKED_UNARY(sam_op_not_unchecked, sam_op_not, !a)
+SAM_UNCHECKED_UNARY(sam_op_isnil_unchecked, sam_op_isnil, !a)
+SAM_UNCHECKED_UNARY(sam_op_ispos_unchecked, sam_op_ispos, a > 0)
+SAM_UNCHECKED_UNARY(sam_op_isneg_unchecked, sam_op_isneg, a < 0)
+SAM_UNCHECKED_UNARY(sam_op_bitnot_unchecked, sam_op_bitnot, ~a)
+SAM_UNCHECKED_BINARY(sam_op_add_unchecked, sam_op_add, a + b)
+SAM_UNCHECKED_BINARY(sam_op_sub_unchecked, sam_op_sub, a - b)
+SAM_UNCHECKED_BINARY(sam_op_times_unchecked, sam_op_times, a * b)
+SAM_UNCHECKED_BINARY(sam_op_and_unchecked, sam_op_and, a && b)
+SAM_UNCHECKED_BINARY(sam_op_or_unchecked, sam_op_or, a || b)
+SAM_UNCHECKED_BINARY(sam_op_bitand_unchecked, sam_op_bitand, a & b)
+SAM_UNCHECKED_BINARY(sam_op_bitor_unchecked, sam_op_bitor, a | b)
+SAM_UNCHECKED_BINARY(sam_op_bitxor_unchecked, sam_op_bitxor, a ^ b)
+SAM_UNCHECKED_BINARY(sam_op_cmp_unchecked, sam_op_cmp,
+		     a < b? -1: a == b? 0: 1)
+SAM_UNCHECKED_BINARY(sam_op_greater_unchecked, sam_op_greater, a > b)
+SAM_UNCHECKED_BINARY(sam_op_less_unchecked, sam_op_less, a < b)
+
+#undef SAM_UNCHECKED_UNARY
+#undef SAM_UNCHECKED_BINARY
+
+/* The unchecked handler of each opcode which has one. */
+static const struct {
+    sam_opcode opcode;
+    sam_handler generic;
+    sam_handler handler;
+} sam_uncheckeds[] = {
+    { SAM_OPCODE_PUSHIMM,  sam_op_pushimm,  sam_op_pushimm_unchecked  },
+    { SAM_OPCODE_PUSHIMMF, sam_op_pushimmf, sam_op_pushimmf_unchecked },
+    { SAM_OPCODE_DUP,	   sam_op_dup,	    sam_op_dup_unchecked      },
+    { SAM_OPCODE_SWAP,	   sam_op_swap,	    sam_op_swap_unchecked     },
+    { SAM_OPCODE_ADDSP,	   sam_op_addsp,    sam_op_addsp_unchecked    },
+    { SAM_OPCODE_PUSHOFF,  sam_op_pushoff,  sam_op_pushoff_unchecked  },
+    { SAM_OPCODE_STOREOFF, sam_op_storeoff, sam_op_storeoff_unchecked },
+    { SAM_OPCODE_POPFBR,   sam_op_popfbr,   sam_op_popfbr_unchecked   },
+    { SAM_OPCODE_UNLINK,   sam_op_unlink,   sam_op_popfbr_unchecked   },
+    { SAM_OPCODE_JUMPC,	   sam_op_jumpc,    sam_op_jumpc_unchecked    },
+    { SAM_OPCODE_NOT,	   sam_op_not,	    sam_op_not_unchecked      },
+    { SAM_OPCODE_ISNIL,	   sam_op_isnil,    sam_op_isnil_unchecked    },
+    { SAM_OPCODE_ISPOS,	   sam_op_ispos,    sam_op_ispos_unchecked    },
+    { SAM_OPCODE_ISNEG,	   sam_op_isneg,    sam_op_isneg_unchecked    },
+    { SAM_OPCODE_BITNOT,   sam_op_bitnot,   sam_op_bitnot_unchecked   },
+    { SAM_OPCODE_ADD,	   sam_op_add,	    sam_op_add_unchecked      },
+    { SAM_OPCODE_SUB,	   sam_op_sub,	    sam_op_sub_unchecked      },
+    { SAM_OPCODE_TIMES,	   sam_op_times,    sam_op_times_unchecked    },
+    { SAM_OPCODE_AND,	   sam_op_and,	    sam_op_and_unchecked      },
+    { SAM_OPCODE_OR,	   sam_op_or,	    sam_op_or_unchecked	      },
+    { SAM_OPCODE_BITAND,   sam_op_bitand,   sam_op_bitand_unchecked   },
+    { SAM_OPCODE_BITOR,	   sam_op_bitor,    sam_op_bitor_unchecked    },
+    { SAM_OPCODE_BITXOR,   sam_op_bitxor,   sam_op_bitxor_unchecked   },
+    { SAM_OPCODE_CMP,	   sam_op_cmp,	    sam_op_cmp_unchecked      },
+    { SAM_OPCODE_GREATER,  sam_op_greater,  sam_op_greater_unchecked  },
+    { SAM_OPCODE_LESS,	   sam_op_less,	    sam_op_less_unchecked     },
+};
+
+bool
+sam_opcode_uncheck(sam_instruction *restrict i)
+{
+    for (size_t u = 0;
+	 u < sizeof sam_uncheckeds / sizeof sam_uncheckeds[0];
+	 ++u) {
+	if (sam_uncheckeds[u].opcode == i->opcode &&
+	    sam_uncheckeds[u].generic == i->handler) {
+	    i->handler = sam_uncheckeds[u].handler;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/* Superinstructions. The head of a fused group gets one of these
+ * handlers in place of its own, and the rest of the group is left
+ * untouched, so jumps into the middle of a group and backtraces behave
+ * exactly as they did before fusion. Each fused handler leaves the pc
+ * on the last instruction it executed. When its fast path doesn't
+ * apply, it runs the group one instruction at a time instead. */
+
+/* Run n instructions starting at the current one, the first through
+ * head, as the call loop would have. */
+static sam_error
+sam_fused_each(/*@in@*/ sam_es *restrict es,
+	       sam_handler head,
+	       size_t n)
+{
+    sam_error err = head(es);
+
+    for (size_t k = 1; err == SAM_OK && k < n; ++k) {
+	sam_es_pc_pp(es);
+	err = sam_es_handler_cur(es)(es);
+    }
+
+    return err;
+}
+
+/* The operand of the instruction k after the current one, which
+ * sam_opcode_fuse() made sure is there. */
+static inline sam_op_value *
+sam_fused_member(/*@in@*/ sam_es *restrict es,
+		 unsigned short k)
+{
+    return &SAM_MODULE_CUR->program.operands[es->pc.l + k];
+}
+
+/* Skip the pc forward over k instructions. */
+static inline void
+sam_fused_skip(/*@in@*/ sam_es *restrict es,
+	       unsigned short k)
+{
+    sam_es_pc_set(es, (sam_pa){
+		      .m = sam_es_pc_get(es).m,
+		      .l = sam_es_pc_get(es).l + k
+		  });
+}
+
+/* The integer in the frame at the operand of a PUSHOFF, if there is
+ * one. */
+/*@null@*/ static inline sam_ml *
+sam_fused_local(/*@in@*/ sam_es *restrict es,
+		const sam_op_value *restrict operand)
+{
+    sam_ml *restrict m = sam_es_stack_get(es, sam_es_fbr_get(es) +
+					  operand->i);
+
+    return m != NULL && SAM_ML_TYPE(*m) == SAM_ML_TYPE_INT? m: NULL;
+}
+
+/* PUSHOFF a / PUSHOFF b / ADD */
+static sam_error
+sam_op_pushoff_pushoff_add(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml *a = sam_fused_local(es, sam_es_operand_cur(es));
+    sam_ml *b = sam_fused_local(es, sam_fused_member(es, 1));
+
+    if (a == NULL || b == NULL ||
+	!sam_es_stack_push(es, SAM_ML_OF_I(SAM_ML_I(*a) + SAM_ML_I(*b)))) {
+	return sam_fused_each(es, sam_op_pushoff, 3);
+    }
+    sam_fused_skip(es, 2);
+
+    return SAM_OK;
+}
+
+/* PUSHOFF a / PUSHIMM k / ADD or SUB */
+static sam_error
+sam_op_pushoff_pushimm_add(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml *a = sam_fused_local(es, sam_es_operand_cur(es));
+    sam_op_value *restrict k = sam_fused_member(es, 1);
+    int sign = SAM_MODULE_CUR->program.opcodes[es->pc.l + 2] ==
+	SAM_OPCODE_SUB? -1: 1;
+
+    if (a == NULL ||
+	!sam_es_stack_push(es, SAM_ML_OF_I(SAM_ML_I(*a) + sign * k->i))) {
+	return sam_fused_each(es, sam_op_pushoff, 3);
+    }
+    sam_fused_skip(es, 2);
+
+    return SAM_OK;
+}
+
+/* PUSHIMM k / ADD */
+static sam_error
+sam_op_pushimm_add(/*@in@*/ sam_es *restrict es)
+{
+    sam_op_value *restrict k = sam_es_operand_cur(es);
+    sam_ml m;
+
+    if (!sam_es_stack_peek(es, &m) || SAM_ML_TYPE(m) != SAM_ML_TYPE_INT) {
+	return sam_fused_each(es, sam_op_pushimm, 2);
+    }
+    SAM_ML_REPLACE_I(m, SAM_ML_I(m) + k->i);
+    sam_es_stack_set(es, m, sam_es_stack_len(es) - 1);
+    sam_fused_skip(es, 1);
+
+    return SAM_OK;
+}
+
+/* PUSHIMM a / PUSHIMM b / ... up to the next instruction which isn't
+ * an unfused PUSHIMM. */
+static sam_error
+sam_op_pushimm_run(/*@in@*/ sam_es *restrict es)
+{
+    const sam_program *restrict program = &SAM_MODULE_CUR->program;
+    sam_handler next;
+    sam_error err;
+
+    for (;;) {
+	if ((err = sam_op_pushimm(es)) != SAM_OK) {
+	    return err;
+	}
+	if (es->pc.l + 1 >= program->len) {
+	    return SAM_OK;
+	}
+	next = program->handlers[es->pc.l + 1];
+	if (next != sam_op_pushimm && next != sam_op_pushimm_unchecked) {
+	    return SAM_OK;
+	}
+	sam_es_pc_pp(es);
+    }
+}
+
+/* LINK / JSR f */
+static sam_error
+sam_op_link_jsr(/*@in@*/ sam_es *restrict es)
+{
+    sam_error err;
+
+    if ((err = sam_op_link(es)) != SAM_OK) {
+	return err;
+    }
+    sam_es_pc_pp(es);
+
+    return sam_es_handler_cur(es)(es);
+}
+
+/* CMP / ISNIL / JUMPC l, or jump if equal */
+static sam_error
+sam_op_cmp_isnil_jumpc(/*@in@*/ sam_es *restrict es)
+{
+    sam_ml *a = sam_es_stack_get(es, sam_es_stack_len(es) - 2);
+    sam_ml *b = sam_es_stack_get(es, sam_es_stack_len(es) - 1);
+
+    if (sam_es_stack_len(es) < 2 ||
+	SAM_ML_TYPE(*a) != SAM_ML_TYPE_INT ||
+	SAM_ML_TYPE(*b) != SAM_ML_TYPE_INT) {
+	return sam_fused_each(es, sam_op_cmp, 3);
+    }
+
+    bool equal = SAM_ML_I(*a) == SAM_ML_I(*b);
+
+    sam_es_stack_resize(es, sam_es_stack_len(es) - 2);
+    sam_fused_skip(es, 2);
+
+    if (!equal) {
+	return SAM_OK;
+    }
+
+    return sam_op_jump(es);
+}
+
+/* The sequences fused by sam_opcode_fuse(), tried in order at each
+ * instruction. */
+static const struct {
+    sam_opcode opcodes[3];
+    size_t len;
+    bool run;		    /**< Do further repeats of the last opcode
+			     *   join the group? */
+    sam_handler handler;
+} sam_fusions[] = {
+    {{SAM_OPCODE_PUSHOFF, SAM_OPCODE_PUSHOFF, SAM_OPCODE_ADD},
+	3, false, sam_op_pushoff_pushoff_add},
+    {{SAM_OPCODE_PUSHOFF, SAM_OPCODE_PUSHIMM, SAM_OPCODE_ADD},
+	3, false, sam_op_pushoff_pushimm_add},
+    {{SAM_OPCODE_PUSHOFF, SAM_OPCODE_PUSHIMM, SAM_OPCODE_SUB},
+	3, false, sam_op_pushoff_pushimm_add},
+    {{SAM_OPCODE_CMP, SAM_OPCODE_ISNIL, SAM_OPCODE_JUMPC},
+	3, false, sam_op_cmp_isnil_jumpc},
+    {{SAM_OPCODE_PUSHIMM, SAM_OPCODE_ADD},
+	2, false, sam_op_pushimm_add},
+    {{SAM_OPCODE_LINK, SAM_OPCODE_JSR},
+	2, false, sam_op_link_jsr},
+    {{SAM_OPCODE_PUSHIMM, SAM_OPCODE_PUSHIMM},
+	2, true,  sam_op_pushimm_run},
 };
 
-sam_instruction *
-sam_opcode_get(/*@in@*/ /*@dependent@*/ const char *name)
+size_t
+sam_opcode_fuse(const unsigned char *restrict opcodes,
+		sam_handler *restrict handlers,
+		size_t len)
+{
+    size_t fused = 0;
+
+    for (size_t l = 0; l < len; ++l) {
+	for (size_t f = 0;
+	     f < sizeof sam_fusions / sizeof sam_fusions[0];
+	     ++f) {
+	    size_t k = 0;
+
+	    while (k < sam_fusions[f].len && l + k < len &&
+		   opcodes[l + k] == sam_fusions[f].opcodes[k] &&
+		   handlers[l + k] != sam_op_optype) {
+		++k;
+	    }
+	    if (k == sam_fusions[f].len) {
+		if (sam_fusions[f].run) {
+		    while (l + k < len &&
+			   opcodes[l + k] == sam_fusions[f].opcodes[k - 1] &&
+			   handlers[l + k] != sam_op_optype) {
+			++k;
+		    }
+		}
+		handlers[l] = sam_fusions[f].handler;
+		l += k - 1;
+		++fused;
+		break;
+	    }
+	}
+    }
+
+    return fused;
+}
+
+void
+sam_opcode_bind(sam_instruction *restrict i)
+{
+    sam_op_type accepted = sam_opcodes[i->opcode].optype;
+    sam_handler label = sam_opcodes[i->opcode].label_handler;
+
+    if (label != NULL) {
+	if (i->optype == SAM_OP_TYPE_LABEL) {
+	    i->handler = label;
+	    return;
+	}
+	accepted &= ~SAM_OP_TYPE_LABEL;
+    }
+    /* before its operand is parsed, an instruction has every type its
+     * opcode accepts */
+    if (i->optype == sam_opcodes[i->opcode].optype) {
+	i->handler = sam_opcodes[i->opcode].handler != NULL?
+	    sam_opcodes[i->opcode].handler: label;
+    } else if (sam_opcodes[i->opcode].handler != NULL &&
+	       (i->optype & (i->optype - 1)) == 0 &&
+	       (i->optype & accepted) != 0) {
+	i->handler = sam_opcodes[i->opcode].handler;
+    } else {
+	i->handler = sam_op_optype;
+    }
+}
+
+bool
+sam_opcode_get(/*@in@*/ const char *restrict name,
+	       /*@out@*/ sam_instruction *restrict i)
 {
-    for (size_t j = 0; sam_opcodes[j].handler != NULL; ++j) {
-	if (strcmp(name, sam_opcodes[j].name) == 0) {
-	    sam_instruction *restrict i = sam_malloc(sizeof (sam_instruction));
-	    i->name = name;
+    for (size_t j = 0; j < SAM_OPCODE_COUNT; ++j) {
+	if (sam_opcodes[j].name != NULL &&
+	    strcmp(name, sam_opcodes[j].name) == 0) {
+	    i->opcode = j;
 	    i->optype = sam_opcodes[j].optype;
-	    i->handler = sam_opcodes[j].handler;
 	    i->operand.i = 0;
-	    return i;
+	    i->label = NULL;
+	    sam_opcode_bind(i);
+	    return true;
 	}
     }
-    return NULL;
+    return false;
+}
+
+const char *
+sam_opcode_name(sam_opcode opcode)
+{
+    return sam_opcodes[opcode].name;
 }
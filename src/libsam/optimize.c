@@ -0,0 +1,612 @@
+/*
+ * optimize.c    simplify a module before it is run
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The optimizer rewrites the instructions of a freshly parsed module
+ * before fusion, verification or any engine sees them. It repeats
+ * three passes until none of them finds anything more to do:
+ *
+ *  - peephole rewrites inside basic blocks: constant folding of
+ *    integer arithmetic, comparisons and conditional jumps, and the
+ *    removal of instructions which can't have any effect, such as
+ *    adding zero to an integer or pushing a value only to pop it;
+ *  - jump threading, which points jumps to a JUMP at its target;
+ *  - the removal of instructions which can't be reached from the
+ *    start of the program, a return address or a PUSHIMMPA.
+ *
+ * Nothing is rewritten if it could change what the program does,
+ * including the errors it stops with; a division by zero is left to
+ * fail when it runs. Removed instructions are then squeezed out, and
+ * every program address in the module (jump and PUSHIMMPA operands,
+ * labels) is renumbered to match. Program addresses which a program
+ * makes by adding to a PUSHIMMPA can't be seen, so -O should not be
+ * used on such programs.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "optimize.h"
+
+/* Give up on a module which is still changing after this many
+ * rounds. */
+#define SAM_OPTIMIZE_ROUNDS_MAX 16
+
+/* How many jumps to a jump are followed before giving up on a loop. */
+#define SAM_OPTIMIZE_THREAD_MAX 64
+
+typedef struct {
+    sam_instruction *instructions; /**< Unpacked from the module, and
+				    *   packed back by
+				    *   sam_optimize_compact(). */
+    size_t len;
+    unsigned short m;
+    bool *removed;	    /**< Is each instruction to be removed? */
+    bool *target;	    /**< Might control reach each instruction
+			     *   other than from the one before it? */
+    bool *reached;
+    size_t *work;
+} sam_optimizer;
+
+/* Is an instruction a jump to a constant address in this module? */
+static inline bool
+sam_optimize_jump_local(const sam_optimizer *restrict o,
+			const sam_instruction *restrict i,
+			/*@out@*/ size_t *restrict l)
+{
+    return sam_es_instruction_target(i, o->m, l);
+}
+
+/* Mark the instructions which can be entered by a jump or a return.
+ * Labels nothing refers to don't count. */
+static void
+sam_optimize_targets(sam_optimizer *restrict o)
+{
+    memset(o->target, 0, o->len * sizeof (bool));
+    for (size_t l = 0; l < o->len; ++l) {
+	const sam_instruction *restrict i = &o->instructions[l];
+	size_t t;
+
+	if (o->removed[l]) {
+	    continue;
+	}
+	if (sam_optimize_jump_local(o, i, &t) && t < o->len) {
+	    o->target[t] = true;
+	}
+	if ((i->opcode == SAM_OPCODE_JSR || i->opcode == SAM_OPCODE_JSRIND) &&
+	    l + 1 < o->len) {
+	    o->target[l + 1] = true;
+	}
+    }
+}
+
+/* The value pushed by a PUSHIMM or PUSHIMMCH. */
+static bool
+sam_optimize_constant(const sam_instruction *restrict i,
+		      /*@out@*/ sam_int *restrict value)
+{
+    if (i->opcode == SAM_OPCODE_PUSHIMM && i->optype == SAM_OP_TYPE_INT) {
+	*value = i->operand.i;
+	return true;
+    }
+    if (i->opcode == SAM_OPCODE_PUSHIMMCH && i->optype == SAM_OP_TYPE_CHAR) {
+	*value = i->operand.c;
+	return true;
+    }
+
+    return false;
+}
+
+/* Does an instruction always push an integer, if it succeeds? */
+static bool
+sam_optimize_pushes_int(const sam_instruction *restrict i)
+{
+    sam_int value;
+
+    switch (i->opcode) {
+	case SAM_OPCODE_TIMES:
+	case SAM_OPCODE_DIV:
+	case SAM_OPCODE_MOD:
+	case SAM_OPCODE_AND:
+	case SAM_OPCODE_OR:
+	case SAM_OPCODE_NAND:
+	case SAM_OPCODE_NOR:
+	case SAM_OPCODE_XOR:
+	case SAM_OPCODE_NOT:
+	case SAM_OPCODE_BITAND:
+	case SAM_OPCODE_BITOR:
+	case SAM_OPCODE_BITNAND:
+	case SAM_OPCODE_BITNOR:
+	case SAM_OPCODE_BITXOR:
+	case SAM_OPCODE_BITNOT:
+	case SAM_OPCODE_CMP:
+	case SAM_OPCODE_CMPF:
+	case SAM_OPCODE_GREATER:
+	case SAM_OPCODE_LESS:
+	case SAM_OPCODE_EQUAL:
+	case SAM_OPCODE_ISNIL:
+	case SAM_OPCODE_ISPOS:
+	case SAM_OPCODE_ISNEG:
+	case SAM_OPCODE_FTOI:
+	case SAM_OPCODE_FTOIR:
+	case SAM_OPCODE_PATOI:
+	    return true;
+	default:
+	    return sam_optimize_constant(i, &value);
+    }
+}
+
+/* Does an instruction only push, and can't fail but by overflowing
+ * the stack? */
+static bool
+sam_optimize_pushes_only(const sam_instruction *restrict i)
+{
+    switch (i->opcode) {
+	case SAM_OPCODE_PUSHIMM:
+	    return i->optype == SAM_OP_TYPE_INT;
+	case SAM_OPCODE_PUSHIMMF:
+	    return i->optype == SAM_OP_TYPE_FLOAT;
+	case SAM_OPCODE_PUSHIMMCH:
+	    return i->optype == SAM_OP_TYPE_CHAR;
+	case SAM_OPCODE_PUSHSP:
+	case SAM_OPCODE_PUSHFBR:
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+/* Work out a unary operation on a constant as its handler would. */
+static bool
+sam_optimize_fold_unary(sam_opcode opcode,
+			sam_int a,
+			/*@out@*/ sam_int *restrict r)
+{
+    switch (opcode) {
+	case SAM_OPCODE_NOT:
+	case SAM_OPCODE_ISNIL:
+	    *r = !a;
+	    return true;
+	case SAM_OPCODE_BITNOT:
+	    *r = ~a;
+	    return true;
+	case SAM_OPCODE_ISPOS:
+	    *r = a > 0;
+	    return true;
+	case SAM_OPCODE_ISNEG:
+	    *r = a < 0;
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+/* Work out a binary operation on two constants as its handler would,
+ * unless it would fail. */
+static bool
+sam_optimize_fold_binary(sam_opcode opcode,
+			 sam_int a,
+			 sam_int b,
+			 /*@out@*/ sam_int *restrict r)
+{
+    switch (opcode) {
+	case SAM_OPCODE_ADD:
+	    *r = (sam_unsigned_int)a + (sam_unsigned_int)b;
+	    return true;
+	case SAM_OPCODE_SUB:
+	    *r = (sam_unsigned_int)a - (sam_unsigned_int)b;
+	    return true;
+	case SAM_OPCODE_TIMES:
+	    *r = (sam_unsigned_int)a * (sam_unsigned_int)b;
+	    return true;
+	case SAM_OPCODE_DIV:
+	case SAM_OPCODE_MOD:
+	    if (b == 0 || (b == -1 && a == LONG_MIN)) {
+		return false;
+	    }
+	    *r = opcode == SAM_OPCODE_DIV? a / b: a % b;
+	    return true;
+	case SAM_OPCODE_AND:
+	    *r = a && b;
+	    return true;
+	case SAM_OPCODE_OR:
+	    *r = a || b;
+	    return true;
+	case SAM_OPCODE_NAND:
+	    *r = !(a && b);
+	    return true;
+	case SAM_OPCODE_NOR:
+	    *r = !(a || b);
+	    return true;
+	case SAM_OPCODE_XOR:
+	    *r = !a ^ !b;
+	    return true;
+	case SAM_OPCODE_BITAND:
+	    *r = a & b;
+	    return true;
+	case SAM_OPCODE_BITOR:
+	    *r = a | b;
+	    return true;
+	case SAM_OPCODE_BITNAND:
+	    *r = ~(a & b);
+	    return true;
+	case SAM_OPCODE_BITNOR:
+	    *r = ~(a | b);
+	    return true;
+	case SAM_OPCODE_BITXOR:
+	    *r = a ^ b;
+	    return true;
+	case SAM_OPCODE_CMP:
+	    *r = a < b? -1: a == b? 0: 1;
+	    return true;
+	case SAM_OPCODE_GREATER:
+	    *r = a > b;
+	    return true;
+	case SAM_OPCODE_LESS:
+	    *r = a < b;
+	    return true;
+	case SAM_OPCODE_EQUAL:
+	    *r = a == b;
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+/* Replace the instruction at l with a new one with the opcode named
+ * and the operand of the old one. */
+static void
+sam_optimize_replace(sam_optimizer *restrict o,
+		     size_t l,
+		     const char *restrict name)
+{
+    sam_instruction i;
+
+    sam_opcode_get(name, &i);
+    i.optype = o->instructions[l].optype;
+    i.operand = o->instructions[l].operand;
+    i.label = o->instructions[l].label;
+    sam_opcode_bind(&i);
+    o->instructions[l] = i;
+}
+
+/* Make the instruction at l push a constant integer. */
+static void
+sam_optimize_set_constant(sam_optimizer *restrict o,
+			  size_t l,
+			  sam_int value)
+{
+    if (o->instructions[l].opcode != SAM_OPCODE_PUSHIMM) {
+	sam_optimize_replace(o, l, "PUSHIMM");
+	o->instructions[l].optype = SAM_OP_TYPE_INT;
+	o->instructions[l].label = NULL;
+	sam_opcode_bind(&o->instructions[l]);
+    }
+    o->instructions[l].operand.i = value;
+}
+
+/* Rewrite what can be rewritten in the sequence starting at l, and
+ * say whether anything was. */
+static bool
+sam_optimize_peephole(sam_optimizer *restrict o,
+		      size_t l)
+{
+    sam_instruction *restrict i = &o->instructions[l];
+    size_t n[3] = {o->len, o->len, o->len};
+    sam_instruction *next[3] = {NULL, NULL, NULL};
+    sam_int a, b, r;
+    size_t t;
+
+    /* the following instructions, if they can only be reached from
+     * this one; a removed instruction which could be jumped to now
+     * stands for the one after it */
+    for (size_t k = 0, p = l + 1; k < 3; ++k, ++p) {
+	while (p < o->len && o->removed[p] && !o->target[p]) {
+	    ++p;
+	}
+	if (p >= o->len || o->target[p]) {
+	    break;
+	}
+	n[k] = p;
+	next[k] = &o->instructions[p];
+    }
+
+    if (i->opcode == SAM_OPCODE_ADDSP && i->optype == SAM_OP_TYPE_INT &&
+	i->operand.i == 0) {
+	o->removed[l] = true;
+	return true;
+    }
+    if (i->opcode == SAM_OPCODE_JUMP && sam_optimize_jump_local(o, i, &t) &&
+	t > l) {
+	/* a jump over nothing */
+	size_t p = l + 1;
+
+	while (p < t && p < o->len && o->removed[p]) {
+	    ++p;
+	}
+	if (p == t) {
+	    o->removed[l] = true;
+	    return true;
+	}
+    }
+    if (next[0] == NULL) {
+	return false;
+    }
+
+    /* a push followed by a pop */
+    if (sam_optimize_pushes_only(i) &&
+	next[0]->opcode == SAM_OPCODE_ADDSP &&
+	next[0]->optype == SAM_OP_TYPE_INT && next[0]->operand.i == -1) {
+	o->removed[l] = o->removed[n[0]] = true;
+	return true;
+    }
+    if (i->opcode == SAM_OPCODE_PUSHSP &&
+	next[0]->opcode == SAM_OPCODE_POPSP) {
+	o->removed[l] = o->removed[n[0]] = true;
+	return true;
+    }
+
+    if (!sam_optimize_constant(i, &a)) {
+	/* x + 0, x - 0, x * 1 and x / 1 for an integer x */
+	if (sam_optimize_pushes_int(i) && next[1] != NULL &&
+	    sam_optimize_constant(next[0], &b) &&
+	    (((next[1]->opcode == SAM_OPCODE_ADD ||
+	       next[1]->opcode == SAM_OPCODE_SUB) && b == 0) ||
+	     ((next[1]->opcode == SAM_OPCODE_TIMES ||
+	       next[1]->opcode == SAM_OPCODE_DIV) && b == 1))) {
+	    o->removed[n[0]] = o->removed[n[1]] = true;
+	    return true;
+	}
+	return false;
+    }
+    if (sam_optimize_fold_unary(next[0]->opcode, a, &r)) {
+	sam_optimize_set_constant(o, l, r);
+	o->removed[n[0]] = true;
+	return true;
+    }
+    if (next[0]->opcode == SAM_OPCODE_JUMPC) {
+	if (a == 0) {
+	    o->removed[l] = o->removed[n[0]] = true;
+	} else {
+	    sam_optimize_replace(o, n[0], "JUMP");
+	    o->removed[l] = true;
+	}
+	return true;
+    }
+    if (next[1] != NULL && sam_optimize_constant(next[0], &b) &&
+	sam_optimize_fold_binary(next[1]->opcode, a, b, &r)) {
+	sam_optimize_set_constant(o, l, r);
+	o->removed[n[0]] = o->removed[n[1]] = true;
+	return true;
+    }
+
+    return false;
+}
+
+/* Point a jump whose target is a JUMP at that JUMP's target. */
+static bool
+sam_optimize_thread(sam_optimizer *restrict o,
+		    size_t l)
+{
+    sam_instruction *restrict i = &o->instructions[l];
+    bool changed = false;
+    size_t t;
+
+    if (i->opcode == SAM_OPCODE_PUSHIMMPA) {
+	return false;
+    }
+    for (unsigned k = 0;
+	 k < SAM_OPTIMIZE_THREAD_MAX && sam_optimize_jump_local(o, i, &t) &&
+	 t < o->len && o->instructions[t].opcode == SAM_OPCODE_JUMP &&
+	 &o->instructions[t] != i;
+	 ++k) {
+	const sam_instruction *restrict j = &o->instructions[t];
+	size_t u;
+
+	if (!sam_optimize_jump_local(o, j, &u) || u == t) {
+	    break;
+	}
+	i->optype = j->optype;
+	i->operand = j->operand;
+	i->label = j->label;
+	sam_opcode_bind(i);
+	changed = true;
+    }
+
+    return changed;
+}
+
+/* Remove the instructions which can't be reached, and say whether
+ * there were any. */
+static bool
+sam_optimize_unreachable(sam_optimizer *restrict o)
+{
+    size_t work_len = 0;
+    bool changed = false;
+
+    memset(o->reached, 0, o->len * sizeof (bool));
+#define SAM_OPTIMIZE_REACH(l)					\
+    do {							\
+	size_t sam_r = (l);					\
+	while (sam_r < o->len && o->removed[sam_r]) {		\
+	    ++sam_r;						\
+	}							\
+	if (sam_r < o->len && !o->reached[sam_r]) {		\
+	    o->reached[sam_r] = true;				\
+	    o->work[work_len++] = sam_r;			\
+	}							\
+    } while (0)
+
+    SAM_OPTIMIZE_REACH(0);
+    for (size_t l = 0; l < o->len; ++l) {
+	size_t t;
+
+	/* anything named by a program address may be jumped to */
+	if (!o->removed[l] &&
+	    o->instructions[l].opcode == SAM_OPCODE_PUSHIMMPA &&
+	    sam_optimize_jump_local(o, &o->instructions[l], &t)) {
+	    SAM_OPTIMIZE_REACH(t);
+	}
+    }
+    while (work_len > 0) {
+	size_t l = o->work[--work_len];
+	const sam_instruction *restrict i = &o->instructions[l];
+	size_t t;
+
+	switch (i->opcode) {
+	    case SAM_OPCODE_JUMP:
+		if (sam_optimize_jump_local(o, i, &t)) {
+		    SAM_OPTIMIZE_REACH(t);
+		}
+		break;
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_JSR:
+		if (sam_optimize_jump_local(o, i, &t)) {
+		    SAM_OPTIMIZE_REACH(t);
+		}
+		SAM_OPTIMIZE_REACH(l + 1);
+		break;
+	    case SAM_OPCODE_JUMPIND:
+	    case SAM_OPCODE_RST:
+	    case SAM_OPCODE_STOP:
+		break;
+	    default:
+		SAM_OPTIMIZE_REACH(l + 1);
+		break;
+	}
+    }
+#undef SAM_OPTIMIZE_REACH
+
+    for (size_t l = 0; l < o->len; ++l) {
+	if (!o->removed[l] && !o->reached[l]) {
+	    o->removed[l] = true;
+	    changed = true;
+	}
+    }
+
+    return changed;
+}
+
+/* Pack the instructions back into the module without the removed
+ * ones, and renumber every program address in the module to match. An
+ * address of a removed instruction becomes that of the next one
+ * kept. */
+static void
+sam_optimize_compact(sam_optimizer *restrict o,
+		     sam_es *restrict es,
+		     sam_es_module *restrict module)
+{
+    size_t *restrict map = sam_malloc((o->len + 1) * sizeof (size_t));
+    sam_program kept;
+
+    sam_program_init(&kept, o->len);
+    for (size_t l = 0; l < o->len; ++l) {
+	map[l] = kept.len;
+	if (!o->removed[l]) {
+	    sam_program_ins(&kept, &o->instructions[l]);
+	}
+    }
+    map[o->len] = kept.len;
+    sam_program_free(&module->program);
+    module->program = kept;
+    sam_es_module_renumber(es, o->m, map, o->len, NULL);
+
+    free(map);
+}
+
+size_t
+sam_optimize(sam_es *restrict es,
+	     unsigned short m)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    size_t len = module->program.len;
+    sam_optimizer o = {
+	.instructions = sam_program_unpack(&module->program),
+	.len = len,
+	.m = m,
+	.removed = sam_malloc((len + 1) * sizeof (bool)),
+	.target = sam_malloc((len + 1) * sizeof (bool)),
+	.reached = sam_malloc((len + 1) * sizeof (bool)),
+	.work = sam_malloc((len + 1) * sizeof (size_t)),
+    };
+    size_t removed = 0;
+    bool rewritten = false;
+
+    memset(o.removed, 0, (len + 1) * sizeof (bool));
+    for (unsigned round = 0; round < SAM_OPTIMIZE_ROUNDS_MAX; ++round) {
+	bool changed = false;
+
+	sam_optimize_targets(&o);
+	for (size_t l = 0; l < len; ++l) {
+	    if (!o.removed[l] && sam_optimize_peephole(&o, l)) {
+		changed = true;
+		/* the targets are still right: only instructions
+		 * which can't be jumped to are removed */
+	    }
+	}
+	for (size_t l = 0; l < len; ++l) {
+	    if (!o.removed[l] && sam_optimize_thread(&o, l)) {
+		changed = true;
+	    }
+	}
+	if (sam_optimize_unreachable(&o)) {
+	    changed = true;
+	}
+	if (!changed) {
+	    break;
+	}
+	rewritten = true;
+    }
+
+    for (size_t l = 0; l < len; ++l) {
+	if (o.removed[l]) {
+	    ++removed;
+	}
+    }
+    if (rewritten) {
+	sam_optimize_compact(&o, es, module);
+    }
+
+    free(o.instructions);
+    free(o.removed);
+    free(o.target);
+    free(o.reached);
+    free(o.work);
+
+    return removed;
+}
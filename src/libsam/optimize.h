@@ -0,0 +1,48 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_OPTIMIZE_H
+#define LIBSAM_OPTIMIZE_H
+
+#include "es_private.h"
+
+/**
+ *  Fold constants, simplify algebraically, thread jumps, and remove
+ *  the instructions of a module which can have no effect or can't be
+ *  reached. Jump and PUSHIMMPA operands and labels are renumbered to
+ *  match.
+ *
+ *  @param es The current execution state.
+ *  @param m The module, which has been parsed but not yet fused.
+ *
+ *  @return The number of instructions removed.
+ */
+extern size_t sam_optimize(/*@in@*/ sam_es *restrict es,
+			   unsigned short m);
+
+#endif /* LIBSAM_OPTIMIZE_H */
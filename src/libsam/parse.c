@@ -42,6 +42,7 @@
 #include <libsam/main.h>
 #include <libsam/opcode.h>
 
+#include "es_private.h"
 #include "parse.h"
 
 #if defined(HAVE_MMAN_H)
@@ -186,6 +187,23 @@ sam_error_operand(const sam_es *restrict es,
     }
 }
 
+#if SAM_NAN_BOX
+/** An integer operand is too big for a memory location to hold. */
+static inline void
+sam_error_int_range(const sam_es *restrict es,
+		    const char *restrict opcode,
+		    sam_int i)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("error: operand for %s is out of range: %ld.\n"),
+		       opcode,
+		       i);
+    }
+}
+#endif /* SAM_NAN_BOX */
+
 /** The same label was found twice. */
 static inline void
 sam_error_duplicate_label(const sam_es *restrict es,
@@ -196,10 +214,27 @@ sam_error_duplicate_label(const sam_es *restrict es,
 	sam_io_fprintf(es,
 		       SAM_IOS_ERR,
 		       _("error: duplicate label \"%s\" was found in module "
-			 "number %hu, line %hu.\n"),
+			 "number %hu, line %lu.\n"),
+		       label,
+		       pa.m,
+		       (unsigned long)pa.l);
+    }
+}
+
+/** A jump or PUSHIMMPA names a label which doesn't exist. */
+static inline void
+sam_error_unknown_label(const sam_es *restrict es,
+			const char *restrict label,
+			sam_pa pa)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("error: unknown label \"%s\" was referenced in "
+			 "module number %hu, line %lu.\n"),
 		       label,
 		       pa.m,
-		       pa.l);
+		       (unsigned long)pa.l);
     }
 }
 
@@ -439,34 +474,44 @@ sam_try_parse_operand(/*@in@*/ char	    **restrict input,
 /*
  *  INSTRUCTION ::= IDENT OPERAND?
  */
-/*@null@*/ static inline sam_instruction *
+static inline bool
 sam_parse_instruction(const sam_es *restrict es,
-		      char **restrict input)
+		      char **restrict input,
+		      /*@out@*/ sam_instruction *restrict i)
 {
     char *opcode, *start = *input;
 
     if (!sam_try_parse_identifier(&start, &opcode, NULL)) {
 	sam_error_identifier(es, start);
-	return NULL;
+	return false;
     }
     sam_parse_whitespace(&start);
 
-    sam_instruction *restrict i = sam_opcode_get(opcode);
-    if (i == NULL) {
+    if (!sam_opcode_get(opcode, i)) {
 	sam_error_opcode(es, opcode);
-	return NULL;
+	return false;
     }
     if (i->optype != SAM_OP_TYPE_NONE) {
 	if (!sam_try_parse_operand(&start, &i->operand, &i->optype)) {
-	    sam_error_operand(es, i->name, start);
-	    free(i);
-	    return NULL;
+	    sam_error_operand(es, sam_opcode_name(i->opcode), start);
+	    return false;
 	}
+#if SAM_NAN_BOX
+	if (i->optype == SAM_OP_TYPE_INT &&
+	    (i->operand.i < SAM_ML_INT_MIN || i->operand.i > SAM_ML_INT_MAX)) {
+	    sam_error_int_range(es, sam_opcode_name(i->opcode), i->operand.i);
+	    return false;
+	}
+#endif /* SAM_NAN_BOX */
+	if (i->optype == SAM_OP_TYPE_LABEL) {
+	    i->label = i->operand.s;
+	}
+	sam_opcode_bind(i);
     }
 
     sam_parse_whitespace(&start);
     *input = start;
-    return i;
+    return true;
 }
 
 /*
@@ -776,6 +821,49 @@ sam_parse_directives(sam_es *restrict es,
 }
 #endif /* SAM_EXTENSIONS */
 
+/*
+ * Replace the label operands of the control flow instructions in the
+ * module just parsed with the program addresses they name, so that
+ * the handlers never have to look labels up while running.
+ *
+ * @return false if a label was not found.
+ */
+static bool
+sam_parse_resolve(sam_es *restrict es)
+{
+    sam_pa pa = {
+	.l = 0,
+	.m = sam_es_modules_len(es) - 1,
+    };
+
+    sam_program *restrict program = &SAM_MODULE(pa.m)->program;
+
+    for (; pa.l < program->len; ++pa.l) {
+	sam_op_value *restrict operand = &program->operands[pa.l];
+	const char *name = operand->s;
+
+	if (program->optypes[pa.l] != SAM_OP_TYPE_LABEL) {
+	    continue;
+	}
+	switch (program->opcodes[pa.l]) {
+	    case SAM_OPCODE_JUMP:
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_JSR:
+	    case SAM_OPCODE_PUSHIMMPA:
+		/* TODO: are jumps automatically module-agnostic? */
+		if (!sam_es_labels_get(es, &operand->pa, name, pa.m)) {
+		    sam_error_unknown_label(es, name, pa);
+		    return false;
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+
+    return true;
+}
+
 /*
  * PROGRAM ::= DIRECTIVE-SECTION ( LABEL* INSTRUCTION )*
  */
@@ -783,9 +871,11 @@ sam_parse_directives(sam_es *restrict es,
 sam_parse(sam_es *restrict es,
 	  const char *restrict file)
 {
-    char *input = file == NULL?
-	sam_string_read(stdin, sam_es_input_get(es)):
-	sam_input_read(es, file, sam_es_input_get(es));
+    sam_string *restrict s = sam_es_input_get(es);
+
+    /* sam_es_new_string() has already put the source in place */
+    char *input = s->alloc > 0? s->data:
+	file == NULL? sam_string_read(stdin, s): sam_input_read(es, file, s);
 
     if (input == NULL || *input == '\0') {
 	sam_error_empty_input(es);
@@ -818,13 +908,13 @@ sam_parse(sam_es *restrict es,
 	    sam_parse_whitespace(&input);
 	}
 
-	sam_instruction *restrict i = sam_parse_instruction(es, &input);
-	if (i == NULL) {
+	sam_instruction i;
+	if (!sam_parse_instruction(es, &input, &i)) {
 	    return false;
 	}
-	sam_es_instructions_ins(es, i);
+	sam_es_instructions_ins(es, &i);
 	++cur_line.l;
     }
 
-    return true;
+    return sam_parse_resolve(es);
 }
@@ -0,0 +1,168 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "program.h"
+
+/* The bytes each instruction takes up in the allocation. */
+#define SAM_PROGRAM_STRIDE						\
+    (sizeof (sam_handler) + sizeof (sam_op_value) + 2)
+
+/* Point the arrays of p into block, which has room for alloc
+ * instructions. The arrays of eight byte items come first, so that
+ * each stays aligned. */
+static void
+sam_program_carve(sam_program *restrict p,
+		  void *restrict block,
+		  size_t alloc)
+{
+    p->handlers = block;
+    p->operands = (sam_op_value *)(p->handlers + alloc);
+    p->opcodes = (unsigned char *)(p->operands + alloc);
+    p->optypes = p->opcodes + alloc;
+    p->alloc = alloc;
+}
+
+void
+sam_program_init(sam_program *restrict p,
+		 size_t alloc)
+{
+    if (alloc == 0) {
+	alloc = 16;
+    }
+    p->len = 0;
+    sam_program_carve(p, sam_malloc(alloc * SAM_PROGRAM_STRIDE), alloc);
+    p->labels = NULL;
+    p->labels_len = 0;
+    p->labels_alloc = 0;
+}
+
+void
+sam_program_free(sam_program *restrict p)
+{
+    free(p->handlers);
+    free(p->labels);
+}
+
+/* Move the program into a block with room for twice as many
+ * instructions. */
+static void
+sam_program_grow(sam_program *restrict p)
+{
+    sam_program old = *p;
+
+    sam_program_carve(p, sam_malloc(2 * old.alloc * SAM_PROGRAM_STRIDE),
+		      2 * old.alloc);
+    memcpy(p->handlers, old.handlers, old.len * sizeof (sam_handler));
+    memcpy(p->operands, old.operands, old.len * sizeof (sam_op_value));
+    memcpy(p->opcodes, old.opcodes, old.len);
+    memcpy(p->optypes, old.optypes, old.len);
+    free(old.handlers);
+}
+
+void
+sam_program_ins(sam_program *restrict p,
+		const sam_instruction *restrict i)
+{
+    if (p->len == p->alloc) {
+	sam_program_grow(p);
+    }
+    p->handlers[p->len] = i->handler;
+    p->operands[p->len] = i->operand;
+    p->opcodes[p->len] = i->opcode;
+    p->optypes[p->len] = i->optype;
+
+    if (i->optype == SAM_OP_TYPE_LABEL && i->label != NULL) {
+	if (p->labels_len == p->labels_alloc) {
+	    p->labels_alloc = p->labels_alloc == 0? 16: 2 * p->labels_alloc;
+	    p->labels = sam_realloc(p->labels, p->labels_alloc *
+				    sizeof (sam_program_label));
+	}
+	p->labels[p->labels_len++] = (sam_program_label){
+	    .l = p->len,
+	    .name = i->label,
+	};
+    }
+    ++p->len;
+}
+
+static int
+sam_program_label_cmp(const void *key,
+		      const void *label)
+{
+    sam_line l = *(const sam_line *)key;
+    sam_line m = ((const sam_program_label *)label)->l;
+
+    return l < m? -1: l > m;
+}
+
+sam_instruction
+sam_program_get(const sam_program *restrict p,
+		size_t l)
+{
+    sam_instruction i = {
+	.opcode = p->opcodes[l],
+	.optype = p->optypes[l],
+	.operand = p->operands[l],
+	.label = NULL,
+	.handler = p->handlers[l],
+    };
+
+    if (i.optype == SAM_OP_TYPE_LABEL && p->labels_len > 0) {
+	sam_line key = l;
+	const sam_program_label *restrict label =
+	    bsearch(&key, p->labels, p->labels_len,
+		    sizeof (sam_program_label), sam_program_label_cmp);
+
+	if (label != NULL) {
+	    i.label = label->name;
+	}
+    }
+
+    return i;
+}
+
+sam_instruction *
+sam_program_unpack(const sam_program *restrict p)
+{
+    sam_instruction *restrict arr =
+	sam_malloc((p->len + 1) * sizeof (sam_instruction));
+
+    for (size_t l = 0; l < p->len; ++l) {
+	arr[l] = sam_program_get(p, l);
+    }
+
+    return arr;
+}
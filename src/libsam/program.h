@@ -0,0 +1,96 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_PROGRAM_H
+#define LIBSAM_PROGRAM_H
+
+#include <libsam/opcode.h>
+#include <libsam/types.h>
+
+/** The name of the label operand of the instruction at l. */
+typedef struct {
+    sam_line l;
+    /*@observer@*/ const char *name;
+} sam_program_label;
+
+/**
+ * The instructions of a module, stored as parallel arrays carved out
+ * of a single allocation: the handler each is bound to, its operand,
+ * and its opcode and operand type in a byte each. The names of label
+ * operands, which only listings and error messages need once sam_parse()
+ * has resolved them, are kept in a table on the side.
+ */
+typedef struct {
+    size_t len;
+    size_t alloc;
+    sam_handler *handlers;	/**< The start of the allocation. */
+    sam_op_value *operands;
+    unsigned char *opcodes;	/**< Each a #sam_opcode. */
+    unsigned char *optypes;	/**< Each a #sam_op_type. */
+    sam_program_label *labels;	/**< Ordered by line. */
+    size_t labels_len;
+    size_t labels_alloc;
+} sam_program;
+
+/**
+ *  Set up an empty program.
+ *
+ *  @param p The program.
+ *  @param alloc How many instructions to make room for.
+ */
+extern void sam_program_init(/*@out@*/ sam_program *restrict p,
+			     size_t alloc);
+
+extern void sam_program_free(sam_program *restrict p);
+
+/**
+ *  Append an instruction to a program.
+ *
+ *  @param p The program.
+ *  @param i The instruction, whose label is kept if its operand is
+ *	     one.
+ */
+extern void sam_program_ins(sam_program *restrict p,
+			    const sam_instruction *restrict i);
+
+/**
+ *  Put the instruction at l of a program back together.
+ */
+extern sam_instruction sam_program_get(const sam_program *restrict p,
+				       size_t l);
+
+/**
+ *  Copy out every instruction of a program, for the passes which move
+ *  them around.
+ *
+ *  @return An array of p->len instructions, to be freed by the caller.
+ */
+/*@only@*/ extern sam_instruction *
+sam_program_unpack(const sam_program *restrict p);
+
+#endif /* LIBSAM_PROGRAM_H */
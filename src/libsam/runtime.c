@@ -0,0 +1,496 @@
+/*
+ * runtime.c    finish a run, and support programs translated by samc
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell, Daniel Perelman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "libsam.h"
+
+#include <libsam/engine.h>
+#include <libsam/es.h>
+#include <libsam/io.h>
+#include <libsam/runtime.h>
+
+#include "es_private.h"
+#include "gc.h"
+#include "layout.h"
+
+/**
+ * The stop instruction was not found when there were no more
+ * instructions left to execute.
+ */
+static inline void
+sam_warning_forgot_stop(sam_es *restrict es)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("warning: final instruction must be STOP.\n"));
+	sam_es_bt_set(es, true);
+    }
+}
+
+static inline sam_exit_code
+sam_warning_empty_stack(sam_es *restrict es)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		      _("warning: program terminated with an empty stack.\n"));
+	sam_es_bt_set(es, true);
+    }
+
+    return SAM_EMPTY_STACK;
+}
+
+/**
+ * The last item on the stack at program termination was not of type
+ * integer.
+ *
+ *  @param es The current state of execution.
+ */
+static inline void
+sam_warning_retval_type(/*@in@*/ sam_es *restrict es)
+{
+    if (!sam_es_options_get(es, SAM_QUIET)) {
+	sam_ml *restrict m = sam_es_stack_get(es, 0);
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("warning: expected bottom of stack to contain an "
+			 "integer (found: %s).\n"),
+		       sam_ml_type_to_string(SAM_ML_TYPE(*m)));
+	sam_es_bt_set(es, true);
+    }
+}
+
+static inline void
+sam_warning_leaks(/*@in@*/ const sam_es *restrict es)
+{
+    unsigned long block_count = 0;
+    unsigned long leak_size = 0;
+
+    if (!sam_es_options_get(es, SAM_QUIET) &&
+	sam_es_heap_leak_check(es, &block_count, &leak_size)) {
+	sam_io_fprintf(es,
+		       SAM_IOS_ERR,
+		       _("warning: your program leaks %lu byte%s in %lu "
+			 "block%s.\n"),
+		       leak_size, leak_size == 1? "": "s",
+		       block_count, block_count == 1? "": "s");
+    }
+}
+
+static inline int
+sam_convert_to_int(sam_es *restrict es,
+		   /*@in@*/ sam_ml *restrict m)
+{
+    if (SAM_ML_TYPE(*m) == SAM_ML_TYPE_INT) {
+	return SAM_ML_I(*m);
+    }
+
+    sam_warning_retval_type(es);
+    switch (SAM_ML_TYPE(*m)) {
+	case SAM_ML_TYPE_FLOAT:
+	    return SAM_ML_F(*m);
+	case SAM_ML_TYPE_PA:
+	    return SAM_ML_PA(*m).l;
+	case SAM_ML_TYPE_HA:
+	    return SAM_ML_HA(*m).index;
+	case SAM_ML_TYPE_SA:
+	    return SAM_ML_SA(*m);
+	case SAM_ML_TYPE_NONE: /*@fallthrough@*/
+	default:
+	    return 0;
+    }
+}
+
+static int
+sam_sprint_char(char	 *s,
+		sam_char  c)
+{
+    char *start = s;
+
+    if (isprint(c)) {
+	sprintf(s, "'%c'", c);
+	return 1;
+    }
+    *s++ = '\'';
+    *s++ = '\\';
+    switch (c) {
+	case '\a':
+	    *s++ = 'a';
+	    break;
+	case '\b':
+	    *s++ = 'b';
+	    break;
+	case '\f':
+	    *s++ = 'f';
+	    break;
+	case '\n':
+	    *s++ = 'n';
+	    break;
+	case '\r':
+	    *s++ = 'r';
+	    break;
+	case '\t':
+	    *s++ = 't';
+	    break;
+	case '\v':
+	    *s++ = 'v';
+	    break;
+	default:
+	    s += sprintf(s, "%d", c);
+    }
+    *s++ = '\'';
+    *s++ = '\0';
+
+    return s - start;
+}
+
+static void
+sam_io_op_value_print(const sam_es *restrict es,
+		      sam_io_stream ios,
+		      const sam_instruction *restrict i)
+{
+    sam_op_value v = i->operand;
+    char buf[8];
+
+    switch (i->optype) {
+	case SAM_OP_TYPE_INT:
+	    sam_io_fprintf(es, ios, "%ld", v.i);
+	    break;
+	case SAM_OP_TYPE_FLOAT:
+	    sam_io_fprintf(es, ios, "%.5g", v.f);
+	    break;
+	case SAM_OP_TYPE_CHAR:
+	    sam_sprint_char(buf, v.c);
+	    sam_io_fprintf(es, ios, "%s", buf);
+	    break;
+	case SAM_OP_TYPE_STR:
+	    sam_io_fprintf(es, ios, "\"%s\"", v.s);
+	    break;
+	case SAM_OP_TYPE_LABEL:
+	    sam_io_fprintf(es, ios, "\"%s\"",
+			   i->label != NULL? i->label: "?");
+	    break;
+	case SAM_OP_TYPE_NONE: /*@fallthrough@*/
+	default:
+	    sam_io_fprintf(es, ios, "?");
+	    break;
+    }
+}
+
+static void
+sam_io_ml_value_print(const sam_es *restrict es,
+		      sam_ml_value v,
+		      sam_ml_type t)
+{
+    switch (t) {
+	case SAM_ML_TYPE_INT:
+	    sam_io_fprintf(es, SAM_IOS_ERR, "%ld", v.i);
+	    break;
+	case SAM_ML_TYPE_FLOAT:
+	    sam_io_fprintf(es, SAM_IOS_ERR, "%.5g", v.f);
+	    break;
+	case SAM_ML_TYPE_HA:
+	    sam_io_fprintf(es,
+			   SAM_IOS_ERR,
+			   "%lu:%luH",
+			   (unsigned long)v.ha.alloc,
+			   (unsigned long)v.ha.index);
+	    break;
+	case SAM_ML_TYPE_SA:
+	    sam_io_fprintf(es, SAM_IOS_ERR, "%luS", (unsigned long)v.sa);
+	    break;
+	case SAM_ML_TYPE_PA:
+	    sam_io_fprintf(es, SAM_IOS_ERR, "%hu:%lu", v.pa.m,
+			   (unsigned long)v.pa.l);
+	    break;
+	case SAM_ML_TYPE_NONE: /*@fallthrough@*/
+	default:
+	    sam_io_fprintf(es, SAM_IOS_ERR, "?");
+	    break;
+    }
+}
+
+/* Die... with style! */
+/*
+ * TODO:
+ *  - module specific
+ *  - print labels
+ *  - i18n friendly
+ */
+static void
+sam_bt(const sam_es *restrict es)
+{
+    size_t i;
+
+    sam_io_fprintf(es,
+		   SAM_IOS_ERR,
+		   _("\nstate of execution:\n"
+		     "PC:\t%hu:%lu\n"
+		     "FBR:\t%lu\n"
+		     "SP:\t%lu\n\n"),
+		   sam_es_pc_get(es).m,
+		   (unsigned long)sam_es_pc_get(es).l,
+		   (unsigned long)sam_es_fbr_get(es),
+		   (unsigned long)sam_es_stack_len(es));
+
+    sam_io_fprintf(es,
+		   SAM_IOS_ERR,
+		   _("    Stack\t    Program\n"));
+    for (i = 0;
+	 i <= sam_es_instructions_len_cur(es) ||
+	 i <= sam_es_stack_len(es);
+	 ++i) {
+	if (i < sam_es_stack_len(es)) {
+	    sam_ml *m = sam_es_stack_get(es, i);
+	    if (i == sam_es_fbr_get(es)) {
+		sam_io_fprintf(es, SAM_IOS_ERR, "==> ");
+	    } else {
+		sam_io_fprintf(es, SAM_IOS_ERR, "    ");
+	    }
+	    sam_io_fprintf(es,
+			   SAM_IOS_ERR,
+			   "%c: ",
+			   sam_ml_type_to_char(SAM_ML_TYPE(*m)));
+	    sam_io_ml_value_print(es, SAM_ML_VALUE(*m), SAM_ML_TYPE(*m));
+	    sam_io_fprintf(es, SAM_IOS_ERR, "\t");
+	} else {
+	    sam_io_fprintf(es, SAM_IOS_ERR, "    \t\t");
+	}
+	if (i <= sam_es_instructions_len_cur(es)) {
+	    if (i == sam_es_pc_get(es).l) {
+		sam_io_fprintf(es, SAM_IOS_ERR, "==> ");
+	    } else {
+		sam_io_fprintf(es, SAM_IOS_ERR, "    ");
+	    }
+	    if (i < sam_es_instructions_len_cur(es)) {
+		sam_instruction inst;
+
+		sam_es_instructions_get(es, (sam_pa){
+					    .l = i,
+					    .m = sam_es_pc_get(es).m
+					}, &inst);
+		sam_io_fprintf(es, SAM_IOS_ERR, "%s",
+			       sam_opcode_name(inst.opcode));
+		if (inst.optype != SAM_OP_TYPE_NONE) {
+		    sam_io_fprintf(es, SAM_IOS_ERR, " ");
+		    sam_io_op_value_print(es, SAM_IOS_ERR, &inst);
+		}
+#if 0
+		char *restrict label = sam_es_labels_get(es, );
+		sam_io_fprintf(es, SAM_IOS_ERR, " [%s]", );
+#endif
+	    }
+	}
+	sam_io_fprintf(es, SAM_IOS_ERR, "\n");
+    }
+    sam_io_fprintf(es, SAM_IOS_ERR, "\n");
+}
+
+/**
+ *  Print the program as it has been loaded, after any optimization,
+ *  in the syntax of the source: each instruction on a line of its own,
+ *  below its labels.
+ *
+ *  @param es The execution state, which has not been run.
+ */
+void
+sam_rt_list(/*@in@*/ sam_es *restrict es)
+{
+    const sam_array *restrict locs = sam_es_locs_get(es);
+    size_t n = 0;
+
+    for (unsigned short m = 0; m < sam_es_modules_len(es); ++m) {
+	for (sam_pa pa = {.l = 0, .m = m};
+	     pa.l < sam_es_instructions_len(es, m);
+	     ++pa.l) {
+	    sam_instruction instruction;
+	    const sam_instruction *restrict i = &instruction;
+
+	    sam_es_instructions_get(es, pa, &instruction);
+
+	    for (; n < locs->len; ++n) {
+		const sam_es_loc *restrict loc = locs->arr[n];
+
+		if (loc->pa.m != pa.m || loc->pa.l != pa.l) {
+		    break;
+		}
+		for (size_t k = 0; k < loc->labels.len; ++k) {
+		    sam_io_fprintf(es, SAM_IOS_OUT, "\"%s\":\n",
+				   (const char *)loc->labels.arr[k]);
+		}
+	    }
+	    sam_io_fprintf(es, SAM_IOS_OUT, "\t%s",
+			   sam_opcode_name(i->opcode));
+	    if (i->optype == SAM_OP_TYPE_FLOAT) {
+		/* every digit, so that it reads back the same */
+		sam_io_fprintf(es, SAM_IOS_OUT, " %.17g", i->operand.f);
+	    } else if (i->optype != SAM_OP_TYPE_NONE) {
+		sam_io_fprintf(es, SAM_IOS_OUT, " ");
+		sam_io_op_value_print(es, SAM_IOS_OUT, i);
+	    }
+	    sam_io_fprintf(es, SAM_IOS_OUT, "\n");
+	}
+    }
+}
+
+/**
+ *  Report on a finished run and work out its exit code: warn about
+ *  leaks, a missing STOP and a return value which is not an integer,
+ *  and print a backtrace if anything asked for one.
+ *
+ *  @param es The execution state of the finished run.
+ *  @param err What sam_engine_run() returned.
+ *
+ *  @return The integer at the bottom of the stack, or why there is
+ *	    none.
+ */
+sam_exit_code
+sam_rt_finish(/*@in@*/ sam_es *restrict es,
+	      sam_error err)
+{
+#if defined(SAM_EXTENSIONS) && defined(HAVE_DLFCN_H)
+    sam_es_dlhandles_close(es);
+#endif /* SAM_EXTENSIONS && HAVE_DLFCN_H */
+    if (sam_es_options_get(es, SAM_PROFILE)) {
+	sam_layout_profile_write(es);
+    }
+    sam_gc_report(es);
+    sam_warning_leaks(es);
+    if (err == SAM_OK) {
+	sam_warning_forgot_stop(es);
+    }
+    if (sam_es_bt_get(es)) {
+	sam_bt(es);
+    }
+
+    sam_ml *restrict m = sam_es_stack_get(es, 0);
+    return m == NULL?
+	sam_warning_empty_stack(es):
+	sam_convert_to_int(es, m);
+}
+
+/**
+ *  Create the execution state of a translated program from the
+ *  source it was translated from. Superinstructions are left unfused,
+ *  since samc steps through the handlers one instruction at a time.
+ */
+/*@null@*/ /*@only@*/ sam_es *
+sam_rt_new(const char *restrict name,
+	   const char *restrict source,
+	   size_t len)
+{
+    return sam_es_new_string(name, source, len, SAM_NO_FUSION, NULL, NULL);
+}
+
+sam_rt_regs
+sam_rt_load(const sam_es *restrict es)
+{
+    return (sam_rt_regs){
+	.stack = es->stack.arr,
+	.sp = es->stack.len,
+	.alloc = es->stack.alloc,
+	.fbr = es->fbr,
+    };
+}
+
+/** Store the registers back, with the program counter at l. */
+void
+sam_rt_store(sam_es *restrict es,
+	     size_t sp,
+	     sam_sa fbr,
+	     unsigned l)
+{
+    es->stack.len = sp;
+    es->fbr = fbr;
+    es->pc = (sam_pa){.l = l, .m = 0};
+}
+
+/** Make room for n more locations above sp, if the stack can grow. */
+void
+sam_rt_reserve(sam_es *restrict es,
+	       size_t sp,
+	       size_t n)
+{
+    es->stack.len = sp;
+    if (sam_es_stack_resize(es, sp + n)) {
+	es->stack.len = sp;
+    }
+}
+
+/**
+ *  Store the registers, as sam_rt_store() does, and run the handler of
+ *  the instruction at l. If the program stops or fails there, or
+ *  jumps out of the translated module, in which case the interpreter
+ *  runs the rest of it, the run is finished and the process exits, as
+ *  though main() had returned.
+ *
+ *  @return The instruction to continue from.
+ */
+unsigned
+sam_rt_step(sam_es *restrict es,
+	    size_t sp,
+	    sam_sa fbr,
+	    unsigned l)
+{
+    sam_error err;
+
+    sam_rt_store(es, sp, fbr, l);
+    err = sam_es_handler_cur(es)(es);
+
+    if (err != SAM_OK) {
+	sam_es_pc_pp(es);
+	exit(sam_rt_exit(es, err));
+    }
+
+    /* handlers leave the pc one before where execution resumes */
+    sam_es_pc_pp(es);
+    if (sam_es_pc_get(es).m != 0) {
+	exit(sam_rt_exit(es, sam_engine_run(es)));
+    }
+
+    return sam_es_pc_get(es).l;
+}
+
+/** Finish the run of a translated program and free it. */
+int
+sam_rt_exit(/*@only@*/ sam_es *restrict es,
+	    sam_error err)
+{
+    sam_exit_code retval = sam_rt_finish(es, err);
+
+    sam_es_free(es);
+
+    return retval;
+}
@@ -37,6 +37,9 @@
 # include <unistd.h>
 #endif /* HAVE_UNISTD_H */
 
+/* How often sam_malloc() and sam_realloc() have been called. */
+static unsigned long sam_malloc_calls;
+
 /**
  * A wrapper around malloc(3) guaranteed to be safe. Calls abort()
  * when memory cannot be allocated.
@@ -50,6 +53,7 @@ sam_malloc(size_t size)
 {
     /*@out@*/ void *p;
 
+    ++sam_malloc_calls;
     if ((p = malloc(size)) == NULL) {
 #if defined(HAVE_UNISTD_H)
 	write(STDERR_FILENO, "no memory", 10);
@@ -64,6 +68,7 @@ sam_malloc(size_t size)
 sam_realloc(/*@only@*/ void *p,
 	    size_t size)
 {
+    ++sam_malloc_calls;
     if ((p = realloc(p, size)) == NULL) {
 	free(p);
 #if defined(HAVE_UNISTD_H)
@@ -73,3 +78,9 @@ sam_realloc(/*@only@*/ void *p,
     }
     return p;
 }
+
+unsigned long
+sam_malloc_count(void)
+{
+    return sam_malloc_calls;
+}
@@ -0,0 +1,999 @@
+/*
+ * verify.c    follow the stack through a module ahead of time
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The verifier is an abstract interpreter over the control-flow graph
+ * of a module. Each subroutine, the code reached from the start of
+ * the program or from a JSR, is followed on its own. Before every
+ * instruction it records the depth of the stack relative to the
+ * subroutine's entry, where the frame base register points, and the
+ * type of each location pushed since the entry. Every subroutine is
+ * then summarised for its callers: whether it returns, whether it
+ * restores the frame base register, and how far below its entry it
+ * writes. Entry states and summaries depend on each other, so the
+ * module is gone over until neither changes.
+ *
+ * The depth at a subroutine's entry is bounded below by the depths at
+ * its call sites, so a check proved at an instruction can never fail
+ * there. That only holds while control flows along the graph and the
+ * stack is only written where the verifier can see it. Modules with
+ * indirect jumps, stores to computed addresses, POPSP, program
+ * addresses as data or dynamic libraries are left alone, as are those
+ * with a subroutine that could overwrite its return address, pop below
+ * its entry, or return from a different depth than it was called at.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsam.h"
+
+#include <libsam/es.h>
+#include <libsam/opcode.h>
+#include <libsam/util.h>
+
+#include "es_private.h"
+#include "verify.h"
+
+/* The type of a location the verifier knows nothing about. */
+#define SAM_VERIFY_ANY (-1)
+
+/* The type pushed by an instruction which pushes nothing. */
+#define SAM_VERIFY_NOTHING (-2)
+
+/* Don't follow a subroutine which keeps more locations than this on
+ * the stack. */
+#define SAM_VERIFY_DEPTH_MAX 4096
+
+/* Give up on a module which hasn't settled after this many passes. */
+#define SAM_VERIFY_PASSES_MAX 32
+
+/* What the frame base register is known to hold. */
+typedef enum {
+    SAM_VERIFY_FBR_UNKNOWN,
+    SAM_VERIFY_FBR_ENTRY,   /**< Whatever it held at the entry. */
+    SAM_VERIFY_FBR_AT	    /**< The location at, counted from the
+			     *   entry. */
+} sam_verify_fbr_kind;
+
+typedef struct {
+    sam_verify_fbr_kind kind;
+    long at;
+} sam_verify_fbr;
+
+/* A location pushed since the entry. */
+typedef struct {
+    int type;		    /**< A #sam_ml_type or #SAM_VERIFY_ANY. */
+    sam_verify_fbr saved;   /**< The frame base register, if the
+			     *   location holds a copy of it. */
+} sam_verify_loc;
+
+/* The stack before an instruction. */
+typedef struct {
+    size_t sub;		    /**< The subroutine the instruction was
+			     *   reached in, or SIZE_MAX if it wasn't. */
+    long depth;		    /**< The locations pushed since the entry. */
+    sam_verify_fbr fbr;
+    /*@null@*/ /*@only@*/
+    sam_verify_loc *locs;   /**< The depth of them, from the entry
+			     *   up. */
+} sam_verify_state;
+
+/* A subroutine: what is known about its callers and what it does for
+ * them. */
+typedef struct {
+    sam_line entry;
+    bool called;	    /**< Has a call site been reached? */
+    size_t base;	    /**< The fewest locations on the stack at the
+			     *   entry. */
+    sam_verify_fbr fbr;	    /**< The frame base register at the entry,
+			     *   agreed on by every call site. */
+    sam_verify_fbr start;   /**< What it was followed from in this
+			     *   pass. */
+    bool returns;	    /**< Can it return? */
+    bool restores;	    /**< Does it always return with the frame
+			     *   base register it was called with? */
+    long low;		    /**< The lowest and highest locations it */
+    long high;		    /**< writes below its entry, counted from
+			     *   the entry. low > high if it writes
+			     *   none. */
+    long depth;		    /**< The most locations it pushes. */
+    size_t reach;	    /**< The same, counting its callees. */
+} sam_verify_sub;
+
+typedef struct {
+    sam_program *program;
+    size_t len;
+    unsigned short m;
+    sam_verify_state *states;
+    size_t *sub_at;	    /**< The subroutine entered at each
+			     *   instruction, or SIZE_MAX. */
+    sam_verify_sub *subs;
+    size_t subs_len;
+    sam_line *work;	    /**< The instructions to go over again. */
+    size_t work_len;
+    bool *queued;
+    sam_verify_loc *scratch;
+    sam_arena arena;	    /**< Holds the locations of each state. */
+    bool changed;	    /**< Has an entry state or a summary changed
+			     *   during this pass? */
+} sam_verifier;
+
+/* What the instructions without special handling do to the stack:
+ * how many locations they pop, the types they need them to have for
+ * their checks to pass, and what they push. */
+static const struct {
+    sam_opcode opcode;
+    sam_op_type optype;
+    unsigned char pops;
+    signed char below;
+    signed char top;
+    signed char push;
+} sam_verify_effects[] = {
+    { SAM_OPCODE_FTOI,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_FTOIR,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_ITOF,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_FLOAT	},
+    { SAM_OPCODE_PUSHIMM,    SAM_OP_TYPE_INT,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_PUSHIMMF,   SAM_OP_TYPE_FLOAT, 0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_FLOAT	},
+    { SAM_OPCODE_PUSHIMMCH,  SAM_OP_TYPE_CHAR,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_PUSHIMMMA,  SAM_OP_TYPE_INT,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_SA	},
+    { SAM_OPCODE_PUSHIMMSTR, SAM_OP_TYPE_STR,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_HA	},
+    { SAM_OPCODE_PUSHSP,     SAM_OP_TYPE_NONE,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_SA	},
+    { SAM_OPCODE_MALLOC,     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_HA	},
+    { SAM_OPCODE_FREE,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_HA,    SAM_VERIFY_NOTHING },
+    { SAM_OPCODE_PUSHIND,    SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_VERIFY_ANY	},
+    { SAM_OPCODE_PUSHABS,    SAM_OP_TYPE_INT,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_VERIFY_ANY	},
+    { SAM_OPCODE_ADD,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_VERIFY_ANY	},
+    { SAM_OPCODE_SUB,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_VERIFY_ANY	},
+    { SAM_OPCODE_TIMES,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_DIV,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_MOD,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_ADDF,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT },
+    { SAM_OPCODE_SUBF,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT },
+    { SAM_OPCODE_TIMESF,     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT },
+    { SAM_OPCODE_DIVF,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT },
+    { SAM_OPCODE_LSHIFT,     SAM_OP_TYPE_INT,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_LSHIFTIND,  SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_RSHIFT,     SAM_OP_TYPE_INT,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_RSHIFTIND,  SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_LRSHIFT,    SAM_OP_TYPE_INT,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_LRSHIFTIND, SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_AND,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_OR,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_NAND,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_NOR,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_XOR,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_NOT,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITAND,     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITOR,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITNAND,    SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITNOR,     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITXOR,     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_BITNOT,     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_CMP,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_CMPF,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_FLOAT, SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_GREATER,    SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_LESS,	     SAM_OP_TYPE_NONE,	2,
+	SAM_ML_TYPE_INT,  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_EQUAL,	     SAM_OP_TYPE_NONE,	2,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_ISNIL,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_ISPOS,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_ISNEG,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_READ,	     SAM_OP_TYPE_NONE,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_READF,	     SAM_OP_TYPE_NONE,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_FLOAT	},
+    { SAM_OPCODE_READCH,     SAM_OP_TYPE_NONE,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_INT	},
+    { SAM_OPCODE_READSTR,    SAM_OP_TYPE_NONE,	0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_HA	},
+    { SAM_OPCODE_WRITE,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_VERIFY_NOTHING },
+    { SAM_OPCODE_WRITEF,     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_FLOAT, SAM_VERIFY_NOTHING },
+    { SAM_OPCODE_WRITECH,    SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_INT,   SAM_VERIFY_NOTHING },
+    { SAM_OPCODE_WRITESTR,   SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_HA,    SAM_VERIFY_NOTHING },
+    { SAM_OPCODE_PUSHIMMHA,  SAM_OP_TYPE_LABEL, 0,
+	SAM_VERIFY_ANY,	  SAM_VERIFY_ANY,    SAM_ML_TYPE_HA	},
+    { SAM_OPCODE_PATOI,	     SAM_OP_TYPE_NONE,	1,
+	SAM_VERIFY_ANY,	  SAM_ML_TYPE_PA,    SAM_ML_TYPE_INT	},
+};
+
+static const sam_verify_fbr sam_verify_fbr_unknown = {
+    .kind = SAM_VERIFY_FBR_UNKNOWN
+};
+
+static const sam_verify_loc sam_verify_loc_unknown = {
+    .type = SAM_VERIFY_ANY,
+    .saved = {.kind = SAM_VERIFY_FBR_UNKNOWN}
+};
+
+/* The entry of sam_verify_effects for an opcode, or -1. */
+static int
+sam_verify_effect(sam_opcode opcode)
+{
+    for (size_t e = 0;
+	 e < sizeof sam_verify_effects / sizeof sam_verify_effects[0];
+	 ++e) {
+	if (sam_verify_effects[e].opcode == opcode) {
+	    return e;
+	}
+    }
+
+    return -1;
+}
+
+static inline bool
+sam_verify_fbr_equal(sam_verify_fbr a,
+		     sam_verify_fbr b)
+{
+    return a.kind == b.kind &&
+	(a.kind != SAM_VERIFY_FBR_AT || a.at == b.at);
+}
+
+/* The constant target of a jump. */
+static inline sam_pa
+sam_verify_target(const sam_instruction *restrict i)
+{
+    return i->operand.pa;
+}
+
+/* Find the subroutines, and reject what can't be followed. */
+static bool
+sam_verify_scan(sam_verifier *restrict v)
+{
+    for (size_t l = 0; l < v->len; ++l) {
+	const sam_instruction instruction = sam_program_get(v->program, l);
+	const sam_instruction *restrict i = &instruction;
+	sam_pa t;
+
+	switch (i->opcode) {
+	    case SAM_OPCODE_JUMP:
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_JSR:
+		if (i->optype != SAM_OP_TYPE_LABEL &&
+		    i->optype != SAM_OP_TYPE_INT) {
+		    return false;
+		}
+		t = sam_verify_target(i);
+		if (t.m != v->m) {
+		    return false;
+		}
+		if (i->opcode == SAM_OPCODE_JSR) {
+		    if (t.l >= v->len) {
+			return false;
+		    }
+		    if (v->sub_at[t.l] == SIZE_MAX) {
+			v->sub_at[t.l] = v->subs_len;
+			v->subs[v->subs_len++] = (sam_verify_sub){
+			    .entry = t.l,
+			    .restores = true,
+			    .low = 0,
+			    .high = -1,
+			};
+		    }
+		}
+		break;
+	    case SAM_OPCODE_ADDSP:
+	    case SAM_OPCODE_PUSHOFF:
+	    case SAM_OPCODE_STOREOFF:
+		if (i->optype != SAM_OP_TYPE_INT) {
+		    return false;
+		}
+		break;
+	    case SAM_OPCODE_JUMPIND:
+		/* followed only as a return from a subroutine */
+	    case SAM_OPCODE_DUP:
+	    case SAM_OPCODE_SWAP:
+	    case SAM_OPCODE_PUSHFBR:
+	    case SAM_OPCODE_POPFBR:
+	    case SAM_OPCODE_LINK:
+	    case SAM_OPCODE_UNLINK:
+	    case SAM_OPCODE_RST:
+	    case SAM_OPCODE_STOP:
+		break;
+	    default:
+		if (sam_verify_effect(i->opcode) < 0) {
+		    return false;
+		}
+		break;
+	}
+    }
+
+    return true;
+}
+
+static void
+sam_verify_queue(sam_verifier *restrict v,
+		 size_t l)
+{
+    if (!v->queued[l]) {
+	v->queued[l] = true;
+	v->work[v->work_len++] = l;
+    }
+}
+
+/* Merge the stack s, reached in subroutine sub, into the state before
+ * the instruction at l. */
+static bool
+sam_verify_flow(sam_verifier *restrict v,
+		size_t sub,
+		const sam_verify_state *restrict s,
+		size_t l)
+{
+    sam_verify_state *restrict to;
+    bool changed = false;
+
+    if (l >= v->len) {
+	/* off the end, where the program stops */
+	return true;
+    }
+    if (v->sub_at[l] != SIZE_MAX && v->sub_at[l] != sub) {
+	/* into the entry of another subroutine */
+	return false;
+    }
+
+    to = &v->states[l];
+    if (to->sub == SIZE_MAX) {
+	to->sub = sub;
+	to->depth = s->depth;
+	to->fbr = s->fbr;
+	to->locs = sam_arena_alloc(&v->arena, (s->depth + 1) *
+				   sizeof (sam_verify_loc));
+	memcpy(to->locs, s->locs, s->depth * sizeof (sam_verify_loc));
+	sam_verify_queue(v, l);
+	return true;
+    }
+    if (to->sub != sub || to->depth != s->depth) {
+	return false;
+    }
+    if (!sam_verify_fbr_equal(to->fbr, s->fbr) &&
+	to->fbr.kind != SAM_VERIFY_FBR_UNKNOWN) {
+	to->fbr = sam_verify_fbr_unknown;
+	changed = true;
+    }
+    for (long k = 0; k < s->depth; ++k) {
+	sam_verify_loc *restrict a = &to->locs[k];
+
+	if (a->type != s->locs[k].type && a->type != SAM_VERIFY_ANY) {
+	    a->type = SAM_VERIFY_ANY;
+	    changed = true;
+	}
+	if (!sam_verify_fbr_equal(a->saved, s->locs[k].saved) &&
+	    a->saved.kind != SAM_VERIFY_FBR_UNKNOWN) {
+	    a->saved = sam_verify_fbr_unknown;
+	    changed = true;
+	}
+    }
+    if (changed) {
+	sam_verify_queue(v, l);
+    }
+
+    return true;
+}
+
+static inline bool
+sam_verify_push(sam_verify_state *restrict s,
+		int type,
+		sam_verify_fbr saved)
+{
+    if (s->depth >= SAM_VERIFY_DEPTH_MAX) {
+	return false;
+    }
+    s->locs[s->depth++] = (sam_verify_loc){.type = type, .saved = saved};
+
+    return true;
+}
+
+static inline bool
+sam_verify_pop(sam_verify_state *restrict s,
+	       long n)
+{
+    if (s->depth < n) {
+	return false;
+    }
+    s->depth -= n;
+
+    return true;
+}
+
+/* Note that a subroutine can be entered from a call site with the
+ * stack s. */
+static void
+sam_verify_call(sam_verifier *restrict v,
+		const sam_verify_sub *restrict caller,
+		const sam_verify_state *restrict s,
+		sam_verify_sub *restrict callee)
+{
+    size_t base = caller->base + s->depth + 1;
+    sam_verify_fbr fbr = sam_verify_fbr_unknown;
+
+    if (s->fbr.kind == SAM_VERIFY_FBR_AT) {
+	fbr = (sam_verify_fbr){
+	    .kind = SAM_VERIFY_FBR_AT,
+	    .at = s->fbr.at - s->depth - 1
+	};
+    }
+    if (!callee->called) {
+	callee->called = true;
+	callee->base = base;
+	callee->fbr = fbr;
+	v->changed = true;
+	return;
+    }
+    if (base < callee->base) {
+	callee->base = base;
+	v->changed = true;
+    }
+    if (!sam_verify_fbr_equal(callee->fbr, fbr) &&
+	callee->fbr.kind != SAM_VERIFY_FBR_UNKNOWN) {
+	callee->fbr = sam_verify_fbr_unknown;
+	v->changed = true;
+    }
+}
+
+/* Follow the instruction at l from the state before it. */
+static bool
+sam_verify_step(sam_verifier *restrict v,
+		size_t l)
+{
+    const sam_verify_state *restrict in = &v->states[l];
+    const sam_instruction instruction = sam_program_get(v->program, l);
+    const sam_instruction *restrict i = &instruction;
+    sam_verify_sub *restrict sub = &v->subs[in->sub];
+    sam_verify_state s = {
+	.sub = in->sub,
+	.depth = in->depth,
+	.fbr = in->fbr,
+	.locs = v->scratch,
+    };
+    sam_verify_loc a, b;
+    sam_verify_sub *restrict callee;
+    long k = i->operand.i;
+    int e;
+
+    memcpy(s.locs, in->locs, s.depth * sizeof (sam_verify_loc));
+    switch (i->opcode) {
+	case SAM_OPCODE_DUP:
+	    if (!sam_verify_pop(&s, 1)) {
+		return false;
+	    }
+	    a = s.locs[s.depth];
+	    if (!sam_verify_push(&s, a.type, a.saved) ||
+		!sam_verify_push(&s, a.type, a.saved)) {
+		return false;
+	    }
+	    break;
+	case SAM_OPCODE_SWAP:
+	    if (!sam_verify_pop(&s, 2)) {
+		return false;
+	    }
+	    a = s.locs[s.depth];
+	    b = s.locs[s.depth + 1];
+	    s.locs[s.depth++] = b;
+	    s.locs[s.depth++] = a;
+	    break;
+	case SAM_OPCODE_ADDSP:
+	    if (k < 0) {
+		if (!sam_verify_pop(&s, -k)) {
+		    return false;
+		}
+	    } else if (k > SAM_VERIFY_DEPTH_MAX) {
+		return false;
+	    } else {
+		for (long n = 0; n < k; ++n) {
+		    /* ADDSP fills the new locations with zeroes */
+		    if (!sam_verify_push(&s, SAM_ML_TYPE_NONE,
+					 sam_verify_fbr_unknown)) {
+			return false;
+		    }
+		}
+	    }
+	    break;
+	case SAM_OPCODE_PUSHFBR:
+	    if (!sam_verify_push(&s, SAM_ML_TYPE_SA, s.fbr)) {
+		return false;
+	    }
+	    break;
+	case SAM_OPCODE_LINK:
+	    if (!sam_verify_push(&s, SAM_ML_TYPE_SA, s.fbr)) {
+		return false;
+	    }
+	    s.fbr = (sam_verify_fbr){
+		.kind = SAM_VERIFY_FBR_AT,
+		.at = s.depth - 1
+	    };
+	    break;
+	case SAM_OPCODE_POPFBR:
+	case SAM_OPCODE_UNLINK:
+	    if (!sam_verify_pop(&s, 1)) {
+		return false;
+	    }
+	    s.fbr = s.locs[s.depth].saved;
+	    break;
+	case SAM_OPCODE_PUSHOFF:
+	    a = sam_verify_loc_unknown;
+	    if (s.fbr.kind == SAM_VERIFY_FBR_AT &&
+		s.fbr.at + k >= 0 && s.fbr.at + k < s.depth) {
+		a = s.locs[s.fbr.at + k];
+	    }
+	    if (!sam_verify_push(&s, a.type, a.saved)) {
+		return false;
+	    }
+	    break;
+	case SAM_OPCODE_STOREOFF:
+	    if (!sam_verify_pop(&s, 1) || s.fbr.kind != SAM_VERIFY_FBR_AT) {
+		return false;
+	    }
+	    k += s.fbr.at;
+	    if (k == -1) {
+		/* the return address */
+		return false;
+	    }
+	    if (k >= 0 && k < s.depth) {
+		s.locs[k] = s.locs[s.depth];
+	    } else if (k < 0 && sub->low > sub->high) {
+		sub->low = sub->high = k;
+		v->changed = true;
+	    } else if (k < sub->low) {
+		sub->low = k;
+		v->changed = true;
+	    } else if (k < 0 && k > sub->high) {
+		sub->high = k;
+		v->changed = true;
+	    }
+	    break;
+	case SAM_OPCODE_JUMP:
+	    return sam_verify_flow(v, in->sub, &s, sam_verify_target(i).l);
+	case SAM_OPCODE_JUMPC:
+	    if (!sam_verify_pop(&s, 1)) {
+		return false;
+	    }
+	    if (!sam_verify_flow(v, in->sub, &s, sam_verify_target(i).l)) {
+		return false;
+	    }
+	    break;
+	case SAM_OPCODE_JSR:
+	    callee = &v->subs[v->sub_at[sam_verify_target(i).l]];
+	    sam_verify_call(v, sub, &s, callee);
+	    if (s.depth + 1 > sub->depth) {
+		sub->depth = s.depth + 1;
+	    }
+	    if (!callee->returns) {
+		return true;
+	    }
+	    if (callee->low <= callee->high) {
+		long low = s.depth + 1 + callee->low;
+
+		if (low < 0) {
+		    return false;
+		}
+		for (long n = low; n <= s.depth + 1 + callee->high; ++n) {
+		    s.locs[n] = sam_verify_loc_unknown;
+		}
+	    }
+	    if (!callee->restores) {
+		s.fbr = sam_verify_fbr_unknown;
+	    }
+	    break;
+	case SAM_OPCODE_JUMPIND:
+	case SAM_OPCODE_RST:
+	    /* only the return address may be left */
+	    if (s.depth != 0 || in->sub == 0) {
+		return false;
+	    }
+	    if (!sub->returns) {
+		sub->returns = true;
+		v->changed = true;
+	    }
+	    if (sub->restores && !sam_verify_fbr_equal(s.fbr, sub->start)) {
+		sub->restores = false;
+		v->changed = true;
+	    }
+	    return true;
+	case SAM_OPCODE_STOP:
+	    return true;
+	default:
+	    e = sam_verify_effect(i->opcode);
+	    if (!sam_verify_pop(&s, sam_verify_effects[e].pops)) {
+		return false;
+	    }
+	    a = s.locs[s.depth];
+	    b = s.locs[s.depth + 1];
+	    switch (i->opcode) {
+		case SAM_OPCODE_ADD:
+		case SAM_OPCODE_SUB:
+		    /* other combinations make addresses */
+		    if (!sam_verify_push(&s,
+					 a.type == SAM_ML_TYPE_INT &&
+					 b.type == SAM_ML_TYPE_INT?
+					 SAM_ML_TYPE_INT: SAM_VERIFY_ANY,
+					 sam_verify_fbr_unknown)) {
+			return false;
+		    }
+		    break;
+		default:
+		    if (sam_verify_effects[e].push != SAM_VERIFY_NOTHING &&
+			!sam_verify_push(&s, sam_verify_effects[e].push,
+					 sam_verify_fbr_unknown)) {
+			return false;
+		    }
+		    break;
+	    }
+	    break;
+    }
+    if (s.depth > sub->depth) {
+	sub->depth = s.depth;
+    }
+
+    return sam_verify_flow(v, in->sub, &s, l + 1);
+}
+
+/* Follow a subroutine from its entry. */
+static bool
+sam_verify_sub_follow(sam_verifier *restrict v,
+		      size_t n)
+{
+    sam_verify_sub *restrict sub = &v->subs[n];
+    sam_verify_state entry = {
+	.sub = n,
+	.depth = 0,
+	.fbr = sub->fbr,
+	.locs = v->scratch,
+    };
+
+    if (entry.fbr.kind != SAM_VERIFY_FBR_AT) {
+	entry.fbr.kind = SAM_VERIFY_FBR_ENTRY;
+    }
+    sub->start = entry.fbr;
+    if (!sam_verify_flow(v, n, &entry, sub->entry)) {
+	return false;
+    }
+    while (v->work_len > 0) {
+	size_t l = v->work[--v->work_len];
+
+	v->queued[l] = false;
+	if (!sam_verify_step(v, l)) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+/* Can none of the checks of the instruction at l fail? */
+static bool
+sam_verify_proved(const sam_verifier *restrict v,
+		  size_t l)
+{
+    const sam_verify_state *restrict s = &v->states[l];
+    const sam_instruction instruction = sam_program_get(v->program, l);
+    const sam_instruction *restrict i = &instruction;
+    long k = i->operand.i;
+    int e;
+
+    switch (i->opcode) {
+	case SAM_OPCODE_DUP:
+	case SAM_OPCODE_SWAP:
+	case SAM_OPCODE_ADDSP:
+	    /* the depth was checked when the module was followed */
+	    return true;
+	case SAM_OPCODE_PUSHOFF:
+	    return s->fbr.kind == SAM_VERIFY_FBR_AT &&
+		(long)v->subs[s->sub].base + s->fbr.at + k >= 0 &&
+		s->fbr.at + k < s->depth;
+	case SAM_OPCODE_STOREOFF:
+	    return s->fbr.kind == SAM_VERIFY_FBR_AT &&
+		(long)v->subs[s->sub].base + s->fbr.at + k >= 0 &&
+		s->fbr.at + k < s->depth - 1;
+	case SAM_OPCODE_POPFBR:
+	case SAM_OPCODE_UNLINK:
+	    return s->locs[s->depth - 1].type == SAM_ML_TYPE_SA;
+	case SAM_OPCODE_JUMPC:
+	    return s->locs[s->depth - 1].type == SAM_ML_TYPE_INT;
+	default:
+	    if ((e = sam_verify_effect(i->opcode)) < 0 ||
+		i->optype != sam_verify_effects[e].optype) {
+		return false;
+	    }
+	    if (sam_verify_effects[e].pops >= 1 &&
+		sam_verify_effects[e].top != SAM_VERIFY_ANY &&
+		s->locs[s->depth - 1].type != sam_verify_effects[e].top) {
+		return false;
+	    }
+	    if (sam_verify_effects[e].pops >= 2 &&
+		sam_verify_effects[e].below != SAM_VERIFY_ANY &&
+		s->locs[s->depth - 2].type != sam_verify_effects[e].below) {
+		return false;
+	    }
+	    return true;
+    }
+}
+
+/* The most locations a subroutine and its callees have on the stack,
+ * or SIZE_MAX if they recurse. */
+static size_t
+sam_verify_reach(sam_verifier *restrict v,
+		 unsigned char *restrict seen,
+		 size_t n)
+{
+    sam_verify_sub *restrict sub = &v->subs[n];
+
+    if (seen[n] == 1) {
+	return SIZE_MAX;
+    }
+    if (seen[n] == 2) {
+	return sub->reach;
+    }
+    seen[n] = 1;
+    sub->reach = sub->depth;
+    for (size_t l = 0; l < v->len && sub->reach != SIZE_MAX; ++l) {
+	const sam_verify_state *restrict s = &v->states[l];
+	size_t reach;
+
+	if (s->sub != n || v->program->opcodes[l] != SAM_OPCODE_JSR) {
+	    continue;
+	}
+	reach = sam_verify_reach(v, seen, v->sub_at[
+			v->program->operands[l].pa.l]);
+	if (reach == SIZE_MAX) {
+	    sub->reach = SIZE_MAX;
+	} else if (s->depth + 1 + reach > sub->reach) {
+	    sub->reach = s->depth + 1 + reach;
+	}
+    }
+    seen[n] = 2;
+
+    return sub->reach;
+}
+
+static void
+sam_verify_reset(sam_verifier *restrict v)
+{
+    for (size_t l = 0; l < v->len; ++l) {
+	v->states[l].locs = NULL;
+	v->states[l].sub = SIZE_MAX;
+    }
+    sam_arena_free(&v->arena);
+}
+
+/* Follow every subroutine until nothing changes. */
+static bool
+sam_verify_follow(sam_verifier *restrict v)
+{
+    if (!sam_verify_scan(v)) {
+	return false;
+    }
+    for (unsigned pass = 0; pass < SAM_VERIFY_PASSES_MAX; ++pass) {
+	sam_verify_reset(v);
+	v->changed = false;
+	for (size_t n = 0; n < v->subs_len; ++n) {
+	    if (v->subs[n].called && !sam_verify_sub_follow(v, n)) {
+		return false;
+	    }
+	}
+	if (!v->changed) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/* Follow a module, and if it can be followed, keep the frame of each
+ * instruction in *frames, if frames isn't NULL. If record is set, the
+ * proved instructions are given their unchecked handlers and the
+ * subroutines are recorded in the module. */
+static bool
+sam_verify_module(sam_es *restrict es,
+		  unsigned short m,
+		  bool record,
+		  /*@null@*/ sam_es_frame **restrict frames)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+    size_t len = module->program.len;
+    sam_verifier v = {
+	.program = &module->program,
+	.len = len,
+	.m = m,
+	.states = sam_malloc(len * sizeof (sam_verify_state)),
+	.sub_at = sam_malloc(len * sizeof (size_t)),
+	.subs = sam_malloc((len + 1) * sizeof (sam_verify_sub)),
+	.work = sam_malloc(len * sizeof (sam_line)),
+	.queued = sam_malloc(len * sizeof (bool)),
+	.scratch = sam_malloc((SAM_VERIFY_DEPTH_MAX + 2) *
+			      sizeof (sam_verify_loc)),
+    };
+    bool verified;
+
+    sam_arena_init(&v.arena);
+    if (len == 0) {
+	verified = false;
+	goto out;
+    }
+    for (size_t l = 0; l < len; ++l) {
+	v.states[l] = (sam_verify_state){.sub = SIZE_MAX, .locs = NULL};
+	v.sub_at[l] = SIZE_MAX;
+	v.queued[l] = false;
+    }
+    /* the start of the program, with an empty stack */
+    v.sub_at[0] = 0;
+    v.subs[v.subs_len++] = (sam_verify_sub){
+	.entry = 0,
+	.called = true,
+	.base = 0,
+	.fbr = {.kind = SAM_VERIFY_FBR_AT, .at = 0},
+	.restores = true,
+	.low = 0,
+	.high = -1,
+    };
+
+    if ((verified = sam_verify_follow(&v))) {
+	unsigned char *restrict seen;
+
+	if (frames != NULL) {
+	    free(*frames);
+	    *frames = sam_malloc(len * sizeof (sam_es_frame));
+	}
+	for (size_t l = 0; l < len; ++l) {
+	    const sam_verify_state *restrict s = &v.states[l];
+	    bool proved = s->sub != SIZE_MAX && sam_verify_proved(&v, l);
+
+	    if (proved && record) {
+		sam_instruction i = sam_program_get(v.program, l);
+
+		if (sam_opcode_uncheck(&i)) {
+		    v.program->handlers[l] = i.handler;
+		}
+	    }
+	    if (frames == NULL) {
+		continue;
+	    }
+	    if (s->sub == SIZE_MAX) {
+		(*frames)[l] = (sam_es_frame){.depth = -1};
+		continue;
+	    }
+	    (*frames)[l] = (sam_es_frame){
+		.depth = s->depth,
+		.fbr = s->fbr.kind == SAM_VERIFY_FBR_AT? s->fbr.at: LONG_MIN,
+		.proved = proved,
+		.below = s->depth >= 2? s->locs[s->depth - 2].type:
+		    SAM_VERIFY_ANY,
+		.top = s->depth >= 1? s->locs[s->depth - 1].type:
+		    SAM_VERIFY_ANY,
+	    };
+	}
+
+	if (!record) {
+	    goto out;
+	}
+	seen = sam_malloc(v.subs_len);
+	memset(seen, 0, v.subs_len);
+	free(module->subroutines);
+	module->subroutines =
+	    sam_malloc(v.subs_len * sizeof (sam_es_subroutine));
+	module->subroutines_len = 0;
+	for (size_t n = 0; n < v.subs_len; ++n) {
+	    if (v.subs[n].called) {
+		module->subroutines[module->subroutines_len++] =
+		    (sam_es_subroutine){
+			.pa = {.l = v.subs[n].entry, .m = m},
+			.depth = v.subs[n].depth,
+			.reach = sam_verify_reach(&v, seen, n),
+		    };
+	    }
+	}
+	free(seen);
+    }
+
+out:
+    sam_verify_reset(&v);
+    free(v.states);
+    free(v.sub_at);
+    free(v.subs);
+    free(v.work);
+    free(v.queued);
+    free(v.scratch);
+
+    return verified;
+}
+
+bool
+sam_verify(sam_es *restrict es,
+	   unsigned short m)
+{
+    sam_es_module *restrict module = SAM_MODULE(m);
+
+    return sam_verify_module(es, m, true,
+			     sam_es_options_get(es, SAM_REGISTERS)?
+			     &module->frames: NULL);
+}
+
+sam_es_frame *
+sam_verify_frames(sam_es *restrict es,
+		  unsigned short m)
+{
+    sam_es_frame *frames = NULL;
+
+    sam_verify_module(es, m, false, &frames);
+
+    return frames;
+}
@@ -0,0 +1,64 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBSAM_VERIFY_H
+#define LIBSAM_VERIFY_H
+
+#include "es_private.h"
+
+/**
+ *  Follow the stack through every path of a module ahead of time,
+ *  and give each instruction whose checks of the stack depth, operand
+ *  types and operand kind can never fail its unchecked handler. The
+ *  subroutines found are recorded in the module, with how deep each
+ *  takes the stack.
+ *
+ *  @param es The current execution state.
+ *  @param m The module, which has been parsed.
+ *
+ *  @return false if the module does something the verifier can't
+ *	    follow, in which case it is left as it was.
+ */
+extern bool sam_verify(/*@in@*/ sam_es *restrict es,
+		       unsigned short m);
+
+/**
+ *  Follow the stack through a module as sam_verify() does, without
+ *  changing it.
+ *
+ *  @param es The current execution state.
+ *  @param m The module.
+ *
+ *  @return The frame of each instruction, to be freed by the caller,
+ *	    or NULL if the module can't be followed.
+ */
+/*@null@*/ /*@only@*/
+extern sam_es_frame *sam_verify_frames(/*@in@*/ sam_es *restrict es,
+				       unsigned short m);
+
+#endif /* LIBSAM_VERIFY_H */
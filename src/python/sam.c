@@ -8,13 +8,14 @@
 static inline PyObject *
 pa_to_dict_key(sam_pa pa)
 {
-    return Py_BuildValue("(ll)", pa.m, pa.l);
+    return Py_BuildValue("(Hk)", pa.m, (unsigned long)pa.l);
 }
 /* ha_to_dict_key () {{{2 */
 static inline PyObject *
 ha_to_dict_key(sam_ha ha)
 {
-    return Py_BuildValue("(ll)", ha.alloc, ha.index);
+    return Py_BuildValue("(kk)", (unsigned long)ha.alloc,
+			 (unsigned long)ha.index);
 }
 /* Exceptions {{{1 */
 /* PyObject SamError {{{2 */
@@ -85,39 +86,41 @@ static PyTypeObject InstructionType = {
 
 /* Instruction_create {{{2 */
 static PyObject *
-Instruction_create(sam_instruction *restrict si, sam_pa addr,
+Instruction_create(const sam_instruction *restrict si, sam_pa addr,
 		   PyObject *locs)
 {
     Instruction *restrict rv =
 	PyObject_New(Instruction, &InstructionType);
+    const char *name = sam_opcode_name(si->opcode);
+    const char *label = si->label != NULL? si->label: "?";
     // TODO we malloc, when do we free?
     char *tmp;
     switch(si->optype) {
 	case SAM_OP_TYPE_INT:
-	    tmp = malloc(20 + strlen(si->name));
+	    tmp = malloc(20 + strlen(name));
 	    /* TODO how big do ints get? */
-	    sprintf(tmp, "%s %li", si->name, (long)si->operand.i);
+	    sprintf(tmp, "%s %li", name, (long)si->operand.i);
 	    rv->inst = tmp;
 	    break;
 	case SAM_OP_TYPE_FLOAT:
-	    tmp = malloc(20 + strlen(si->name));
+	    tmp = malloc(20 + strlen(name));
 	    /* TODO how big do floats get? */
-	    sprintf(tmp, "%s %f", si->name, si->operand.f);
+	    sprintf(tmp, "%s %f", name, si->operand.f);
 	    rv->inst = tmp;
 	    break;
 	case SAM_OP_TYPE_CHAR:
-	    tmp = malloc(4 + strlen(si->name));
+	    tmp = malloc(4 + strlen(name));
 	    /* TODO are sam_char's really chars? */
-	    sprintf(tmp, "%s '%c'", si->name, si->operand.c);
+	    sprintf(tmp, "%s '%c'", name, si->operand.c);
 	    rv->inst = tmp;
 	    break;
 	case SAM_OP_TYPE_LABEL:
-	    tmp = malloc(strlen(si->name) + 2 + strlen(si->operand.s));
-	    sprintf(tmp, "%s %s", si->name, si->operand.s);
+	    tmp = malloc(strlen(name) + 2 + strlen(label));
+	    sprintf(tmp, "%s %s", name, label);
 	    rv->inst = tmp;
 	    break;
 	default:
-	    rv->inst = si->name;
+	    rv->inst = name;
     }
     PyObject *key = pa_to_dict_key(addr);
     rv->labels = PyDict_GetItem(locs, key);
@@ -154,9 +157,9 @@ InstructionsIter_next(InstructionsIterObject *restrict self)
 	return NULL;
     }
     sam_pa addr = { .m = self->module_num, .l = self->idx++ };
-    sam_instruction *si =
-	sam_es_instructions_get(self->es, addr);
-    return Instruction_create(si, addr, self->locs);
+    sam_instruction si;
+    sam_es_instructions_get(self->es, addr, &si);
+    return Instruction_create(&si, addr, self->locs);
 }
 
 /* PyTypeObject InstructionsIterType {{{2 */
@@ -217,9 +220,10 @@ Instructions_item(Instructions *self, unsigned i)
     }
 
     sam_pa addr = { .m = self->module_num,.l = i};
-    sam_instruction *inst = sam_es_instructions_get(self->es, addr);
+    sam_instruction inst;
+    sam_es_instructions_get(self->es, addr, &inst);
 
-    return Instruction_create(inst, addr, self->locs);
+    return Instruction_create(&inst, addr, self->locs);
 }
 
 /* PySquenceMethods Instructions_sequence_methods {{{2 */
@@ -438,19 +442,19 @@ typedef struct {
 static PyObject *
 Value_value_get(Value *restrict self)
 {
-    switch (self->value.type) {
+    switch (SAM_ML_TYPE(self->value)) {
 	case SAM_ML_TYPE_NONE:
 	    return PyLong_FromLong(0);
 	case SAM_ML_TYPE_INT:
-	    return PyLong_FromLong(self->value.value.i);
+	    return PyLong_FromLong(SAM_ML_I(self->value));
 	case SAM_ML_TYPE_FLOAT:
-	    return PyFloat_FromDouble(self->value.value.f);
+	    return PyFloat_FromDouble(SAM_ML_F(self->value));
 	case SAM_ML_TYPE_SA:
-	    return PyLong_FromLong(self->value.value.sa);
+	    return PyLong_FromLong(SAM_ML_SA(self->value));
 	case SAM_ML_TYPE_HA:
-	    return ha_to_dict_key(self->value.value.ha);
+	    return ha_to_dict_key(SAM_ML_HA(self->value));
 	case SAM_ML_TYPE_PA:
-	    return pa_to_dict_key(self->value.value.pa);
+	    return pa_to_dict_key(SAM_ML_PA(self->value));
 	default:
 	    // TODO is this an exception?
 	    return NULL;
@@ -461,7 +465,7 @@ Value_value_get(Value *restrict self)
 static PyObject *
 Value_type_get(Value *restrict self)
 {
-    return PyLong_FromUnsignedLong(self->value.type);
+    return PyLong_FromUnsignedLong(SAM_ML_TYPE(self->value));
 }
 
 /* PyGetSetDef Value_getset {{{2 */
@@ -599,13 +603,13 @@ typedef struct {
 static Value *
 HeapAllocIter_next(HeapAllocIter *restrict self)
 {
-    if (self->idx >=
-	sam_es_heap_get_allocation_size(self->es, self->alloc)) {
+    if (!sam_es_heap_is_allocation_valid(self->es, self->alloc) ||
+	self->idx >= sam_es_heap_get_allocation_size(self->es, self->alloc)) {
 	return NULL;
     }
 
-    return Value_create(*sam_es_heap_get(self->es, 
-		(sam_ha) { .alloc = self->alloc, .index = self->idx++ }));
+    return Value_create(sam_es_heap_get_allocation_words(self->es,
+		self->alloc)[self->idx++]);
 }
 
 /* PyTypeObject HeapAllocIterType {{{2 */
@@ -658,12 +662,13 @@ HeapAlloc_length(HeapAlloc *self)
 static Value *
 HeapAlloc_item(HeapAlloc *self, unsigned i)
 {
-    if (i >= sam_es_heap_get_allocation_size(self->es, self->alloc)) {
+    if (!sam_es_heap_is_allocation_valid(self->es, self->alloc) ||
+	i >= sam_es_heap_get_allocation_size(self->es, self->alloc)) {
 	return NULL;
     }
 
-    return Value_create(*sam_es_heap_get(self->es,
-			(sam_ha) { .alloc = self->alloc, .index = i }));
+    return Value_create(sam_es_heap_get_allocation_words(self->es,
+			self->alloc)[i]);
 }
 
 /* PySquenceMethods HeapAlloc_sequence_methods {{{2 */
@@ -817,7 +822,9 @@ static PyObject *
 Change_type_get(Change *restrict self)
 {
     long rv = self->change->stack * 3;
-    if (self->change->add)
+    if (self->change->overflow)
+	rv = 6;
+    else if (self->change->add)
 	rv += 0;
     else if (self->change->remove)
 	rv += 1;
@@ -848,12 +855,12 @@ Change_size_get (Change *restrict self)
 static PyObject *
 Change_value_get (Change *restrict self)
 {
-    if (self->change->remove) {
+    if (self->change->remove || self->change->overflow) {
 	// TODO exception?
 	return NULL;
     }
 
-    return (PyObject *) Value_create(*self->change->ml);
+    return (PyObject *) Value_create(self->change->ml);
 }
 
 /* PyGetSetDef Change_getset {{{2 */
@@ -1154,6 +1161,7 @@ Program_changes_get(Program *restrict self)
     }
 
     changes->es = self->es;
+    sam_es_changes_track(self->es, true);
     Py_INCREF(changes); // TODO Why is this required?
     return (PyObject *)changes;
 }
@@ -1259,7 +1267,7 @@ static PyObject *
 Program_step(Program *restrict self)
 {
     // TODO multi-modules
-    long err = sam_es_instructions_cur(self->es)->handler(self->es);
+    long err = sam_es_handler_cur(self->es)(self->es);
     if(err == SAM_STOP) {
 	Py_RETURN_FALSE;
     } else if(err != SAM_OK) {
@@ -1342,7 +1350,7 @@ Program_load(Program *restrict self)
     // TODO shouldn't strcmp() work here?
     self->es = sam_es_new(self->file[0] == '-' && self->file[1] == '\0'?
 			  NULL: self->file,
-			  0,
+			  SAM_TRACK_CHANGES | SAM_NO_FUSION,
 			  Program_io_dispatcher,
 			  self);
     if (self->es == NULL) {
@@ -1494,13 +1502,14 @@ initsam(void)
     Py_INCREF(TypeChars);
     PyModule_AddObject(m, "TypeChars", TypeChars);
 
-    PyObject *ChangeTypes = Py_BuildValue("(ssssss)",
+    PyObject *ChangeTypes = Py_BuildValue("(sssssss)",
 					  "heap_alloc",
 					  "heap_free",
 					  "heap_change",
 					  "stack_push",
 					  "stack_pop",
-					  "stack_change");
+					  "stack_change",
+					  "overflow");
     Py_INCREF(ChangeTypes);
     PyModule_AddObject(m, "ChangeTypes", ChangeTypes);
 
@@ -0,0 +1,803 @@
+/*
+ * samc.c    translate a sam program to C
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * samc writes a C program which runs a sam program the way samiam
+ * would. The program is cut into blocks at every instruction which is
+ * jumped to or returned to, and each block becomes a function which
+ * runs its instructions inline on the stack registers held in locals.
+ * Jumps within a block become gotos; any other transfer returns the
+ * next instruction to a loop in main(), which calls the block starting
+ * there. Instructions without an inline translation, and every error,
+ * run through their handler in libsam, which is why the source is
+ * carried along and parsed again at startup. Execution which ends up
+ * anywhere else, such as after a handler jumped to an instruction
+ * which does not start a block, is left to the interpreter. The
+ * result is built with
+ *
+ *	cc -O2 prog.c -lsam -o prog
+ */
+
+#include "samc.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(HAVE_LIBINTL_H)
+# include <locale.h>
+#endif /* HAVE_LIBINTL_H */
+
+#include <libsam/es.h>
+#include <libsam/string.h>
+#include <libsam/util.h>
+
+/* The most instructions translated into one function; the compiler
+ * takes time more than linear in the size of a function. */
+#define SAMC_BLOCK_MAX 256
+
+typedef struct {
+    FILE *out;
+    size_t len;		/**< The number of instructions. */
+    bool *leader;	/**< Which instructions start a block. */
+    unsigned *block;	/**< The first instruction of the block each
+			 *   instruction is in. */
+    bool *ref;		/**< Which instructions are jumped to from
+			 *   within their block. */
+    bool *stub;		/**< Which instructions have a slow path. */
+    unsigned first;	/**< The block being emitted. */
+    unsigned end;
+    bool exit;		/**< Does the block being emitted jump to its
+			 *   exit? */
+} samc_state;
+
+static bool
+samc_usage(const char *restrict name)
+{
+    fprintf(stderr,
+	    _("Usage: %s [-o OUTPUT] [FILE]\n"
+	      "Translate the sam program FILE to C, which can be built "
+	      "with\n`cc -O2 OUTPUT -lsam'.\n\n"
+	      "options:\n"
+	      "    -o    write the program to OUTPUT instead of standard "
+	      "output\n"),
+	    name);
+
+    return false;
+}
+
+static bool
+samc_parse_options(int argc,
+		   char *const argv[restrict],
+		   char **restrict file,
+		   char **restrict output)
+{
+    const char *name = argv[0];
+
+    for (; argc > 1; ++argv, --argc) {
+	if (strcmp(argv[1], "-o") == 0 && argc > 2) {
+	    *output = argv[2];
+	    ++argv, --argc;
+	} else {
+	    break;
+	}
+    }
+    *file = argc == 1? NULL: argv[1];
+    return argc > 2? samc_usage(name): true;
+}
+
+/* Write s as the body of a C string literal, breaking the literal
+ * after each newline. */
+static void
+samc_quote(FILE *restrict out,
+	   const char *restrict s,
+	   size_t len,
+	   const char *restrict indent)
+{
+    fprintf(out, "%s\"", indent);
+    for (size_t i = 0; i < len; ++i) {
+	unsigned char c = s[i];
+
+	switch (c) {
+	    case '\n':
+		fputs("\\n\"", out);
+		if (i + 1 < len) {
+		    fprintf(out, "\n%s\"", indent);
+		    continue;
+		}
+		return;
+	    case '\\':
+	    case '"':
+	    case '?':	/* trigraphs */
+		fprintf(out, "\\%c", c);
+		break;
+	    default:
+		if (c < ' ' || c > '~') {
+		    /* always three digits, so a digit after it is not
+		     * swallowed */
+		    fprintf(out, "\\%03o", c);
+		} else {
+		    fputc(c, out);
+		}
+	}
+    }
+    fputc('"', out);
+}
+
+/* A long as a C constant expression. */
+static void
+samc_int(FILE *restrict out,
+	 long i)
+{
+    if (i == LONG_MIN) {
+	fprintf(out, "(%ldL - 1)", i + 1);
+    } else {
+	fprintf(out, "%ldL", i);
+    }
+}
+
+/* The target of a jump, if it has a constant one. */
+static bool
+samc_target(const sam_instruction *restrict i,
+	    /*@out@*/ sam_pa *restrict pa)
+{
+    if (i->optype == SAM_OP_TYPE_LABEL || i->optype == SAM_OP_TYPE_INT) {
+	*pa = i->operand.pa;
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+/* The target of a jump in the module, if it has a constant one. */
+static bool
+samc_local_target(const sam_instruction *restrict i,
+		  size_t len,
+		  /*@out@*/ unsigned *restrict l)
+{
+    sam_pa pa;
+
+    if (!samc_target(i, &pa) || pa.m != 0 || pa.l >= len) {
+	return false;
+    }
+    *l = pa.l;
+
+    return true;
+}
+
+/* Cut the program into blocks. */
+static void
+samc_blocks(samc_state *restrict st,
+	    sam_es *restrict es)
+{
+    unsigned first = 0;
+    unsigned t;
+
+    st->leader[0] = true;
+    for (unsigned l = 0; l < st->len; ++l) {
+	sam_instruction instruction;
+	const sam_instruction *restrict i = &instruction;
+
+	sam_es_instructions_get(es, (sam_pa){.l = l, .m = 0}, &instruction);
+
+	switch (i->opcode) {
+	    case SAM_OPCODE_JSR:
+	    case SAM_OPCODE_JSRIND:
+		/* where the subroutine returns to */
+		if (l + 1 < st->len) {
+		    st->leader[l + 1] = true;
+		}
+		/*@fallthrough@*/
+	    case SAM_OPCODE_JUMP:
+	    case SAM_OPCODE_JUMPC:
+	    case SAM_OPCODE_PUSHIMMPA:
+		if (samc_local_target(i, st->len, &t)) {
+		    st->leader[t] = true;
+		}
+		break;
+	    default:
+		break;
+	}
+    }
+    for (unsigned l = 0; l < st->len; ++l) {
+	if (l - first == SAMC_BLOCK_MAX) {
+	    st->leader[l] = true;
+	}
+	if (st->leader[l]) {
+	    first = l;
+	}
+	st->block[l] = first;
+    }
+    for (unsigned l = 0; l < st->len; ++l) {
+	sam_instruction instruction;
+	const sam_instruction *restrict i = &instruction;
+
+	sam_es_instructions_get(es, (sam_pa){.l = l, .m = 0}, &instruction);
+
+	if ((i->opcode == SAM_OPCODE_JUMP || i->opcode == SAM_OPCODE_JUMPC ||
+	     i->opcode == SAM_OPCODE_JSR) &&
+	    samc_local_target(i, st->len, &t) &&
+	    st->block[t] == st->block[l]) {
+	    st->ref[t] = true;
+	}
+    }
+}
+
+/* Leave the block for the instruction at l, given as a C expression. */
+static void
+samc_exit(samc_state *restrict st,
+	  const char *restrict indent)
+{
+    fprintf(st->out, "%sgoto out;\n", indent);
+    st->exit = true;
+}
+
+/* Transfer control to the instruction at pa. */
+static void
+samc_goto(samc_state *restrict st,
+	  sam_pa pa,
+	  unsigned l,
+	  const char *restrict indent)
+{
+    if (pa.m != 0) {
+	/* out of the program; let the handler deal with it */
+	fprintf(st->out, "%sSAM_RT_SLOW(%u);\n", indent, l);
+    } else if (pa.l >= st->first && pa.l < st->end) {
+	fprintf(st->out, "%sgoto i%lu;\n", indent, (unsigned long)pa.l);
+    } else {
+	fprintf(st->out, "%sl = %lu;\n", indent, (unsigned long)pa.l);
+	samc_exit(st, indent);
+    }
+}
+
+/* Jump to the program address on top of the stack, which has already
+ * been checked. */
+static void
+samc_goto_top(samc_state *restrict st,
+	      unsigned l)
+{
+    fprintf(st->out,
+	    "    if (SAM_ML_PA(SAM_RT_TOP).m != 0) {\n"
+	    "\tSAM_RT_SLOW(%u);\n"
+	    "    }\n"
+	    "    l = SAM_ML_PA(SAM_RT_TOP).l;\n",
+	    l);
+}
+
+/* Emit the instruction at l. */
+static void
+samc_instruction(samc_state *restrict st,
+		 const sam_instruction *restrict i,
+		 unsigned l)
+{
+    FILE *restrict out = st->out;
+    long k = i->operand.i;
+    sam_pa pa;
+
+    if (st->ref[l] || (l > st->first && st->stub[l - 1])) {
+	fprintf(out, "i%u: /* %s */\n", l, sam_opcode_name(i->opcode));
+    } else {
+	fprintf(out, "    /* %s */\n", sam_opcode_name(i->opcode));
+    }
+    st->stub[l] = true;
+    switch (i->opcode) {
+	case SAM_OPCODE_ITOF:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_INT, %u);\n"
+		    "    SAM_ML_SET(SAM_RT_TOP, f, (sam_float)SAM_ML_I(SAM_RT_TOP),\n"
+		    "\t       SAM_ML_TYPE_FLOAT);\n",
+		    l, l);
+	    return;
+	case SAM_OPCODE_PUSHIMM:
+	case SAM_OPCODE_PUSHIMMMA:
+	    if (i->optype != SAM_OP_TYPE_INT) {
+		break;
+	    }
+	    fprintf(out, "    SAM_RT_PUSH(%s, ",
+		    i->opcode == SAM_OPCODE_PUSHIMM?
+		    "SAM_ML_TYPE_INT, i": "SAM_ML_TYPE_SA, sa");
+	    samc_int(out, k);
+	    fprintf(out, ", %u);\n", l);
+	    return;
+	case SAM_OPCODE_PUSHIMMF:
+	    if (i->optype != SAM_OP_TYPE_FLOAT) {
+		break;
+	    }
+	    fprintf(out, "    SAM_RT_PUSH(SAM_ML_TYPE_FLOAT, f, %a, %u);\n",
+		    i->operand.f, l);
+	    return;
+	case SAM_OPCODE_PUSHIMMCH:
+	    if (i->optype != SAM_OP_TYPE_CHAR) {
+		break;
+	    }
+	    fprintf(out, "    SAM_RT_PUSH(SAM_ML_TYPE_INT, i, %d, %u);\n",
+		    i->operand.c, l);
+	    return;
+	case SAM_OPCODE_PUSHIMMPA:
+	    if (!samc_target(i, &pa)) {
+		break;
+	    }
+	    fprintf(out,
+		    "    SAM_RT_PUSH(SAM_ML_TYPE_PA, pa, "
+		    "((sam_pa){.l = %lu, .m = %hu}), %u);\n",
+		    (unsigned long)pa.l, pa.m, l);
+	    return;
+	case SAM_OPCODE_PUSHSP:
+	    fprintf(out, "    SAM_RT_PUSH(SAM_ML_TYPE_SA, sa, r.sp, %u);\n", l);
+	    return;
+	case SAM_OPCODE_PUSHFBR:
+	    fprintf(out, "    SAM_RT_PUSH(SAM_ML_TYPE_SA, sa, r.fbr, %u);\n", l);
+	    return;
+	case SAM_OPCODE_POPFBR:
+	case SAM_OPCODE_UNLINK:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_SA, %u);\n"
+		    "    r.fbr = SAM_ML_SA(SAM_RT_TOP);\n"
+		    "    --r.sp;\n",
+		    l, l);
+	    return;
+	case SAM_OPCODE_LINK:
+	    fprintf(out,
+		    "    SAM_RT_PUSH(SAM_ML_TYPE_SA, sa, r.fbr, %u);\n"
+		    "    r.fbr = r.sp - 1;\n",
+		    l);
+	    return;
+	case SAM_OPCODE_DUP:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_ROOM(1, %u);\n"
+		    "    SAM_RT_COPY(r.stack[r.sp], SAM_RT_TOP);\n"
+		    "    ++r.sp;\n",
+		    l, l);
+	    return;
+	case SAM_OPCODE_SWAP:
+	    fprintf(out,
+		    "    SAM_RT_NEED(2, %u);\n"
+		    "    {\n"
+		    "\tsam_ml top;\n\n"
+		    "\tSAM_RT_COPY(top, SAM_RT_TOP);\n"
+		    "\tSAM_RT_COPY(SAM_RT_TOP, SAM_RT_BELOW(2));\n"
+		    "\tSAM_RT_COPY(SAM_RT_BELOW(2), top);\n"
+		    "    }\n",
+		    l);
+	    return;
+	case SAM_OPCODE_ADDSP:
+	    if (i->optype != SAM_OP_TYPE_INT || k == LONG_MIN) {
+		break;
+	    }
+	    st->stub[l] = k != 0;
+	    if (k < 0) {
+		fprintf(out,
+			"    SAM_RT_NEED(%ld, %u);\n"
+			"    r.sp -= %ld;\n",
+			-k, l, -k);
+	    } else if (k > 0) {
+		fprintf(out,
+			"    SAM_RT_ROOM(%ld, %u);\n"
+			"    memset(r.stack + r.sp, 0, %ld * sizeof (sam_ml));\n"
+			"    r.sp += %ld;\n",
+			k, l, k, k);
+	    }
+	    return;
+	case SAM_OPCODE_PUSHIND:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_SA, %u);\n"
+		    "    if (SAM_ML_SA(SAM_RT_TOP) >= r.sp - 1) {\n"
+		    "\tSAM_RT_SLOW(%u);\n"
+		    "    }\n"
+		    "    SAM_RT_COPY(SAM_RT_TOP, r.stack[SAM_ML_SA(SAM_RT_TOP)]);\n",
+		    l, l, l);
+	    return;
+	case SAM_OPCODE_STOREIND:
+	    fprintf(out,
+		    "    SAM_RT_NEED(2, %u);\n"
+		    "    SAM_RT_NEED_BELOW(SAM_ML_TYPE_SA, %u);\n"
+		    "    if (SAM_ML_SA(SAM_RT_BELOW(2)) >= r.sp - 2) {\n"
+		    "\tSAM_RT_SLOW(%u);\n"
+		    "    }\n"
+		    "    SAM_RT_COPY(r.stack[SAM_ML_SA(SAM_RT_BELOW(2))], SAM_RT_TOP);\n"
+		    "    r.sp -= 2;\n",
+		    l, l, l);
+	    return;
+	case SAM_OPCODE_PUSHABS:
+	case SAM_OPCODE_PUSHOFF:
+	    if (i->optype != SAM_OP_TYPE_INT || k == LONG_MIN ||
+		(k < 0 && i->opcode == SAM_OPCODE_PUSHABS)) {
+		break;
+	    }
+	    fprintf(out,
+		    "    {\n"
+		    "\tsize_t a = %s%ld;\n\n"
+		    "\tif (a >= r.sp) {\n"
+		    "\t    SAM_RT_SLOW(%u);\n"
+		    "\t}\n"
+		    "\tSAM_RT_ROOM(1, %u);\n"
+		    "\tSAM_RT_COPY(r.stack[r.sp], r.stack[a]);\n"
+		    "\t++r.sp;\n"
+		    "    }\n",
+		    i->opcode == SAM_OPCODE_PUSHOFF? "r.fbr + ": "", k, l, l);
+	    return;
+	case SAM_OPCODE_STOREABS:
+	case SAM_OPCODE_STOREOFF:
+	    if (i->optype != SAM_OP_TYPE_INT || k == LONG_MIN ||
+		(k < 0 && i->opcode == SAM_OPCODE_STOREABS)) {
+		break;
+	    }
+	    fprintf(out,
+		    "    {\n"
+		    "\tsize_t a = %s%ld;\n\n"
+		    "\tSAM_RT_NEED(1, %u);\n"
+		    "\tif (a >= r.sp - 1) {\n"
+		    "\t    SAM_RT_SLOW(%u);\n"
+		    "\t}\n"
+		    "\tSAM_RT_COPY(r.stack[a], SAM_RT_TOP);\n"
+		    "\t--r.sp;\n"
+		    "    }\n",
+		    i->opcode == SAM_OPCODE_STOREOFF? "r.fbr + ": "", k, l, l);
+	    return;
+	case SAM_OPCODE_ADD:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a + b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_SUB:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a - b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_TIMES:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a * b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_DIV:
+	case SAM_OPCODE_MOD:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    if (SAM_ML_I(SAM_RT_TOP) == 0) {\n"
+		    "\tSAM_RT_SLOW(%u);\n"
+		    "    }\n"
+		    "    SAM_RT_INT_BINARY(a %c b, %u);\n",
+		    l, l, i->opcode == SAM_OPCODE_DIV? '/': '%', l);
+	    return;
+	case SAM_OPCODE_ADDF:
+	    fprintf(out, "    SAM_RT_FLOAT_BINARY(a + b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_SUBF:
+	    fprintf(out, "    SAM_RT_FLOAT_BINARY(a - b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_TIMESF:
+	    fprintf(out, "    SAM_RT_FLOAT_BINARY(a * b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_DIVF:
+	    fprintf(out, "    SAM_RT_FLOAT_BINARY(a / b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_AND:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a && b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_OR:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a || b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_BITAND:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a & b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_BITOR:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a | b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_BITXOR:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a ^ b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_CMP:
+	    fprintf(out,
+		    "    SAM_RT_INT_BINARY(a < b? -1: a == b? 0: 1, %u);\n", l);
+	    return;
+	case SAM_OPCODE_GREATER:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a > b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_LESS:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a < b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_EQUAL:
+	    fprintf(out, "    SAM_RT_INT_BINARY(a == b, %u);\n", l);
+	    return;
+	case SAM_OPCODE_NOT:
+	case SAM_OPCODE_ISNIL:
+	    fprintf(out, "    SAM_RT_INT_UNARY(!a, %u);\n", l);
+	    return;
+	case SAM_OPCODE_BITNOT:
+	    fprintf(out, "    SAM_RT_INT_UNARY(~a, %u);\n", l);
+	    return;
+	case SAM_OPCODE_ISPOS:
+	    fprintf(out, "    SAM_RT_INT_UNARY(a > 0, %u);\n", l);
+	    return;
+	case SAM_OPCODE_ISNEG:
+	    fprintf(out, "    SAM_RT_INT_UNARY(a < 0, %u);\n", l);
+	    return;
+	case SAM_OPCODE_JUMP:
+	    if (!samc_target(i, &pa)) {
+		break;
+	    }
+	    st->stub[l] = pa.m != 0;
+	    samc_goto(st, pa, l, "    ");
+	    return;
+	case SAM_OPCODE_JUMPC:
+	    if (!samc_target(i, &pa)) {
+		break;
+	    }
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_INT, %u);\n"
+		    "    if (SAM_ML_I(r.stack[--r.sp]) != 0) {\n",
+		    l, l);
+	    /* the stack is popped already, so only a jump in the module
+	     * can be taken here */
+	    if (pa.m == 0) {
+		samc_goto(st, pa, l, "\t");
+	    } else {
+		fprintf(out, "\t++r.sp;\n\tSAM_RT_SLOW(%u);\n", l);
+	    }
+	    fputs("    }\n", out);
+	    return;
+	case SAM_OPCODE_JUMPIND:
+	case SAM_OPCODE_RST:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_PA, %u);\n",
+		    l, l);
+	    samc_goto_top(st, l);
+	    fputs("    --r.sp;\n", out);
+	    samc_exit(st, "    ");
+	    return;
+	case SAM_OPCODE_JSR:
+	    if (!samc_target(i, &pa)) {
+		break;
+	    }
+	    fprintf(out,
+		    "    SAM_RT_PUSH(SAM_ML_TYPE_PA, pa, "
+		    "((sam_pa){.l = %u, .m = 0}), %u);\n",
+		    l + 1, l);
+	    samc_goto(st, pa, l, "    ");
+	    return;
+	case SAM_OPCODE_JSRIND:
+	    fprintf(out,
+		    "    SAM_RT_NEED(1, %u);\n"
+		    "    SAM_RT_NEED_TOP(SAM_ML_TYPE_PA, %u);\n",
+		    l, l);
+	    samc_goto_top(st, l);
+	    fprintf(out,
+		    "    SAM_ML_SET(SAM_RT_TOP, pa, ((sam_pa){.l = %u, .m = 0}),\n"
+		    "\t       SAM_ML_TYPE_PA);\n",
+		    l + 1);
+	    samc_exit(st, "    ");
+	    return;
+	default:
+	    break;
+    }
+    fprintf(out,
+	    "    SAM_RT_STEP(%u);\n"
+	    "    if (l != %u) {\n",
+	    l, l + 1);
+    samc_exit(st, "\t");
+    fputs("    }\n", out);
+    st->stub[l] = false;
+}
+
+/* Emit the slow path of the instruction at l. */
+static void
+samc_stub(samc_state *restrict st,
+	  unsigned l)
+{
+    fprintf(st->out, "s%u:\n    SAM_RT_STEP(%u);\n", l, l);
+    if (l + 1 < st->end) {
+	fprintf(st->out,
+		"    if (l == %u) {\n"
+		"\tgoto i%u;\n"
+		"    }\n",
+		l + 1, l + 1);
+    }
+    samc_exit(st, "    ");
+}
+
+/* Emit the function for the block starting at first. */
+static void
+samc_block(samc_state *restrict st,
+	   sam_es *restrict es,
+	   unsigned first)
+{
+    FILE *restrict out = st->out;
+
+    st->first = first;
+    for (st->end = first + 1;
+	 st->end < st->len && !st->leader[st->end];
+	 ++st->end);
+    st->exit = false;
+
+    fprintf(out,
+	    "static unsigned\n"
+	    "sam_block_%u(sam_es *restrict es)\n"
+	    "{\n"
+	    "    sam_rt_regs r = sam_regs;\n"
+	    "    unsigned l;\n\n",
+	    first);
+    for (unsigned l = first; l < st->end; ++l) {
+	sam_instruction i;
+
+	sam_es_instructions_get(es, (sam_pa){.l = l, .m = 0}, &i);
+	samc_instruction(st, &i, l);
+    }
+    for (unsigned l = first; l < st->end; ++l) {
+	st->exit |= st->stub[l];
+    }
+
+    fprintf(out, "    l = %u;\n", st->end);
+    if (st->exit) {
+	fputs("out:\n", out);
+    }
+    fputs("    sam_regs = r;\n"
+	  "    return l;\n", out);
+    for (unsigned l = first; l < st->end; ++l) {
+	if (st->stub[l]) {
+	    fputc('\n', out);
+	    samc_stub(st, l);
+	}
+    }
+    fputs("}\n\n", out);
+}
+
+/* Translate the program in es, parsed from source, to C. */
+static void
+samc_translate(FILE *restrict out,
+	       sam_es *restrict es,
+	       const char *restrict name,
+	       const sam_string *restrict source)
+{
+    size_t len = sam_es_instructions_len(es, 0);
+    samc_state st = {
+	.out = out,
+	.len = len,
+	.leader = sam_malloc(len * sizeof (bool)),
+	.block = sam_malloc(len * sizeof (unsigned)),
+	.ref = sam_malloc(len * sizeof (bool)),
+	.stub = sam_malloc(len * sizeof (bool)),
+    };
+
+    memset(st.leader, 0, len * sizeof (bool));
+    memset(st.ref, 0, len * sizeof (bool));
+    memset(st.stub, 0, len * sizeof (bool));
+    samc_blocks(&st, es);
+
+    fputs("/* Translated by samc from ", out);
+    samc_quote(out, name, strlen(name), "");
+    fputs(". */\n\n"
+	  "#include <string.h>\n"
+	  "#include <libsam/runtime.h>\n\n"
+	  "static const char sam_source[] =\n", out);
+    samc_quote(out, source->data, source->len, "    ");
+    fputs(";\n\n"
+	  "/* the registers between blocks */\n"
+	  "static sam_rt_regs sam_regs;\n\n", out);
+
+    for (unsigned l = 0; l < len; ++l) {
+	if (st.leader[l]) {
+	    samc_block(&st, es, l);
+	}
+    }
+
+    fprintf(out,
+	    "static unsigned (*const sam_blocks[%lu])(sam_es *restrict es) = {\n",
+	    (unsigned long)len);
+    for (unsigned l = 0; l < len; ++l) {
+	if (st.leader[l]) {
+	    fprintf(out, "    [%u] = sam_block_%u,\n", l, l);
+	}
+    }
+    fputs("};\n\n"
+	  "int\n"
+	  "main(void)\n"
+	  "{\n"
+	  "    sam_es *restrict es = sam_rt_new(", out);
+    samc_quote(out, name, strlen(name), "");
+    fprintf(out,
+	    ", sam_source,\n"
+	    "\t\t\t\t     sizeof sam_source - 1);\n"
+	    "    unsigned l = 0;\n\n"
+	    "    if (es == NULL) {\n"
+	    "\treturn SAM_PARSE_ERROR;\n"
+	    "    }\n"
+	    "    sam_regs = sam_rt_load(es);\n"
+	    "    while (l < %lu && sam_blocks[l] != NULL) {\n"
+	    "\tl = sam_blocks[l](es);\n"
+	    "    }\n\n"
+	    "    /* off the end, or somewhere no block starts */\n"
+	    "    sam_rt_store(es, sam_regs.sp, sam_regs.fbr, l);\n"
+	    "    return sam_rt_exit(es, sam_engine_run(es));\n"
+	    "}\n",
+	    (unsigned long)len);
+
+    free(st.leader);
+    free(st.block);
+    free(st.ref);
+    free(st.stub);
+}
+
+int
+main(int argc,
+     char *const argv[restrict])
+{
+    char *file = NULL;
+    char *output = NULL;
+    sam_string source;
+
+#if defined(HAVE_LIBINTL_H)
+    setlocale(LC_ALL, "");
+    textdomain(PACKAGE);
+#endif /* HAVE_LIBINTL_H */
+
+    if (!samc_parse_options(argc, argv, &file, &output)) {
+	return SAM_USAGE;
+    }
+
+    FILE *restrict in = file == NULL? stdin: fopen(file, "r");
+    if (in == NULL) {
+	perror("fopen");
+	return SAM_PARSE_ERROR;
+    }
+    if (sam_string_read(in, &source) == NULL) {
+	return SAM_PARSE_ERROR;
+    }
+    if (in != stdin) {
+	fclose(in);
+    }
+
+    const char *name = file == NULL? "-": file;
+    sam_es *restrict es = sam_es_new_string(name, source.data, source.len,
+					    SAM_NO_FUSION, NULL, NULL);
+    if (es == NULL) {
+	sam_string_free(&source);
+	return SAM_PARSE_ERROR;
+    }
+
+    FILE *restrict out = output == NULL? stdout: fopen(output, "w");
+    if (out == NULL) {
+	perror("fopen");
+	sam_es_free(es);
+	sam_string_free(&source);
+	return SAM_USAGE;
+    }
+    samc_translate(out, es, name, &source);
+    if (out != stdout && fclose(out) != 0) {
+	perror("fclose");
+    }
+
+    sam_es_free(es);
+    sam_string_free(&source);
+
+    return 0;
+}
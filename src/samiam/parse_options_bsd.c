@@ -39,7 +39,7 @@
 static bool
 samiam_usage(void)
 {
-    puts(_("usage: samiam [-q] [samfile]"));
+    puts(_("usage: samiam [-qcftjOlpPrg] [samfile]"));
     return false;
 }
 
@@ -51,11 +51,41 @@ samiam_parse_options(int argc,
 {
     int opt;
 
-    while ((opt = getopt(argc, argv, "q")) > -1) {
+    while ((opt = getopt(argc, argv, "qcftjOlpPrg")) > -1) {
 	switch (opt) {
 	    case 'q':
 		*options |= SAM_QUIET;
 		break;
+	    case 'c':
+		*options |= SAM_CALL_LOOP;
+		break;
+	    case 'f':
+		*options |= SAM_NO_FUSION;
+		break;
+	    case 't':
+		*options |= SAM_CACHE_TOS;
+		break;
+	    case 'j':
+		*options |= SAM_JIT;
+		break;
+	    case 'O':
+		*options |= SAM_OPTIMIZE;
+		break;
+	    case 'l':
+		*options |= SAM_LIST;
+		break;
+	    case 'p':
+		*options |= SAM_PROFILE;
+		break;
+	    case 'P':
+		*options |= SAM_PROFILE_USE;
+		break;
+	    case 'r':
+		*options |= SAM_REGISTERS;
+		break;
+	    case 'g':
+		*options |= SAM_GC;
+		break;
 	    case '?':
 		return samiam_usage();
 	}
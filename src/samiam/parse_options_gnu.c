@@ -74,9 +74,28 @@ samiam_help(const char *restrict name)
 {
     printf(_("Usage: %s [OPTION]... [FILE]\n"
 	     "Interpret and execute FILE as sam.\n\n"
-	     "  -q, --quiet    suppress most error messages\n"
-	     "      --help     display this help and exit\n"
-	     "      --version  output version information and exit\n\n"),
+	     "  -q, --quiet      suppress most error messages\n"
+	     "  -c, --call-loop  run each instruction through its handler\n"
+	     "                   instead of the threaded engine\n"
+	     "  -f, --no-fusion  don't fuse common instruction sequences\n"
+	     "  -t, --cache-tos  keep the top of the stack in a register\n"
+	     "  -j, --jit        compile the program to machine code, where\n"
+	     "                   supported\n"
+	     "  -O, --optimize   fold constants, thread jumps, inline small\n"
+	     "                   subroutines and remove dead code before\n"
+	     "                   running\n"
+	     "  -l, --list       print the program as it would be run,\n"
+	     "                   instead of running it\n"
+	     "  -p, --profile    count how often each instruction runs,\n"
+	     "                   into FILE.prof\n"
+	     "  -P, --use-profile\n"
+	     "                   lay the program out by FILE.prof\n"
+	     "  -r, --registers  run the program as register code, where\n"
+	     "                   possible\n"
+	     "  -g, --gc         free heap allocations the program can no\n"
+	     "                   longer reach\n"
+	     "      --help       display this help and exit\n"
+	     "      --version    output version information and exit\n\n"),
 	   name);
     exit(0);
 }
@@ -97,16 +116,56 @@ samiam_parse_options(int argc,
     int opt;
     static struct option long_options[] = {
 	{"quiet", 0, NULL, 'q'},
+	{"call-loop", 0, NULL, 'c'},
+	{"no-fusion", 0, NULL, 'f'},
+	{"cache-tos", 0, NULL, 't'},
+	{"jit", 0, NULL, 'j'},
+	{"optimize", 0, NULL, 'O'},
+	{"list", 0, NULL, 'l'},
+	{"profile", 0, NULL, 'p'},
+	{"use-profile", 0, NULL, 'P'},
+	{"registers", 0, NULL, 'r'},
+	{"gc", 0, NULL, 'g'},
 	{"help", 0, NULL, 'h'},
 	{"version", 0, NULL, 'v'},
 	{0, 0, NULL, 0},
     };
 
-    while ((opt = getopt_long(argc, argv, "q", long_options, NULL)) > -1) {
+    while ((opt = getopt_long(argc, argv, "qcftjOlpPrg", long_options, NULL)) > -1) {
 	switch (opt) {
 	    case 'q':
 		*options |= SAM_QUIET;
 		break;
+	    case 'c':
+		*options |= SAM_CALL_LOOP;
+		break;
+	    case 'f':
+		*options |= SAM_NO_FUSION;
+		break;
+	    case 't':
+		*options |= SAM_CACHE_TOS;
+		break;
+	    case 'j':
+		*options |= SAM_JIT;
+		break;
+	    case 'O':
+		*options |= SAM_OPTIMIZE;
+		break;
+	    case 'l':
+		*options |= SAM_LIST;
+		break;
+	    case 'p':
+		*options |= SAM_PROFILE;
+		break;
+	    case 'P':
+		*options |= SAM_PROFILE_USE;
+		break;
+	    case 'r':
+		*options |= SAM_REGISTERS;
+		break;
+	    case 'g':
+		*options |= SAM_GC;
+		break;
 	    case 'v':
 		samiam_copyright();
 	    case 'h':
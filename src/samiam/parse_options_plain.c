@@ -41,7 +41,17 @@ samiam_usage(void)
     puts(_("usage: samiam [options ...] [samfile]\n"
 	   "Interpret and execute a SaM source file.\n\n"
 	   "options:\n"
-	   "    -q    suppress output\n"));
+	   "    -q    suppress output\n"
+	   "    -c    use the call loop instead of the threaded engine\n"
+	   "    -f    don't fuse common instruction sequences\n"
+	   "    -t    keep the top of the stack in a register\n"
+	   "    -j    compile the program to machine code, where supported\n"
+	   "    -O    fold constants, inline small subroutines and remove dead code\n"
+	   "    -l    print the program as it would be run instead of running it\n"
+	   "    -p    count how often each instruction runs, into samfile.prof\n"
+	   "    -P    lay the program out by samfile.prof\n"
+	   "    -r    run the program as register code, where possible\n"
+	   "    -g    free heap allocations the program can no longer reach\n"));
 
     return false;
 }
@@ -52,10 +62,32 @@ samiam_parse_options(int argc,
 		     sam_options *restrict options,
 		     char **restrict file)
 {
-    if (argc > 1 && (strcmp (argv[1], "-q") == 0)) {
-	*options |= SAM_QUIET;
-	++argv;
-	--argc;
+    for (; argc > 1; ++argv, --argc) {
+	if (strcmp(argv[1], "-q") == 0) {
+	    *options |= SAM_QUIET;
+	} else if (strcmp(argv[1], "-c") == 0) {
+	    *options |= SAM_CALL_LOOP;
+	} else if (strcmp(argv[1], "-f") == 0) {
+	    *options |= SAM_NO_FUSION;
+	} else if (strcmp(argv[1], "-t") == 0) {
+	    *options |= SAM_CACHE_TOS;
+	} else if (strcmp(argv[1], "-j") == 0) {
+	    *options |= SAM_JIT;
+	} else if (strcmp(argv[1], "-O") == 0) {
+	    *options |= SAM_OPTIMIZE;
+	} else if (strcmp(argv[1], "-l") == 0) {
+	    *options |= SAM_LIST;
+	} else if (strcmp(argv[1], "-p") == 0) {
+	    *options |= SAM_PROFILE;
+	} else if (strcmp(argv[1], "-P") == 0) {
+	    *options |= SAM_PROFILE_USE;
+	} else if (strcmp(argv[1], "-r") == 0) {
+	    *options |= SAM_REGISTERS;
+	} else if (strcmp(argv[1], "-g") == 0) {
+	    *options |= SAM_GC;
+	} else {
+	    break;
+	}
     }
     *file = argc == 1? NULL: argv[1];
     return argc > 2? samiam_usage(): true;
@@ -0,0 +1,131 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+
+#include <libsam/es.h>
+#include <libsam/main.h>
+
+/* How many of each kind of record were read from the change log. */
+typedef struct {
+    unsigned long records;
+    unsigned long overflows;
+} counts;
+
+static void
+read_changes(sam_es *restrict es,
+	     counts *restrict c)
+{
+    for (sam_es_change ch; sam_es_change_get(es, &ch);) {
+	if (ch.overflow) {
+	    ++c->overflows;
+	} else {
+	    ++c->records;
+	}
+    }
+}
+
+static void
+drain(sam_es *restrict es,
+      void *data)
+{
+    read_changes(es, data);
+}
+
+static void
+ignore(sam_es *restrict es,
+       void *data)
+{
+    (void)es;
+    (void)data;
+}
+
+/* Step through file one instruction at a time, reading the change log
+ * after each instruction if step is set and only at the end
+ * otherwise. */
+static counts
+run(const char *restrict file,
+    bool step,
+    size_t capacity,
+    sam_es_change_policy policy,
+    sam_es_change_drain drainer)
+{
+    counts c = {0, 0};
+    sam_es *restrict es = sam_es_new(file,
+				     SAM_TRACK_CHANGES | SAM_NO_FUSION |
+				     SAM_QUIET, NULL, NULL);
+
+    if (es == NULL) {
+	fprintf(stderr, "%s: couldn't be loaded\n", file);
+	return c;
+    }
+    sam_es_changes_policy_set(es, capacity, policy, drainer, &c);
+    for (sam_error err = SAM_OK;
+	 sam_es_pc_get(es).l < sam_es_instructions_len_cur(es) &&
+	 err == SAM_OK;
+	 sam_es_pc_pp(es)) {
+	err = sam_es_handler_cur(es)(es);
+	if (step) {
+	    read_changes(es, &c);
+	}
+    }
+    read_changes(es, &c);
+    sam_es_free(es);
+
+    return c;
+}
+
+static void
+report(const char *restrict what,
+       counts c)
+{
+    printf("%s: %lu records, %lu overflows\n", what, c.records, c.overflows);
+}
+
+/* Step through each program named, and say how many change records
+ * it makes, and what each policy does with them in a log of 8. */
+int
+main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+	printf("%s\n", argv[i]);
+	report("stepped", run(argv[i], true, 4096,
+			      SAM_CHANGES_OVERFLOW, NULL));
+	report("overflow", run(argv[i], false, 8,
+			       SAM_CHANGES_OVERFLOW, NULL));
+	report("drop oldest", run(argv[i], false, 8,
+				  SAM_CHANGES_DROP_OLDEST, NULL));
+	report("block", run(argv[i], false, 8,
+			    SAM_CHANGES_BLOCK, drain));
+	report("block, not drained", run(argv[i], false, 8,
+					 SAM_CHANGES_BLOCK, ignore));
+    }
+
+    return 0;
+}
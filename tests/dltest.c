@@ -17,32 +17,29 @@ addemup(sam_es *restrict es)
     long i;
 
     {
-	sam_ml *restrict m = sam_es_stack_pop(es);
+	sam_ml m;
 
-	if (m == NULL) {
+	if (!sam_es_stack_pop(es, &m)) {
 	    return sam_error_stack_underflow(es);
 	}
-	if (m->type != SAM_ML_TYPE_INT) {
-	    sam_ml_type t = m->type;
-	    free(m);
-	    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_INT);
+	if (SAM_ML_TYPE(m) != SAM_ML_TYPE_INT) {
+	    return sam_error_stack_input(es, 1, SAM_ML_TYPE(m),
+					 SAM_ML_TYPE_INT);
 	}
-	i = m->value.i;
-	free(m);
+	i = SAM_ML_I(m);
     }
 
     sam_ml_value v = {.i = 0};
     while (i-- > 0) {
-	sam_ml *restrict m = sam_es_stack_pop(es);
+	sam_ml m;
 
-	if (m == NULL) {
+	if (!sam_es_stack_pop(es, &m)) {
 	    return sam_error_stack_underflow(es);
 	}
-	if (m->type == SAM_ML_TYPE_INT) {
-	    v.i += m->value.i;
+	if (SAM_ML_TYPE(m) == SAM_ML_TYPE_INT) {
+	    v.i += SAM_ML_I(m);
 	}
-	free(m);
     }
-    return sam_es_stack_push(es, sam_ml_new(v, SAM_ML_TYPE_INT))?
+    return sam_es_stack_push(es, SAM_ML(v, SAM_ML_TYPE_INT))?
 	SAM_OK: sam_error_stack_overflow(es);
 }
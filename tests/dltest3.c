@@ -10,17 +10,16 @@ printy(sam_es *restrict es)
 {
     sam_ha ha;
     {
-	sam_ml *restrict m = sam_es_stack_pop(es);
-	if (m == NULL) {
+	sam_ml m;
+
+	if (!sam_es_stack_pop(es, &m)) {
 	    return sam_error_stack_underflow(es);
 	}
-	if (m->type != SAM_ML_TYPE_HA) {
-	    sam_ml_type t = m->type;
-	    free(m);
-	    return sam_error_stack_input(es, 1, t, SAM_ML_TYPE_HA);
+	if (SAM_ML_TYPE(m) != SAM_ML_TYPE_HA) {
+	    return sam_error_stack_input(es, 1, SAM_ML_TYPE(m),
+					 SAM_ML_TYPE_HA);
 	}
-	ha = m->value.ha;
-	free(m);
+	ha = SAM_ML_HA(m);
     }
 
     sam_error err;
@@ -0,0 +1,44 @@
+#!/usr/bin/perl
+# gen_long.pl        generate long.sam, a module too long for 16-bit addresses
+# $Id$
+#
+# part of samiam - the fast sam interpreter
+#
+# Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+# BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+# ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+use strict;
+use warnings;
+
+# The padding is never run; it only pushes far past line 65535, so that
+# the jumps there and back only land if program addresses are wide
+# enough.
+my $padding = 70000;
+
+open OUT, ">long.sam"
+    or die "couldn't open long.sam";
+print OUT "PUSHIMM 5\nJUMP far\n";
+print OUT "back:\nPUSHIMM 1\nADD\nSTOP\n";
+print OUT "PUSHIMM 100\nADD\n" x $padding;
+print OUT "far:\nPUSHIMM 2\nTIMES\nJUMP back\n";
+close OUT;
@@ -0,0 +1,55 @@
+/*
+ * $Id$
+ *
+ * part of samiam - the fast sam interpreter
+ *
+ * Copyright (c) 2007 Trevor Caira, Jimmy Hartzell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+
+#include <libsam/es.h>
+#include <libsam/main.h>
+#include <libsam/util.h>
+
+/* Load each program named, and say how many allocations it took. */
+int
+main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+	unsigned long before = sam_malloc_count();
+	sam_es *restrict es = sam_es_new(argv[i], SAM_QUIET, NULL, NULL);
+
+	if (es == NULL) {
+	    fprintf(stderr, "%s: couldn't be loaded\n", argv[i]);
+	    return 1;
+	}
+	printf("%s: %lu instructions, %lu allocations\n", argv[i],
+	       (unsigned long)sam_es_instructions_len(es, 0),
+	       sam_malloc_count() - before);
+	sam_es_free(es);
+    }
+
+    return 0;
+}
@@ -47,6 +47,13 @@
 # Added the Id and Log tags and copyright notice where they were missing.
 #
 
+# usage: tester.pl [DB [FLAG]...]
+#
+# Each line of DB names a test, the status samiam should exit with, and
+# any flags to run it with; the FLAGs given here are added to every
+# test. A status of =FILE means the output of samiam must match FILE
+# instead.
+
 use strict;
 use warnings;
 
@@ -55,9 +62,11 @@ my $filename = "tests.db";
 my $sysinf = 0;
 my @tests = ();
 my @pids = ();
+my @flags = ();
 
 if (@ARGV > 0) {
-    $filename = $ARGV[0];
+    $filename = shift @ARGV;
+    @flags = @ARGV;
 }
 
 system './inf';
@@ -66,7 +75,11 @@ if ($? == -1) {
 }
 $sysinf = $? >> 8;
 
-print "failed test cases:\n";
+if (@flags) {
+    print "failed test cases with @flags:\n";
+} else {
+    print "failed test cases:\n";
+}
 print "actual\texpected\ttest case\n";
 open DB, "<$filename" or die "couldn't open $filename: $!.\n";
 while (<DB>) {
@@ -76,15 +89,26 @@ while (<DB>) {
     push @pids, $pid;
     if ($pid == 0) {
 	/\S/ or next;
-	my ($test, $rv) = split /\s+/;
+	my ($test, $rv, @args) = split /\s+/;
+	my $name = join ' ', @args, $test;
+	my ($listing, $expected);
+	if ($rv =~ /^=(.*)/) {
+	    $listing = $1;
+	    open EXPECTED, "<$listing" or die "couldn't open $listing: $!.\n";
+	    $expected = join '', <EXPECTED>;
+	    close EXPECTED;
+	    $rv = 0;
+	}
 	$rv =~ /inf/ and $rv = $sysinf;
-	my $output = `$app -q $test`;
+	my $output = `$app -q @flags @args $test`;
 	if ($? == -1) {
 	    print "couldn't execute $app: $!.\n";
 	} elsif ($? & 127) {
-	    printf "$test died with signal %d.\n", ($? & 127);
+	    printf "$name died with signal %d.\n", ($? & 127);
 	} elsif (($? >> 8) != ($rv & 0xff)) {
-	    printf "%d\t%d\t\t$test\n", ($? >> 8), ($rv & 0xff);
+	    printf "%d\t%d\t\t$name\n", ($? >> 8), ($rv & 0xff);
+	} elsif (defined $expected && $output ne $expected) {
+	    print "output\t$listing\t$name\n";
 	}
 	exit;
     }
@@ -23,8 +23,8 @@ static void
 buffer_changes(const sam_es_change *restrict ch)
 {
     if (ch->stack) {
-	stack_items += ch->add;
-	stack_items -= ch->remove;
+	stack_items += ch->add * ch->size;
+	stack_items -= ch->remove * ch->size;
     } else {
 	heap_items += ch->add;
 	heap_items -= ch->remove;
@@ -52,13 +52,13 @@ main(void)
     signal(SIGALRM, (sighandler_t)sighandler);
     sighandler();
 
-    sam_es *restrict es = sam_es_new(NULL, 0, NULL, NULL);
+    sam_es *restrict es = sam_es_new(NULL, SAM_TRACK_CHANGES, NULL, NULL);
 
     for (sam_error err = SAM_OK;
 	 sam_es_pc_get(es).l < sam_es_instructions_len_cur(es) &&
 	 err == SAM_OK;
 	 sam_es_pc_pp(es)) {
-	err = sam_es_instructions_cur(es)->handler(es);
+	err = sam_es_handler_cur(es)(es);
 
 	for (sam_es_change ch; sam_es_change_get(es, &ch);) {
 	    buffer_changes(&ch);
@@ -70,7 +70,7 @@ main(void)
     }
 
     printf("Return value: %ld\n", sam_es_stack_len(es) >= 1?
-	   sam_es_stack_get(es, 0)->value.i: -1);
+	   SAM_ML_I(*sam_es_stack_get(es, 0)): -1);
     sam_es_free(es);
     return 0;
 }